@@ -0,0 +1,854 @@
+
+// Monte Carlo balance simulator for the dinosaur game.
+//
+// Runs [[game_logic]] for many independent player sessions with a scripted player policy and
+// reports the distribution of the results, so that changes to [[rules]], [[props]],
+// [[dinosaurs]], [[drops]] and [[mementos]] can be evaluated without hours of real play.
+//
+// The simulator is built as a unity build that includes `dinosaur_simulate.c` directly, so it
+// always runs the same game logic and tables as the plugin. Like the plugin, it uses the data pack
+// named by the `DINO_DATA_PACK` environment variable, if set. Sessions are spread over all cores.
+// Each session seeds the random stream of its state from the seed and the session index, so the
+// results don't depend on the number of threads.
+//
+// Usage:
+//
+// ~~~
+// dinosaur_balance [--sessions <n>] [--hours <n>] [--dt <seconds>] [--threads <n>] [--seed <n>]
+//     [--check-in-minutes <n>] [--buy unseen|cheapest|random] [--max-placed <n>]
+//     [--reserve <money>] [--no-sell] [--polling] [--check-fast-forward] [--check-spawn-rates]
+// ~~~
+//
+// `--polling` runs the polled game logic instead of the event queue (see `rules.event_queue`).
+//
+// `--check-fast-forward` verifies [[fast_forward]] instead of simulating sessions. For every
+// session, the policy sets up a scene, which is then advanced `--hours` both by ticking
+// [[game_logic]] at [[CHECK_TICK_HZ]] and by a single [[fast_forward]]. The distributions of the two
+// results are compared and the program exits with an error if they differ significantly.
+// Deterministic metrics, such as money with fixed coin intervals, must match exactly.
+//
+// `--check-spawn-rates` verifies that dinosaurs spawn at the rates given by their
+// `minutes_to_spawn`, independent of the frame rate, `rules.simulation_hz` and the speed
+// multiplier. For each combination, `--sessions` trials place a single prop and advance the game
+// with [[step_game]] at the frame rate for about the mean time to the first spawn. The fraction of
+// trials with a spawn is compared to the exact probability and the program exits with an error if
+// they differ significantly.
+
+#include "../dinosaur_simulate.c"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Errors
+
+// Implements `tm_error_i->errorf()` and `tm_error_i->fatal()` by printing to `stderr`. Errors are
+// only reported when loading a data pack.
+static void balance_errorf(struct tm_error_o* inst, const char* file, uint32_t line, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "error: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+static tm_error_i balance_error = { .errorf = balance_errorf, .fatal = balance_errorf };
+static struct tm_error_api balance_error_api = { .def = &balance_error };
+
+// Memory
+
+// Implements `tm_allocator_i->realloc()` with `realloc()`. Used for the scene storage of the
+// simulated states.
+static void* balance_realloc(struct tm_allocator_i* a, void* ptr, uint64_t old_size, uint64_t new_size, const char* file, uint32_t line)
+{
+    if (!new_size) {
+        free(ptr);
+        return 0;
+    }
+    return realloc(ptr, new_size);
+}
+
+static tm_allocator_i balance_allocator = { .realloc = balance_realloc };
+
+// Replaces the carray `a` with a copy of it allocated from `allocator`.
+#define CLONE_CARRAY(a, allocator)                           \
+    do {                                                     \
+        const void* from = (a);                              \
+        const uint64_t capacity = tm_carray_capacity(a);     \
+        (a) = 0;                                             \
+        if (capacity) {                                      \
+            tm_carray_ensure(a, capacity, allocator);        \
+            memcpy((a), from, capacity * sizeof(*(a)));      \
+        }                                                    \
+    } while (0)
+
+// Gives `state`, a byte copy of another state, its own copy of the scene storage.
+static void clone_scene(tm_simulate_state_o* state)
+{
+    tm_allocator_i* a = state->allocator;
+    CLONE_CARRAY(state->scene_props, a);
+    CLONE_CARRAY(state->prop_slots.slots, a);
+    CLONE_CARRAY(state->prop_ages.handles, a);
+    CLONE_CARRAY(state->scene_dinosaurs, a);
+    CLONE_CARRAY(state->dinosaur_slots.slots, a);
+    CLONE_CARRAY(state->events, a);
+    CLONE_CARRAY(state->depth.keys, a);
+    CLONE_CARRAY(state->scene_cache.items, a);
+    CLONE_CARRAY(state->scene_cache.cell_items, a);
+    CLONE_CARRAY(state->scene_cache.item_cells, a);
+    CLONE_CARRAY(state->scene_cache.visible, a);
+}
+
+
+// Policy
+
+// Strategy the scripted player uses to decide what to buy.
+enum BUY_POLICY {
+    // Buy the cheapest prop that attracts a dinosaur which isn't in the album yet. Falls back to
+    // [[BUY_POLICY__CHEAPEST]] once the album is complete.
+    BUY_POLICY__UNSEEN,
+
+    // Always buy the cheapest prop.
+    BUY_POLICY__CHEAPEST,
+
+    // Buy a random affordable prop.
+    BUY_POLICY__RANDOM,
+};
+
+// Scripted player policy.
+//
+// The player checks in at regular intervals. On each check-in they claim all awarded drops, sell
+// their mementos, buy props and place props in the scene until `max_placed` props are placed.
+struct policy_t {
+    // Minutes of simulated time between each time the player opens the game.
+    double check_in_minutes;
+
+    // Strategy for buying props.
+    enum BUY_POLICY buy;
+
+    // Number of props the player tries to keep placed in the scene.
+    uint32_t max_placed;
+
+    // Money the player keeps in reserve and doesn't spend.
+    uint32_t reserve;
+
+    // If true, the player sells all mementos at every check-in.
+    bool sell_mementos;
+};
+
+// Options
+
+// Command line options.
+struct options_t {
+    uint32_t sessions;
+    double hours;
+    double dt;
+    uint32_t threads;
+    uint64_t seed;
+    struct policy_t policy;
+    bool check_fast_forward;
+    bool check_spawn_rates;
+};
+
+// Results
+
+// Results of a single simulated session.
+struct session_result_t {
+    // Hours until all dinosaurs were in the album, or a negative value if the album was not
+    // completed within the session.
+    double album_hours;
+
+    // Money earned per hour from coins and memento sales.
+    double income_per_hour;
+
+    // Number of props and mementos the player held at the end of the session.
+    uint32_t final_inventory;
+
+    // Maximum number of props and mementos the player held at any check-in.
+    uint32_t peak_inventory;
+
+    // Number of drops discarded because [[MAX_AWARDED_DROPS]] unclaimed drops were queued.
+    uint32_t discarded_drops;
+
+    // Maximum number of unclaimed drops at any check-in.
+    uint32_t peak_awarded_drops;
+};
+
+// Session
+
+// Returns true if the prop `prop_i` attracts a dinosaur that isn't in the album.
+static bool attracts_unseen(const tm_simulate_state_o* state, uint32_t prop_i)
+{
+    const uint32_t first = indices.attraction_first[props[prop_i].image * 2];
+    const uint32_t last = indices.attraction_first[props[prop_i].image * 2 + 2];
+    for (uint32_t a = first; a < last; ++a) {
+        if (!in_album(state, indices.attraction[a]))
+            return true;
+    }
+    return false;
+}
+
+// Returns true if the prop `prop_i` should be placed in the lake. That is the case if it attracts
+// any [[DINO_TYPE__ICTYOSAUR]].
+static bool place_in_lake(uint32_t prop_i)
+{
+    const uint32_t key = props[prop_i].image * 2 + 1;
+    return indices.attraction_first[key + 1] > indices.attraction_first[key];
+}
+
+// Picks a prop to buy or place according to `policy`. If `from_inventory` is true, only props in
+// the player's inventory are considered, otherwise only props that the player can afford. Returns
+// `NUM_PROPS` if no prop is available.
+static uint32_t pick_prop(tm_simulate_state_o* state, const struct policy_t* policy, bool from_inventory)
+{
+    const uint32_t budget = state->money > policy->reserve ? state->money - policy->reserve : 0;
+
+    uint32_t candidates[NUM_PROPS];
+    uint32_t num_candidates = 0;
+    for (uint32_t i = 0; i < NUM_PROPS; ++i) {
+        const bool available = from_inventory ? state->inventory[i] > 0 : props[i].price <= budget;
+        if (available)
+            candidates[num_candidates++] = i;
+    }
+    if (!num_candidates)
+        return NUM_PROPS;
+
+    if (policy->buy == BUY_POLICY__RANDOM)
+        return candidates[random_next(&state->random) % num_candidates];
+
+    uint32_t best = NUM_PROPS;
+    bool best_unseen = false;
+    for (uint32_t c = 0; c < num_candidates; ++c) {
+        const uint32_t i = candidates[c];
+        const bool unseen = policy->buy == BUY_POLICY__UNSEEN && attracts_unseen(state, i);
+        if (best == NUM_PROPS || (unseen && !best_unseen) || (unseen == best_unseen && props[i].price < props[best].price)) {
+            best = i;
+            best_unseen = unseen;
+        }
+    }
+    return best;
+}
+
+// Places the prop `prop_i` at a random position in the lake or on land.
+static void place_prop(tm_simulate_state_o* state, uint32_t prop_i)
+{
+    const bool lake = place_in_lake(prop_i);
+    float x, y;
+    enum REGION region;
+    do {
+        x = (float)roll(state, (struct range_t){ 0, 1 });
+        y = (float)roll(state, (struct range_t){ 0.35, 1 });
+        region = region_at(x, y);
+    } while (region == REGION__OFF_LIMITS || (region == REGION__LAKE) != lake);
+
+    add_scene_prop(state, (struct scene_prop_t){ .prop = (uint16_t)prop_i, .x = x, .y = y });
+    set_inventory(state, prop_i, state->inventory[prop_i] - 1);
+}
+
+// Returns the number of props and mementos the player holds.
+static uint32_t inventory_items(const tm_simulate_state_o* state)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < NUM_PROPS; ++i)
+        n += state->inventory[i];
+    for (uint32_t i = 0; i < NUM_MEMENTOS; ++i)
+        n += state->mementos[i];
+    return n;
+}
+
+// Runs a player check-in according to `policy`. Returns the money earned from memento sales.
+static uint32_t check_in(tm_simulate_state_o* state, const struct policy_t* policy, struct session_result_t* res)
+{
+    res->peak_awarded_drops = tm_max(res->peak_awarded_drops, state->num_awarded_drops);
+
+    // Claim gifts
+    while (state->num_awarded_drops) {
+        const struct awarded_drop_t* award = unclaimed_drop(state, 0);
+        for (uint32_t i = 0; i < award->num_items; ++i)
+            claim_gift(state, award->items[i].image, award->items[i].quantity);
+        pop_unclaimed_drop(state);
+    }
+    res->peak_inventory = tm_max(res->peak_inventory, inventory_items(state));
+
+    // Sell mementos
+    uint32_t sold = 0;
+    if (policy->sell_mementos) {
+        for (uint32_t i = 0; i < NUM_MEMENTOS; ++i) {
+            sold += state->mementos[i] * mementos[i].sell_value;
+            set_mementos(state, i, 0);
+        }
+        state->money += sold;
+    }
+
+    // Buy and place props
+    const uint32_t max_placed = tm_min(policy->max_placed, rules.max_scene_props);
+    while (state->num_scene_props < max_placed) {
+        uint32_t prop_i = pick_prop(state, policy, true);
+        if (prop_i == NUM_PROPS) {
+            prop_i = pick_prop(state, policy, false);
+            if (prop_i == NUM_PROPS)
+                break;
+            state->money -= props[prop_i].price;
+            set_inventory(state, prop_i, state->inventory[prop_i] + 1);
+        }
+        place_prop(state, prop_i);
+    }
+
+    return sold;
+}
+
+// Seeds the random stream of `state` with stream `stream` of session `session_i`.
+static void seed_session(tm_simulate_state_o* state, const struct options_t* opt, uint32_t session_i, uint32_t stream)
+{
+    seed_random(&state->random, (opt->seed * 0x2545f4914f6cdd1dULL + session_i) * 4 + stream);
+}
+
+// Simulates session number `session_i` and returns the result.
+static struct session_result_t run_session(const struct options_t* opt, uint32_t session_i)
+{
+    tm_simulate_state_o* state = calloc(1, sizeof(*state));
+    state->allocator = &balance_allocator;
+    seed_session(state, opt, session_i, 0);
+    state->money = (uint32_t)roll(state, rules.start_money);
+    state->state = STATE__MAIN;
+
+    struct session_result_t res = { .album_hours = -1 };
+    const double duration = opt->hours * 60 * 60;
+    const double check_in_interval = opt->policy.check_in_minutes * 60;
+    double next_check_in = 0;
+    uint32_t num_in_album = 0;
+    uint64_t earned = 0;
+
+    for (double t = 0; t < duration; t += opt->dt) {
+        if (t >= next_check_in) {
+            earned += check_in(state, &opt->policy, &res);
+            next_check_in += check_in_interval;
+        }
+
+        const uint32_t money = state->money;
+        const uint32_t num_scene_dinosaurs = state->num_scene_dinosaurs;
+        game_logic(state, opt->dt);
+        earned += state->money - money;
+
+        // A dinosaur can only enter the album when it spawns.
+        if (state->num_scene_dinosaurs > num_scene_dinosaurs && res.album_hours < 0) {
+            num_in_album = 0;
+            for (uint32_t i = 0; i < NUM_DINOSAURS; ++i)
+                num_in_album += in_album(state, i);
+            if (num_in_album == NUM_DINOSAURS)
+                res.album_hours = (t + opt->dt) / 3600;
+        }
+    }
+
+    res.income_per_hour = (double)earned / opt->hours;
+    res.final_inventory = inventory_items(state);
+    res.discarded_drops = state->num_discarded_drops;
+
+    free_scene(state);
+    free(state);
+    return res;
+}
+
+// Fast forward check
+
+// Quantities compared by the fast forward check.
+enum CHECK_METRIC {
+    CHECK_METRIC__MONEY,
+    CHECK_METRIC__IN_ALBUM,
+    CHECK_METRIC__AWARDED_ITEMS,
+    CHECK_METRIC__SCENE_PROPS,
+    CHECK_METRIC__SCENE_DINOSAURS,
+    NUM_CHECK_METRICS,
+};
+
+static const char* check_metric_names[NUM_CHECK_METRICS] = {
+    [CHECK_METRIC__MONEY] = "money",
+    [CHECK_METRIC__IN_ALBUM] = "dinosaurs in album",
+    [CHECK_METRIC__AWARDED_ITEMS] = "awarded items",
+    [CHECK_METRIC__SCENE_PROPS] = "props in scene",
+    [CHECK_METRIC__SCENE_DINOSAURS] = "dinosaurs in scene",
+};
+
+// Results of one session of the fast forward check.
+struct check_result_t {
+    double ticked[NUM_CHECK_METRICS];
+    double fast_forwarded[NUM_CHECK_METRICS];
+};
+
+// Measures the metrics of `state` into `m`.
+static void measure_state(const tm_simulate_state_o* state, double* m)
+{
+    m[CHECK_METRIC__MONEY] = state->money;
+    m[CHECK_METRIC__IN_ALBUM] = 0;
+    for (uint32_t i = 0; i < NUM_DINOSAURS; ++i)
+        m[CHECK_METRIC__IN_ALBUM] += in_album(state, i);
+    m[CHECK_METRIC__AWARDED_ITEMS] = 0;
+    for (uint32_t i = 0; i < state->num_awarded_drops; ++i) {
+        const struct awarded_drop_t* award = state->awarded_drops + ((state->first_awarded_drop + i) & (MAX_AWARDED_DROPS - 1));
+        for (uint32_t j = 0; j < award->num_items; ++j)
+            m[CHECK_METRIC__AWARDED_ITEMS] += award->items[j].quantity;
+    }
+    m[CHECK_METRIC__SCENE_PROPS] = state->num_scene_props;
+    m[CHECK_METRIC__SCENE_DINOSAURS] = state->num_scene_dinosaurs;
+}
+
+// Frame rate that the fast forward check ticks at. The step is exact in binary floating point, so
+// the ticked session reaches the end time exactly. (Summing 1/60 s steps ends a few nanoseconds
+// short of the end time, so an event due exactly at the end, such as the last coin with fixed coin
+// intervals, would be left for the next tick.)
+enum { CHECK_TICK_HZ = 64 };
+
+// Runs session `session_i` of the fast forward check. Sets up a scene with the policy and then
+// advances copies of it by ticking at [[CHECK_TICK_HZ]] and by fast forwarding.
+static struct check_result_t run_check(const struct options_t* opt, uint32_t session_i)
+{
+    tm_simulate_state_o* start = calloc(1, sizeof(*start));
+    start->allocator = &balance_allocator;
+    seed_session(start, opt, session_i, 0);
+    start->money = (uint32_t)roll(start, rules.start_money);
+    start->state = STATE__MAIN;
+    struct session_result_t res = { 0 };
+    check_in(start, &opt->policy, &res);
+
+    struct check_result_t check = { 0 };
+    tm_simulate_state_o* state = calloc(1, sizeof(*state));
+    const double duration = opt->hours * 60 * 60;
+
+    *state = *start;
+    clone_scene(state);
+    seed_session(state, opt, session_i, 1);
+    const double dt = 1.0 / CHECK_TICK_HZ;
+    const uint64_t ticks = (uint64_t)(duration / dt);
+    for (uint64_t t = 0; t < ticks; ++t)
+        game_logic(state, dt);
+    if (duration > ticks * dt)
+        game_logic(state, duration - ticks * dt);
+    measure_state(state, check.ticked);
+
+    free_scene(state);
+    *state = *start;
+    clone_scene(state);
+    seed_session(state, opt, session_i, 2);
+    fast_forward(state, duration);
+    measure_state(state, check.fast_forwarded);
+
+    free_scene(state);
+    free(state);
+    free_scene(start);
+    free(start);
+    return check;
+}
+
+// Spawn rate check
+
+// Frame rates, simulation rates (see `rules.simulation_hz`) and speed multipliers that the spawn
+// rate check runs each combination of.
+static const double spawn_check_fps[] = { 1, 24, 60, 144 };
+static const double spawn_check_hz[] = { 1, 10 };
+static const double spawn_check_speeds[] = { 1, 10, 100 };
+
+// A combination of settings run by the spawn rate check.
+struct spawn_case_t {
+    // Index of the case, used to give each case its own random streams.
+    uint32_t index;
+
+    double fps;
+    double hz;
+    double speed;
+
+    // Prop that the trials place.
+    uint32_t prop;
+
+    // Total rate per second at which the dinosaurs attracted by `prop` spawn where it is placed.
+    double spawn_rate;
+
+    // Number of simulation steps that each trial runs.
+    uint32_t steps;
+};
+
+// Results of one trial of the spawn rate check.
+struct spawn_result_t {
+    // True if a dinosaur spawned.
+    bool spawned;
+
+    // Simulated seconds that the trial ran.
+    double seconds;
+};
+
+// Returns the total rate per second at which dinosaurs spawn at the prop `prop_i` when it is
+// placed by [[place_prop]].
+static double prop_spawn_rate(uint32_t prop_i)
+{
+    const uint32_t key = props[prop_i].image * 2 + place_in_lake(prop_i);
+    double rate = 0;
+    for (uint32_t a = indices.attraction_first[key]; a < indices.attraction_first[key + 1]; ++a)
+        rate += 1 / (60 * dinosaurs[indices.attraction[a]].minutes_to_spawn);
+    return rate;
+}
+
+// Runs trial `session_i` of the spawn rate check case `c`. Places the prop and ticks the game at
+// the case's frame rate until all the steps have run. The trial doesn't stop at the first spawn,
+// so that the time it runs doesn't depend on the outcome.
+static struct spawn_result_t run_spawn_trial(const struct options_t* opt, const struct spawn_case_t* c, uint32_t session_i)
+{
+    tm_simulate_state_o* state = calloc(1, sizeof(*state));
+    state->allocator = &balance_allocator;
+    seed_session(state, opt, c->index * opt->sessions + session_i, 3);
+    state->state = STATE__MAIN;
+    set_inventory(state, c->prop, 1);
+    place_prop(state, c->prop);
+
+    uint32_t steps = 0;
+    while (steps < c->steps)
+        steps += step_game(state, 1 / c->fps);
+
+    struct spawn_result_t res = { .seconds = steps * c->speed / c->hz };
+    for (uint32_t i = 0; i < NUM_DINOSAURS; ++i)
+        res.spawned = res.spawned || in_album(state, i);
+
+    free_scene(state);
+    free(state);
+    return res;
+}
+
+// Threads
+
+// Work shared by the simulation threads.
+struct work_t {
+    const struct options_t* opt;
+    struct session_result_t* results;
+    struct check_result_t* checks;
+    struct spawn_result_t* spawns;
+
+    // Spawn rate check case that `spawns` are run for.
+    const struct spawn_case_t* spawn_case;
+
+    // Index of the next session to simulate. Threads grab sessions from this counter until all
+    // sessions are done.
+    uint32_t next_session;
+};
+
+// Thread entry point. Simulates sessions until there are no more left.
+static void* worker(void* data)
+{
+    struct work_t* work = data;
+    while (true) {
+        const uint32_t i = __atomic_fetch_add(&work->next_session, 1, __ATOMIC_RELAXED);
+        if (i >= work->opt->sessions)
+            break;
+        if (work->spawns)
+            work->spawns[i] = run_spawn_trial(work->opt, work->spawn_case, i);
+        else if (work->checks)
+            work->checks[i] = run_check(work->opt, i);
+        else
+            work->results[i] = run_session(work->opt, i);
+    }
+    return 0;
+}
+
+// Report
+
+// Compares two doubles for `qsort()`.
+static int compare_double(const void* a, const void* b)
+{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Prints the mean and percentiles of the `n` values in `v`. Sorts `v`.
+static void print_distribution(const char* name, double* v, uint32_t n)
+{
+    if (!n) {
+        printf("%-24s (no samples)\n", name);
+        return;
+    }
+    qsort(v, n, sizeof(*v), compare_double);
+    double sum = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        sum += v[i];
+#define P(p) v[(uint32_t)((p) * (n - 1) + 0.5)]
+    printf("%-24s mean %10.2f   p10 %10.2f   p50 %10.2f   p90 %10.2f   p99 %10.2f   max %10.2f\n",
+        name, sum / n, P(0.1), P(0.5), P(0.9), P(0.99), v[n - 1]);
+#undef P
+}
+
+// Reports the fast forward check. Returns false if the ticked and fast forwarded distributions
+// differ significantly for any metric.
+static bool report_check(const struct options_t* opt, const struct check_result_t* checks)
+{
+    printf("%-24s %9u Hz %12s %8s\n", "", CHECK_TICK_HZ, "fast forward", "z");
+    bool ok = true;
+    const double n = opt->sessions;
+    for (uint32_t m = 0; m < NUM_CHECK_METRICS; ++m) {
+        double sum_t = 0, sum_f = 0, sq_t = 0, sq_f = 0;
+        for (uint32_t i = 0; i < opt->sessions; ++i) {
+            sum_t += checks[i].ticked[m];
+            sum_f += checks[i].fast_forwarded[m];
+            sq_t += checks[i].ticked[m] * checks[i].ticked[m];
+            sq_f += checks[i].fast_forwarded[m] * checks[i].fast_forwarded[m];
+        }
+        const double mean_t = sum_t / n, mean_f = sum_f / n;
+        const double var_t = tm_max(sq_t / n - mean_t * mean_t, 0), var_f = tm_max(sq_f / n - mean_f * mean_f, 0);
+        const double se = sqrt((var_t + var_f) / n);
+        const double z = se > 0 ? (mean_f - mean_t) / se : (mean_f == mean_t ? 0 : INFINITY);
+
+        // With five metrics, |z| > 4 happens by chance in about 0.03 % of the runs. Deterministic
+        // quantities (such as money with fixed coin intervals) have no variance, so `z` is infinite
+        // unless they match exactly.
+        const bool metric_ok = fabs(z) <= 4;
+        ok = ok && metric_ok;
+        printf("%-24s %12.3f %12.3f %8.2f%s\n", check_metric_names[m], mean_t, mean_f, z, metric_ok ? "" : "   MISMATCH");
+    }
+    printf("%s\n", ok ? "fast forward matches ticking" : "fast forward DOES NOT match ticking");
+    return ok;
+}
+
+// Reports case `c` of the spawn rate check. Returns false if the fraction of trials with a spawn
+// differs significantly from the probability given by the spawn rate.
+static bool report_spawn_case(const struct options_t* opt, const struct spawn_case_t* c, const struct spawn_result_t* spawns)
+{
+    double observed = 0, expected = 0, var = 0, seconds = 0;
+    for (uint32_t i = 0; i < opt->sessions; ++i) {
+        // Spawns are a Poisson process, so the chance of a spawn within `seconds` is exact.
+        const double p = -expm1(-c->spawn_rate * spawns[i].seconds);
+        observed += spawns[i].spawned;
+        expected += p;
+        var += p * (1 - p);
+        seconds += spawns[i].seconds;
+    }
+    const double z = var > 0 ? (observed - expected) / sqrt(var) : (observed == expected ? 0 : INFINITY);
+
+    // With 24 cases, |z| > 4 happens by chance in about 0.2 % of the runs.
+    const bool ok = fabs(z) <= 4;
+    const double n = opt->sessions;
+    printf("%8.0f %8.0f %8.0f %10.1f %10.3f %10.3f %8.2f%s\n", c->fps, c->hz, c->speed, seconds / n, expected / n,
+        observed / n, z, ok ? "" : "   MISMATCH");
+    return ok;
+}
+
+// Runs the spawn rate check, using `threads` to run the trials. Returns false if any case fails.
+static bool check_spawn_rates(const struct options_t* opt, pthread_t* threads)
+{
+    // The prop that attracts dinosaurs at the highest total rate gives the shortest trials.
+    struct spawn_case_t c = { 0 };
+    for (uint32_t i = 0; i < NUM_PROPS; ++i) {
+        const double rate = prop_spawn_rate(i);
+        if (rate > c.spawn_rate) {
+            c.prop = i;
+            c.spawn_rate = rate;
+        }
+    }
+    if (!c.spawn_rate) {
+        printf("no prop attracts any dinosaurs\n");
+        return false;
+    }
+
+    // The prop must not spoil before a dinosaur spawns.
+    rules.food_lifetime_minutes = (struct range_t){ 1e6, 1e6 };
+
+    printf("spawn rate check:        %u trials per case on %u threads, %s, %s (%.3f spawns / minute)\n", opt->sessions,
+        opt->threads, rules.event_queue ? "event queue" : "polling", props[c.prop].name, c.spawn_rate * 60);
+    printf("%8s %8s %8s %10s %10s %10s %8s\n", "fps", "sim Hz", "speed", "seconds", "expected", "observed", "z");
+
+    struct spawn_result_t* spawns = calloc(opt->sessions, sizeof(*spawns));
+    bool ok = true;
+    for (uint32_t fi = 0; fi < TM_ARRAY_COUNT(spawn_check_fps); ++fi) {
+        for (uint32_t hi = 0; hi < TM_ARRAY_COUNT(spawn_check_hz); ++hi) {
+            for (uint32_t si = 0; si < TM_ARRAY_COUNT(spawn_check_speeds); ++si) {
+                c.fps = spawn_check_fps[fi];
+                c.hz = spawn_check_hz[hi];
+                c.speed = spawn_check_speeds[si];
+                rules.simulation_hz = c.hz;
+                rules.speed_multiplier = (struct range_t){ c.speed, c.speed };
+
+                // Run for about the mean time to the first spawn, so that about 63 % of the trials
+                // spawn a dinosaur.
+                c.steps = (uint32_t)ceil(c.hz / (c.spawn_rate * c.speed));
+
+                struct work_t work = { .opt = opt, .spawns = spawns, .spawn_case = &c };
+                for (uint32_t i = 0; i < opt->threads; ++i)
+                    pthread_create(threads + i, 0, worker, &work);
+                for (uint32_t i = 0; i < opt->threads; ++i)
+                    pthread_join(threads[i], 0);
+                ok = report_spawn_case(opt, &c, spawns) && ok;
+                ++c.index;
+            }
+        }
+    }
+    printf("%s\n", ok ? "spawn rates match minutes_to_spawn" : "spawn rates DO NOT match minutes_to_spawn");
+    free(spawns);
+    return ok;
+}
+
+// Prints usage information.
+static void print_usage(void)
+{
+    printf("Usage: dinosaur_balance [--sessions <n>] [--hours <n>] [--dt <seconds>] [--threads <n>] [--seed <n>]\n"
+           "    [--check-in-minutes <n>] [--buy unseen|cheapest|random] [--max-placed <n>]\n"
+           "    [--reserve <money>] [--no-sell] [--polling] [--check-fast-forward] [--check-spawn-rates]\n");
+}
+
+// Returns the current time in seconds.
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** argv)
+{
+    tm_error_api = &balance_error_api;
+    build_indices();
+    reload_data_pack();
+
+    struct options_t opt = {
+        .sessions = 1000,
+        .hours = 100,
+        .dt = 1,
+        .threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN),
+        .seed = 1,
+        .policy = {
+            .check_in_minutes = 30,
+            .buy = BUY_POLICY__UNSEEN,
+            .max_placed = 8,
+            .sell_mementos = true,
+        },
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        if (strcmp(a, "--help") == 0) {
+            print_usage();
+            return 0;
+        } else if (strcmp(a, "--no-sell") == 0) {
+            opt.policy.sell_mementos = false;
+            continue;
+        } else if (strcmp(a, "--polling") == 0) {
+            rules.event_queue = false;
+            continue;
+        } else if (strcmp(a, "--check-fast-forward") == 0) {
+            opt.check_fast_forward = true;
+            continue;
+        } else if (strcmp(a, "--check-spawn-rates") == 0) {
+            opt.check_spawn_rates = true;
+            continue;
+        }
+
+        const char* v = i + 1 < argc ? argv[++i] : 0;
+        if (!v) {
+            print_usage();
+            return 1;
+        }
+        if (strcmp(a, "--sessions") == 0)
+            opt.sessions = (uint32_t)strtoul(v, 0, 10);
+        else if (strcmp(a, "--hours") == 0)
+            opt.hours = strtod(v, 0);
+        else if (strcmp(a, "--dt") == 0)
+            opt.dt = strtod(v, 0);
+        else if (strcmp(a, "--threads") == 0)
+            opt.threads = (uint32_t)strtoul(v, 0, 10);
+        else if (strcmp(a, "--seed") == 0)
+            opt.seed = strtoull(v, 0, 10);
+        else if (strcmp(a, "--check-in-minutes") == 0)
+            opt.policy.check_in_minutes = strtod(v, 0);
+        else if (strcmp(a, "--max-placed") == 0)
+            opt.policy.max_placed = (uint32_t)strtoul(v, 0, 10);
+        else if (strcmp(a, "--reserve") == 0)
+            opt.policy.reserve = (uint32_t)strtoul(v, 0, 10);
+        else if (strcmp(a, "--buy") == 0 && strcmp(v, "unseen") == 0)
+            opt.policy.buy = BUY_POLICY__UNSEEN;
+        else if (strcmp(a, "--buy") == 0 && strcmp(v, "cheapest") == 0)
+            opt.policy.buy = BUY_POLICY__CHEAPEST;
+        else if (strcmp(a, "--buy") == 0 && strcmp(v, "random") == 0)
+            opt.policy.buy = BUY_POLICY__RANDOM;
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (!opt.sessions || !opt.threads || opt.hours <= 0 || opt.dt <= 0 || opt.policy.check_in_minutes <= 0) {
+        print_usage();
+        return 1;
+    }
+
+    if (opt.check_spawn_rates) {
+        pthread_t* threads = calloc(opt.threads, sizeof(pthread_t));
+        const bool ok = check_spawn_rates(&opt, threads);
+        free(threads);
+        return ok ? 0 : 1;
+    }
+
+    // Simulate
+    struct work_t work = { .opt = &opt };
+    if (opt.check_fast_forward)
+        work.checks = calloc(opt.sessions, sizeof(struct check_result_t));
+    else
+        work.results = calloc(opt.sessions, sizeof(struct session_result_t));
+    const double t0 = now();
+    pthread_t* threads = calloc(opt.threads, sizeof(pthread_t));
+    for (uint32_t i = 0; i < opt.threads; ++i)
+        pthread_create(threads + i, 0, worker, &work);
+    for (uint32_t i = 0; i < opt.threads; ++i)
+        pthread_join(threads[i], 0);
+    const double wall = now() - t0;
+
+    if (opt.check_fast_forward) {
+        printf("fast forward check:      %u x %.1f h on %u threads, %s, %.2f s\n", opt.sessions, opt.hours, opt.threads,
+            rules.event_queue ? "event queue" : "polling", wall);
+        const bool ok = report_check(&opt, work.checks);
+        free(threads);
+        free(work.checks);
+        return ok ? 0 : 1;
+    }
+
+    // Report
+    double* v = calloc(opt.sessions, sizeof(double));
+    const double player_hours = opt.sessions * opt.hours;
+    printf("sessions:                %u x %.1f h (%.0f player-hours) on %u threads, %s\n", opt.sessions, opt.hours, player_hours, opt.threads,
+        rules.event_queue ? "event queue" : "polling");
+    printf("wall time:               %.2f s (%.3g x real time)\n", wall, player_hours * 3600 / wall);
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < opt.sessions; ++i) {
+        if (work.results[i].album_hours >= 0)
+            v[n++] = work.results[i].album_hours;
+    }
+    printf("album completed:         %.1f %% of sessions\n", 100.0 * n / opt.sessions);
+    print_distribution("album hours", v, n);
+
+    for (uint32_t i = 0; i < opt.sessions; ++i)
+        v[i] = work.results[i].income_per_hour;
+    print_distribution("income / hour", v, opt.sessions);
+
+    for (uint32_t i = 0; i < opt.sessions; ++i)
+        v[i] = work.results[i].final_inventory;
+    print_distribution("final inventory", v, opt.sessions);
+
+    for (uint32_t i = 0; i < opt.sessions; ++i)
+        v[i] = work.results[i].peak_inventory;
+    print_distribution("peak inventory", v, opt.sessions);
+
+    for (uint32_t i = 0; i < opt.sessions; ++i)
+        v[i] = work.results[i].peak_awarded_drops;
+    print_distribution("peak unclaimed drops", v, opt.sessions);
+
+    uint64_t discarded = 0;
+    n = 0;
+    for (uint32_t i = 0; i < opt.sessions; ++i) {
+        discarded += work.results[i].discarded_drops;
+        n += work.results[i].discarded_drops > 0;
+        v[i] = work.results[i].discarded_drops;
+    }
+    printf("drop queue overflow:     %.1f %% of sessions, %.3f discarded drops / hour\n", 100.0 * n / opt.sessions, discarded / player_hours);
+    print_distribution("discarded drops", v, opt.sessions);
+
+    free(v);
+    free(threads);
+    free(work.results);
+    return 0;
+}
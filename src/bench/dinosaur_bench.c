@@ -0,0 +1,1317 @@
+// Microbenchmarks for the dinosaur game.
+//
+// Times the plugin's hot paths on synthetic data, outside of the engine. The benchmarks are built
+// as a unity build that includes `dinosaur_simulate.c` directly, so they always measure the
+// plugin's current code. Before timing, each benchmark checks that the code under test gives the
+// same results as the reference it is compared with.
+//
+// Usage:
+//
+// ~~~
+// dinosaur_bench [--seconds <n>] [--out <file>] [--baseline <file>] [--threshold <fraction>]
+// ~~~
+//
+// `--seconds` is the minimum time spent on each measurement (default 0.2).
+//
+// `--out` writes the results to a CSV file with the columns `kernel,n,ns_per_op,items_per_s,
+// allocs_per_iter`. `--baseline` compares the results with such a file and exits with an error if
+// a kernel got slower than the baseline by more than `--threshold` (default 0.2, i.e. 20 %) or
+// makes more allocations. Kernels that aren't in the baseline are reported, but never fail.
+//
+// ## Kernels
+//
+// The functions that run every frame, on synthetic scenes of 8, 1k and 100k entities. An op is one
+// entity, so `ns/op` can be compared across sizes:
+//
+// * `lake_outline`, `region_at`, `classify_regions`: Looking up the region of random points, with
+//   the hand-coded lake outline that the game used to evaluate per entity, with single
+//   [[region_at]] queries and with the batched [[classify_regions]].
+// * `roll`: [[roll]] of a range.
+// * `game_logic/polled`, `game_logic/scheduled`: One 60 Hz [[game_logic]] tick of a scene with
+//   `n` props, with `rules.event_queue` off and on.
+// * `scene_prop_draw_item`, `scene_dinosaur_draw_item`: Building the [[draw_item_t]] of a scene
+//   prop or dinosaur.
+// * `gift_name`, `claim_gift`: [[gift_name]] and [[claim_gift]] for random images. Before timing,
+//   checks that [[claim_gift]] adds the items and keeps the lists of owned items in order.
+// * `sprintf_uint`, `format_uint`: Formatting random numbers of all magnitudes with `sprintf()`,
+//   as the menus used to, and with [[format_uint]].
+//
+// The sort of the draw items is measured by the depth sort benchmarks below.
+//
+// ## Depth sort
+//
+// Compares the [[depth_list_t]] with the way the scene used to be sorted -- collecting a
+// [[draw_item_t]] for every item and the background layers and sorting them with `qsort()` every
+// frame. Measured at 32 (the default scene budget), 1k and 100k items:
+//
+// * `qsort`: The old path, per frame.
+// * `rebuild`: A full [[depth_sort]] of shuffled keys, as done when a state is started.
+// * `update`: Removing one item and inserting another with [[depth_remove]] and
+//   [[depth_insert]], as done when a prop is eaten or a dinosaur leaves.
+// * `merge`: Walking the sorted list with the background layers merged in, as done when the
+//   [[scene_cache_t]] is rebuilt.
+//
+// ## Culling
+//
+// A park of `n` props and `n` dinosaurs on a background four times as wide as the view, as on a
+// narrow display. First checks that [[cull_scene_cache]] never culls an item that overlaps the
+// view, at scroll positions across the background, then prints how many items are drawn and
+// culled and times the culling:
+//
+// * `scene/cull`: Marking the visible items of the [[scene_cache_t]] for one frame. An op is one
+//   item in the cache.
+//
+// ## Save games
+//
+// Prints the size of [[tm_simulate_state_o]] and of the fields at its start that the game logic
+// touches every tick, up to `num_discarded_drops`.
+//
+// A game with `n` props and `n` dinosaurs in the scene. First checks that loading a save gives the
+// same [[hash_state]] as the saved game, also after running both on, and that a corrupt save is
+// rejected, then prints the size of the save and the time for the job to hash and write it and
+// times:
+//
+// * `save/snapshot`: [[snapshot_game]], the part of a save that blocks the frame. An op is one
+//   prop or dinosaur.
+// * `save/load`: [[load_game]] of the save file.
+//
+// ## Hot reload
+//
+// Checks that the [[state_schema]] describes the state, and that [[migrate_state]] moves a state
+// with random contents from an older layout -- the fields in reverse order, without
+// `items_version` and with a shorter `inventory` -- to the fields with the same names, then times:
+//
+// * `state/migrate`: [[migrate_state]] from the older layout. An op is one field.
+
+#include "../dinosaur_simulate.c"
+
+#include <time.h>
+
+// Minimum seconds spent on each measurement. Set by `--seconds`.
+static double min_seconds = 0.2;
+
+// Number of failed checks.
+static uint32_t num_failures;
+
+// Accumulates results that must not be optimized away.
+static double sink;
+
+// Returns the current time in seconds.
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Random
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+// Returns the next value of the xorshift64 sequence.
+static uint64_t rng_next(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// Returns a random float in `[a, b)`.
+static float rng_float(float a, float b)
+{
+    return a + (b - a) * (float)(rng_next() >> 40) * (1.0f / (1 << 24));
+}
+
+// Reports a failed check.
+static void fail(const char* format, const char* what)
+{
+    ++num_failures;
+    fprintf(stderr, "FAILED: ");
+    fprintf(stderr, format, what);
+    fprintf(stderr, "\n");
+}
+
+// Allocations
+
+// Number of allocations made through [[bench_allocator]].
+static uint64_t num_allocs;
+
+// Implements `tm_allocator_i->realloc()` with `realloc()`, counting the allocations.
+static void* bench_realloc(struct tm_allocator_i* a, void* ptr, uint64_t old_size, uint64_t new_size, const char* file, uint32_t line)
+{
+    if (new_size > old_size)
+        ++num_allocs;
+    if (!new_size) {
+        free(ptr);
+        return 0;
+    }
+    return realloc(ptr, new_size);
+}
+
+// Allocator given to the states, so that allocations in the kernels are counted.
+static tm_allocator_i bench_allocator = { .realloc = bench_realloc };
+
+// Timing
+
+// Defines a measurement. `setup` runs before each batch of runs and isn't timed.
+struct measure_t {
+    void (*setup)(void* data);
+    void (*run)(void* data);
+    void* data;
+};
+
+// Result of [[measure]].
+struct timing_t {
+    // Mean seconds per run.
+    double seconds;
+
+    // Mean allocations per run, counted by [[bench_allocator]].
+    double allocs;
+};
+
+// Returns the mean time and allocations per run of `m`, measured for at least [[min_seconds]].
+// Without a `setup`, a whole batch of runs is timed at once, so that the clock doesn't dominate
+// the small kernels.
+static struct timing_t measure(struct measure_t m)
+{
+    double total = 0;
+    uint64_t runs = 0;
+    const uint64_t allocs_before = num_allocs;
+    for (uint32_t batch = 1; total < min_seconds; batch *= 2) {
+        if (!m.setup) {
+            const double t0 = now();
+            for (uint32_t i = 0; i < batch; ++i)
+                m.run(m.data);
+            total += now() - t0;
+        } else {
+            for (uint32_t i = 0; i < batch; ++i) {
+                m.setup(m.data);
+                const double t0 = now();
+                m.run(m.data);
+                total += now() - t0;
+            }
+        }
+        runs += batch;
+    }
+    return (struct timing_t){ total / (double)runs, (double)(num_allocs - allocs_before) / (double)runs };
+}
+
+// Results
+
+// A recorded result.
+struct result_t {
+    char kernel[48];
+
+    // Size of the synthetic data.
+    uint32_t n;
+
+    double ns_per_op;
+    double items_per_s;
+    double allocs_per_iter;
+};
+
+// Maximum number of results in a run or a baseline.
+enum { MAX_RESULTS = 256 };
+
+// Results of this run, and of the baseline read by [[read_results]].
+static struct result_t results[MAX_RESULTS];
+static uint32_t num_results;
+static struct result_t baseline[MAX_RESULTS];
+static uint32_t num_baseline;
+
+// Fraction that a kernel may get slower than the baseline before it counts as a regression. Set by
+// `--threshold`.
+static double threshold = 0.2;
+
+// Number of kernels that regressed against the baseline.
+static uint32_t num_regressions;
+
+// Returns the result for `kernel` and `n` in `(rs, num_rs)`, or `NULL`.
+static const struct result_t* find_result(const struct result_t* rs, uint32_t num_rs, const char* kernel, uint32_t n)
+{
+    for (uint32_t i = 0; i < num_rs; ++i) {
+        if (rs[i].n == n && strcmp(rs[i].kernel, kernel) == 0)
+            return rs + i;
+    }
+    return NULL;
+}
+
+// Records the result `t` of a kernel that processes `ops` items per run on data of size `n`, prints
+// it and compares it with the baseline. If `reference` is non-zero, the speedup over a run taking
+// `reference` seconds is printed too.
+static void record(const char* kernel, uint32_t n, uint32_t ops, struct timing_t t, double reference)
+{
+    struct result_t r = { .n = n, .ns_per_op = t.seconds * 1e9 / ops, .items_per_s = ops / t.seconds, .allocs_per_iter = t.allocs };
+    snprintf(r.kernel, sizeof(r.kernel), "%s", kernel);
+    if (num_results < MAX_RESULTS)
+        results[num_results++] = r;
+
+    printf("  %-26s %7u %10.2f ns/op %12.4g items/s %6.2f allocs", kernel, n, r.ns_per_op, r.items_per_s, r.allocs_per_iter);
+    if (reference > 0)
+        printf(" %8.1fx", reference / t.seconds);
+    const struct result_t* base = find_result(baseline, num_baseline, r.kernel, n);
+    if (base) {
+        const bool slower = r.ns_per_op > base->ns_per_op * (1 + threshold);
+        const bool allocs = r.allocs_per_iter > base->allocs_per_iter + 0.005;
+        printf("  %+6.1f %%%s", (r.ns_per_op / base->ns_per_op - 1) * 100, slower || allocs ? "  REGRESSION" : "");
+        num_regressions += slower || allocs;
+    } else if (num_baseline) {
+        printf("  (new)");
+    }
+    printf("\n");
+}
+
+// Writes [[results]] to the CSV file `path`.
+static void write_results(const char* path)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fail("could not write `%s`", path);
+        return;
+    }
+    fprintf(f, "kernel,n,ns_per_op,items_per_s,allocs_per_iter\n");
+    for (uint32_t i = 0; i < num_results; ++i) {
+        const struct result_t* r = results + i;
+        fprintf(f, "%s,%u,%.3f,%.6g,%.3f\n", r->kernel, r->n, r->ns_per_op, r->items_per_s, r->allocs_per_iter);
+    }
+    fclose(f);
+}
+
+// Reads the baseline from the CSV file `path`, written by [[write_results]].
+static void read_results(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fail("could not read `%s`", path);
+        return;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f) && num_baseline < MAX_RESULTS) {
+        struct result_t* r = baseline + num_baseline;
+        if (sscanf(line, "%47[^,],%u,%lf,%lf,%lf", r->kernel, &r->n, &r->ns_per_op, &r->items_per_s, &r->allocs_per_iter) == 5)
+            ++num_baseline;
+    }
+    fclose(f);
+    if (!num_baseline)
+        fail("no results in `%s`", path);
+}
+
+// Kernels
+
+// Data for the kernel benchmarks.
+struct kernel_bench_t {
+    uint32_t n;
+
+    // Random points and images.
+    tm_vec2_t* points;
+    enum IMAGE* images;
+
+    // Regions of the points.
+    uint8_t* regions;
+
+    // Random numbers of all magnitudes.
+    uint32_t* values;
+
+    // Random scene entities and their draw items.
+    struct scene_prop_t* props;
+    struct scene_dinosaur_t* dinos;
+    struct draw_item_t* items;
+
+    // State for [[game_logic]] and [[claim_gift]], with `n` props.
+    tm_simulate_state_o* state;
+};
+
+// Returns a random scene prop.
+static struct scene_prop_t random_scene_prop(void)
+{
+    struct scene_prop_t p = { .prop = (uint16_t)(rng_next() % NUM_PROPS), .x = rng_float(0, 1), .y = rng_float(0.35f, 1) };
+    p.region = region_at(p.x, p.y);
+    return p;
+}
+
+// Runs [[lake_outline]] for the points.
+static void lake_outline_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < b->n; ++i)
+        count += lake_outline(b->points[i].x, b->points[i].y);
+    sink += count;
+}
+
+// Runs [[region_at]] for the points.
+static void region_at_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < b->n; ++i)
+        count += region_at(b->points[i].x, b->points[i].y) == REGION__LAKE;
+    sink += count;
+}
+
+// Runs [[classify_regions]] for the points.
+static void classify_regions_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    classify_regions(b->points, b->n, b->regions);
+    sink += b->regions[b->n - 1];
+}
+
+// Checks that [[classify_regions]] gives the same regions as [[region_at]], also for points
+// outside the background and NaN and infinite coordinates, and that the default region map
+// follows [[lake_outline]] at the cell centers.
+static void check_regions(struct kernel_bench_t* b)
+{
+    tm_vec2_t* outside = malloc(b->n * sizeof(*outside));
+    for (uint32_t i = 0; i < b->n; ++i)
+        outside[i] = (tm_vec2_t){ rng_float(-0.5f, 1.5f), rng_float(-0.5f, 1.5f) };
+    const float odd[] = { NAN, -NAN, INFINITY, -INFINITY, 0.5f };
+    tm_vec2_t* non_finite = malloc(b->n * sizeof(*non_finite));
+    for (uint32_t i = 0; i < b->n; ++i)
+        non_finite[i] = (tm_vec2_t){ odd[i % TM_ARRAY_COUNT(odd)], odd[i / TM_ARRAY_COUNT(odd) % TM_ARRAY_COUNT(odd)] };
+    const tm_vec2_t* sets[] = { b->points, outside, non_finite };
+    for (uint32_t s = 0; s < TM_ARRAY_COUNT(sets); ++s) {
+        classify_regions(sets[s], b->n, b->regions);
+        for (uint32_t i = 0; i < b->n; ++i) {
+            if (b->regions[i] != region_at(sets[s][i].x, sets[s][i].y)) {
+                fail("batched and single region queries differ (%s)", "classify_regions");
+                break;
+            }
+        }
+    }
+    free(outside);
+    free(non_finite);
+
+    for (uint32_t r = 0; r < REGION_MAP_HEIGHT; ++r) {
+        for (uint32_t c = 0; c < REGION_MAP_WIDTH; ++c) {
+            const float x = ((float)c + 0.5f) / REGION_MAP_WIDTH;
+            const float y = ((float)r + 0.5f) / REGION_MAP_HEIGHT;
+            if (y >= 0.35f && (region_at(x, y) == REGION__LAKE) != lake_outline(x, y)) {
+                fail("the default region map doesn't follow the lake outline (%s)", "region_at");
+                return;
+            }
+        }
+    }
+}
+
+// Runs [[roll]] `n` times.
+static void roll_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    double sum = 0;
+    for (uint32_t i = 0; i < b->n; ++i)
+        sum += roll(b->state, rules.speed_multiplier);
+    sink += sum;
+}
+
+// Tops up the props of the state, which the game logic consumes, without timing it.
+static void game_logic_setup(void* data)
+{
+    struct kernel_bench_t* b = data;
+    while (b->state->num_scene_props < b->n)
+        add_scene_prop(b->state, random_scene_prop());
+    b->state->num_awarded_drops = 0;
+}
+
+// Ticks the state by one 60 Hz frame.
+static void game_logic_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    game_logic(b->state, 1.0 / 60.0);
+}
+
+// Builds the draw items of the scene props.
+static void scene_prop_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    const tm_rect_t background_r = { 0, 0, 2048, 1024 };
+    for (uint32_t i = 0; i < b->n; ++i)
+        b->items[i] = scene_prop_draw_item(background_r, b->props + i);
+    sink += b->items[b->n - 1].rect.x;
+}
+
+// Builds the draw items of the scene dinosaurs.
+static void scene_dinosaur_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    const tm_rect_t background_r = { 0, 0, 2048, 1024 };
+    for (uint32_t i = 0; i < b->n; ++i)
+        b->items[i] = scene_dinosaur_draw_item(background_r, b->dinos + i);
+    sink += b->items[b->n - 1].rect.x;
+}
+
+// Runs [[gift_name]] for the images.
+static void gift_name_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < b->n; ++i)
+        sum += (uint64_t)gift_name(b->images[i])[0];
+    sink += (double)sum;
+}
+
+// Runs [[claim_gift]] for the images.
+static void claim_gift_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    for (uint32_t i = 0; i < b->n; ++i)
+        claim_gift(b->state, b->images[i], 1);
+}
+
+// Checks that [[claim_gift]] adds each claimed prop and memento to the state once.
+static void check_claim_gift(struct kernel_bench_t* b)
+{
+    tm_simulate_state_o* state = b->state;
+    uint64_t expected = 0, before = 0, after = 0;
+    for (uint32_t i = 0; i < b->n; ++i) {
+        const enum ITEM_KIND kind = indices.items[b->images[i]].kind;
+        expected += kind == ITEM_KIND__PROP || kind == ITEM_KIND__MEMENTO;
+    }
+    for (uint32_t i = 0; i < NUM_PROPS; ++i)
+        before += state->inventory[i];
+    for (uint32_t i = 0; i < NUM_MEMENTOS; ++i)
+        before += state->mementos[i];
+    claim_gift_run(b);
+    for (uint32_t i = 0; i < NUM_PROPS; ++i)
+        after += state->inventory[i];
+    for (uint32_t i = 0; i < NUM_MEMENTOS; ++i)
+        after += state->mementos[i];
+    if (after - before != expected)
+        fail("claim_gift doesn't add the claimed items (%s)", "claim_gift");
+
+    // The incrementally kept lists of owned items must match lists rebuilt from the counts.
+    tm_simulate_state_o* rebuilt = malloc(sizeof(*rebuilt));
+    *rebuilt = *state;
+    rebuild_item_lists(rebuilt);
+    if (rebuilt->num_owned_props != state->num_owned_props || rebuilt->num_owned_mementos != state->num_owned_mementos
+        || memcmp(rebuilt->owned_props, state->owned_props, state->num_owned_props * sizeof(*state->owned_props))
+        || memcmp(rebuilt->owned_mementos, state->owned_mementos, state->num_owned_mementos * sizeof(*state->owned_mementos)))
+        fail("%s doesn't keep the lists of owned items up to date", "claim_gift");
+    free(rebuilt);
+}
+
+// Formats the values with `sprintf()`.
+static void sprintf_uint_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    char s[UINT_STRING_SIZE];
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < b->n; ++i)
+        sum += (uint64_t)sprintf(s, "%u", b->values[i]) + (uint8_t)s[0];
+    sink += (double)sum;
+}
+
+// Formats the values with [[format_uint]].
+static void format_uint_run(void* data)
+{
+    struct kernel_bench_t* b = data;
+    char s[UINT_STRING_SIZE];
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < b->n; ++i)
+        sum += format_uint(s, b->values[i]) + (uint8_t)s[0];
+    sink += (double)sum;
+}
+
+// Checks that [[format_uint]] gives the same strings as `sprintf()` for the values and the
+// limits.
+static void check_format_uint(struct kernel_bench_t* b)
+{
+    for (uint32_t i = 0; i < b->n + 4; ++i) {
+        const uint32_t limits[] = { 0, 9, 10, UINT32_MAX };
+        const uint32_t v = i < b->n ? b->values[i] : limits[i - b->n];
+        char expected[UINT_STRING_SIZE], formatted[UINT_STRING_SIZE];
+        const uint32_t n = (uint32_t)sprintf(expected, "%u", v);
+        if (format_uint(formatted, v) != n || strcmp(formatted, expected)) {
+            fail("%s doesn't give the same strings as sprintf()", "format_uint");
+            return;
+        }
+    }
+}
+
+// Runs the kernel benchmarks on synthetic scenes of `n` entities.
+static void bench_kernels(uint32_t n)
+{
+    struct kernel_bench_t b = {
+        .n = n,
+        .points = malloc(n * sizeof(*b.points)),
+        .images = malloc(n * sizeof(*b.images)),
+        .regions = malloc(n * sizeof(*b.regions)),
+        .values = malloc(n * sizeof(*b.values)),
+        .props = malloc(n * sizeof(*b.props)),
+        .dinos = malloc(n * sizeof(*b.dinos)),
+        .items = malloc(n * sizeof(*b.items)),
+        .state = calloc(1, sizeof(tm_simulate_state_o)),
+    };
+    b.state->allocator = &bench_allocator;
+    seed_random(&b.state->random, rng_next());
+    const struct rules_t default_rules = rules;
+    rules.max_scene_props = n;
+    rules.max_scene_dinosaurs = n;
+    for (uint32_t i = 0; i < n; ++i) {
+        b.points[i] = (tm_vec2_t){ rng_float(0, 1), rng_float(0.35f, 1) };
+        b.images[i] = (enum IMAGE)(rng_next() % NUM_IMAGES);
+        b.values[i] = (uint32_t)rng_next() >> (rng_next() % 32);
+        b.props[i] = random_scene_prop();
+        b.dinos[i] = (struct scene_dinosaur_t){ .dinosaur = (uint16_t)(rng_next() % NUM_DINOSAURS), .x = rng_float(0, 1), .y = rng_float(0.35f, 1), .flipped = rng_next() & 1 };
+        b.dinos[i].region = region_at(b.dinos[i].x, b.dinos[i].y);
+    }
+
+    check_claim_gift(&b);
+    check_regions(&b);
+    check_format_uint(&b);
+
+    const struct timing_t outline = measure((struct measure_t){ 0, lake_outline_run, &b });
+    record("lake_outline", n, n, outline, 0);
+    record("region_at", n, n, measure((struct measure_t){ 0, region_at_run, &b }), outline.seconds);
+    record("classify_regions", n, n, measure((struct measure_t){ 0, classify_regions_run, &b }), outline.seconds);
+    record("roll", n, n, measure((struct measure_t){ 0, roll_run, &b }), 0);
+    rules.event_queue = false;
+    record("game_logic/polled", n, n, measure((struct measure_t){ game_logic_setup, game_logic_run, &b }), 0);
+    rules.event_queue = true;
+    record("game_logic/scheduled", n, n, measure((struct measure_t){ game_logic_setup, game_logic_run, &b }), 0);
+    record("scene_prop_draw_item", n, n, measure((struct measure_t){ 0, scene_prop_run, &b }), 0);
+    record("scene_dinosaur_draw_item", n, n, measure((struct measure_t){ 0, scene_dinosaur_run, &b }), 0);
+    record("gift_name", n, n, measure((struct measure_t){ 0, gift_name_run, &b }), 0);
+    record("claim_gift", n, n, measure((struct measure_t){ 0, claim_gift_run, &b }), 0);
+    const struct timing_t sprintf_uint = measure((struct measure_t){ 0, sprintf_uint_run, &b });
+    record("sprintf_uint", n, n, sprintf_uint, 0);
+    record("format_uint", n, n, measure((struct measure_t){ 0, format_uint_run, &b }), sprintf_uint.seconds);
+
+    rules = default_rules;
+    free_scene(b.state);
+    free(b.state);
+    free(b.points);
+    free(b.images);
+    free(b.regions);
+    free(b.values);
+    free(b.props);
+    free(b.dinos);
+    free(b.items);
+}
+
+// Depth sort
+
+// Data for the depth sort benchmarks.
+struct depth_bench_t {
+    uint32_t n;
+
+    // Sorted keys and a shuffled copy.
+    struct depth_key_t* sorted;
+    struct depth_key_t* shuffled;
+
+    // Working copy and scratch space for [[depth_sort]].
+    struct depth_key_t* keys;
+    struct depth_key_t* tmp;
+    uint32_t num_keys;
+
+    // Draw items for the `qsort` path.
+    struct draw_item_t* items;
+
+    // Prevents the compiler from optimizing away the merge.
+    float sink;
+};
+
+// Sets up the `qsort` benchmark: fills the draw items in scene order.
+static void qsort_setup(void* data)
+{
+    struct depth_bench_t* b = data;
+    for (uint32_t i = 0; i < b->n; ++i)
+        b->items[i] = (struct draw_item_t){ .y = b->shuffled[i].y, .image = props[i % NUM_PROPS].image };
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(background_layers); ++i)
+        b->items[b->n + i] = (struct draw_item_t){ .y = background_layers[i].y, .image = background_layers[i].image };
+}
+
+// The old path: sorts the draw items and the background layers with `qsort()`.
+static void qsort_run(void* data)
+{
+    struct depth_bench_t* b = data;
+    qsort(b->items, b->n + TM_ARRAY_COUNT(background_layers), sizeof(*b->items), compare_float);
+}
+
+// Sets up the `rebuild` benchmark.
+static void rebuild_setup(void* data)
+{
+    struct depth_bench_t* b = data;
+    memcpy(b->keys, b->shuffled, b->n * sizeof(*b->keys));
+}
+
+// Sorts the shuffled keys with [[depth_sort]].
+static void rebuild_run(void* data)
+{
+    struct depth_bench_t* b = data;
+    depth_sort(b->keys, b->n, b->tmp);
+}
+
+// Removes a random key and inserts a new one, keeping the list at `n` keys.
+static void update_run(void* data)
+{
+    struct depth_bench_t* b = data;
+    const struct depth_key_t old = b->keys[rng_next() % b->num_keys];
+    depth_remove(b->keys, &b->num_keys, old);
+    depth_insert(b->keys, &b->num_keys, (struct depth_key_t){ rng_float(0.35f, 1), old.item });
+}
+
+// Walks the sorted keys with the background layers merged in, like [[build_scene_cache]].
+static void merge_run(void* data)
+{
+    struct depth_bench_t* b = data;
+    const struct depth_key_t* k = b->keys;
+    const struct depth_key_t* end = k + b->num_keys;
+    uint32_t layer = 0;
+    float sum = 0;
+    while (k != end || layer < TM_ARRAY_COUNT(background_layers)) {
+        if (layer < TM_ARRAY_COUNT(background_layers) && (k == end || background_layers[layer].y <= k->y))
+            sum += background_layers[layer++].y;
+        else
+            sum += (k++)->y;
+    }
+    b->sink += sum;
+}
+
+// Returns `true` if `(keys, n)` is sorted by y.
+static bool is_sorted(const struct depth_key_t* keys, uint32_t n)
+{
+    for (uint32_t i = 1; i < n; ++i) {
+        if (keys[i].y < keys[i - 1].y)
+            return false;
+    }
+    return true;
+}
+
+// Checks [[depth_sort]], [[depth_insert]] and [[depth_remove]] against `qsort()` for `b`.
+static void check_depth_sort(struct depth_bench_t* b)
+{
+    memcpy(b->keys, b->shuffled, b->n * sizeof(*b->keys));
+    depth_sort(b->keys, b->n, b->tmp);
+    for (uint32_t i = 0; i < b->n; ++i) {
+        if (b->keys[i].y != b->sorted[i].y) {
+            fail("depth_sort doesn't match qsort (%s)", "rebuild");
+            return;
+        }
+    }
+    // Equal y-coordinates must keep their order.
+    for (uint32_t i = 1; i < b->n; ++i) {
+        if (b->keys[i].y == b->keys[i - 1].y && b->keys[i].item < b->keys[i - 1].item) {
+            fail("depth_sort is not stable (%s)", "rebuild");
+            return;
+        }
+    }
+
+    b->num_keys = b->n;
+    for (uint32_t i = 0; i < 1000; ++i)
+        update_run(b);
+    if (b->num_keys != b->n || !is_sorted(b->keys, b->num_keys))
+        fail("depth_insert / depth_remove broke the order (%s)", "update");
+}
+
+// Returns `true` if the [[depth_list_t]] of `state` is sorted and has exactly one key for each
+// prop and dinosaur, at its y-coordinate.
+static bool depth_list_matches_scene(const tm_simulate_state_o* state)
+{
+    const struct depth_list_t* depth = &state->depth;
+    if (depth->num_keys != state->num_scene_props + state->num_scene_dinosaurs || !is_sorted(depth->keys, depth->num_keys))
+        return false;
+    for (uint32_t i = 0; i < depth->num_keys; ++i) {
+        const uint32_t slot = depth->keys[i].item & ~DEPTH_ITEM__DINOSAUR;
+        const bool dino = depth->keys[i].item & DEPTH_ITEM__DINOSAUR;
+        const struct scene_slots_t* slots = dino ? &state->dinosaur_slots : &state->prop_slots;
+        if (slot >= slots->num_slots)
+            return false;
+        const uint32_t index = slots->slots[slot].index;
+        const uint32_t n = dino ? state->num_scene_dinosaurs : state->num_scene_props;
+        if (index >= n)
+            return false;
+        const uint32_t handle = dino ? state->scene_dinosaurs[index].handle : state->scene_props[index].handle;
+        const float y = dino ? state->scene_dinosaurs[index].y : state->scene_props[index].y;
+        if ((handle & SCENE_HANDLE_SLOT_MASK) != slot || y != depth->keys[i].y)
+            return false;
+    }
+    return true;
+}
+
+// Checks that the [[depth_list_t]] of a state follows [[add_scene_prop]], [[remove_scene_prop]],
+// [[add_scene_dinosaur]] and [[remove_scene_dinosaur]], including when the oldest prop is dropped
+// because the scene is full.
+static void check_state_depth_list(void)
+{
+    tm_simulate_state_o* state = calloc(1, sizeof(tm_simulate_state_o));
+    state->allocator = &bench_allocator;
+    seed_random(&state->random, rng_next());
+    rebuild_depth_list(state);
+    for (uint32_t step = 0; step < 100000; ++step) {
+        const uint64_t r = rng_next();
+        if (r % 4 == 0 && state->num_scene_props)
+            remove_scene_prop(state, (uint32_t)(rng_next() % state->num_scene_props));
+        else if (r % 4 == 1 && state->num_scene_dinosaurs)
+            remove_scene_dinosaur(state, (uint32_t)(rng_next() % state->num_scene_dinosaurs));
+        else if (r % 4 == 2 && state->num_scene_dinosaurs < rules.max_scene_dinosaurs)
+            add_scene_dinosaur(state, (struct scene_dinosaur_t){ .dinosaur = (uint16_t)(rng_next() % NUM_DINOSAURS), .y = rng_float(0.35f, 1) });
+        else {
+            // Quantized, so that there are equal y-coordinates.
+            add_scene_prop(state, (struct scene_prop_t){ .prop = (uint16_t)(rng_next() % NUM_PROPS), .y = (float)(rng_next() % 16) / 16 });
+        }
+        if (!depth_list_matches_scene(state)) {
+            fail("the depth list doesn't match the scene (%s)", "state");
+            break;
+        }
+    }
+    free_scene(state);
+    free(state);
+}
+
+// Number of props and dinosaurs in [[check_scene_storage]].
+enum { STORAGE_CHECK_ENTITIES = 100000 };
+
+// Checks the scene storage at [[STORAGE_CHECK_ENTITIES]] props and dinosaurs: that handles stay
+// valid while other entities are removed and the storage grows, that handles of removed entities
+// go stale, and that placing a prop in a full scene removes the oldest one.
+static void check_scene_storage(void)
+{
+    const struct rules_t default_rules = rules;
+    rules.max_scene_props = STORAGE_CHECK_ENTITIES;
+    rules.max_scene_dinosaurs = STORAGE_CHECK_ENTITIES;
+    tm_simulate_state_o* state = calloc(1, sizeof(tm_simulate_state_o));
+    state->allocator = &bench_allocator;
+    seed_random(&state->random, rng_next());
+    rebuild_depth_list(state);
+
+    // Order in which the props were placed, by slot.
+    uint64_t* placed = calloc(STORAGE_CHECK_ENTITIES, sizeof(*placed));
+    uint64_t num_placed = 0;
+
+    bool ok = true;
+    for (uint32_t step = 0; ok && step < 4 * STORAGE_CHECK_ENTITIES; ++step) {
+        const uint64_t r = rng_next() % 8;
+        if (r == 0 && state->num_scene_props) {
+            const uint32_t i = (uint32_t)(rng_next() % state->num_scene_props);
+            const uint32_t h = state->scene_props[i].handle;
+            remove_scene_prop(state, i);
+            ok = handle_index(&state->prop_slots, h) == UINT32_MAX;
+        } else if (r == 1 && state->num_scene_dinosaurs) {
+            const uint32_t i = (uint32_t)(rng_next() % state->num_scene_dinosaurs);
+            const uint32_t h = state->scene_dinosaurs[i].handle;
+            remove_scene_dinosaur(state, i);
+            ok = handle_index(&state->dinosaur_slots, h) == UINT32_MAX;
+        } else if (r <= 3 && state->num_scene_dinosaurs < rules.max_scene_dinosaurs) {
+            const struct scene_dinosaur_t d = { .dinosaur = (uint16_t)(rng_next() % NUM_DINOSAURS), .y = rng_float(0.35f, 1) };
+            const uint32_t h = add_scene_dinosaur(state, d);
+            const uint32_t i = handle_index(&state->dinosaur_slots, h);
+            ok = i < state->num_scene_dinosaurs && state->scene_dinosaurs[i].y == d.y;
+        } else {
+            // In a full scene, every 1000th placement checks that the oldest prop is removed.
+            uint32_t oldest = UINT32_MAX;
+            if (state->num_scene_props == rules.max_scene_props && step % 1000 == 0) {
+                for (uint32_t i = 0; i < state->num_scene_props; ++i) {
+                    const uint32_t slot = state->scene_props[i].handle & SCENE_HANDLE_SLOT_MASK;
+                    if (oldest == UINT32_MAX || placed[slot] < placed[state->scene_props[oldest].handle & SCENE_HANDLE_SLOT_MASK])
+                        oldest = i;
+                }
+                oldest = state->scene_props[oldest].handle;
+            }
+            const struct scene_prop_t p = { .prop = (uint16_t)(rng_next() % NUM_PROPS), .y = rng_float(0.35f, 1) };
+            const uint32_t h = add_scene_prop(state, p);
+            placed[h & SCENE_HANDLE_SLOT_MASK] = num_placed++;
+            const uint32_t i = handle_index(&state->prop_slots, h);
+            ok = i < state->num_scene_props && state->scene_props[i].y == p.y;
+            if (oldest != UINT32_MAX && handle_index(&state->prop_slots, oldest) != UINT32_MAX) {
+                fail("placing a prop in a full scene didn't remove the oldest prop (%s)", "storage");
+                break;
+            }
+        }
+        if (!ok)
+            fail("a scene handle doesn't resolve to its entity (%s)", "storage");
+    }
+
+    // Every entity must be found through its handle.
+    for (uint32_t i = 0; ok && i < state->num_scene_props; ++i)
+        ok = handle_index(&state->prop_slots, state->scene_props[i].handle) == i;
+    for (uint32_t i = 0; ok && i < state->num_scene_dinosaurs; ++i)
+        ok = handle_index(&state->dinosaur_slots, state->scene_dinosaurs[i].handle) == i;
+    if (!ok)
+        fail("the scene handles don't match the entities (%s)", "storage");
+    if (!depth_list_matches_scene(state))
+        fail("the depth list doesn't match the scene (%s)", "storage");
+    if (state->prop_ages.capacity > 4 * rules.max_scene_props)
+        fail("the prop age ring grew beyond the budget (%s)", "storage");
+
+    printf("  %u props, %u dinosaurs, %u prop slots, %u dinosaur slots\n", state->num_scene_props, state->num_scene_dinosaurs,
+        state->prop_slots.num_slots, state->dinosaur_slots.num_slots);
+
+    free(placed);
+    free_scene(state);
+    free(state);
+    rules = default_rules;
+}
+
+// Returns `true` if the event queue of `state` is a valid heap with one event for the coin and
+// for each prop and dinosaur, and every owner refers back to its event.
+static bool event_queue_matches_scene(const tm_simulate_state_o* state)
+{
+    if (state->num_events != 1 + state->num_scene_props + state->num_scene_dinosaurs)
+        return false;
+    if (state->num_events > tm_carray_capacity(state->events))
+        return false;
+    for (uint32_t i = 1; i < state->num_events; ++i) {
+        if (state->events[i].time < state->events[(i - 1) / 2].time)
+            return false;
+    }
+    if (state->events[state->coin_event].type != EVENT__COIN)
+        return false;
+    for (uint32_t i = 0; i < state->num_scene_props; ++i) {
+        const struct event_t* e = state->events + state->scene_props[i].event;
+        if (e->type != EVENT__PROP || e->handle != state->scene_props[i].handle)
+            return false;
+    }
+    for (uint32_t i = 0; i < state->num_scene_dinosaurs; ++i) {
+        const struct event_t* e = state->events + state->scene_dinosaurs[i].event;
+        if (e->type != EVENT__DINOSAUR || e->handle != state->scene_dinosaurs[i].handle)
+            return false;
+    }
+    return true;
+}
+
+// Checks the event queue of a scene with the default budgets: fills the props and dinosaurs to the
+// cap and keeps placing props, so that each placement removes the oldest prop and its event.
+static void check_full_scene_events(void)
+{
+    tm_simulate_state_o* state = calloc(1, sizeof(tm_simulate_state_o));
+    state->allocator = &bench_allocator;
+    seed_random(&state->random, rng_next());
+    build_event_queue(state);
+    for (uint32_t i = 0; i < rules.max_scene_dinosaurs; ++i)
+        add_scene_dinosaur(state, (struct scene_dinosaur_t){ .dinosaur = (uint16_t)(rng_next() % NUM_DINOSAURS), .y = rng_float(0.35f, 1) });
+    for (uint32_t step = 0; step < 16 * rules.max_scene_props; ++step) {
+        add_scene_prop(state, random_scene_prop());
+        if (state->num_scene_props > rules.max_scene_props || !event_queue_matches_scene(state)) {
+            fail("the event queue doesn't match the scene (%s)", "full scene");
+            break;
+        }
+    }
+    if (state->num_scene_props != rules.max_scene_props)
+        fail("the scene wasn't filled to the cap (%s)", "full scene");
+    free_scene(state);
+    free(state);
+}
+
+// Compares `float` y-coordinates for `qsort()`.
+static int compare_key_y(const void* a, const void* b)
+{
+    const float x = ((const struct depth_key_t*)a)->y;
+    const float y = ((const struct depth_key_t*)b)->y;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Runs the depth sort benchmarks for `n` items.
+static void bench_depth_sort(uint32_t n)
+{
+    struct depth_bench_t b = {
+        .n = n,
+        .sorted = malloc(n * sizeof(*b.sorted)),
+        .shuffled = malloc(n * sizeof(*b.shuffled)),
+        .keys = malloc((n + 1) * sizeof(*b.keys)),
+        .tmp = malloc(n * sizeof(*b.tmp)),
+        .items = malloc((n + TM_ARRAY_COUNT(background_layers)) * sizeof(*b.items)),
+    };
+    for (uint32_t i = 0; i < n; ++i)
+        b.shuffled[i] = (struct depth_key_t){ rng_float(0.35f, 1), i };
+    memcpy(b.sorted, b.shuffled, n * sizeof(*b.sorted));
+    qsort(b.sorted, n, sizeof(*b.sorted), compare_key_y);
+
+    check_depth_sort(&b);
+
+    const struct timing_t base = measure((struct measure_t){ qsort_setup, qsort_run, &b });
+    record("depth/qsort", n, n, base, 0);
+    record("depth/rebuild", n, n, measure((struct measure_t){ rebuild_setup, rebuild_run, &b }), base.seconds);
+    memcpy(b.keys, b.sorted, n * sizeof(*b.keys));
+    b.num_keys = n;
+    record("depth/update", n, 1, measure((struct measure_t){ 0, update_run, &b }), base.seconds);
+    record("depth/merge", n, n, measure((struct measure_t){ 0, merge_run, &b }), base.seconds);
+
+    free(b.sorted);
+    free(b.shuffled);
+    free(b.keys);
+    free(b.tmp);
+    free(b.items);
+}
+
+// Culling
+
+// Data for the culling benchmark.
+struct cull_bench_t {
+    // State with a built [[scene_cache_t]].
+    tm_simulate_state_o* state;
+
+    // Where the background is drawn and the part of it that is in view.
+    tm_rect_t background_r;
+    tm_rect_t view_r;
+};
+
+// Size of the background and the view in the culling benchmark.
+#define CULL_BACKGROUND_W 4096.0f
+#define CULL_VIEW_W 1024.0f
+#define CULL_VIEW_H 2048.0f
+
+// Culls the scene cache.
+static void cull_run(void* data)
+{
+    struct cull_bench_t* b = data;
+    cull_scene_cache(b->state, b->background_r, b->view_r);
+}
+
+// Checks that every item of the scene cache that overlaps the view is marked visible, when the
+// background is scrolled by `scroll`.
+static bool check_cull(struct cull_bench_t* b, float scroll)
+{
+    const struct scene_cache_t* cache = &b->state->scene_cache;
+    b->background_r = (tm_rect_t){ -scroll, 0, CULL_BACKGROUND_W, CULL_VIEW_H };
+    cull_scene_cache(b->state, b->background_r, b->view_r);
+    for (uint32_t i = 0; i < cache->num_items; ++i) {
+        const tm_rect_t r = cache->items[i].rect;
+        const bool overlaps = r.x - scroll < b->view_r.x + b->view_r.w && r.x + r.w - scroll > b->view_r.x
+            && r.y < b->view_r.y + b->view_r.h && r.y + r.h > b->view_r.y;
+        if (overlaps && !(cache->visible[i / 64] & (1ULL << (i % 64))))
+            return false;
+    }
+    return true;
+}
+
+// Runs the culling benchmark for `n` props and `n` dinosaurs.
+static void bench_scene_culling(uint32_t n)
+{
+    const struct rules_t default_rules = rules;
+    rules.max_scene_props = n;
+    rules.max_scene_dinosaurs = n;
+    struct cull_bench_t b = {
+        .state = calloc(1, sizeof(tm_simulate_state_o)),
+        .view_r = { 0, 0, CULL_VIEW_W, CULL_VIEW_H },
+    };
+    b.state->allocator = &bench_allocator;
+    seed_random(&b.state->random, rng_next());
+    rebuild_depth_list(b.state);
+    for (uint32_t i = 0; i < n; ++i) {
+        add_scene_prop(b.state, random_scene_prop());
+        add_scene_dinosaur(b.state, (struct scene_dinosaur_t){ .dinosaur = (uint16_t)(rng_next() % NUM_DINOSAURS), .x = rng_float(0, 1), .y = rng_float(0.35f, 1), .flipped = rng_next() & 1 });
+    }
+    build_scene_cache(b.state, CULL_BACKGROUND_W, CULL_VIEW_H);
+
+    for (float scroll = 0; scroll <= CULL_BACKGROUND_W - CULL_VIEW_W; scroll += CULL_VIEW_W / 8) {
+        if (!check_cull(&b, scroll)) {
+            fail("an item in view was culled (%s)", "culling");
+            break;
+        }
+    }
+
+    // Time the view in the middle of the background.
+    check_cull(&b, (CULL_BACKGROUND_W - CULL_VIEW_W) / 2);
+    const struct scene_cache_t* cache = &b.state->scene_cache;
+    printf("  %u items: %u drawn, %u culled\n", cache->num_items, cache->num_drawn, cache->num_culled);
+    record("scene/cull", n, cache->num_items, measure((struct measure_t){ 0, cull_run, &b }), 0);
+
+    rules = default_rules;
+    free_scene(b.state);
+    free(b.state);
+}
+
+// Save games
+
+// Data for the save benchmark.
+struct save_bench_t {
+    // State with a scene, and the state it is loaded into.
+    tm_simulate_state_o* state;
+    tm_simulate_state_o* loaded;
+
+    // Last snapshot of `state`.
+    struct save_t* save;
+};
+
+// Path of the save file written by the save benchmark.
+#define SAVE_BENCH_PATH "dinosaur_bench.save"
+
+// Frees the snapshot of the benchmark, if any.
+static void free_snapshot(struct save_bench_t* b)
+{
+    if (b->save) {
+        tm_free(&bench_allocator, b->save->data, b->save->size);
+        tm_free(&bench_allocator, b->save, sizeof(*b->save));
+        b->save = NULL;
+    }
+}
+
+// Takes a snapshot of the state.
+static void snapshot_run(void* data)
+{
+    struct save_bench_t* b = data;
+    free_snapshot(b);
+    b->save = snapshot_game(b->state, SAVE_BENCH_PATH);
+}
+
+// Resets the state that the save is loaded into.
+static void load_setup(void* data)
+{
+    struct save_bench_t* b = data;
+    free_scene(b->loaded);
+    memset(b->loaded, 0, sizeof(*b->loaded));
+    b->loaded->allocator = &bench_allocator;
+}
+
+// Loads the save.
+static void load_run(void* data)
+{
+    struct save_bench_t* b = data;
+    if (!load_game(b->loaded, SAVE_BENCH_PATH))
+        fail("could not load the save (%s)", "save");
+}
+
+// Runs the save benchmark for `n` props and `n` dinosaurs. First checks that a loaded save has the
+// same state as the saved game and stays the same as the game runs on, and that a corrupt save is
+// rejected.
+static void bench_save(uint32_t n)
+{
+    const struct rules_t default_rules = rules;
+    rules.max_scene_props = n;
+    rules.max_scene_dinosaurs = n;
+    struct save_bench_t b = {
+        .state = calloc(1, sizeof(tm_simulate_state_o)),
+        .loaded = calloc(1, sizeof(tm_simulate_state_o)),
+    };
+    b.state->allocator = &bench_allocator;
+    b.state->data_props = props;
+    b.state->data_dinosaurs = dinosaurs;
+    seed_random(&b.state->random, rng_next());
+    b.state->money = 1234;
+    for (uint32_t i = 0; i < n; ++i) {
+        add_scene_prop(b.state, random_scene_prop());
+        add_scene_dinosaur(b.state, (struct scene_dinosaur_t){ .dinosaur = (uint16_t)(rng_next() % NUM_DINOSAURS), .x = rng_float(0, 1), .y = rng_float(0.35f, 1), .flipped = rng_next() & 1 });
+    }
+    // The drops wrap around the end of the award ring.
+    b.state->first_awarded_drop = MAX_AWARDED_DROPS - 1;
+    b.state->num_awarded_drops = 2;
+    *unclaimed_drop(b.state, 0) = (struct awarded_drop_t){ .dinosaur = 0, .num_items = 1, .items = { { .image = BONE, .quantity = 2 } } };
+    *unclaimed_drop(b.state, 1) = (struct awarded_drop_t){ .dinosaur = NUM_DINOSAURS - 1, .num_items = 1, .items = { { .image = BONE, .quantity = 1 } } };
+    game_logic(b.state, 1.0 / 60.0);
+
+    snapshot_run(&b);
+    const double t0 = now();
+    save_job(b.save);
+    if (!b.save->ok)
+        fail("could not write `%s`", SAVE_BENCH_PATH);
+    printf("  %u props, %u dinosaurs: %.1f KB, hashed and written in %.2f ms\n", b.state->num_scene_props, b.state->num_scene_dinosaurs, (double)b.save->size / 1024, (now() - t0) * 1000);
+    load_setup(&b);
+    load_run(&b);
+    if (hash_state(b.loaded) != hash_state(b.state))
+        fail("loaded state differs from the saved state (%s)", "save");
+    for (uint32_t i = 0; i < 60; ++i) {
+        game_logic(b.state, 1.0 / 60.0);
+        game_logic(b.loaded, 1.0 / 60.0);
+    }
+    fast_forward(b.state, 600);
+    fast_forward(b.loaded, 600);
+    if (hash_state(b.loaded) != hash_state(b.state))
+        fail("loaded game diverged from the saved game (%s)", "save");
+
+    if (check_save((const struct save_header_t*)b.save->data, b.save->size))
+        fail("snapshot rejected (%s)", "save");
+    b.save->data[b.save->size / 2] ^= 1;
+    if (!check_save((const struct save_header_t*)b.save->data, b.save->size))
+        fail("corrupt save accepted (%s)", "save");
+    b.save->data[b.save->size / 2] ^= 1;
+    ((struct save_header_t*)b.save->data)->schema_hash ^= 1;
+    if (!check_save((const struct save_header_t*)b.save->data, b.save->size))
+        fail("save with another state schema accepted (%s)", "save");
+
+    const uint32_t items = b.state->num_scene_props + b.state->num_scene_dinosaurs;
+    record("save/snapshot", n, items, measure((struct measure_t){ 0, snapshot_run, &b }), 0);
+    record("save/load", n, items, measure((struct measure_t){ load_setup, load_run, &b }), 0);
+
+    rules = default_rules;
+    remove(SAVE_BENCH_PATH);
+    free_snapshot(&b);
+    free_scene(b.state);
+    free(b.state);
+    free_scene(b.loaded);
+    free(b.loaded);
+}
+
+// Hot reload
+
+// Data for the migration benchmark.
+struct migrate_bench_t {
+    // The older layout and a state laid out as it describes.
+    struct state_field_t old_schema[TM_ARRAY_COUNT(state_schema)];
+    uint32_t num_old_fields;
+    char* old;
+
+    // The state that `old` was made from, and the state it is migrated into.
+    tm_simulate_state_o* state;
+    tm_simulate_state_o* migrated;
+};
+
+// Zeroes the state that the old state is migrated into.
+static void migrate_setup(void* data)
+{
+    struct migrate_bench_t* b = data;
+    memset(b->migrated, 0, sizeof(*b->migrated));
+}
+
+// Migrates the old state.
+static void migrate_run(void* data)
+{
+    struct migrate_bench_t* b = data;
+    uint32_t num_reset;
+    sink += migrate_state(b->migrated, b->old, b->old_schema, b->num_old_fields, &num_reset);
+}
+
+// Checks the [[state_schema]] and [[migrate_state]] from an older layout, then times the migration.
+static void bench_migrate_state(void)
+{
+    const char* error = check_state_schema();
+    if (error)
+        fail("%s (state_schema)", error);
+    hash_state_layouts();
+
+    struct migrate_bench_t b = {
+        .old = calloc(1, 2 * sizeof(tm_simulate_state_o)),
+        .state = malloc(sizeof(tm_simulate_state_o)),
+        .migrated = malloc(sizeof(tm_simulate_state_o)),
+    };
+    for (uint32_t i = 0; i < sizeof(tm_simulate_state_o); ++i)
+        ((uint8_t*)b.state)[i] = (uint8_t)rng_next();
+
+    // The older layout has the fields in reverse order, packed with 8 byte alignment.
+    uint32_t offset = 0;
+    for (uint32_t i = TM_ARRAY_COUNT(state_schema); i-- > 0;) {
+        const struct state_field_t* f = state_schema + i;
+        if (strcmp(f->name, "items_version") == 0)
+            continue;
+        struct state_field_t* o = b.old_schema + b.num_old_fields++;
+        *o = *f;
+        o->offset = offset;
+        if (strcmp(f->name, "inventory") == 0)
+            --o->count;
+        memcpy(b.old + o->offset, (const char*)b.state + f->offset, (uint64_t)o->size * o->count);
+        offset += (o->size * o->count + 7) & ~7u;
+    }
+
+    migrate_setup(&b);
+    uint32_t num_reset;
+    const uint32_t copied = migrate_state(b.migrated, b.old, b.old_schema, b.num_old_fields, &num_reset);
+    if (copied != b.num_old_fields || num_reset)
+        fail("%s didn't copy every field of the old layout", "migrate_state");
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(state_schema); ++i) {
+        const struct state_field_t* f = state_schema + i;
+        const char* migrated = (const char*)b.migrated + f->offset;
+        const char* expected = (const char*)b.state + f->offset;
+        uint64_t kept = (uint64_t)f->size * f->count;
+        if (strcmp(f->name, "items_version") == 0)
+            kept = 0;
+        else if (strcmp(f->name, "inventory") == 0)
+            kept -= f->size;
+        bool zeroed = true;
+        for (uint64_t j = kept; j < (uint64_t)f->size * f->count; ++j)
+            zeroed = zeroed && !migrated[j];
+        if (memcmp(migrated, expected, kept) || !zeroed)
+            fail("%s gives the wrong value for a field", "migrate_state");
+    }
+
+    // If the layout of `scene_prop_t` changed, the whole scene is reset and the rest is copied.
+    for (uint32_t i = 0; i < b.num_old_fields; ++i) {
+        if (strcmp(b.old_schema[i].name, "scene_props") == 0)
+            b.old_schema[i].layout ^= 1;
+    }
+    migrate_setup(&b);
+    migrate_state(b.migrated, b.old, b.old_schema, b.num_old_fields, &num_reset);
+    uint32_t num_scene_fields = 0;
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(state_schema); ++i) {
+        const struct state_field_t* f = state_schema + i;
+        const char* migrated = (const char*)b.migrated + f->offset;
+        const bool scene = f->group == STATE_GROUP__SCENE;
+        num_scene_fields += scene;
+        bool zeroed = true;
+        for (uint64_t j = 0; j < (uint64_t)f->size * f->count; ++j)
+            zeroed = zeroed && !migrated[j];
+        if (scene ? !zeroed : strcmp(f->name, "money") == 0 && memcmp(migrated, (const char*)b.state + f->offset, f->size))
+            fail("%s kept part of a scene with a changed layout", "migrate_state");
+    }
+    if (num_reset != num_scene_fields)
+        fail("%s reset the wrong number of fields", "migrate_state");
+    for (uint32_t i = 0; i < b.num_old_fields; ++i) {
+        if (strcmp(b.old_schema[i].name, "scene_props") == 0)
+            b.old_schema[i].layout ^= 1;
+    }
+
+    printf("  %u fields, %zu bytes\n", (uint32_t)TM_ARRAY_COUNT(state_schema), sizeof(tm_simulate_state_o));
+    record("state/migrate", TM_ARRAY_COUNT(state_schema), TM_ARRAY_COUNT(state_schema), measure((struct measure_t){ migrate_setup, migrate_run, &b }), 0);
+
+    free(b.old);
+    free(b.state);
+    free(b.migrated);
+}
+
+// Main
+
+// Prints the command line options.
+static void print_usage(void)
+{
+    printf("Usage: dinosaur_bench [--seconds <n>] [--out <file>] [--baseline <file>] [--threshold <fraction>]\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* out_path = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+            min_seconds = strtod(argv[++i], 0);
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            out_path = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            read_results(argv[++i]);
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            threshold = strtod(argv[++i], 0);
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    build_indices();
+    init_state_schema();
+
+    printf("kernels:\n");
+    bench_kernels(8);
+    bench_kernels(1000);
+    bench_kernels(100000);
+
+    printf("scene storage:\n");
+    check_scene_storage();
+    check_full_scene_events();
+
+    printf("depth sort (speedup over qsort):\n");
+    check_state_depth_list();
+    bench_depth_sort(32);
+    bench_depth_sort(1000);
+    bench_depth_sort(100000);
+
+    printf("culling:\n");
+    bench_scene_culling(8);
+    bench_scene_culling(1000);
+    bench_scene_culling(100000);
+
+    printf("save games:\n");
+    const size_t hot_bytes = offsetof(tm_simulate_state_o, num_discarded_drops) + sizeof(uint32_t);
+    printf("  state: %zu bytes, game logic fields in the first %zu bytes (%zu cache lines)\n", sizeof(tm_simulate_state_o), hot_bytes, (hot_bytes + 63) / 64);
+    bench_save(8);
+    bench_save(1000);
+    bench_save(100000);
+
+    printf("hot reload:\n");
+    bench_migrate_state();
+
+    if (out_path)
+        write_results(out_path);
+    if (num_regressions)
+        fprintf(stderr, "%u kernels regressed by more than %.0f %% against the baseline\n", num_regressions, threshold * 100);
+    if (num_failures)
+        fprintf(stderr, "%u checks failed\n", num_failures);
+    return num_regressions || num_failures ? 1 : 0;
+}
@@ -8,13 +8,20 @@ static struct tm_error_api* tm_error_api;
 static struct tm_the_truth_api* tm_the_truth_api;
 static struct tm_temp_allocator_api* tm_temp_allocator_api;
 static struct tm_random_api* tm_random_api;
+static struct tm_job_system_api* tm_job_system_api;
+static struct tm_logger_api* tm_logger_api;
+static struct tm_os_api* tm_os_api;
 
 #include <foundation/allocator.h>
 #include <foundation/api_registry.h>
+#include <foundation/atomics.inl>
 #include <foundation/carray.inl>
 #include <foundation/error.h>
+#include <foundation/job_system.h>
+#include <foundation/log.h>
 #include <foundation/macros.h>
 #include <foundation/math.inl>
+#include <foundation/os.h>
 #include <foundation/random.h>
 #include <foundation/rect.inl>
 #include <foundation/sort.inl>
@@ -35,12 +42,32 @@ static struct tm_random_api* tm_random_api;
 
 #include <math.h>
 #include <memory.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+#if defined(TM_OS_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define REGION_SIMD 1
+#include <emmintrin.h>
+#else
+#define REGION_SIMD 0
+#endif
 
 // Implements a dinosaur collecting game.
 //
 // Static game data is saved in the arrays [[image_paths]], [[props]], [[dinosaurs]], [[drops]] and
-// [[mementos]], where as all dynamic game data is saved in the [[tm_simulate_state_o]].
+// [[mementos]], where as all dynamic game data is saved in the [[tm_simulate_state_o]]. The static
+// data can be replaced at runtime by a [[data_pack_header_t]] file.
 
 // Helpers
 
@@ -53,6 +80,23 @@ struct range_t {
     double min, max;
 };
 
+// Returns true if `x` is positive and finite. (NaN is not.)
+static bool is_positive(double x)
+{
+    return x > 0 && x < INFINITY;
+}
+
+// Returns true if `r` is a range of finite, non-negative values with `min <= max`. If `positive`
+// is set, `max` must be positive too, as for the intervals between events.
+static bool is_valid_range(struct range_t r, bool positive)
+{
+    return r.min >= 0 && r.min <= r.max && r.max < INFINITY && (!positive || r.max > 0);
+}
+
+// Size of the name strings in the static tables. The names are stored inline rather than as
+// pointers, so that the tables can be used directly from a memory-mapped data pack.
+enum { NAME_SIZE = 32 };
+
 // Images
 
 // Index of all images in the game.
@@ -142,8 +186,11 @@ enum IMAGE {
 // Default image to use when no image has been specified.
 #define MISSING_ART "art/icons/missing.creation"
 
+// Size of the path strings in [[image_paths]].
+enum { IMAGE_PATH_SIZE = 64 };
+
 // Specifies project paths for the various images. Used to load the image data.
-const char* image_paths[NUM_IMAGES] = {
+static const char default_image_paths[NUM_IMAGES][IMAGE_PATH_SIZE] = {
     [PLACEHOLDER] = MISSING_ART,
 
     [BACKGROUND_LAYER_0] = "art/backgrounds/background.creation",
@@ -216,6 +263,79 @@ const char* image_paths[NUM_IMAGES] = {
     [SHELL] = "art/mementos/shell.creation",
 };
 
+// Image paths in use. Points to [[default_image_paths]] or into the current data pack.
+static const char (*image_paths)[IMAGE_PATH_SIZE] = default_image_paths;
+
+// Atlas
+//
+// The packer in `pack/dinosaur_pack.c` can lay out the small art (icons, props, mementos and
+// optionally dinosaurs) on a few atlas pages. The art pipeline composes the page images from the
+// layout, and images on a resident page are drawn from the page with their sub-rect as UVs, so
+// that a frame switches between a few textures instead of one texture per item. See
+// [[draw_image]]. The compiled tables have no atlas and draw every image from its own texture.
+
+// Maximum number of atlas pages.
+enum { MAX_ATLAS_PAGES = 4 };
+
+// Location of an image in the atlas.
+struct atlas_rect_t {
+    // One plus the index of the page in [[atlas_pages]] that holds the image, or zero if the image
+    // isn't in the atlas.
+    uint32_t page;
+
+    // Location of the image on the page, in UV coordinates.
+    tm_rect_t uv;
+};
+
+// Atlas locations of the images when there is no atlas.
+static const struct atlas_rect_t default_atlas_rects[NUM_IMAGES];
+
+// Atlas in use. Points to [[default_atlas_rects]] or into the current data pack.
+static uint32_t num_atlas_pages;
+static const char (*atlas_pages)[IMAGE_PATH_SIZE];
+static const struct atlas_rect_t* atlas_rects = default_atlas_rects;
+
+// Regions
+//
+// The background is divided into regions that control where props can be placed, which
+// dinosaurs they attract and how sprites are drawn. The regions are stored in a low-resolution
+// [[region_map]] over the background-relative coordinates `[0,1]²`, so a query is a single table
+// lookup. The packer bakes the map from a mask image painted over the background art. Without a
+// data pack, the map is baked from [[lake_outline]], a hand-coded approximation of the lake.
+
+// Region classes.
+enum REGION {
+    // Props can be placed and attract land dinosaurs.
+    REGION__LAND,
+
+    // Props attract [[DINO_TYPE__ICTYOSAUR]]s only, and props and dinosaurs are drawn half
+    // submerged.
+    REGION__LAKE,
+
+    // Land at the water's edge. Behaves as land, but is kept apart so that rules can be given to
+    // the shore without repainting the mask. The compiled map has no shore.
+    REGION__SHORE,
+
+    // Props can't be placed here.
+    REGION__OFF_LIMITS,
+
+    NUM_REGIONS,
+};
+
+// Size of the [[region_map]]. The map has the aspect ratio of the background.
+enum {
+    REGION_MAP_WIDTH_BITS = 8,
+    REGION_MAP_WIDTH = 1 << REGION_MAP_WIDTH_BITS,
+    REGION_MAP_HEIGHT = REGION_MAP_WIDTH / 2,
+};
+
+// Region map when there is no data pack. Baked by [[bake_default_region_map]].
+static uint8_t default_region_map[REGION_MAP_HEIGHT][REGION_MAP_WIDTH];
+
+// Region map in use, as [[REGION]] values by row and column. Points to [[default_region_map]] or
+// into the current data pack.
+static const uint8_t (*region_map)[REGION_MAP_WIDTH] = default_region_map;
+
 // Props
 //
 // Props are food you can buy and place in the level to attract dinosaurs. The dinosaurs will
@@ -231,7 +351,7 @@ enum PROP_TYPE {
 // Properties for Props.
 struct prop_t {
     // Name of the prop.
-    const char* name;
+    char name[NAME_SIZE];
 
     // Image index for the prop.
     enum IMAGE image;
@@ -257,7 +377,7 @@ struct prop_t {
 // List of all the Props in the game.
 //
 // This list is generated from https://docs.google.com/spreadsheets/d/11sT_7U7IMrL_BpgIoLGul436z4L0lZe-oSCdbEn09DU/edit?pli=1#gid=0
-struct prop_t props[] = {
+static const struct prop_t default_props[] = {
     { .name = "Leaves", .image = LEAVES, .type = PROP_TYPE__VEG, .price = 5, .margin = 0.17, .scale = 0.9 },
     { .name = "Meat", .image = MEAT, .type = PROP_TYPE__MEAT, .price = 5, .margin = 0.2, .scale = 1 },
     { .name = "Fish", .image = FISH, .type = PROP_TYPE__FISH, .price = 5, .margin = 0.35, .scale = 0.7 },
@@ -273,7 +393,10 @@ struct prop_t props[] = {
 };
 
 // Total number of Props in the game.
-#define NUM_PROPS (TM_ARRAY_COUNT(props))
+#define NUM_PROPS (TM_ARRAY_COUNT(default_props))
+
+// Props in use. Points to [[default_props]] or into the current data pack.
+static const struct prop_t* props = default_props;
 
 // Dinosaurs
 
@@ -289,7 +412,7 @@ enum DINO_TYPE {
 // Properties for Dinosaurs.
 struct dinosaur_t {
     // Name of the dinosaur.
-    const char* name;
+    char name[NAME_SIZE];
 
     // Image for the dinosaur.
     enum IMAGE image;
@@ -310,7 +433,7 @@ struct dinosaur_t {
 // All the Dinosaurs in the game.
 //
 // Generated from: https://docs.google.com/spreadsheets/d/11sT_7U7IMrL_BpgIoLGul436z4L0lZe-oSCdbEn09DU/edit?pli=1#gid=4726286
-struct dinosaur_t dinosaurs[] = {
+static const struct dinosaur_t default_dinosaurs[] = {
     { .name = "Ankylosaurus", .image = ANKYLOSAURUS, .type = DINO_TYPE__HERBIVORE, .minutes_to_spawn = 1, .attracted_by = { LEAVES }, .margin = 0.3, .scale = 0.9 },
     { .name = "Ankylosuarus 2", .image = ANKYLOSAURUS_2, .type = DINO_TYPE__HERBIVORE, .minutes_to_spawn = 3, .attracted_by = { HERB_BUNDLE }, .margin = 0.4, .scale = 0.9 },
     { .name = "Apatosaurus", .image = APATOSAURUS, .type = DINO_TYPE__HERBIVORE, .minutes_to_spawn = 5, .attracted_by = { LEAVES }, .margin = 0.03, .scale = 1.2 },
@@ -338,7 +461,10 @@ struct dinosaur_t dinosaurs[] = {
 };
 
 // Total number of Dinosaurs in the game.
-#define NUM_DINOSAURS (TM_ARRAY_COUNT(dinosaurs))
+#define NUM_DINOSAURS (TM_ARRAY_COUNT(default_dinosaurs))
+
+// Dinosaurs in use. Points to [[default_dinosaurs]] or into the current data pack.
+static const struct dinosaur_t* dinosaurs = default_dinosaurs;
 
 // Drops
 //
@@ -368,7 +494,7 @@ struct drop_t {
 // (The actual drop number is rounded to the nearest integer.)
 //
 // Generated from: https://docs.google.com/spreadsheets/d/11sT_7U7IMrL_BpgIoLGul436z4L0lZe-oSCdbEn09DU/edit?pli=1#gid=1632155867
-struct drop_t drops[] = {
+static const struct drop_t default_drops[] = {
     { .dinosaur_image = ANKYLOSAURUS, .drop_image = ORE, .quantity = { 1, 1 }, .probability = 1 },
     { .dinosaur_image = ANKYLOSAURUS_2, .drop_image = DIAMOND, .quantity = { 1, 1 }, .probability = 1 },
     { .dinosaur_image = APATOSAURUS, .drop_image = ORE, .quantity = { 1, 1 }, .probability = 1 },
@@ -395,6 +521,12 @@ struct drop_t drops[] = {
     { .dinosaur_image = VELOCIRAPTOR, .drop_image = DIAMOND, .quantity = { 1, 1 }, .probability = 1 },
 };
 
+// Total number of drop rules in the game.
+#define NUM_DROPS (TM_ARRAY_COUNT(default_drops))
+
+// Drop rules in use. Points to [[default_drops]] or into the current data pack.
+static const struct drop_t* drops = default_drops;
+
 // Mementos
 //
 // Mementos are items dropped by dinosaurs that can be sold for cash value.
@@ -402,7 +534,7 @@ struct drop_t drops[] = {
 // Properties for Mementos.
 struct memento_t {
     // Name of the memento.
-    const char* name;
+    char name[NAME_SIZE];
 
     // Image index for the memento.
     enum IMAGE image;
@@ -414,7 +546,7 @@ struct memento_t {
 // All the Mementos in the game.
 //
 // Generated from: https://docs.google.com/spreadsheets/d/11sT_7U7IMrL_BpgIoLGul436z4L0lZe-oSCdbEn09DU/edit?pli=1#gid=1102118616
-struct memento_t mementos[] = {
+static const struct memento_t default_mementos[] = {
     { .name = "Ore", .image = ORE, .sell_value = 1 },
     { .name = "Diamond", .image = DIAMOND, .sell_value = 10 },
     { .name = "Agate", .image = AGATE, .sell_value = 5 },
@@ -429,7 +561,10 @@ struct memento_t mementos[] = {
 };
 
 // Total number of Mementos in the game.
-#define NUM_MEMENTOS TM_ARRAY_COUNT(mementos)
+#define NUM_MEMENTOS TM_ARRAY_COUNT(default_mementos)
+
+// Mementos in use. Points to [[default_mementos]] or into the current data pack.
+static const struct memento_t* mementos = default_mementos;
 
 // Rules
 
@@ -449,9 +584,34 @@ struct rules_t {
 
     // Time food stays around if no dinosaur comes to eat it.
     struct range_t food_lifetime_minutes;
+
+    // If true, coins, spawns and expirations are scheduled in an event queue, so that a tick only
+    // processes the events that are due. If false, every prop and dinosaur is polled every tick.
+    // See [[game_logic]].
+    bool event_queue;
+
+    // Rate in Hz of the fixed steps that the game logic is run in. Each frame runs the steps that
+    // are due, so the game logic and its random rolls don't depend on the frame rate. See
+    // [[step_game]].
+    double simulation_hz;
+
+    // Memory budget in MB for dinosaur, prop and memento images. When the resident images exceed
+    // it, the least recently used ones are evicted. See [[image_loader_t]].
+    double image_budget_mb;
+
+    // Maximum number of props in the scene. When a prop is placed in a full scene, the oldest
+    // prop is removed. The scene storage grows up to this size, and at most to
+    // [[SCENE_HANDLE_SLOT_MASK]].
+    uint32_t max_scene_props;
+
+    // Maximum number of dinosaurs in the scene. Props don't attract dinosaurs while the scene is
+    // full.
+    uint32_t max_scene_dinosaurs;
 };
 
-// Current game rules.
+// Current game rules. (Unlike the tables, the design rules in [[rule_fields]] are copied out of the
+// data pack, so that tools can tweak them. The other fields are engine settings and keep the values
+// of the build.)
 //
 // Generated from: https://docs.google.com/spreadsheets/d/11sT_7U7IMrL_BpgIoLGul436z4L0lZe-oSCdbEn09DU/edit?pli=1#gid=702050057
 struct rules_t rules = {
@@ -460,6 +620,520 @@ struct rules_t rules = {
     .minutes_to_coin = { 1, 1 },
     .dinosaur_lifetime_minutes = { 1, 10 },
     .food_lifetime_minutes = { 10, 20 },
+    .event_queue = true,
+    .simulation_hz = 10,
+    .image_budget_mb = 64,
+    .max_scene_props = 32,
+    .max_scene_dinosaurs = 32,
+};
+
+// A design rule, one that is set by `rules.csv` and stored in the data pack.
+struct rule_field_t {
+    // Name of the rule.
+    const char* name;
+
+    // Offset of the rule's [[range_t]] in [[rules_t]].
+    uint32_t offset;
+
+    // True if the rule is an interval between events, which must have a positive `max`.
+    // Otherwise the events would all be due at once.
+    bool interval;
+};
+
+// The design rules. `event_queue`, `simulation_hz`, `image_budget_mb` and the scene limits are
+// engine settings, not design rules, so they aren't included.
+static const struct rule_field_t rule_fields[] = {
+    { "speed_multiplier", offsetof(struct rules_t, speed_multiplier) },
+    { "start_money", offsetof(struct rules_t, start_money) },
+    { "minutes_to_coin", offsetof(struct rules_t, minutes_to_coin), true },
+    { "dinosaur_lifetime_minutes", offsetof(struct rules_t, dinosaur_lifetime_minutes), true },
+    { "food_lifetime_minutes", offsetof(struct rules_t, food_lifetime_minutes), true },
+};
+
+// Indices
+//
+// Lookup tables over the static game data, built by [[build_indices]] when the plugin is loaded.
+// They let the game logic and the menus find the relevant table entries directly instead of
+// scanning the tables, so costs stay flat as the catalog grows.
+
+// Kind of game item that an image represents.
+enum ITEM_KIND {
+    ITEM_KIND__NONE,
+    ITEM_KIND__PROP,
+    ITEM_KIND__DINOSAUR,
+    ITEM_KIND__MEMENTO,
+};
+
+// Table entry for an image.
+struct image_item_t {
+    // Kind of item. Determines which table `index` refers to.
+    uint16_t kind;
+
+    // Index into [[props]], [[dinosaurs]] or [[mementos]].
+    uint16_t index;
+};
+
+// Maximum number of props that can attract a single dinosaur.
+#define MAX_ATTRACTED_BY (TM_ARRAY_COUNT(((struct dinosaur_t*)0)->attracted_by))
+
+// Lookup indices. The attraction and drop tables are stored in compressed sparse row format: the
+// entries for key `k` are `list[first[k]]` up to (but not including) `list[first[k + 1]]`.
+struct indices_t {
+    // Maps each image to the prop, dinosaur or memento that uses it.
+    struct image_item_t items[NUM_IMAGES];
+
+    // Dinosaurs that can spawn at a prop, keyed by `food_image * 2 + in_lake`, where
+    // `in_lake` is 1 for props in [[REGION__LAKE]].
+    uint32_t attraction_first[2 * NUM_IMAGES + 1];
+    uint16_t attraction[NUM_DINOSAURS * MAX_ATTRACTED_BY];
+
+    // Indices of the [[drops]] rules for each dinosaur, keyed by dinosaur index.
+    uint32_t drops_first[NUM_DINOSAURS + 1];
+    uint16_t drops[NUM_DROPS];
+
+    // Largest size of a prop or dinosaur sprite at the front of the scene, relative to the height
+    // of the background. (See [[scene_prop_draw_item]] and [[scene_dinosaur_draw_item]].) Used as
+    // the margin when culling.
+    float max_sprite_size;
+};
+
+static struct indices_t indices;
+
+// Data pack
+//
+// A data pack is a binary file with replacements for the static tables above, built from the
+// spreadsheet's CSV exports by the packer in `pack/dinosaur_pack.c`. If the environment variable
+// [[DATA_PACK_ENV]] names a pack, the plugin maps it into memory and points [[image_paths]],
+// [[props]], [[dinosaurs]], [[drops]], [[mementos]], the atlas and the [[region_map]] straight into the mapping, without any
+// parsing or copying. Only the design rules in [[rule_fields]] are copied into [[rules]]; the engine
+// settings keep the values of the build. The file is polled for changes and a changed pack is
+// swapped in between ticks, so data edits don't need a rebuild of the plugin.
+//
+// The tables are stored in the exact in-memory layout of the structs above, so a pack must be
+// built by a packer compiled from the same source. The header records the layout and packs that
+// don't match the plugin are rejected. Since the [[IMAGE]] enum and the state arrays are sized
+// from the compiled tables, adding or removing entries still requires a rebuild.
+
+// Environment variable with the path of the data pack to use.
+#define DATA_PACK_ENV "DINO_DATA_PACK"
+
+// Magic number at the start of a data pack.
+#define DATA_PACK_MAGIC "DINOPACK"
+
+// Current version of the data pack format.
+enum { DATA_PACK_VERSION = 4 };
+
+// Alignment of the tables in a data pack. Tables start on a cache line.
+enum { DATA_PACK_ALIGN = 64 };
+
+// Tables stored in a data pack.
+enum DATA_PACK_TABLE {
+    DATA_PACK_TABLE__IMAGE_PATHS,
+    DATA_PACK_TABLE__PROPS,
+    DATA_PACK_TABLE__DINOSAURS,
+    DATA_PACK_TABLE__DROPS,
+    DATA_PACK_TABLE__MEMENTOS,
+    DATA_PACK_TABLE__RULES,
+    DATA_PACK_TABLE__ATLAS_PAGES,
+    DATA_PACK_TABLE__ATLAS_RECTS,
+    DATA_PACK_TABLE__REGIONS,
+    DATA_PACK_TABLE__COUNT,
+};
+
+// Location and layout of a table in a data pack.
+struct data_pack_table_t {
+    // Byte offset of the table from the start of the file. A multiple of [[DATA_PACK_ALIGN]].
+    uint32_t offset;
+
+    // Number of entries in the table.
+    uint32_t count;
+
+    // Size of each entry in bytes.
+    uint32_t stride;
+
+    uint32_t padding;
+};
+
+// Header at the start of a data pack file.
+struct data_pack_header_t {
+    // [[DATA_PACK_MAGIC]], without the terminating zero.
+    char magic[8];
+
+    // [[DATA_PACK_VERSION]] of the file.
+    uint32_t version;
+
+    // Total size of the file in bytes.
+    uint32_t size;
+
+    // [[hash_bytes]] of the rest of the file, following the header.
+    uint64_t hash;
+
+    // Tables in the file, indexed by [[DATA_PACK_TABLE]].
+    struct data_pack_table_t tables[DATA_PACK_TABLE__COUNT];
+};
+
+// A data pack file mapped into memory.
+struct mapped_data_pack_t {
+    // Start of the mapping.
+    const struct data_pack_header_t* header;
+
+    // Size of the mapping.
+    uint64_t size;
+
+    // [[file_stamp]] of the file when it was mapped. Used to detect changes.
+    uint64_t stamp;
+};
+
+// Maximum number of data packs that can be mapped during a run of the plugin.
+//
+// When a new pack is swapped in, the old one stays mapped, since states that haven't ticked yet
+// still point into it. Packs are only unmapped when the plugin is unloaded.
+enum { MAX_MAPPED_DATA_PACKS = 256 };
+
+// Seconds between checks for changes to the data pack.
+#define DATA_PACK_POLL_SECONDS 1.0
+
+// Mapped data packs. The last one is the one in use.
+static struct {
+    uint32_t num_packs;
+    struct mapped_data_pack_t packs[MAX_MAPPED_DATA_PACKS];
+
+    // [[file_stamp]] of the last pack that was rejected, so that we only report it once.
+    uint64_t rejected_stamp;
+
+    // Time until the next check for changes.
+    double poll_timer;
+} data_packs;
+
+// Profiling
+//
+// Hot paths are wrapped in [[PROFILE_BEGIN]] and [[PROFILE_END]] scopes. Each thread records the
+// scopes it finishes into its own [[profile_thread_t]] ring buffer, so recording takes no locks: a
+// ring has a single writer that publishes new events by storing its `head`. The latest samples can
+// be shown as an overlay with [[profile_overlay]], and if the environment variable
+// [[PROFILE_TRACE_ENV]] names a file, the recording is written to it as a Chrome trace (viewable in
+// `chrome://tracing` or Perfetto) when the game stops.
+//
+// Build with `DINO_PROFILE=0` to compile the scopes out.
+
+#ifndef DINO_PROFILE
+#define DINO_PROFILE 1
+#endif
+
+// Environment variable with the path of the Chrome trace to write on stop.
+#define PROFILE_TRACE_ENV "DINO_PROFILE_TRACE"
+
+// Profiled scopes.
+enum PROFILE_SCOPE {
+    PROFILE_SCOPE__TICK,
+    PROFILE_SCOPE__GAME_LOGIC,
+    PROFILE_SCOPE__SCENE,
+
+    // Rebuilding the [[scene_cache_t]], including [[PROFILE_SCOPE__DEPTH_SORT]].
+    PROFILE_SCOPE__SCENE_CACHE,
+    PROFILE_SCOPE__DEPTH_SORT,
+    PROFILE_SCOPE__MONEY,
+
+    // One scope for each menu screen, indexed by [[STATE]]. Includes the menu button drawn in
+    // [[STATE__MAIN]] and [[STATE__PLACING]].
+    PROFILE_SCOPE__MENU,
+    PROFILE_SCOPE__MENU_LAST = PROFILE_SCOPE__MENU + 7,
+
+    // Evaluating an image, on the main thread or in an [[image_load_job]].
+    PROFILE_SCOPE__LOAD_IMAGE,
+    PROFILE_SCOPE__COUNT,
+};
+
+#if DINO_PROFILE
+// Names of the [[PROFILE_SCOPE]]s, as shown in the overlay and the trace.
+static const char* profile_scope_names[PROFILE_SCOPE__COUNT] = {
+    [PROFILE_SCOPE__TICK] = "tick",
+    [PROFILE_SCOPE__GAME_LOGIC] = "game_logic",
+    [PROFILE_SCOPE__SCENE] = "scene",
+    [PROFILE_SCOPE__SCENE_CACHE] = "scene_cache",
+    [PROFILE_SCOPE__DEPTH_SORT] = "depth_sort",
+    [PROFILE_SCOPE__MONEY] = "money",
+    [PROFILE_SCOPE__MENU + 0] = "menu/main",
+    [PROFILE_SCOPE__MENU + 1] = "menu/menu",
+    [PROFILE_SCOPE__MENU + 2] = "menu/inventory",
+    [PROFILE_SCOPE__MENU + 3] = "menu/shop",
+    [PROFILE_SCOPE__MENU + 4] = "menu/album",
+    [PROFILE_SCOPE__MENU + 5] = "menu/placing",
+    [PROFILE_SCOPE__MENU + 6] = "menu/award",
+    [PROFILE_SCOPE__MENU + 7] = "menu/mementos",
+    [PROFILE_SCOPE__LOAD_IMAGE] = "load_image",
+};
+#endif
+
+// A finished scope.
+struct profile_event_t {
+    // Start time, in seconds since [[profiler]] `epoch`.
+    double start;
+
+    // Duration in seconds.
+    float duration;
+
+    // [[PROFILE_SCOPE]] of the event.
+    uint32_t scope;
+};
+
+// Number of events in each thread's ring. Must be a power of two. At 60 Hz, the main thread's ring
+// holds the last ~10 seconds.
+enum { PROFILE_RING_SIZE = 4096 };
+
+// Maximum number of nested open scopes on a thread.
+enum { MAX_PROFILE_DEPTH = 8 };
+
+// Number of rings allocated on top of one per logical processor, for the main thread and threads
+// outside the job system. Scopes on further threads are dropped.
+enum { PROFILE_EXTRA_THREADS = 4 };
+
+// Ring buffer of the events recorded by a single thread.
+struct profile_thread_t {
+    // Number of events ever written to `events`. Only written by the owning thread. Readers
+    // load it and then read at most the [[PROFILE_RING_SIZE]] events before it.
+    atomic_uint32_t head;
+
+    // Number of open scopes in `open`.
+    uint32_t depth;
+
+    // Start times and scopes of the open scopes.
+    tm_clock_o open[MAX_PROFILE_DEPTH];
+    uint32_t open_scope[MAX_PROFILE_DEPTH];
+
+    struct profile_event_t events[PROFILE_RING_SIZE];
+};
+
+#if DINO_PROFILE
+// Global profiler, shared by all simulation states.
+static struct {
+    // Time that [[profile_event_t]] `start` is relative to. Set by [[start_profiler]].
+    tm_clock_o epoch;
+
+    // Number of threads that have claimed a ring in `threads`.
+    atomic_uint32_t num_threads;
+
+    // One ring per thread that the job system runs on, plus [[PROFILE_EXTRA_THREADS]]. Mapped by
+    // [[start_profiler]] when the plugin is loaded, so nothing is recorded before that.
+    struct profile_thread_t* threads;
+    uint32_t max_threads;
+} profiler;
+#endif
+
+// Number of recent samples of each scope that the overlay computes percentiles from.
+enum { PROFILE_OVERLAY_SAMPLES = 256 };
+
+// Declares a thread local variable.
+#if defined(TM_OS_WINDOWS)
+#define PROFILE_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILE_THREAD_LOCAL __thread
+#endif
+
+#if DINO_PROFILE
+// Opens the profile scope `scope`. Must be matched by a [[PROFILE_END]] on the same thread.
+#define PROFILE_BEGIN(scope) profile_begin(scope)
+
+// Closes the profile scope `scope` and records it.
+#define PROFILE_END(scope) profile_end()
+#else
+#define PROFILE_BEGIN(scope)
+#define PROFILE_END(scope)
+#endif
+
+// Replay
+//
+// A session can be recorded and played back exactly. Each state draws all its rolls from its own
+// random stream, so a session is fully determined by the stream's seed and the input of each tick.
+// If [[REPLAY_RECORD_ENV]] is set, the seed and the input of every tick are written to a replay
+// file. If [[REPLAY_PLAY_ENV]] is set, the state is seeded from the file and each tick reads its
+// input, time step and rect from the file instead of from the UI. The file ends with a hash of the
+// state, which is checked when the playback reaches it. After that, the game continues with live
+// input.
+//
+// Only the input that the game reads is recorded (see [[frame_input_t]]). A replay must be played
+// back with the rules and tables it was recorded with, i.e. the same data pack.
+
+// Environment variable with the path of the replay file to record.
+#define REPLAY_RECORD_ENV "DINO_RECORD"
+
+// Environment variable with the path of the replay file to play back.
+#define REPLAY_PLAY_ENV "DINO_REPLAY"
+
+// Magic number at the start of a replay file.
+#define REPLAY_MAGIC "DINOREPL"
+
+// Current version of the replay file format.
+enum { REPLAY_VERSION = 1 };
+
+// Header at the start of a replay file.
+struct replay_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t padding;
+
+    // Seed of the state's random stream.
+    uint64_t seed;
+
+    // [[game_data_hash]] of the rules and tables that the replay was recorded with.
+    uint64_t data_hash;
+};
+
+// The header is followed by a flags byte for each frame. Values that haven't changed since the
+// previous frame are left out. The flags are followed by the values they announce, in the order
+// of the flags.
+enum REPLAY_FRAME {
+    // The left mouse button was pressed.
+    REPLAY_FRAME__PRESSED = 0x01,
+
+    // The game's rect could be hovered.
+    REPLAY_FRAME__HOVER = 0x02,
+
+    // Followed by the mouse position, as a `tm_vec2_t`.
+    REPLAY_FRAME__MOUSE = 0x04,
+
+    // Followed by `dt` and `dt_unscaled`, as floats.
+    REPLAY_FRAME__TIME = 0x08,
+
+    // Followed by the rect, as a `tm_rect_t`.
+    REPLAY_FRAME__RECT = 0x10,
+
+    // Not a frame. Marks the end of the replay and is followed by a [[replay_footer_t]].
+    REPLAY_FRAME__END = 0x80,
+};
+
+// Footer at the end of a replay file.
+struct replay_footer_t {
+    // Number of frames in the replay.
+    uint32_t num_frames;
+    uint32_t padding;
+
+    // [[hash_state]] of the state after the last frame.
+    uint64_t state_hash;
+};
+
+// A replay that is being recorded or played back.
+struct replay_t {
+    // True if the replay is being played back, false if it is being recorded.
+    bool playing;
+
+    // When recording, the file that the frames are written to.
+    FILE* file;
+
+    // When playing back, the contents of the replay file and the read position in it.
+    uint8_t* data;
+    uint64_t size;
+    uint64_t pos;
+
+    // Number of frames recorded or played back so far.
+    uint32_t num_frames;
+
+    // Values of the previous frame.
+    tm_vec2_t mouse_pos;
+    float dt, dt_unscaled;
+    tm_rect_t rect;
+};
+
+// Save games
+//
+// If [[SAVE_ENV]] names a file, the game is loaded from it on start and saved to it every
+// [[SAVE_INTERVAL_SECONDS]] and on stop, so that progress survives closing the Simulate tab.
+//
+// The state and the arrays of the scene are saved in their in-memory layout, each in its own
+// section of the file. Saving copies them into a snapshot buffer and hands the buffer to a job that
+// writes it, so autosaves don't block the frame on file I/O. The state refers to the tables by
+// index, so only the pointers to runtime data (the allocator, the image loader, the caches) need
+// to be cleared. Loading maps the file and copies each section into place with a single `memcpy()`.
+//
+// Since the state is stored as is, a save is only loaded by a build with the same [[SAVE_VERSION]],
+// [[state_schema_hash]] and table sizes. (The schema hash also covers the layouts of the scene
+// arrays, so a build that changes any saved struct rejects the save rather than misreading it.) Saves aren't loaded or written while a replay is
+// being recorded or played back, since a replay starts from a new game.
+
+// Environment variable with the path of the save file.
+#define SAVE_ENV "DINO_SAVE"
+
+// Magic number at the start of a save file.
+#define SAVE_MAGIC "DINOSAVE"
+
+// Current version of the save file format.
+enum { SAVE_VERSION = 3 };
+
+// Seconds between autosaves.
+#define SAVE_INTERVAL_SECONDS 30.0
+
+// Sections of a save file.
+enum SAVE_SECTION {
+    // The `tm_simulate_state_o`.
+    SAVE_SECTION__STATE,
+
+    // The scene arrays, with the number of items given by the saved state.
+    SAVE_SECTION__SCENE_PROPS,
+    SAVE_SECTION__PROP_SLOTS,
+    SAVE_SECTION__PROP_AGES,
+    SAVE_SECTION__SCENE_DINOSAURS,
+    SAVE_SECTION__DINOSAUR_SLOTS,
+    SAVE_SECTION__EVENTS,
+
+    SAVE_SECTION__COUNT,
+};
+
+// Location of a section in a save file.
+struct save_section_t {
+    // Byte offset of the section from the start of the file. A multiple of [[DATA_PACK_ALIGN]].
+    uint64_t offset;
+
+    // Size of the section in bytes.
+    uint64_t size;
+};
+
+// Header at the start of a save file.
+struct save_header_t {
+    char magic[8];
+    uint32_t version;
+
+    // `sizeof(tm_simulate_state_o)` of the build that wrote the save.
+    uint32_t state_size;
+
+    // [[state_schema_hash]] of the build that wrote the save.
+    uint64_t schema_hash;
+
+    // Sizes of the tables that the saved indices refer to.
+    uint32_t num_props;
+    uint32_t num_dinosaurs;
+    uint32_t num_mementos;
+    uint32_t num_images;
+
+    // [[game_data_hash]] when the game was saved.
+    uint64_t data_hash;
+
+    // [[hash_bytes]] of the rest of the file, following the header.
+    uint64_t hash;
+
+    // Sections in the file, indexed by [[SAVE_SECTION]].
+    struct save_section_t sections[SAVE_SECTION__COUNT];
+};
+
+// Size of the path strings in [[save_t]].
+enum { SAVE_PATH_SIZE = 512 };
+
+// A snapshot of a game, taken by [[snapshot_game]] and written by [[save_job]].
+struct save_t {
+    // Path of the save file. The job writes to a temporary file next to it and then replaces it,
+    // so that an interrupted save doesn't destroy the last one.
+    char path[SAVE_PATH_SIZE];
+
+    // Contents of the save file.
+    uint8_t* data;
+    uint64_t size;
+
+    // Set by the job when the file has been written. `ok` is only valid once `done` is set.
+    bool ok;
+    atomic_uint32_t done;
+
+    // Job and counter of the write.
+    tm_jobdecl_t job;
+    struct tm_jobs_counter_o* counter;
 };
 
 // Runtime state
@@ -491,10 +1165,70 @@ enum STATE {
     STATE__MEMENTOS,
 };
 
-// Data for a prop placed in the scene.
+// Scene storage
+//
+// The props and dinosaurs in the scene are stored in dense arrays that grow on demand, up to
+// `rules.max_scene_props` and `rules.max_scene_dinosaurs`. Entities are removed by swapping the
+// last entity into their place, so indices into the arrays change. The event queue and the
+// [[depth_list_t]] refer to entities by stable handles instead, that are resolved through a
+// [[scene_slots_t]].
+//
+// The arrays of the scene are carrays allocated from the state's allocator, but only their
+// capacity is tracked by the carray. The number of items is kept in the state.
+
+// Number of bits of a scene handle used for the slot. The high bits hold the slot's generation,
+// so that handles to removed entities can be detected.
+enum { SCENE_HANDLE_SLOT_BITS = 24 };
+
+// Mask of the slot in a scene handle. This also limits the number of props and dinosaurs.
+#define SCENE_HANDLE_SLOT_MASK ((1u << SCENE_HANDLE_SLOT_BITS) - 1)
+
+// A slot in a [[scene_slots_t]].
+struct scene_slot_t {
+    // If the slot is in use, the index of its entity in the scene array. Otherwise the 1-based
+    // index of the next free slot, or zero.
+    uint32_t index;
+
+    // Incremented when the slot is freed. Never zero in a handle, so the handle `0` is never
+    // valid.
+    uint32_t generation;
+};
+
+// Maps scene handles to indices in the scene array.
+struct scene_slots_t {
+    // 1-based index of the first free slot in `slots`, or zero.
+    uint32_t first_free;
+
+    // Number of slots in `slots`, free or not.
+    uint32_t num_slots;
+
+    /* carray */ struct scene_slot_t* slots;
+};
+
+// Ring buffer of scene handles, in the order they were pushed.
+struct handle_ring_t {
+    // Number of handles ever pushed and popped. The handles in the ring are `[tail, head)`.
+    uint32_t head;
+    uint32_t tail;
+
+    // Number of handles that fit in `handles`. Zero or a power of two.
+    uint32_t capacity;
+    /* carray */ uint32_t* handles;
+};
+
+// Data for a prop placed in the scene. The fields are ordered to keep the struct small, since the
+// scene can hold many props.
 struct scene_prop_t {
-    // Prop.
-    const struct prop_t* prop;
+    // Index of the prop in [[props]].
+    uint16_t prop;
+
+    // In event queue mode -- index of the dinosaur that the prop attracts at the event time, or
+    // `NUM_DINOSAURS` if the prop spoils at the event time.
+    uint16_t attracts;
+
+    // [[REGION]] at the prop's position. Set when the prop is added and when the region map
+    // changes.
+    uint8_t region;
 
     // X and Y position of the prop (in relative coordinates, relative to the background image).
     // I.e. `(0,0)` represents the top left corner of the background image and `(1,1)` the bottom
@@ -502,109 +1236,101 @@ struct scene_prop_t {
     float x, y;
 
     // Time that this prop has left to live until it disappears.
-    double lifetime;
-};
+    float lifetime;
+
+    // In event queue mode -- simulated time when the prop spoils.
+    double expires;
 
-// Maximum number of props that can be placed in the scene.
-enum { MAX_SCENE_PROPS = 32 };
+    // In event queue mode -- index of the prop's event in `tm_simulate_state_o->events`.
+    uint32_t event;
+
+    // Handle of the prop while it is in the scene.
+    uint32_t handle;
+};
 
 // Data for a dinosaur placed in the scene.
 struct scene_dinosaur_t {
-    // Dinosaur.
-    const struct dinosaur_t* dinosaur;
+    // Index of the dinosaur in [[dinosaurs]].
+    uint16_t dinosaur;
+
+    // If true, the graphics of this dinosaur is horizontally flipped.
+    bool flipped;
+
+    // [[REGION]] at the dinosaur's position. Set when the dinosaur is added and when the region
+    // map changes.
+    uint8_t region;
 
     // X and Y position of the dinosaur (in relative coordinates, relative to the background image).
     // I.e. `(0,0)` represents the top left corner of the background image and `(1,1)` the bottom
     // right corner.
     float x, y;
 
-    // If true, the graphics of this dinosaur is horizontally flipped.
-    bool flipped;
-
     // Time that this dinosaur has left to live until it disappears.
-    double lifetime;
-};
-
-// Maximum number of dinosaurs in the scene.
-enum { MAX_SCENE_DINOSAURS = 32 };
-
-// A drop that has been awarded to the player.
-struct awarded_drop_t {
-    // Dinosaur that awarded the drop.
-    const struct dinosaur_t* dinosaur;
+    float lifetime;
 
-    // Number of items (identified by image) in the drop.
-    uint32_t quantity[NUM_IMAGES];
+    // In event queue mode -- index of the dinosaur's event in `tm_simulate_state_o->events`.
+    uint32_t event;
 
-    // Total number of dropped items.
-    uint32_t total_items;
+    // Handle of the dinosaur while it is in the scene.
+    uint32_t handle;
 };
 
-// Maximum number of unclaimed awarded drops that a player can have.
-enum { MAX_AWARDED_DROPS = 16 };
-
-// We reserve this many bytes for the game state.
-//
-// !!! NOTE
-//     By reserving `> sizeof(tm_simulate_state_o)` bytes and initializing it to zero, we can
-//     add new items to the end of the game state while hot-reloading without crashing. The added
-//     items will be zero initialized.
-enum { RESERVE_STATE_BYTES = 32 * 1024 };
-
-// Game state.
-struct tm_simulate_state_o {
-    tm_allocator_i* allocator;
-
-    // Money that the player has.
-    uint32_t money;
+// Maximum number of different items in an awarded drop. Data packs with dinosaurs that have more
+// drop rules than this are rejected.
+enum { MAX_AWARD_ITEMS = 4 };
 
-    // Time until next coin is received.
-    double next_coin;
+// An item in an [[awarded_drop_t]].
+struct award_item_t {
+    // Image of the item, a Prop or a Memento.
+    uint16_t image;
 
-    // Loaded image data.
-    uint32_t images[NUM_IMAGES];
+    // Number of items.
+    uint16_t quantity;
+};
 
-    // Current game state.
-    enum STATE state;
+// A drop that has been awarded to the player.
+struct awarded_drop_t {
+    // Index of the dinosaur that awarded the drop in [[dinosaurs]].
+    uint16_t dinosaur;
 
-    // Current page when the STATE is a menu screen.
-    uint32_t page;
+    // Number of entries in `items`.
+    uint16_t num_items;
 
-    // Number of items of each prop type that the player has in her inventory.
-    uint32_t inventory[NUM_PROPS];
+    // The items of the drop, sorted by image. Items are removed as they are claimed.
+    struct award_item_t items[MAX_AWARD_ITEMS];
+};
 
-    // Number of items of each memento type that the player has in her inventory.
-    uint32_t mementos[NUM_MEMENTOS];
+// Maximum number of unclaimed awarded drops that a player can have. Must be a power of two.
+enum { MAX_AWARDED_DROPS = 16 };
 
-    // Current scroll amount for main screen. On small displays, the main screen scrolls
-    // horizontally to fit the full background image.
-    float scroll;
+// Types of scheduled events.
+enum EVENT {
+    // The player receives a coin.
+    EVENT__COIN,
 
-    // In [[STATE__PLACING]] -- the index of the prop that is currently being placed.
-    uint32_t place_prop;
+    // A prop either spoils or attracts a dinosaur, depending on [[scene_prop_t]]'s `attracts`.
+    EVENT__PROP,
 
-    // Props currently paced in the scene.
-    uint32_t num_scene_props;
-    struct scene_prop_t scene_props[MAX_SCENE_PROPS + 1];
+    // A dinosaur walks away.
+    EVENT__DINOSAUR,
+};
 
-    // Dinosaurs currently in the scene.
-    uint32_t num_scene_dinosaurs;
-    struct scene_dinosaur_t scene_dinosaurs[MAX_SCENE_DINOSAURS];
+// An event scheduled in the event queue.
+struct event_t {
+    // Simulated time when the event happens.
+    double time;
 
-    // Dinosaurs that the player has seen.
-    bool in_album[NUM_DINOSAURS];
+    // Type of the event.
+    enum EVENT type;
 
-    // Drops that the player hasn't claimed yet.
-    uint32_t num_awarded_drops;
-    struct awarded_drop_t awarded_drops[MAX_AWARDED_DROPS];
+    // For [[EVENT__PROP]] and [[EVENT__DINOSAUR]], the handle of the prop or dinosaur.
+    uint32_t handle;
 };
 
-// Runtime structs
-
 // Represents an item to draw in the scene.
 //
-// To draw the scene, we generate a number of [[draw_item_t]], sort them by their
-// y-coordinates and draw them in that order.
+// To draw the scene, we generate a [[draw_item_t]] for each background layer, prop and dinosaur
+// in the order given by the [[depth_list_t]] and keep them in the [[scene_cache_t]].
 struct draw_item_t {
     // Y-coordinate for sorting.
     float y;
@@ -619,208 +1345,2982 @@ struct draw_item_t {
     tm_rect_t uv_rect;
 };
 
-// Code
+// Set in [[depth_key_t]] `item` for dinosaurs. The rest of `item` is the slot of the item's handle.
+#define DEPTH_ITEM__DINOSAUR 0x80000000u
 
-// Loads the image at the specified `asset_path` and returns an image handle to it. If the image
-// fails to load, the image handle `0` is returned. (This handle is used for the placeholder image.)
-static uint32_t load_image(tm_simulate_start_args_t* args, const char* asset_path)
-{
-    if (!asset_path)
-        asset_path = MISSING_ART;
+// A prop or dinosaur in the [[depth_list_t]].
+struct depth_key_t {
+    // Y-coordinate that the item is sorted by.
+    float y;
 
-    const tm_tt_id_t asset = tm_the_truth_assets_api->asset_from_path(args->tt, args->asset_root, asset_path);
-    if (!TM_ASSERT(asset.u64, tm_error_api->def, "Image not found `%s`", asset_path))
-        return 0;
+    // Slot of the item in `prop_slots`, or in `dinosaur_slots` or'ed with
+    // [[DEPTH_ITEM__DINOSAUR]]. Slots don't change while the item is in the scene.
+    uint32_t item;
+};
 
-    const tm_tt_id_t object = tm_the_truth_api->get_subobject(args->tt, tm_tt_read(args->tt, asset), TM_TT_PROP__ASSET__OBJECT);
-    tm_creation_graph_context_t ctx = (tm_creation_graph_context_t){ .rb = args->render_backend, .device_affinity_mask = TM_RENDERER_DEVICE_AFFINITY_MASK_ALL, .tt = args->tt };
-    tm_creation_graph_instance_t inst = tm_creation_graph_api->create_instance(args->tt, object, &ctx);
-    tm_creation_graph_output_t output = tm_creation_graph_api->output(&inst, TM_CREATION_GRAPH__IMAGE__OUTPUT_NODE_HASH, &ctx, 0);
-    const tm_creation_graph_image_data_t* cg_image = (tm_creation_graph_image_data_t*)output.output;
-    const uint32_t image = tm_ui_renderer_api->allocate_image_slot(args->ui_renderer);
-    tm_ui_renderer_api->set_image(args->ui_renderer, image, cg_image->handle);
-    return image;
-}
+// The props and dinosaurs in the scene, sorted back to front by y. Since the items don't move, the
+// order only changes when items are added or removed, and the list is updated in place by
+// [[depth_insert]] and [[depth_remove]] instead of being sorted every frame. The background layers
+// aren't in the list -- they are merged in at their fixed y-coordinates when the scene is drawn.
+struct depth_list_t {
+    // If `false`, the list is rebuilt by [[depth_sort]] before it is used. This is the case for a
+    // new state and for a state that was created by an older version of the plugin.
+    bool ready;
+
+    uint32_t num_keys;
+    /* carray */ struct depth_key_t* keys;
+};
 
-// Returns `true` if the background-realtive coordinates `(x,y)` are "in the lake". Only
-// [[DINO_TYPE__ICTYOSAUR]] can spawn in the lake.
-static const bool in_lake(float x, float y)
-{
-    if (x > 0.39f)
-        return false;
+// Number of background layers in the scene. See [[background_layers]].
+enum { NUM_BACKGROUND_LAYERS = 5 };
 
-    if (y < 0.68f) {
-        if (x < 0.09f)
-            return y > tm_lerp(0.48f, 0.45f, (x - 0.00f) / 0.09f);
-        else if (x < 0.13f)
-            return y > tm_lerp(0.45f, 0.52f, (x - 0.09f) / 0.04f);
-        else if (x < 0.33f)
-            return y > tm_lerp(0.52f, 0.55f, (x - 0.13f) / 0.20f);
-        else
-            return y > tm_lerp(0.55f, 0.68f, (x - 0.33f) / 0.06f);
-    } else {
-        if (x < 0.22f)
-            return y < 0.88f;
-        else
+// Size of the culling grid of the [[scene_cache_t]]. The grid divides the background-relative
+// coordinates `[0,1]²` into uniform cells.
+enum {
+    SCENE_GRID_COLUMNS = 32,
+    SCENE_GRID_ROWS = 8,
+    SCENE_GRID_CELLS = SCENE_GRID_COLUMNS * SCENE_GRID_ROWS,
+};
+
+// The scene's draw items, in draw order, with rects relative to the top-left corner of the
+// background. The cache is rebuilt when the props and dinosaurs change (see `scene_version`) or
+// when the background changes size. Scrolling and centering only move the background, so they are
+// applied as an offset when the items are drawn. The prop being placed follows the mouse, so it
+// isn't cached but merged in when drawing.
+//
+// When the background is wider than the view, only the items near the view are drawn. The props
+// and dinosaurs are binned in a grid by their position, and [[cull_scene_cache]] picks the items
+// in the cells that overlap the view.
+struct scene_cache_t {
+    // If `false`, the cache must be rebuilt.
+    bool valid;
+
+    // `scene_version` and background size that the cache was built for.
+    uint32_t version;
+    float width;
+    float height;
+
+    uint32_t num_items;
+    /* carray */ struct draw_item_t* items;
+
+    // Indices in `items` of the items in each grid cell, in draw order. The items of cell `c` are
+    // `cell_items[cell_first[c]]` up to (but not including) `cell_items[cell_first[c + 1]]`. The
+    // background layers are kept in an extra cell, `SCENE_GRID_CELLS`, that is never culled.
+    uint32_t cell_first[SCENE_GRID_CELLS + 2];
+    /* carray */ uint32_t* cell_items;
+
+    // Scratch space for the grid cell of each item, used while building the grid.
+    /* carray */ uint32_t* item_cells;
+
+    // Bit set of the items to draw in this frame, set by [[cull_scene_cache]].
+    /* carray */ uint64_t* visible;
+
+    // Number of items drawn and culled in the last frame.
+    uint32_t num_drawn;
+    uint32_t num_culled;
+};
+
+// Size of the strings written by [[format_uint]]: the ten digits of the largest `uint32_t` and the
+// terminator.
+enum { UINT_STRING_SIZE = 11 };
+
+// Number of items on a page of the menu screens, a 3 x 3 grid.
+enum { MENU_PAGE_ITEMS = 9 };
+
+// A cell of the grid on a menu page, with the rects and texts that [[menu]] draws in it.
+struct menu_cell_t {
+    // Index of the cell's item in the screen's table -- [[props]] in the inventory and the shop,
+    // [[dinosaurs]] in the album, [[mementos]] in the mementos screen and the items of the
+    // unclaimed drop in the award screen. In the menu screen, the [[STATE]] that the button opens.
+    uint32_t item;
+
+    // Image of the cell's button.
+    uint32_t image;
+
+    // False if the item can't be bought.
+    bool enabled;
+
+    // Button, name, number and [[BONE]] rects. Screens without numbers leave the number and bone
+    // rects empty.
+    tm_rect_t icon_r;
+    tm_rect_t desc_r;
+    tm_rect_t number_r;
+    tm_rect_t bone_r;
+
+    // Price or sell value, drawn to the left of `number_r`, and the number of items, drawn centered
+    // or to the right.
+    char value_str[UINT_STRING_SIZE];
+    char count_str[UINT_STRING_SIZE];
+};
+
+// Cached layout of the menu screens. [[menu]] rebuilds it with [[build_menu_layout]] when the
+// screen, the page, the viewport or anything the screens show changes, so that other frames don't
+// divide the grid or format numbers.
+struct menu_layout_t {
+    // If `false`, the layout must be rebuilt.
+    bool valid;
+
+    // Screen, page, viewport and font scale that the layout was built for.
+    enum STATE screen;
+    uint32_t page;
+    tm_rect_t rect;
+    float font_scale;
+
+    // `money`, `items_version` and first unclaimed drop of the state that the layout was built
+    // for.
+    uint32_t money;
+    uint32_t items_version;
+    struct awarded_drop_t award;
+
+    // Rects of the menu button, the menu background, the close button and the page arrows.
+    tm_rect_t menu_icon_r;
+    tm_rect_t menu_r;
+    tm_rect_t close_r;
+    tm_rect_t left_button_r;
+    tm_rect_t right_button_r;
+
+    // Rect of the grid that the cells are laid out in and the gap between the cells. Used by
+    // [[menu_hover_cell]].
+    tm_rect_t grid_r;
+    float grid_gap;
+
+    // Number of pages in the screen and the cells of the current page.
+    uint32_t num_pages;
+    uint32_t num_cells;
+    struct menu_cell_t cells[MENU_PAGE_ITEMS];
+
+    // Font scale of the texts in the cells.
+    float cell_font_scale;
+
+    // Images of the items on the pages next to the current one, which are prefetched every frame.
+    // See [[prefetch_grid_image]].
+    uint32_t num_prefetch;
+    uint16_t prefetch[2 * MENU_PAGE_ITEMS];
+
+    // Title of the award screen.
+    tm_rect_t title_r;
+    char title[NAME_SIZE + 32];
+};
+
+// Cached layout and text of the money counter. Rebuilt by [[money]] when the money or the viewport
+// changes.
+struct money_layout_t {
+    // If `false`, the layout must be rebuilt.
+    bool valid;
+
+    // Money and viewport that the layout was built for.
+    uint32_t money;
+    tm_rect_t rect;
+
+    tm_rect_t symbol_r;
+    tm_rect_t amount_r;
+    tm_rect_t background_r;
+    float font_scale;
+    char money_str[UINT_STRING_SIZE];
+};
+
+// State of a xorshift128+ random number generator. See [[seed_random]] and [[random_next]].
+struct random_stream_t {
+    uint64_t s[2];
+};
+
+// Input that the game reads in a tick. Comes from the UI, or from the replay when a replay is
+// being played back. See [[read_input]].
+struct frame_input_t {
+    // Mouse position, in the coordinates of `tm_simulate_frame_args_t->rect`.
+    tm_vec2_t mouse_pos;
+
+    // True if the left mouse button was pressed in this frame.
+    bool left_mouse_pressed;
+
+    // True if the UI lets the game's rect be hovered in this frame. Buttons are hovered if this is
+    // set and the mouse is inside them.
+    bool hover;
+};
+
+// Game state. The fields that the game logic touches every tick come first, so that they share a
+// few cache lines. Tables and other data that is only used by the menus, the drawing or on start
+// follow.
+//
+// Fields can be added anywhere, since a hot reload moves the state by its [[state_schema]] rather
+// than relying on new fields being appended. Builds from before the schema and the magic in
+// [[state_handle_t]] inserted fields in the middle of the state while still handing the engine the
+// raw state, so a game they started can't be reloaded into and must be restarted.
+struct tm_simulate_state_o {
+    // Money that the player has.
+    uint32_t money;
+
+    // Current game state.
+    enum STATE state;
+
+    // Time until next coin is received.
+    double next_coin;
+
+    // Simulated time in seconds. Only advanced in event queue mode.
+    double time;
+
+    // Real time in seconds that has passed since the last simulation step. See [[step_game]].
+    double step_time;
+
+    // Random stream that all the rolls of the game logic are drawn from. Seeded on start, so that a
+    // recorded session can be replayed exactly from its seed and its input.
+    struct random_stream_t random;
+
+    // Props currently placed in the scene, in no particular order, and their handles.
+    uint32_t num_scene_props;
+    /* carray */ struct scene_prop_t* scene_props;
+    struct scene_slots_t prop_slots;
+
+    // Dinosaurs currently in the scene, in no particular order, and their handles.
+    uint32_t num_scene_dinosaurs;
+    /* carray */ struct scene_dinosaur_t* scene_dinosaurs;
+    struct scene_slots_t dinosaur_slots;
+
+    // True if the event queue has been built from the current scene. The queue is built lazily by
+    // the first tick in event queue mode.
+    bool events_ready;
+
+    // Event queue. A binary min-heap on `time`.
+    uint32_t num_events;
+    /* carray */ struct event_t* events;
+
+    // Index of the [[EVENT__COIN]] event in `events`.
+    uint32_t coin_event;
+
+    // Dinosaurs that the player has seen, a bit per dinosaur. See [[in_album()]].
+    uint64_t in_album[(NUM_DINOSAURS + 63) / 64];
+
+    // Drops that the player hasn't claimed yet, a ring buffer of `num_awarded_drops` drops starting
+    // at `first_awarded_drop`. See [[unclaimed_drop()]].
+    uint32_t first_awarded_drop;
+    uint32_t num_awarded_drops;
+
+    // Number of drops that were discarded because the player already had [[MAX_AWARDED_DROPS]]
+    // unclaimed drops.
+    uint32_t num_discarded_drops;
+
+    tm_allocator_i* allocator;
+
+    // Current page when the STATE is a menu screen.
+    uint32_t page;
+
+    // Number of items of each prop type that the player has in her inventory.
+    uint32_t inventory[NUM_PROPS];
+
+    // Number of items of each memento type that the player has in her inventory.
+    uint32_t mementos[NUM_MEMENTOS];
+
+    // Indices of the props and mementos that the player has and of the dinosaurs in the album, in
+    // table order, so that the menu pages can be sliced from them. Kept up to date by
+    // [[set_inventory]], [[set_mementos]] and [[add_to_album]].
+    uint32_t num_owned_props;
+    uint16_t owned_props[NUM_PROPS];
+    uint32_t num_owned_mementos;
+    uint16_t owned_mementos[NUM_MEMENTOS];
+    uint32_t num_album_dinosaurs;
+    uint16_t album_dinosaurs[NUM_DINOSAURS];
+
+    // Incremented when the inventory, the mementos or the album change.
+    uint32_t items_version;
+
+    // Current scroll amount for main screen. On small displays, the main screen scrolls
+    // horizontally to fit the full background image.
+    float scroll;
+
+    // In [[STATE__PLACING]] -- the index of the prop that is currently being placed.
+    uint32_t place_prop;
+
+    // Handles of the props in the order they were placed, so that the oldest prop can be found
+    // when the scene is full. Handles of props that have been removed are skipped.
+    struct handle_ring_t prop_ages;
+
+    // The unclaimed drops. See `first_awarded_drop`.
+    struct awarded_drop_t awarded_drops[MAX_AWARDED_DROPS];
+
+    // The [[props]] and [[dinosaurs]] tables that the regions and the event queue of the scene were
+    // computed with. When a new data pack is swapped in, [[rebase_state]] updates them for the new
+    // tables.
+    const struct prop_t* data_props;
+    const struct dinosaur_t* data_dinosaurs;
+
+    // Loads the images in the background. Until an image has loaded, the [[PLACEHOLDER]] is drawn
+    // in its place.
+    struct image_loader_t* image_loader;
+
+    // Draw order of the scene props and dinosaurs.
+    struct depth_list_t depth;
+
+    // Incremented when props or dinosaurs are added to or removed from the scene, or when their
+    // tables change.
+    uint32_t scene_version;
+
+    // Cached draw items of the scene.
+    struct scene_cache_t scene_cache;
+
+    // Cached layouts of the menu screens and the money counter.
+    struct menu_layout_t menu_layout;
+    struct money_layout_t money_layout;
+
+    // Input for the current tick.
+    struct frame_input_t input;
+
+    // Replay that the input is recorded to or played back from, or `NULL`. See [[REPLAY_RECORD_ENV]]
+    // and [[REPLAY_PLAY_ENV]].
+    struct replay_t* replay;
+
+    // Save that is being written, or `NULL`.
+    struct save_t* save;
+
+    // Time until the next autosave.
+    double save_timer;
+};
+
+// Runtime structs
+
+// Residency status of an image.
+enum IMAGE_STATUS {
+    // The image isn't loaded. Drawing it draws the [[PLACEHOLDER]].
+    IMAGE_STATUS__UNLOADED,
+
+    // An [[image_load_job]] is loading the image.
+    IMAGE_STATUS__LOADING,
+
+    // The image is loaded and set in its UI renderer slot.
+    IMAGE_STATUS__RESIDENT,
+
+    // The image wasn't found. The [[PLACEHOLDER]] is drawn in its place and it isn't loaded again.
+    // Failed images don't count as resident.
+    IMAGE_STATUS__FAILED,
+};
+
+// Index of no image in the lists of an [[image_loader_t]].
+#define NO_IMAGE UINT32_MAX
+
+// An image managed by the [[image_loader_t]].
+struct image_load_t {
+    // Loader that the image belongs to.
+    struct image_loader_t* loader;
+
+    // Asset path of the image. Copied, since the data pack may be swapped while a job runs.
+    char path[IMAGE_PATH_SIZE];
+
+    // Results of the job. Only valid once `done` is set.
+    tm_creation_graph_instance_t instance;
+    tm_renderer_handle_t handle;
+    bool found;
+
+    // Estimated GPU memory used by the image. See [[image_bytes]].
+    uint64_t bytes;
+
+    // Seconds the job spent loading the image.
+    double seconds;
+
+    // Set by the job when the results have been written.
+    atomic_uint32_t done;
+
+    // The fields below are only used by the main thread.
+
+    enum IMAGE_STATUS status;
+
+    // If true, the image is never evicted. Used for the backgrounds and the UI icons.
+    bool pinned;
+
+    // Job and counter of the current load.
+    tm_jobdecl_t job;
+    struct tm_jobs_counter_o* counter;
+
+    // UI renderer slot of the image. Allocated the first time the image is loaded and reused
+    // when the image is reloaded after an eviction. Zero if no slot has been allocated yet.
+    uint32_t slot;
+
+    // [[image_loader_t]] `frame` when the image was last drawn or prefetched.
+    uint64_t last_used;
+
+    // Previous and next image in the loader's LRU list, or [[NO_IMAGE]]. See [[lru_member]].
+    uint32_t lru_prev;
+    uint32_t lru_next;
+};
+
+// Manages the residency of the images of a [[tm_simulate_state_o]]. The backgrounds, UI icons and
+// atlas pages are loaded at start and stay resident. Dinosaur, prop and memento art is loaded the
+// first time it is drawn or prefetched (see [[draw_image]] and [[prefetch_image]]) and the least
+// recently used images are evicted when the resident images exceed `rules.image_budget_mb`. Loads
+// run as jobs, so they never stall a frame, and the [[PLACEHOLDER]] is drawn until an image is
+// ready.
+struct image_loader_t {
+    // Arguments needed by the jobs, copied from `tm_simulate_start_args_t`.
+    struct tm_the_truth_o* tt;
+    tm_tt_id_t asset_root;
+    struct tm_renderer_backend_i* render_backend;
+    struct tm_ui_renderer_o* ui_renderer;
+
+    // `tm_os_api->time->now()` when the state was started.
+    tm_clock_o start_time;
+
+    // Seconds from the start of [[simulate__start]] until it returned.
+    double first_frame_seconds;
+
+    // Number of pinned images that haven't loaded yet. The startup load time is logged when this
+    // reaches zero.
+    uint32_t num_pinned_pending;
+
+    // IDs of the images with [[IMAGE_STATUS__LOADING]], in no particular order, and their number.
+    // A carray.
+    uint32_t* loading;
+    uint32_t num_loading;
+
+    // Number of resident images and their total estimated size, and the most bytes that were
+    // resident at once.
+    uint32_t num_resident;
+    uint64_t resident_bytes;
+    uint64_t peak_resident_bytes;
+
+    // Number of images that weren't found and number of evictions.
+    uint32_t num_failed;
+    uint32_t num_evictions;
+
+    // Doubly linked list of the images that can be evicted, through [[image_load_t]] `lru_prev`
+    // and `lru_next`, from the least to the most recently used. An image moves to the end when it
+    // is used, so evicting the least recently used image is O(1).
+    uint32_t lru_first;
+    uint32_t lru_last;
+
+    // Incremented every tick. Used for the LRU order.
+    uint64_t frame;
+
+    // Copy of the atlas when the loader was started, indexed by [[IMAGE]]. Changes to the atlas in a
+    // new data pack are picked up by the next start, since the loaded pages must match the rects.
+    // Only the table images can be on a page, so the atlas pages themselves have no rects.
+    uint32_t num_atlas_pages;
+    struct atlas_rect_t atlas_rects[NUM_IMAGES];
+
+    // Allocator of the tables below. The allocator of the [[tm_simulate_state_o]].
+    tm_allocator_i* allocator;
+
+    // Asset paths of the images that the loader can load, indexed by image ID. The image ID of a
+    // table image is its [[IMAGE]] and the atlas pages follow (see [[atlas_page_image]]). A carray.
+    char (*paths)[IMAGE_PATH_SIZE];
+
+    // [[image_paths]] when the paths of the table images were copied. A new data pack is picked
+    // up by [[refresh_image_paths]].
+    const char (*table_paths)[IMAGE_PATH_SIZE];
+
+    // Indexed by image ID. A carray with an entry for each image in `paths`.
+    struct image_load_t* loads;
+
+    // UI renderer slot of the [[PLACEHOLDER]]. Drawn for images that aren't resident.
+    uint32_t placeholder_slot;
+};
+
+// State schema
+//
+// The engine keeps the pointer returned by [[simulate__start]] across hot reloads of the plugin, so
+// it points to a [[state_handle_t]], whose layout never changes, rather than to the state. The
+// handle keeps a copy of the [[state_schema]] that the state was laid out with. When a reload
+// changes the schema, [[migrate_state]] moves the state into an exactly sized allocation with the
+// new layout, copying each field from the old field with the same name, type and layout. Fields can
+// be added, removed and reordered, and arrays can grow or shrink, e.g. `inventory` when a prop is
+// added. New fields and fields that changed type start out zeroed.
+//
+// The structs that the fields are made of, or point to arrays of, are described member by member
+// in [[layout_types]], and each field carries a hash of the layouts it depends on. A field whose
+// struct changed layout, even if not size, is reset instead of copied, together with the rest of its
+// [[STATE_GROUP]]: if `scene_prop_t` changes, the whole scene is cleared rather than leaving handles
+// to props that are gone. The buffers of a reset field are abandoned, since the new build can't tell
+// how large they are. Derived caches are never carried over: they are copied only to keep their
+// buffers and then invalidated by [[reset_state_caches]].
+//
+// The runtime objects that the state points to (the image loader, the replay and the save) are
+// described in [[layout_types]] too. If one changed layout, its field is reset and the old object is
+// abandoned, since the new build can't stop its jobs or free it. [[handle_state]] then starts a new
+// image loader from the arguments kept in the handle. A reset replay stops recording or playing
+// back, and a reset save is written again by the next autosave.
+
+// Struct types that fields of [[tm_simulate_state_o]] are made of or point to. The values are only
+// meaningful within a build; the schema stores hashes of the layouts instead.
+enum LAYOUT_TYPE {
+    // A plain value.
+    LAYOUT_TYPE__NONE,
+
+    LAYOUT_TYPE__RANDOM_STREAM,
+    LAYOUT_TYPE__SCENE_SLOT,
+    LAYOUT_TYPE__SCENE_SLOTS,
+    LAYOUT_TYPE__HANDLE_RING,
+    LAYOUT_TYPE__SCENE_PROP,
+    LAYOUT_TYPE__SCENE_DINOSAUR,
+    LAYOUT_TYPE__EVENT,
+    LAYOUT_TYPE__AWARD_ITEM,
+    LAYOUT_TYPE__AWARDED_DROP,
+    LAYOUT_TYPE__DEPTH_KEY,
+    LAYOUT_TYPE__DEPTH_LIST,
+    LAYOUT_TYPE__DRAW_ITEM,
+    LAYOUT_TYPE__SCENE_CACHE,
+    LAYOUT_TYPE__MENU_CELL,
+    LAYOUT_TYPE__MENU_LAYOUT,
+    LAYOUT_TYPE__MONEY_LAYOUT,
+    LAYOUT_TYPE__FRAME_INPUT,
+    LAYOUT_TYPE__ATLAS_RECT,
+    LAYOUT_TYPE__IMAGE_LOAD,
+    LAYOUT_TYPE__IMAGE_LOADER,
+    LAYOUT_TYPE__REPLAY,
+    LAYOUT_TYPE__SAVE,
+    LAYOUT_TYPE__COUNT,
+};
+
+// A member of a struct described in [[layout_types]].
+struct layout_member_t {
+    const char* name;
+    uint32_t offset;
+    uint32_t size;
+
+    // [[LAYOUT_TYPE]] of the member, or of the elements it points to if it is a carray.
+    enum LAYOUT_TYPE type;
+};
+
+// Describes the member `m` of `struct t`. `lt` is the [[LAYOUT_TYPE]] of the member or of the
+// elements it points to.
+#define LAYOUT_MEMBER(t, m, lt) { #m, offsetof(struct t, m), sizeof(((struct t*)0)->m), lt }
+
+// Describes the plain member `m` of `struct t`.
+#define LAYOUT_VALUE(t, m) LAYOUT_MEMBER(t, m, LAYOUT_TYPE__NONE)
+
+static const struct layout_member_t random_stream_members[] = {
+    LAYOUT_VALUE(random_stream_t, s),
+};
+
+static const struct layout_member_t scene_slot_members[] = {
+    LAYOUT_VALUE(scene_slot_t, index),
+    LAYOUT_VALUE(scene_slot_t, generation),
+};
+
+static const struct layout_member_t scene_slots_members[] = {
+    LAYOUT_VALUE(scene_slots_t, first_free),
+    LAYOUT_VALUE(scene_slots_t, num_slots),
+    LAYOUT_MEMBER(scene_slots_t, slots, LAYOUT_TYPE__SCENE_SLOT),
+};
+
+static const struct layout_member_t handle_ring_members[] = {
+    LAYOUT_VALUE(handle_ring_t, head),
+    LAYOUT_VALUE(handle_ring_t, tail),
+    LAYOUT_VALUE(handle_ring_t, capacity),
+    LAYOUT_VALUE(handle_ring_t, handles),
+};
+
+static const struct layout_member_t scene_prop_members[] = {
+    LAYOUT_VALUE(scene_prop_t, prop),
+    LAYOUT_VALUE(scene_prop_t, attracts),
+    LAYOUT_VALUE(scene_prop_t, region),
+    LAYOUT_VALUE(scene_prop_t, x),
+    LAYOUT_VALUE(scene_prop_t, y),
+    LAYOUT_VALUE(scene_prop_t, lifetime),
+    LAYOUT_VALUE(scene_prop_t, expires),
+    LAYOUT_VALUE(scene_prop_t, event),
+    LAYOUT_VALUE(scene_prop_t, handle),
+};
+
+static const struct layout_member_t scene_dinosaur_members[] = {
+    LAYOUT_VALUE(scene_dinosaur_t, dinosaur),
+    LAYOUT_VALUE(scene_dinosaur_t, flipped),
+    LAYOUT_VALUE(scene_dinosaur_t, region),
+    LAYOUT_VALUE(scene_dinosaur_t, x),
+    LAYOUT_VALUE(scene_dinosaur_t, y),
+    LAYOUT_VALUE(scene_dinosaur_t, lifetime),
+    LAYOUT_VALUE(scene_dinosaur_t, event),
+    LAYOUT_VALUE(scene_dinosaur_t, handle),
+};
+
+static const struct layout_member_t event_members[] = {
+    LAYOUT_VALUE(event_t, time),
+    LAYOUT_VALUE(event_t, type),
+    LAYOUT_VALUE(event_t, handle),
+};
+
+static const struct layout_member_t award_item_members[] = {
+    LAYOUT_VALUE(award_item_t, image),
+    LAYOUT_VALUE(award_item_t, quantity),
+};
+
+static const struct layout_member_t awarded_drop_members[] = {
+    LAYOUT_VALUE(awarded_drop_t, dinosaur),
+    LAYOUT_VALUE(awarded_drop_t, num_items),
+    LAYOUT_MEMBER(awarded_drop_t, items, LAYOUT_TYPE__AWARD_ITEM),
+};
+
+static const struct layout_member_t depth_key_members[] = {
+    LAYOUT_VALUE(depth_key_t, y),
+    LAYOUT_VALUE(depth_key_t, item),
+};
+
+static const struct layout_member_t depth_list_members[] = {
+    LAYOUT_VALUE(depth_list_t, ready),
+    LAYOUT_VALUE(depth_list_t, num_keys),
+    LAYOUT_MEMBER(depth_list_t, keys, LAYOUT_TYPE__DEPTH_KEY),
+};
+
+static const struct layout_member_t draw_item_members[] = {
+    LAYOUT_VALUE(draw_item_t, y),
+    LAYOUT_VALUE(draw_item_t, image),
+    LAYOUT_VALUE(draw_item_t, rect),
+    LAYOUT_VALUE(draw_item_t, uv_rect),
+};
+
+static const struct layout_member_t scene_cache_members[] = {
+    LAYOUT_VALUE(scene_cache_t, valid),
+    LAYOUT_VALUE(scene_cache_t, version),
+    LAYOUT_VALUE(scene_cache_t, width),
+    LAYOUT_VALUE(scene_cache_t, height),
+    LAYOUT_VALUE(scene_cache_t, num_items),
+    LAYOUT_MEMBER(scene_cache_t, items, LAYOUT_TYPE__DRAW_ITEM),
+    LAYOUT_VALUE(scene_cache_t, cell_first),
+    LAYOUT_VALUE(scene_cache_t, cell_items),
+    LAYOUT_VALUE(scene_cache_t, item_cells),
+    LAYOUT_VALUE(scene_cache_t, visible),
+    LAYOUT_VALUE(scene_cache_t, num_drawn),
+    LAYOUT_VALUE(scene_cache_t, num_culled),
+};
+
+static const struct layout_member_t menu_cell_members[] = {
+    LAYOUT_VALUE(menu_cell_t, item),
+    LAYOUT_VALUE(menu_cell_t, image),
+    LAYOUT_VALUE(menu_cell_t, enabled),
+    LAYOUT_VALUE(menu_cell_t, icon_r),
+    LAYOUT_VALUE(menu_cell_t, desc_r),
+    LAYOUT_VALUE(menu_cell_t, number_r),
+    LAYOUT_VALUE(menu_cell_t, bone_r),
+    LAYOUT_VALUE(menu_cell_t, value_str),
+    LAYOUT_VALUE(menu_cell_t, count_str),
+};
+
+static const struct layout_member_t menu_layout_members[] = {
+    LAYOUT_VALUE(menu_layout_t, valid),
+    LAYOUT_VALUE(menu_layout_t, screen),
+    LAYOUT_VALUE(menu_layout_t, page),
+    LAYOUT_VALUE(menu_layout_t, rect),
+    LAYOUT_VALUE(menu_layout_t, font_scale),
+    LAYOUT_VALUE(menu_layout_t, money),
+    LAYOUT_VALUE(menu_layout_t, items_version),
+    LAYOUT_MEMBER(menu_layout_t, award, LAYOUT_TYPE__AWARDED_DROP),
+    LAYOUT_VALUE(menu_layout_t, menu_icon_r),
+    LAYOUT_VALUE(menu_layout_t, menu_r),
+    LAYOUT_VALUE(menu_layout_t, close_r),
+    LAYOUT_VALUE(menu_layout_t, left_button_r),
+    LAYOUT_VALUE(menu_layout_t, right_button_r),
+    LAYOUT_VALUE(menu_layout_t, grid_r),
+    LAYOUT_VALUE(menu_layout_t, grid_gap),
+    LAYOUT_VALUE(menu_layout_t, num_pages),
+    LAYOUT_VALUE(menu_layout_t, num_cells),
+    LAYOUT_MEMBER(menu_layout_t, cells, LAYOUT_TYPE__MENU_CELL),
+    LAYOUT_VALUE(menu_layout_t, cell_font_scale),
+    LAYOUT_VALUE(menu_layout_t, num_prefetch),
+    LAYOUT_VALUE(menu_layout_t, prefetch),
+    LAYOUT_VALUE(menu_layout_t, title_r),
+    LAYOUT_VALUE(menu_layout_t, title),
+};
+
+static const struct layout_member_t money_layout_members[] = {
+    LAYOUT_VALUE(money_layout_t, valid),
+    LAYOUT_VALUE(money_layout_t, money),
+    LAYOUT_VALUE(money_layout_t, rect),
+    LAYOUT_VALUE(money_layout_t, symbol_r),
+    LAYOUT_VALUE(money_layout_t, amount_r),
+    LAYOUT_VALUE(money_layout_t, background_r),
+    LAYOUT_VALUE(money_layout_t, font_scale),
+    LAYOUT_VALUE(money_layout_t, money_str),
+};
+
+static const struct layout_member_t frame_input_members[] = {
+    LAYOUT_VALUE(frame_input_t, mouse_pos),
+    LAYOUT_VALUE(frame_input_t, left_mouse_pressed),
+    LAYOUT_VALUE(frame_input_t, hover),
+};
+
+static const struct layout_member_t atlas_rect_members[] = {
+    LAYOUT_VALUE(atlas_rect_t, page),
+    LAYOUT_VALUE(atlas_rect_t, uv),
+};
+
+static const struct layout_member_t image_load_members[] = {
+    LAYOUT_VALUE(image_load_t, loader),
+    LAYOUT_VALUE(image_load_t, path),
+    LAYOUT_VALUE(image_load_t, instance),
+    LAYOUT_VALUE(image_load_t, handle),
+    LAYOUT_VALUE(image_load_t, found),
+    LAYOUT_VALUE(image_load_t, bytes),
+    LAYOUT_VALUE(image_load_t, seconds),
+    LAYOUT_VALUE(image_load_t, done),
+    LAYOUT_VALUE(image_load_t, status),
+    LAYOUT_VALUE(image_load_t, pinned),
+    LAYOUT_VALUE(image_load_t, job),
+    LAYOUT_VALUE(image_load_t, counter),
+    LAYOUT_VALUE(image_load_t, slot),
+    LAYOUT_VALUE(image_load_t, last_used),
+    LAYOUT_VALUE(image_load_t, lru_prev),
+    LAYOUT_VALUE(image_load_t, lru_next),
+};
+
+static const struct layout_member_t image_loader_members[] = {
+    LAYOUT_VALUE(image_loader_t, tt),
+    LAYOUT_VALUE(image_loader_t, asset_root),
+    LAYOUT_VALUE(image_loader_t, render_backend),
+    LAYOUT_VALUE(image_loader_t, ui_renderer),
+    LAYOUT_VALUE(image_loader_t, start_time),
+    LAYOUT_VALUE(image_loader_t, first_frame_seconds),
+    LAYOUT_VALUE(image_loader_t, num_pinned_pending),
+    LAYOUT_VALUE(image_loader_t, loading),
+    LAYOUT_VALUE(image_loader_t, num_loading),
+    LAYOUT_VALUE(image_loader_t, num_resident),
+    LAYOUT_VALUE(image_loader_t, resident_bytes),
+    LAYOUT_VALUE(image_loader_t, peak_resident_bytes),
+    LAYOUT_VALUE(image_loader_t, num_failed),
+    LAYOUT_VALUE(image_loader_t, num_evictions),
+    LAYOUT_VALUE(image_loader_t, lru_first),
+    LAYOUT_VALUE(image_loader_t, lru_last),
+    LAYOUT_VALUE(image_loader_t, frame),
+    LAYOUT_VALUE(image_loader_t, num_atlas_pages),
+    LAYOUT_MEMBER(image_loader_t, atlas_rects, LAYOUT_TYPE__ATLAS_RECT),
+    LAYOUT_VALUE(image_loader_t, allocator),
+    LAYOUT_VALUE(image_loader_t, paths),
+    LAYOUT_VALUE(image_loader_t, table_paths),
+    LAYOUT_MEMBER(image_loader_t, loads, LAYOUT_TYPE__IMAGE_LOAD),
+    LAYOUT_VALUE(image_loader_t, placeholder_slot),
+};
+
+static const struct layout_member_t replay_members[] = {
+    LAYOUT_VALUE(replay_t, playing),
+    LAYOUT_VALUE(replay_t, file),
+    LAYOUT_VALUE(replay_t, data),
+    LAYOUT_VALUE(replay_t, size),
+    LAYOUT_VALUE(replay_t, pos),
+    LAYOUT_VALUE(replay_t, num_frames),
+    LAYOUT_VALUE(replay_t, mouse_pos),
+    LAYOUT_VALUE(replay_t, dt),
+    LAYOUT_VALUE(replay_t, dt_unscaled),
+    LAYOUT_VALUE(replay_t, rect),
+};
+
+static const struct layout_member_t save_members[] = {
+    LAYOUT_VALUE(save_t, path),
+    LAYOUT_VALUE(save_t, data),
+    LAYOUT_VALUE(save_t, size),
+    LAYOUT_VALUE(save_t, ok),
+    LAYOUT_VALUE(save_t, done),
+    LAYOUT_VALUE(save_t, job),
+    LAYOUT_VALUE(save_t, counter),
+};
+
+// Layout of a struct type.
+struct layout_type_t {
+    uint32_t size;
+    uint32_t num_members;
+    const struct layout_member_t* members;
+};
+
+// Describes `struct t` with the `members` array.
+#define LAYOUT_TYPE(t, members) { sizeof(struct t), TM_ARRAY_COUNT(members), members }
+
+// Layouts of the [[LAYOUT_TYPE]]s. Must be updated with the structs. [[check_layout_types]]
+// catches most omissions.
+static const struct layout_type_t layout_types[LAYOUT_TYPE__COUNT] = {
+    [LAYOUT_TYPE__RANDOM_STREAM] = LAYOUT_TYPE(random_stream_t, random_stream_members),
+    [LAYOUT_TYPE__SCENE_SLOT] = LAYOUT_TYPE(scene_slot_t, scene_slot_members),
+    [LAYOUT_TYPE__SCENE_SLOTS] = LAYOUT_TYPE(scene_slots_t, scene_slots_members),
+    [LAYOUT_TYPE__HANDLE_RING] = LAYOUT_TYPE(handle_ring_t, handle_ring_members),
+    [LAYOUT_TYPE__SCENE_PROP] = LAYOUT_TYPE(scene_prop_t, scene_prop_members),
+    [LAYOUT_TYPE__SCENE_DINOSAUR] = LAYOUT_TYPE(scene_dinosaur_t, scene_dinosaur_members),
+    [LAYOUT_TYPE__EVENT] = LAYOUT_TYPE(event_t, event_members),
+    [LAYOUT_TYPE__AWARD_ITEM] = LAYOUT_TYPE(award_item_t, award_item_members),
+    [LAYOUT_TYPE__AWARDED_DROP] = LAYOUT_TYPE(awarded_drop_t, awarded_drop_members),
+    [LAYOUT_TYPE__DEPTH_KEY] = LAYOUT_TYPE(depth_key_t, depth_key_members),
+    [LAYOUT_TYPE__DEPTH_LIST] = LAYOUT_TYPE(depth_list_t, depth_list_members),
+    [LAYOUT_TYPE__DRAW_ITEM] = LAYOUT_TYPE(draw_item_t, draw_item_members),
+    [LAYOUT_TYPE__SCENE_CACHE] = LAYOUT_TYPE(scene_cache_t, scene_cache_members),
+    [LAYOUT_TYPE__MENU_CELL] = LAYOUT_TYPE(menu_cell_t, menu_cell_members),
+    [LAYOUT_TYPE__MENU_LAYOUT] = LAYOUT_TYPE(menu_layout_t, menu_layout_members),
+    [LAYOUT_TYPE__MONEY_LAYOUT] = LAYOUT_TYPE(money_layout_t, money_layout_members),
+    [LAYOUT_TYPE__FRAME_INPUT] = LAYOUT_TYPE(frame_input_t, frame_input_members),
+    [LAYOUT_TYPE__ATLAS_RECT] = LAYOUT_TYPE(atlas_rect_t, atlas_rect_members),
+    [LAYOUT_TYPE__IMAGE_LOAD] = LAYOUT_TYPE(image_load_t, image_load_members),
+    [LAYOUT_TYPE__IMAGE_LOADER] = LAYOUT_TYPE(image_loader_t, image_loader_members),
+    [LAYOUT_TYPE__REPLAY] = LAYOUT_TYPE(replay_t, replay_members),
+    [LAYOUT_TYPE__SAVE] = LAYOUT_TYPE(save_t, save_members),
+};
+
+// Groups of fields of [[tm_simulate_state_o]] that refer to each other, so they are only carried
+// over together. Like [[LAYOUT_TYPE]], only meaningful within a build.
+enum STATE_GROUP {
+    // A field that stands on its own.
+    STATE_GROUP__NONE,
+
+    // The props, the dinosaurs, their handles and the event queue that refers to them.
+    STATE_GROUP__SCENE,
+
+    // The awarded drops and their queue.
+    STATE_GROUP__AWARDS,
+    STATE_GROUP__COUNT,
+};
+
+// Description of a field of [[tm_simulate_state_o]] in the [[state_schema]]. Stored inline, so
+// that a copy stays valid when the build that made it is unloaded.
+struct state_field_t {
+    // Name of the field and of its type, or of the type of its elements for an array.
+    char name[32];
+    char type[32];
+
+    // Offset of the field, size of each element and number of elements, one if it isn't an array.
+    uint32_t offset;
+    uint32_t size;
+    uint32_t count;
+
+    // [[LAYOUT_TYPE]] that the field is made of or points to, and its [[STATE_GROUP]]. Only used
+    // by the build that made the schema.
+    uint32_t layout_type;
+    uint32_t group;
+
+    // Hash of the layout of `layout_type`, with the layouts of its members. Set by
+    // [[hash_state_layouts]].
+    uint64_t layout;
+};
+
+// Describes the field `f` of type `t`, made of or pointing to the [[LAYOUT_TYPE]] `lt`, in the
+// [[STATE_GROUP]] `g`.
+#define STATE_STRUCT(f, t, lt, g) { #f, #t, offsetof(tm_simulate_state_o, f), sizeof(((tm_simulate_state_o*)0)->f), 1, lt, g }
+
+// Describes the plain field `f` of type `t` in the [[STATE_GROUP]] `g`.
+#define STATE_GROUP_FIELD(f, t, g) STATE_STRUCT(f, t, LAYOUT_TYPE__NONE, g)
+
+// Describes the plain field `f` of type `t`.
+#define STATE_FIELD(f, t) STATE_GROUP_FIELD(f, t, STATE_GROUP__NONE)
+
+// Describes the array field `f` of elements of type `t`, made of the [[LAYOUT_TYPE]] `lt`, in the
+// [[STATE_GROUP]] `g`.
+#define STATE_STRUCT_ARRAY(f, t, lt, g) { #f, #t, offsetof(tm_simulate_state_o, f), sizeof(((tm_simulate_state_o*)0)->f[0]), TM_ARRAY_COUNT(((tm_simulate_state_o*)0)->f), lt, g }
+
+// Describes the array field `f` of plain elements of type `t`.
+#define STATE_ARRAY(f, t) STATE_STRUCT_ARRAY(f, t, LAYOUT_TYPE__NONE, STATE_GROUP__NONE)
+
+// The fields of [[tm_simulate_state_o]], in order. Must be updated with the struct.
+// [[check_state_schema]] catches most omissions. Not `const`, since the layout hashes are filled
+// in when the plugin is loaded.
+static struct state_field_t state_schema[] = {
+    STATE_FIELD(money, uint32_t),
+    STATE_FIELD(state, enum STATE),
+    STATE_FIELD(next_coin, double),
+    STATE_FIELD(time, double),
+    STATE_FIELD(step_time, double),
+    STATE_STRUCT(random, struct random_stream_t, LAYOUT_TYPE__RANDOM_STREAM, STATE_GROUP__NONE),
+    STATE_GROUP_FIELD(num_scene_props, uint32_t, STATE_GROUP__SCENE),
+    STATE_STRUCT(scene_props, struct scene_prop_t*, LAYOUT_TYPE__SCENE_PROP, STATE_GROUP__SCENE),
+    STATE_STRUCT(prop_slots, struct scene_slots_t, LAYOUT_TYPE__SCENE_SLOTS, STATE_GROUP__SCENE),
+    STATE_GROUP_FIELD(num_scene_dinosaurs, uint32_t, STATE_GROUP__SCENE),
+    STATE_STRUCT(scene_dinosaurs, struct scene_dinosaur_t*, LAYOUT_TYPE__SCENE_DINOSAUR, STATE_GROUP__SCENE),
+    STATE_STRUCT(dinosaur_slots, struct scene_slots_t, LAYOUT_TYPE__SCENE_SLOTS, STATE_GROUP__SCENE),
+    STATE_GROUP_FIELD(events_ready, bool, STATE_GROUP__SCENE),
+    STATE_GROUP_FIELD(num_events, uint32_t, STATE_GROUP__SCENE),
+    STATE_STRUCT(events, struct event_t*, LAYOUT_TYPE__EVENT, STATE_GROUP__SCENE),
+    STATE_GROUP_FIELD(coin_event, uint32_t, STATE_GROUP__SCENE),
+    STATE_ARRAY(in_album, uint64_t),
+    STATE_GROUP_FIELD(first_awarded_drop, uint32_t, STATE_GROUP__AWARDS),
+    STATE_GROUP_FIELD(num_awarded_drops, uint32_t, STATE_GROUP__AWARDS),
+    STATE_GROUP_FIELD(num_discarded_drops, uint32_t, STATE_GROUP__AWARDS),
+    STATE_FIELD(allocator, tm_allocator_i*),
+    STATE_FIELD(page, uint32_t),
+    STATE_ARRAY(inventory, uint32_t),
+    STATE_ARRAY(mementos, uint32_t),
+    STATE_FIELD(num_owned_props, uint32_t),
+    STATE_ARRAY(owned_props, uint16_t),
+    STATE_FIELD(num_owned_mementos, uint32_t),
+    STATE_ARRAY(owned_mementos, uint16_t),
+    STATE_FIELD(num_album_dinosaurs, uint32_t),
+    STATE_ARRAY(album_dinosaurs, uint16_t),
+    STATE_FIELD(items_version, uint32_t),
+    STATE_FIELD(scroll, float),
+    STATE_FIELD(place_prop, uint32_t),
+    STATE_STRUCT(prop_ages, struct handle_ring_t, LAYOUT_TYPE__HANDLE_RING, STATE_GROUP__SCENE),
+    STATE_STRUCT_ARRAY(awarded_drops, struct awarded_drop_t, LAYOUT_TYPE__AWARDED_DROP, STATE_GROUP__AWARDS),
+    STATE_FIELD(data_props, const struct prop_t*),
+    STATE_FIELD(data_dinosaurs, const struct dinosaur_t*),
+    STATE_STRUCT(image_loader, struct image_loader_t*, LAYOUT_TYPE__IMAGE_LOADER, STATE_GROUP__NONE),
+    STATE_STRUCT(depth, struct depth_list_t, LAYOUT_TYPE__DEPTH_LIST, STATE_GROUP__NONE),
+    STATE_GROUP_FIELD(scene_version, uint32_t, STATE_GROUP__SCENE),
+    STATE_STRUCT(scene_cache, struct scene_cache_t, LAYOUT_TYPE__SCENE_CACHE, STATE_GROUP__NONE),
+    STATE_STRUCT(menu_layout, struct menu_layout_t, LAYOUT_TYPE__MENU_LAYOUT, STATE_GROUP__NONE),
+    STATE_STRUCT(money_layout, struct money_layout_t, LAYOUT_TYPE__MONEY_LAYOUT, STATE_GROUP__NONE),
+    STATE_STRUCT(input, struct frame_input_t, LAYOUT_TYPE__FRAME_INPUT, STATE_GROUP__NONE),
+    STATE_STRUCT(replay, struct replay_t*, LAYOUT_TYPE__REPLAY, STATE_GROUP__NONE),
+    STATE_STRUCT(save, struct save_t*, LAYOUT_TYPE__SAVE, STATE_GROUP__NONE),
+    STATE_FIELD(save_timer, double),
+};
+
+// Hash of the [[state_schema]] of this build. Set by [[init_state_schema]].
+static uint64_t state_schema_hash;
+
+// Value of [[state_handle_t]] `magic`: "DINOSTH" and a version byte, to be bumped if the handle or
+// [[state_field_t]] ever has to change. Older handles start with the state pointer, and builds from
+// before the handle passed the engine the state itself, which starts with `money` and `state`.
+// Neither can equal the magic, since it isn't a canonical pointer and its high half is far larger
+// than any [[STATE]]. Version 2 added the arguments of the image loader.
+#define STATE_HANDLE_MAGIC 0x44494e4f53544802ULL
+
+// What the engine holds as the `tm_simulate_state_o` of a running game. See [[handle_state]].
+//
+// !!! NOTE
+//     A hot reload hands a handle made by the old build to the new one, so the layout of this
+//     struct must not change. Add new data to the state instead. If it has to change anyway, bump
+//     the version in [[STATE_HANDLE_MAGIC]], so that older handles are turned away.
+struct state_handle_t {
+    // [[STATE_HANDLE_MAGIC]]. Checked by [[is_state_handle]] before anything else is read.
+    uint64_t magic;
+
+    // The game state, laid out as described by `schema`, and the size of its allocation.
+    tm_simulate_state_o* state;
+    uint64_t state_size;
+
+    // Copy of the [[state_schema]] of the build that laid out `state`, and its hash.
+    struct state_field_t* schema;
+    uint32_t num_fields;
+    uint64_t schema_hash;
+
+    // Allocator of the handle, the state and the schema copy.
+    tm_allocator_i* allocator;
+
+    // Arguments of [[start_image_loader]], copied from `tm_simulate_start_args_t`, so that the
+    // image loader can be started again if a reload changes its layout.
+    struct tm_the_truth_o* tt;
+    tm_tt_id_t asset_root;
+    struct tm_renderer_backend_i* render_backend;
+    struct tm_ui_renderer_o* ui_renderer;
+};
+
+static const struct layout_member_t state_handle_members[] = {
+    LAYOUT_VALUE(state_handle_t, magic),
+    LAYOUT_VALUE(state_handle_t, state),
+    LAYOUT_VALUE(state_handle_t, state_size),
+    LAYOUT_VALUE(state_handle_t, schema),
+    LAYOUT_VALUE(state_handle_t, num_fields),
+    LAYOUT_VALUE(state_handle_t, schema_hash),
+    LAYOUT_VALUE(state_handle_t, allocator),
+    LAYOUT_VALUE(state_handle_t, tt),
+    LAYOUT_VALUE(state_handle_t, asset_root),
+    LAYOUT_VALUE(state_handle_t, render_backend),
+    LAYOUT_VALUE(state_handle_t, ui_renderer),
+};
+
+static const struct layout_member_t state_field_members[] = {
+    LAYOUT_VALUE(state_field_t, name),
+    LAYOUT_VALUE(state_field_t, type),
+    LAYOUT_VALUE(state_field_t, offset),
+    LAYOUT_VALUE(state_field_t, size),
+    LAYOUT_VALUE(state_field_t, count),
+    LAYOUT_VALUE(state_field_t, layout_type),
+    LAYOUT_VALUE(state_field_t, group),
+    LAYOUT_VALUE(state_field_t, layout),
+};
+
+// Layouts of the structs that one build hands to the next on a hot reload: the handle and the
+// entries of its schema copy. These are the only layouts that can't be migrated.
+static const struct layout_type_t handle_layouts[] = {
+    LAYOUT_TYPE(state_handle_t, state_handle_members),
+    LAYOUT_TYPE(state_field_t, state_field_members),
+};
+
+// Hash of the [[handle_layouts]] that go with the version in [[STATE_HANDLE_MAGIC]]. Before the
+// state had a schema, reload compatibility relied on the rule that fields were only appended, and
+// builds broke it without anything noticing. This rule is checked instead: if the handle or the
+// schema entries change, [[check_state_schema]] fails until the magic version is bumped and this
+// hash is updated to the one it reports.
+#define STATE_HANDLE_LAYOUT 0xea6326b5924d036eULL
+
+// Code
+
+// Returns `true` if the background-relative coordinates `(x,y)` are inside the hand-coded outline
+// of the lake. Only used to bake the [[default_region_map]].
+static bool lake_outline(float x, float y)
+{
+    if (x > 0.39f)
+        return false;
+
+    if (y < 0.68f) {
+        if (x < 0.09f)
+            return y > tm_lerp(0.48f, 0.45f, (x - 0.00f) / 0.09f);
+        else if (x < 0.13f)
+            return y > tm_lerp(0.45f, 0.52f, (x - 0.09f) / 0.04f);
+        else if (x < 0.33f)
+            return y > tm_lerp(0.52f, 0.55f, (x - 0.13f) / 0.20f);
+        else
+            return y > tm_lerp(0.55f, 0.68f, (x - 0.33f) / 0.06f);
+    } else {
+        if (x < 0.22f)
+            return y < 0.88f;
+        else
             return y < tm_lerp(0.90f, 0.74f, (x - 0.22f) / 0.17f);
     }
 }
 
-// Draws scene props in the array `(draw_props, num_props)`.
-static void draw_scene_props(tm_rect_t background_r, struct scene_prop_t* draw_props, uint32_t num_props,
-    struct draw_item_t** draw_ptr, tm_temp_allocator_i* ta)
+// Bakes [[default_region_map]] from [[lake_outline]], sampling each cell at its center. The area
+// above the horizon, where props couldn't be placed, is off limits.
+static void bake_default_region_map(void)
+{
+    for (uint32_t r = 0; r < REGION_MAP_HEIGHT; ++r) {
+        for (uint32_t c = 0; c < REGION_MAP_WIDTH; ++c) {
+            const float x = ((float)c + 0.5f) / REGION_MAP_WIDTH;
+            const float y = ((float)r + 0.5f) / REGION_MAP_HEIGHT;
+            default_region_map[r][c] = (uint8_t)(y < 0.35f ? REGION__OFF_LIMITS : lake_outline(x, y) ? REGION__LAKE : REGION__LAND);
+        }
+    }
+}
+
+// Returns the region at the background-relative coordinates `(x,y)`. Coordinates outside the
+// background are clamped to its edge. NaN coordinates are clamped to the last row or column, the
+// same as by `_mm_min_ps()` in [[classify_regions]], so that they never index outside the map.
+static enum REGION region_at(float x, float y)
+{
+    const uint32_t c = (uint32_t)tm_max(tm_min(x * REGION_MAP_WIDTH, (float)(REGION_MAP_WIDTH - 1)), 0.0f);
+    const uint32_t r = (uint32_t)tm_max(tm_min(y * REGION_MAP_HEIGHT, (float)(REGION_MAP_HEIGHT - 1)), 0.0f);
+    return (enum REGION)region_map[r][c];
+}
+
+// Classifies the `n` background-relative `points`, writing their [[REGION]]s to `regions`. Gives
+// the same results as calling [[region_at]] for each point, but computes the map cells of four
+// points at a time with SSE2.
+static void classify_regions(const tm_vec2_t* points, uint32_t n, uint8_t* regions)
+{
+    uint32_t i = 0;
+#if REGION_SIMD
+    const uint8_t* cells = region_map[0];
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 w = _mm_set1_ps(REGION_MAP_WIDTH), max_c = _mm_set1_ps(REGION_MAP_WIDTH - 1);
+    const __m128 h = _mm_set1_ps(REGION_MAP_HEIGHT), max_r = _mm_set1_ps(REGION_MAP_HEIGHT - 1);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 a = _mm_loadu_ps(&points[i].x);
+        const __m128 b = _mm_loadu_ps(&points[i + 2].x);
+        const __m128 x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        // `_mm_min_ps()` returns its second operand if either is NaN, so the coordinate goes first.
+        const __m128i c = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(x, w), max_c), zero));
+        const __m128i r = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(y, h), max_r), zero));
+        uint32_t cell[4];
+        _mm_storeu_si128((__m128i*)cell, _mm_add_epi32(_mm_slli_epi32(r, REGION_MAP_WIDTH_BITS), c));
+        regions[i + 0] = cells[cell[0]];
+        regions[i + 1] = cells[cell[1]];
+        regions[i + 2] = cells[cell[2]];
+        regions[i + 3] = cells[cell[3]];
+    }
+#endif
+    for (; i < n; ++i)
+        regions[i] = (uint8_t)region_at(points[i].x, points[i].y);
+}
+
+// Builds the lookup [[indices]] from the static tables. The first call also bakes the
+// [[default_region_map]].
+static void build_indices(void)
+{
+    static bool default_region_map_baked;
+    if (!default_region_map_baked) {
+        bake_default_region_map();
+        default_region_map_baked = true;
+    }
+
+    memset(&indices, 0, sizeof(indices));
+
+    for (uint32_t i = 0; i < NUM_PROPS; ++i)
+        indices.items[props[i].image] = (struct image_item_t){ ITEM_KIND__PROP, (uint16_t)i };
+    for (uint32_t i = 0; i < NUM_DINOSAURS; ++i)
+        indices.items[dinosaurs[i].image] = (struct image_item_t){ ITEM_KIND__DINOSAUR, (uint16_t)i };
+    for (uint32_t i = 0; i < NUM_MEMENTOS; ++i)
+        indices.items[mementos[i].image] = (struct image_item_t){ ITEM_KIND__MEMENTO, (uint16_t)i };
+
+    // Attraction. Counting sort on the key: count, prefix sum, then fill.
+    for (uint32_t i = 0; i < NUM_DINOSAURS; ++i) {
+        for (uint32_t a = 0; a < MAX_ATTRACTED_BY; ++a) {
+            const enum IMAGE food = dinosaurs[i].attracted_by[a];
+            if (food)
+                ++indices.attraction_first[food * 2 + (dinosaurs[i].type == DINO_TYPE__ICTYOSAUR) + 1];
+        }
+    }
+    for (uint32_t k = 0; k < 2 * NUM_IMAGES; ++k)
+        indices.attraction_first[k + 1] += indices.attraction_first[k];
+    uint32_t attraction_fill[2 * NUM_IMAGES];
+    memcpy(attraction_fill, indices.attraction_first, sizeof(attraction_fill));
+    for (uint32_t i = 0; i < NUM_DINOSAURS; ++i) {
+        for (uint32_t a = 0; a < MAX_ATTRACTED_BY; ++a) {
+            const enum IMAGE food = dinosaurs[i].attracted_by[a];
+            if (food)
+                indices.attraction[attraction_fill[food * 2 + (dinosaurs[i].type == DINO_TYPE__ICTYOSAUR)]++] = (uint16_t)i;
+        }
+    }
+
+    // Drops.
+    for (uint32_t i = 0; i < NUM_DROPS; ++i) {
+        const struct image_item_t dino = indices.items[drops[i].dinosaur_image];
+        if (dino.kind == ITEM_KIND__DINOSAUR)
+            ++indices.drops_first[dino.index + 1];
+    }
+    for (uint32_t k = 0; k < NUM_DINOSAURS; ++k) {
+        // An award holds at most [[MAX_AWARD_ITEMS]] distinct items, see [[add_award_item]]. Data
+        // packs are checked for this by [[check_data_pack]], the compiled tables only here.
+        const uint32_t n = indices.drops_first[k + 1];
+        TM_ASSERT(n <= MAX_AWARD_ITEMS, tm_error_api->def, "Dinosaur `%s` has %u drops, but an award holds at most %d items", dinosaurs[k].name, n, MAX_AWARD_ITEMS);
+        indices.drops_first[k + 1] += indices.drops_first[k];
+    }
+    uint32_t drops_fill[NUM_DINOSAURS];
+    memcpy(drops_fill, indices.drops_first, sizeof(drops_fill));
+    for (uint32_t i = 0; i < NUM_DROPS; ++i) {
+        const struct image_item_t dino = indices.items[drops[i].dinosaur_image];
+        if (dino.kind == ITEM_KIND__DINOSAUR)
+            indices.drops[drops_fill[dino.index]++] = (uint16_t)i;
+    }
+
+    // Sprite sizes, at the front of the scene.
+    for (uint32_t i = 0; i < NUM_PROPS; ++i)
+        indices.max_sprite_size = tm_max(indices.max_sprite_size, 0.24f * (float)props[i].scale);
+    for (uint32_t i = 0; i < NUM_DINOSAURS; ++i)
+        indices.max_sprite_size = tm_max(indices.max_sprite_size, 0.48f * (float)dinosaurs[i].scale);
+}
+
+// Start value for [[hash_bytes]].
+#define HASH_BYTES_SEED 0xcbf29ce484222325ULL
+
+// Returns the 64-bit FNV-1a hash of the `size` bytes at `data`, continuing from the hash `h`. Pass
+// [[HASH_BYTES_SEED]] to start a new hash.
+static uint64_t hash_bytes(uint64_t h, const void* data, uint64_t size)
+{
+    for (const uint8_t *p = data, *end = p + size; p != end; ++p)
+        h = (h ^ *p) * 0x100000001b3ULL;
+    return h;
+}
+
+// Returns the start of table `t` in the data pack `h`.
+static const void* data_pack_table(const struct data_pack_header_t* h, enum DATA_PACK_TABLE t)
+{
+    return (const char*)h + h->tables[t].offset;
+}
+
+// Checks that the `size` bytes at `h` are a data pack that matches the plugin. Returns a
+// description of the problem, or `NULL` if the pack can be used.
+static const char* check_data_pack(const struct data_pack_header_t* h, uint64_t size)
+{
+    if (size < sizeof(*h) || memcmp(h->magic, DATA_PACK_MAGIC, sizeof(h->magic)))
+        return "not a data pack";
+    if (h->version != DATA_PACK_VERSION)
+        return "unsupported version";
+    if (h->size != size)
+        return "truncated file";
+    if (h->hash != hash_bytes(HASH_BYTES_SEED, h + 1, size - sizeof(*h)))
+        return "checksum mismatch";
+
+    // The number of atlas pages varies, up to [[MAX_ATLAS_PAGES]].
+    const uint32_t pages = h->tables[DATA_PACK_TABLE__ATLAS_PAGES].count;
+    if (pages > MAX_ATLAS_PAGES)
+        return "too many atlas pages";
+    const uint32_t count[DATA_PACK_TABLE__COUNT] = { NUM_IMAGES, NUM_PROPS, NUM_DINOSAURS, NUM_DROPS, NUM_MEMENTOS, 1, pages, NUM_IMAGES, REGION_MAP_HEIGHT };
+    const uint32_t stride[DATA_PACK_TABLE__COUNT] = { IMAGE_PATH_SIZE, sizeof(struct prop_t), sizeof(struct dinosaur_t), sizeof(struct drop_t),
+        sizeof(struct memento_t), sizeof(struct rules_t), IMAGE_PATH_SIZE, sizeof(struct atlas_rect_t), REGION_MAP_WIDTH };
+    for (uint32_t t = 0; t < DATA_PACK_TABLE__COUNT; ++t) {
+        const struct data_pack_table_t* table = h->tables + t;
+        if (table->count != count[t] || table->stride != stride[t])
+            return "tables don't match the plugin, rebuild the pack";
+        if (table->offset % DATA_PACK_ALIGN || table->offset < sizeof(*h) || (uint64_t)table->offset + (uint64_t)table->count * table->stride > size)
+            return "table out of bounds";
+    }
+
+    // Check everything that is used as an array index or a string, so that a bad pack can't make
+    // the plugin read out of bounds. The values are checked like `dinosaur_pack` checks them, so
+    // that a pack that wasn't written by it can't stall the game with a zero interval or NaN.
+    const char(*paths)[IMAGE_PATH_SIZE] = data_pack_table(h, DATA_PACK_TABLE__IMAGE_PATHS);
+    for (uint32_t i = 0; i < NUM_IMAGES; ++i) {
+        if (paths[i][IMAGE_PATH_SIZE - 1])
+            return "image path not terminated";
+    }
+    const struct prop_t* p = data_pack_table(h, DATA_PACK_TABLE__PROPS);
+    for (uint32_t i = 0; i < NUM_PROPS; ++i) {
+        if (p[i].name[NAME_SIZE - 1] || (uint32_t)p[i].image >= NUM_IMAGES || !is_positive(p[i].scale))
+            return "bad prop";
+    }
+    const struct dinosaur_t* d = data_pack_table(h, DATA_PACK_TABLE__DINOSAURS);
+    for (uint32_t i = 0; i < NUM_DINOSAURS; ++i) {
+        if (d[i].name[NAME_SIZE - 1] || (uint32_t)d[i].image >= NUM_IMAGES || !is_positive(d[i].minutes_to_spawn) || !is_positive(d[i].scale))
+            return "bad dinosaur";
+        for (uint32_t a = 0; a < MAX_ATTRACTED_BY; ++a) {
+            if ((uint32_t)d[i].attracted_by[a] >= NUM_IMAGES)
+                return "bad dinosaur";
+        }
+    }
+    const struct drop_t* dr = data_pack_table(h, DATA_PACK_TABLE__DROPS);
+    uint32_t drops_per_image[NUM_IMAGES] = { 0 };
+    for (uint32_t i = 0; i < NUM_DROPS; ++i) {
+        if ((uint32_t)dr[i].dinosaur_image >= NUM_IMAGES || (uint32_t)dr[i].drop_image >= NUM_IMAGES)
+            return "bad drop";
+        if (!(dr[i].probability >= 0 && dr[i].probability <= 1) || !is_valid_range(dr[i].quantity, false))
+            return "bad drop";
+        if (++drops_per_image[dr[i].dinosaur_image] > MAX_AWARD_ITEMS)
+            return "too many drops for a dinosaur";
+    }
+    const struct memento_t* m = data_pack_table(h, DATA_PACK_TABLE__MEMENTOS);
+    for (uint32_t i = 0; i < NUM_MEMENTOS; ++i) {
+        if (m[i].name[NAME_SIZE - 1] || (uint32_t)m[i].image >= NUM_IMAGES)
+            return "bad memento";
+    }
+    const struct rules_t* r = data_pack_table(h, DATA_PACK_TABLE__RULES);
+    for (const struct rule_field_t* f = rule_fields; f != TM_ARRAY_END(rule_fields); ++f) {
+        if (!is_valid_range(*(const struct range_t*)((const char*)r + f->offset), f->interval))
+            return "bad rule";
+    }
+    const char(*page_paths)[IMAGE_PATH_SIZE] = data_pack_table(h, DATA_PACK_TABLE__ATLAS_PAGES);
+    for (uint32_t i = 0; i < pages; ++i) {
+        if (page_paths[i][IMAGE_PATH_SIZE - 1])
+            return "atlas page path not terminated";
+    }
+    const struct atlas_rect_t* ar = data_pack_table(h, DATA_PACK_TABLE__ATLAS_RECTS);
+    for (uint32_t i = 0; i < NUM_IMAGES; ++i) {
+        if (ar[i].page > pages)
+            return "bad atlas rect";
+    }
+    const uint8_t* regions = data_pack_table(h, DATA_PACK_TABLE__REGIONS);
+    for (uint32_t i = 0; i < REGION_MAP_HEIGHT * REGION_MAP_WIDTH; ++i) {
+        if (regions[i] >= NUM_REGIONS)
+            return "bad region";
+    }
+    return NULL;
+}
+
+// Points the static tables into the data pack `h`, which must have passed [[check_data_pack]].
+static void use_data_pack(const struct data_pack_header_t* h)
+{
+    image_paths = data_pack_table(h, DATA_PACK_TABLE__IMAGE_PATHS);
+    props = data_pack_table(h, DATA_PACK_TABLE__PROPS);
+    dinosaurs = data_pack_table(h, DATA_PACK_TABLE__DINOSAURS);
+    drops = data_pack_table(h, DATA_PACK_TABLE__DROPS);
+    mementos = data_pack_table(h, DATA_PACK_TABLE__MEMENTOS);
+    const struct rules_t* pack_rules = data_pack_table(h, DATA_PACK_TABLE__RULES);
+    for (const struct rule_field_t* f = rule_fields; f != TM_ARRAY_END(rule_fields); ++f)
+        memcpy((char*)&rules + f->offset, (const char*)pack_rules + f->offset, sizeof(struct range_t));
+    num_atlas_pages = h->tables[DATA_PACK_TABLE__ATLAS_PAGES].count;
+    atlas_pages = data_pack_table(h, DATA_PACK_TABLE__ATLAS_PAGES);
+    atlas_rects = data_pack_table(h, DATA_PACK_TABLE__ATLAS_RECTS);
+    region_map = data_pack_table(h, DATA_PACK_TABLE__REGIONS);
+    build_indices();
+}
+
+// Returns a value that changes when the file at `path` is modified, or 0 if the file doesn't
+// exist.
+static uint64_t file_stamp(const char* path)
+{
+#if defined(TM_OS_WINDOWS)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+        return 0;
+    const uint64_t time = (uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime;
+    const uint64_t size = (uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+#else
+    struct stat st;
+    if (stat(path, &st))
+        return 0;
+    const uint64_t time = (uint64_t)st.st_mtim.tv_sec * 1000000000 + (uint64_t)st.st_mtim.tv_nsec;
+    const uint64_t size = (uint64_t)st.st_size;
+#endif
+    return (time * 31 + size) | 1;
+}
+
+// Maps the file at `path` read-only and returns its start, or `NULL` if the file can't be mapped or
+// is empty. Returns the size of the file in `size`.
+static const void* map_file(const char* path, uint64_t* size)
+{
+#if defined(TM_OS_WINDOWS)
+    // `FILE_SHARE_DELETE` lets the file be replaced (e.g. by the packer) while we have it mapped.
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+    LARGE_INTEGER file_size = { 0 };
+    HANDLE mapping = NULL;
+    void* data = NULL;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) {
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    if (!data)
+        return NULL;
+    *size = (uint64_t)file_size.QuadPart;
+#else
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+    *size = (uint64_t)st.st_size;
+#endif
+    return data;
+}
+
+// Unmaps the `size` bytes at `data`, mapped by [[map_file]].
+static void unmap_file(const void* data, uint64_t size)
+{
+#if defined(TM_OS_WINDOWS)
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+// Maps the file at `path` read-only into `pack`. Returns `false` if the file can't be mapped.
+static bool map_data_pack(const char* path, struct mapped_data_pack_t* pack)
+{
+    pack->header = map_file(path, &pack->size);
+    return pack->header != NULL;
+}
+
+// Unmaps a pack mapped by [[map_data_pack]].
+static void unmap_data_pack(struct mapped_data_pack_t* pack)
+{
+    unmap_file(pack->header, pack->size);
+    *pack = (struct mapped_data_pack_t){ 0 };
+}
+
+// Maps the data pack named by [[DATA_PACK_ENV]] and swaps it in, if it has changed since it was
+// last mapped. Invalid packs are reported and leave the current tables in place.
+static void reload_data_pack(void)
+{
+    const char* path = getenv(DATA_PACK_ENV);
+    if (!path || !*path)
+        return;
+
+    const uint64_t stamp = file_stamp(path);
+    if (!stamp || stamp == data_packs.rejected_stamp)
+        return;
+    if (data_packs.num_packs && data_packs.packs[data_packs.num_packs - 1].stamp == stamp)
+        return;
+    if (!TM_ASSERT(data_packs.num_packs < MAX_MAPPED_DATA_PACKS, tm_error_api->def, "Too many data pack reloads, restart to pick up `%s`", path)) {
+        data_packs.rejected_stamp = stamp;
+        return;
+    }
+
+    struct mapped_data_pack_t pack = { .stamp = stamp };
+    if (!map_data_pack(path, &pack))
+        return;
+
+    const char* error = check_data_pack(pack.header, pack.size);
+    if (!TM_ASSERT(!error, tm_error_api->def, "Data pack `%s`: %s", path, error)) {
+        unmap_data_pack(&pack);
+        data_packs.rejected_stamp = stamp;
+        return;
+    }
+
+    data_packs.packs[data_packs.num_packs++] = pack;
+    use_data_pack(pack.header);
+}
+
+#if DINO_PROFILE
+
+// Maps the rings of the [[profiler]], sized for the threads of the job system. Called when the
+// plugin is loaded.
+static void start_profiler(void)
+{
+    profiler.epoch = tm_os_api->time->now();
+    profiler.max_threads = tm_os_api->info->num_logical_processors() + PROFILE_EXTRA_THREADS;
+    profiler.threads = tm_os_api->virtual_memory->map(profiler.max_threads * sizeof(*profiler.threads));
+}
+
+// Unmaps the rings of the [[profiler]]. Called when the plugin is unloaded.
+static void stop_profiler(void)
+{
+    if (profiler.threads)
+        tm_os_api->virtual_memory->unmap(profiler.threads, profiler.max_threads * sizeof(*profiler.threads));
+    profiler.threads = NULL;
+    profiler.max_threads = 0;
+}
+
+// Returns the calling thread's ring in [[profiler]], claiming one the first time the thread
+// records. Returns `NULL` if all rings are taken or the rings aren't mapped.
+static struct profile_thread_t* profile_thread(void)
+{
+    // 1-based index of the thread's ring, or `UINT32_MAX` if it didn't get one.
+    static PROFILE_THREAD_LOCAL uint32_t slot;
+    if (!slot) {
+        if (!profiler.threads)
+            return NULL;
+        const uint32_t i = atomic_fetch_add_uint32_t(&profiler.num_threads, 1);
+        slot = i < profiler.max_threads ? i + 1 : UINT32_MAX;
+    }
+    return slot != UINT32_MAX ? profiler.threads + slot - 1 : NULL;
+}
+
+// Implements [[PROFILE_BEGIN]].
+static void profile_begin(enum PROFILE_SCOPE scope)
+{
+    struct profile_thread_t* t = profile_thread();
+    if (!t || t->depth == MAX_PROFILE_DEPTH)
+        return;
+    t->open_scope[t->depth] = scope;
+    t->open[t->depth++] = tm_os_api->time->now();
+}
+
+// Implements [[PROFILE_END]]. Records the innermost open scope, so the scope passed to
+// [[PROFILE_END]] is only documentation.
+static void profile_end(void)
+{
+    const tm_clock_o now = tm_os_api->time->now();
+    struct profile_thread_t* t = profile_thread();
+    if (!t || !t->depth)
+        return;
+    const tm_clock_o start = t->open[--t->depth];
+    const uint32_t head = t->head;
+    t->events[head & (PROFILE_RING_SIZE - 1)] = (struct profile_event_t){
+        .start = tm_os_api->time->delta(start, profiler.epoch),
+        .duration = (float)tm_os_api->time->delta(now, start),
+        .scope = t->open_scope[t->depth],
+    };
+    atomic_store_uint32_t(&t->head, head + 1);
+}
+
+// Draws the p50 and p99 durations of the last [[PROFILE_OVERLAY_SAMPLES]] samples of each scope.
+//
+// The rings of other threads may be written while we read them, so we skip the oldest quarter of
+// each ring, which is the part that a writer could overwrite during the read.
+static void profile_overlay(tm_simulate_frame_args_t* args)
+{
+    float samples[PROFILE_SCOPE__COUNT][PROFILE_OVERLAY_SAMPLES];
+    uint32_t num_samples[PROFILE_SCOPE__COUNT] = { 0 };
+
+    const uint32_t num_threads = tm_min(atomic_load_uint32_t(&profiler.num_threads), profiler.max_threads);
+    for (uint32_t ti = 0; ti < num_threads; ++ti) {
+        const struct profile_thread_t* t = profiler.threads + ti;
+        const uint32_t head = atomic_load_uint32_t((atomic_uint32_t*)&t->head);
+        const uint32_t n = tm_min(head, PROFILE_RING_SIZE - PROFILE_RING_SIZE / 4);
+        for (uint32_t i = 0; i < n; ++i) {
+            const struct profile_event_t* e = t->events + ((head - 1 - i) & (PROFILE_RING_SIZE - 1));
+            if (e->scope < PROFILE_SCOPE__COUNT && num_samples[e->scope] < PROFILE_OVERLAY_SAMPLES)
+                samples[e->scope][num_samples[e->scope]++] = e->duration;
+        }
+    }
+
+    const float line_h = 18;
+    tm_rect_t line_r = { args->rect.x + args->rect.w - 320, args->rect.y + 5, 315, line_h };
+    for (uint32_t s = 0; s < PROFILE_SCOPE__COUNT; ++s) {
+        const uint32_t n = num_samples[s];
+        if (!n)
+            continue;
+        qsort(samples[s], n, sizeof(float), compare_float);
+        char line_str[128];
+        sprintf(line_str, "%-16s p50 %7.3f ms  p99 %7.3f ms", profile_scope_names[s],
+            samples[s][n / 2] * 1e3, samples[s][(n * 99) / 100] * 1e3);
+        tm_ui_api->text(args->ui, args->uistyle, &(tm_ui_text_t){ .rect = line_r, .text = line_str, .color = &HEXCOLOR(0xff0000) });
+        line_r.y += line_h;
+    }
+}
+
+// Writes the events in the profile rings to `path` as a Chrome trace. Should only be called when
+// no other threads are recording.
+static void write_profile_trace(const char* path)
+{
+    FILE* f = fopen(path, "wb");
+    if (!TM_ASSERT(f, tm_error_api->def, "Could not write profile trace `%s`", path))
+        return;
+
+    uint32_t num_events = 0;
+    fprintf(f, "{\"traceEvents\":[");
+    const uint32_t num_threads = tm_min(atomic_load_uint32_t(&profiler.num_threads), profiler.max_threads);
+    for (uint32_t ti = 0; ti < num_threads; ++ti) {
+        const struct profile_thread_t* t = profiler.threads + ti;
+        const uint32_t head = atomic_load_uint32_t((atomic_uint32_t*)&t->head);
+        for (uint32_t i = head - tm_min(head, PROFILE_RING_SIZE); i != head; ++i) {
+            const struct profile_event_t* e = t->events + (i & (PROFILE_RING_SIZE - 1));
+            fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}", num_events++ ? "," : "",
+                profile_scope_names[e->scope], e->start * 1e6, e->duration * 1e6, ti);
+        }
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+    TM_LOG("Wrote %u profile events to `%s`.", num_events, path);
+}
+
+#endif
+
+// Creates a creation graph instance for the image at the specified `asset_path` and evaluates its
+// image output into `inst` and `image`. Returns `false` if the image doesn't exist. Doesn't touch
+// the UI renderer, so it can run in a job.
+static bool evaluate_image(struct tm_the_truth_o* tt, tm_tt_id_t asset_root, struct tm_renderer_backend_i* rb,
+    const char* asset_path, tm_creation_graph_instance_t* inst, tm_creation_graph_image_data_t* image)
+{
+    if (!asset_path || !*asset_path)
+        asset_path = MISSING_ART;
+
+    const tm_tt_id_t asset = tm_the_truth_assets_api->asset_from_path(tt, asset_root, asset_path);
+    if (!TM_ASSERT(asset.u64, tm_error_api->def, "Image not found `%s`", asset_path))
+        return false;
+
+    const tm_tt_id_t object = tm_the_truth_api->get_subobject(tt, tm_tt_read(tt, asset), TM_TT_PROP__ASSET__OBJECT);
+    tm_creation_graph_context_t ctx = (tm_creation_graph_context_t){ .rb = rb, .device_affinity_mask = TM_RENDERER_DEVICE_AFFINITY_MASK_ALL, .tt = tt };
+    *inst = tm_creation_graph_api->create_instance(tt, object, &ctx);
+    tm_creation_graph_output_t output = tm_creation_graph_api->output(inst, TM_CREATION_GRAPH__IMAGE__OUTPUT_NODE_HASH, &ctx, 0);
+    *image = *(tm_creation_graph_image_data_t*)output.output;
+    return true;
+}
+
+// Returns an estimate of the GPU memory used by `image`. We assume four bytes per texel and add a
+// third for the mip chain.
+static uint64_t image_bytes(const tm_creation_graph_image_data_t* image)
+{
+    const uint64_t texels = (uint64_t)image->desc.width * image->desc.height * tm_max(image->desc.depth, 1);
+    return image->desc.mip_levels > 1 ? texels * 4 * 4 / 3 : texels * 4;
+}
+
+// Returns the image ID of the atlas page `p`. The atlas pages follow the table images.
+static uint32_t atlas_page_image(uint32_t p)
+{
+    return NUM_IMAGES + p;
+}
+
+// Gives the asset `path` the next image ID in `loader` and an entry in `loader->loads`. Only called
+// by [[start_image_loader]] before any load job runs, since the jobs point into `loads`.
+static void add_image(struct image_loader_t* loader, const char* path)
+{
+    const uint64_t id = tm_carray_size(loader->paths);
+    tm_carray_resize(loader->paths, id + 1, loader->allocator);
+    memset(loader->paths[id], 0, IMAGE_PATH_SIZE);
+    memcpy(loader->paths[id], path, strlen(path));
+    tm_carray_push(loader->loads, ((struct image_load_t){ .loader = loader, .lru_prev = NO_IMAGE, .lru_next = NO_IMAGE }), loader->allocator);
+}
+
+// Copies the paths of the table images from [[image_paths]] into `loader` if a new data pack has
+// been swapped in since they were copied. Images that are already resident keep their old art
+// until they are evicted.
+static void refresh_image_paths(struct image_loader_t* loader)
+{
+    if (loader->table_paths == image_paths)
+        return;
+    loader->table_paths = image_paths;
+    memcpy(loader->paths, image_paths, NUM_IMAGES * IMAGE_PATH_SIZE);
+}
+
+// Job that loads the image `data`, an [[image_load_t]]. Only writes to its own [[image_load_t]].
+static void image_load_job(void* data)
+{
+    struct image_load_t* load = data;
+    const struct image_loader_t* loader = load->loader;
+    const tm_clock_o t0 = tm_os_api->time->now();
+    tm_creation_graph_image_data_t image;
+    PROFILE_BEGIN(PROFILE_SCOPE__LOAD_IMAGE);
+    load->found = evaluate_image(loader->tt, loader->asset_root, loader->render_backend, load->path, &load->instance, &image);
+    PROFILE_END(PROFILE_SCOPE__LOAD_IMAGE);
+    if (load->found) {
+        load->handle = image.handle;
+        load->bytes = image_bytes(&image);
+    }
+    load->seconds = tm_os_api->time->delta(tm_os_api->time->now(), t0);
+    atomic_store_uint32_t(&load->done, 1);
+}
+
+// Returns `true` if `load` can be evicted and is in the LRU list of its loader: it is resident and
+// isn't pinned.
+static bool lru_member(const struct image_load_t* load)
+{
+    return load->status == IMAGE_STATUS__RESIDENT && !load->pinned;
+}
+
+// Removes the image `i` from the LRU list of `loader`.
+static void lru_unlink(struct image_loader_t* loader, uint32_t i)
+{
+    struct image_load_t* load = loader->loads + i;
+    if (load->lru_prev != NO_IMAGE)
+        loader->loads[load->lru_prev].lru_next = load->lru_next;
+    else
+        loader->lru_first = load->lru_next;
+    if (load->lru_next != NO_IMAGE)
+        loader->loads[load->lru_next].lru_prev = load->lru_prev;
+    else
+        loader->lru_last = load->lru_prev;
+    load->lru_prev = load->lru_next = NO_IMAGE;
+}
+
+// Appends the image `i` to the LRU list of `loader`, as the most recently used image.
+static void lru_append(struct image_loader_t* loader, uint32_t i)
+{
+    struct image_load_t* load = loader->loads + i;
+    load->lru_prev = loader->lru_last;
+    load->lru_next = NO_IMAGE;
+    if (loader->lru_last != NO_IMAGE)
+        loader->loads[loader->lru_last].lru_next = i;
+    else
+        loader->lru_first = i;
+    loader->lru_last = i;
+}
+
+// Marks the image `i` of `loader` as used in this frame and starts loading it from `path` if it
+// isn't resident.
+static void request_load(struct image_loader_t* loader, uint32_t i, const char* path)
+{
+    struct image_load_t* load = loader->loads + i;
+    load->last_used = loader->frame;
+    if (lru_member(load) && loader->lru_last != i) {
+        lru_unlink(loader, i);
+        lru_append(loader, i);
+    }
+    if (load->status != IMAGE_STATUS__UNLOADED)
+        return;
+
+    load->status = IMAGE_STATUS__LOADING;
+    load->done = 0;
+    memcpy(load->path, path, IMAGE_PATH_SIZE);
+    load->job = (tm_jobdecl_t){ .task = image_load_job, .data = load };
+    load->counter = tm_job_system_api->run_jobs(&load->job, 1);
+    tm_carray_push(loader->loading, i, loader->allocator);
+    ++loader->num_loading;
+}
+
+// Marks `image` as used in this frame and starts loading it if it isn't resident.
+static void prefetch_image(tm_simulate_state_o* state, enum IMAGE image)
+{
+    struct image_loader_t* loader = state->image_loader;
+    request_load(loader, image, loader->paths[image]);
+}
+
+// Returns the UI renderer slot to draw the image `id` of `loader` with: the image's own slot if it
+// is resident, otherwise the [[PLACEHOLDER]]'s.
+static uint32_t image_slot(const struct image_loader_t* loader, uint32_t id)
+{
+    const struct image_load_t* load = loader->loads + id;
+    return load->status == IMAGE_STATUS__RESIDENT ? load->slot : loader->placeholder_slot;
+}
+
+// Prefetches `image`, an item on a page next to the current page of a paginated grid in [[menu]],
+// so that flipping pages doesn't show placeholders. Images in the atlas are already resident.
+static void prefetch_grid_image(tm_simulate_state_o* state, enum IMAGE image)
+{
+    if (state->image_loader->atlas_rects[image].page)
+        return;
+    prefetch_image(state, image);
+}
+
+// Draws the `uv` part of `image` into `rect`. Images on a resident atlas page are drawn from the
+// page, with `uv` mapped into the image's rect on the page. Other images are requested with
+// [[prefetch_image]] and drawn as the [[PLACEHOLDER]] until they have loaded. If an atlas page
+// fails to load, its images are loaded on their own.
+static void draw_image(tm_simulate_state_o* state, const tm_ui_buffers_t* uib, const tm_draw2d_style_t* style, tm_rect_t rect, enum IMAGE image, tm_rect_t uv)
+{
+    struct image_loader_t* loader = state->image_loader;
+    const struct atlas_rect_t* a = loader->atlas_rects + image;
+    uint32_t slot = loader->placeholder_slot;
+    if (a->page) {
+        struct image_load_t* page = loader->loads + atlas_page_image(a->page - 1);
+        page->last_used = loader->frame;
+        if (page->status == IMAGE_STATUS__RESIDENT) {
+            slot = page->slot;
+            uv = (tm_rect_t){ a->uv.x + uv.x * a->uv.w, a->uv.y + uv.y * a->uv.h, uv.w * a->uv.w, uv.h * a->uv.h };
+        } else if (page->status == IMAGE_STATUS__FAILED) {
+            prefetch_image(state, image);
+            slot = image_slot(loader, image);
+        }
+    } else {
+        prefetch_image(state, image);
+        slot = image_slot(loader, image);
+    }
+    tm_draw2d_api->textured_rect(uib->vbuffer, *uib->ibuffers, style, rect, slot, uv);
+}
+
+// Releases the creation graph instance of the resident image `load`.
+static void release_image(struct image_loader_t* loader, struct image_load_t* load)
+{
+    tm_creation_graph_context_t ctx = { .rb = loader->render_backend, .device_affinity_mask = TM_RENDERER_DEVICE_AFFINITY_MASK_ALL, .tt = loader->tt };
+    tm_creation_graph_api->destroy_instance(&load->instance, &ctx);
+    loader->resident_bytes -= load->bytes;
+    --loader->num_resident;
+}
+
+// Starts the image loader for `state`. Gives IDs to the images of the static tables and the atlas
+// pages, loads the [[PLACEHOLDER]] right away and starts loading the pinned
+// images and atlas pages. Images are drawn as the placeholder until they have loaded.
+static void start_image_loader(tm_simulate_state_o* state, tm_simulate_start_args_t* args, tm_clock_o start_time)
+{
+    struct image_loader_t* loader = tm_alloc(state->allocator, sizeof(*loader));
+    *loader = (struct image_loader_t){
+        .tt = args->tt,
+        .asset_root = args->asset_root,
+        .render_backend = args->render_backend,
+        .ui_renderer = args->ui_renderer,
+        .start_time = start_time,
+        .num_atlas_pages = num_atlas_pages,
+        .allocator = state->allocator,
+        .lru_first = NO_IMAGE,
+        .lru_last = NO_IMAGE,
+    };
+    memcpy(loader->atlas_rects, atlas_rects, sizeof(loader->atlas_rects));
+    state->image_loader = loader;
+
+    // The table images come first, so that each [[IMAGE]] is the ID of its image.
+    for (uint32_t i = 0; i < NUM_IMAGES; ++i)
+        add_image(loader, image_paths[i]);
+    loader->table_paths = image_paths;
+    for (uint32_t p = 0; p < loader->num_atlas_pages; ++p)
+        add_image(loader, atlas_pages[p]);
+
+    // The placeholder is loaded right away, so that there is something to draw. If it fails to
+    // load, the slot `0` is drawn instead.
+    struct image_load_t* placeholder = loader->loads + PLACEHOLDER;
+    tm_creation_graph_image_data_t placeholder_data;
+    PROFILE_BEGIN(PROFILE_SCOPE__LOAD_IMAGE);
+    placeholder->found = evaluate_image(args->tt, args->asset_root, args->render_backend, image_paths[PLACEHOLDER], &placeholder->instance, &placeholder_data);
+    PROFILE_END(PROFILE_SCOPE__LOAD_IMAGE);
+    placeholder->pinned = true;
+    placeholder->status = placeholder->found ? IMAGE_STATUS__RESIDENT : IMAGE_STATUS__FAILED;
+    if (placeholder->found) {
+        placeholder->slot = tm_ui_renderer_api->allocate_image_slot(args->ui_renderer);
+        tm_ui_renderer_api->set_image(args->ui_renderer, placeholder->slot, placeholder_data.handle);
+        placeholder->bytes = image_bytes(&placeholder_data);
+        loader->placeholder_slot = placeholder->slot;
+        ++loader->num_resident;
+        loader->resident_bytes = loader->peak_resident_bytes = placeholder->bytes;
+    }
+    for (uint32_t i = 0; i < NUM_IMAGES; ++i) {
+        struct image_load_t* load = loader->loads + i;
+        if (i == PLACEHOLDER)
+            continue;
+        load->pinned = indices.items[i].kind == ITEM_KIND__NONE && !loader->atlas_rects[i].page;
+        if (load->pinned) {
+            prefetch_image(state, i);
+            ++loader->num_pinned_pending;
+        }
+    }
+    for (uint32_t p = 0; p < loader->num_atlas_pages; ++p) {
+        const uint32_t id = atlas_page_image(p);
+        loader->loads[id].pinned = true;
+        request_load(loader, id, loader->paths[id]);
+        ++loader->num_pinned_pending;
+    }
+}
+
+// Hands the images that have finished loading to the UI renderer, evicts the least recently used
+// images while over budget and logs the load times.
+static void update_image_loader(tm_simulate_state_o* state)
+{
+    struct image_loader_t* loader = state->image_loader;
+    if (!loader)
+        return;
+    ++loader->frame;
+    refresh_image_paths(loader);
+
+    for (uint32_t l = 0; l < loader->num_loading; ++l) {
+        const uint32_t i = loader->loading[l];
+        struct image_load_t* load = loader->loads + i;
+        if (!atomic_load_uint32_t(&load->done))
+            continue;
+
+        tm_job_system_api->wait_for_counter_and_free_no_fiber(load->counter);
+        loader->loading[l--] = loader->loading[--loader->num_loading];
+        tm_carray_shrink(loader->loading, loader->num_loading);
+        if (!load->found) {
+            // Keep drawing the placeholder and don't try again.
+            load->status = IMAGE_STATUS__FAILED;
+            load->bytes = 0;
+            ++loader->num_failed;
+        } else {
+            if (!load->slot)
+                load->slot = tm_ui_renderer_api->allocate_image_slot(loader->ui_renderer);
+            tm_ui_renderer_api->set_image(loader->ui_renderer, load->slot, load->handle);
+            load->status = IMAGE_STATUS__RESIDENT;
+            ++loader->num_resident;
+            loader->resident_bytes += load->bytes;
+            loader->peak_resident_bytes = tm_max(loader->peak_resident_bytes, loader->resident_bytes);
+            if (lru_member(load))
+                lru_append(loader, i);
+            TM_LOG("Loaded image `%s` in %.2f ms", load->path, load->seconds * 1000);
+        }
+
+        if (load->pinned && !--loader->num_pinned_pending) {
+            const double seconds = tm_os_api->time->delta(tm_os_api->time->now(), loader->start_time);
+            TM_LOG("Loaded startup images in %.1f ms (first frame after %.1f ms)", seconds * 1000, loader->first_frame_seconds * 1000);
+        }
+    }
+
+    // Evict the least recently used images that weren't used in the last frame. If everything
+    // that is over budget is in use, we stay over budget rather than flicker.
+    const uint64_t budget = (uint64_t)(rules.image_budget_mb * 1024 * 1024);
+    uint32_t evicted = 0;
+    while (loader->resident_bytes > budget && loader->lru_first != NO_IMAGE) {
+        const uint32_t i = loader->lru_first;
+        struct image_load_t* lru = loader->loads + i;
+        if (lru->last_used + 1 >= loader->frame)
+            break;
+        lru_unlink(loader, i);
+        release_image(loader, lru);
+        lru->status = IMAGE_STATUS__UNLOADED;
+        ++evicted;
+    }
+    loader->num_evictions += evicted;
+    if (evicted)
+        TM_LOG("Evicted %u images, %.1f MB resident", evicted, (double)loader->resident_bytes / (1024 * 1024));
+}
+
+// Waits for the image jobs, releases the resident images and frees the loader.
+static void stop_image_loader(tm_simulate_state_o* state)
+{
+    struct image_loader_t* loader = state->image_loader;
+    if (!loader)
+        return;
+
+    TM_LOG("Image loader: %u images resident (%.1f MB, peak %.1f MB of %.0f MB), %u not found, %u evictions", loader->num_resident,
+        (double)loader->resident_bytes / (1024 * 1024), (double)loader->peak_resident_bytes / (1024 * 1024), rules.image_budget_mb,
+        loader->num_failed, loader->num_evictions);
+
+    for (uint32_t l = 0; l < loader->num_loading; ++l) {
+        struct image_load_t* load = loader->loads + loader->loading[l];
+        tm_job_system_api->wait_for_counter_and_free_no_fiber(load->counter);
+        load->status = load->found ? IMAGE_STATUS__RESIDENT : IMAGE_STATUS__FAILED;
+        if (load->found) {
+            ++loader->num_resident;
+            loader->resident_bytes += load->bytes;
+        }
+    }
+    for (struct image_load_t* load = loader->loads; load != tm_carray_end(loader->loads); ++load) {
+        if (load->status == IMAGE_STATUS__RESIDENT)
+            release_image(loader, load);
+    }
+    tm_carray_free(loader->loading, loader->allocator);
+    tm_carray_free(loader->paths, loader->allocator);
+    tm_carray_free(loader->loads, loader->allocator);
+    tm_free(state->allocator, loader, sizeof(*loader));
+    state->image_loader = NULL;
+}
+
+// Returns the draw item for the scene prop `p`.
+static struct draw_item_t scene_prop_draw_item(tm_rect_t background_r, const struct scene_prop_t* p)
+{
+    const struct prop_t* prop = props + p->prop;
+
+    const float x = background_r.x + background_r.w * p->x;
+    const float y = background_r.y + background_r.h * p->y;
+
+    const float unit = background_r.h;
+    const float far_size = 0.06f * unit * (float)prop->scale;
+    const float close_size = 0.24f * unit * (float)prop->scale;
+    const float rel_size = (p->y - 0.35f) / (1.0f - 0.35f);
+    const float size = tm_lerp(far_size, close_size, rel_size);
+
+    if (p->region == REGION__LAKE) {
+        const tm_rect_t r = { x - size / 2, y - size + size * (float)prop->margin, size, size / 2 };
+        return (struct draw_item_t){ .image = prop->image, .y = p->y, .rect = r, .uv_rect = (tm_rect_t){ 0, 0, 1, 0.5f } };
+    } else {
+        const tm_rect_t r = { x - size / 2, y - size + size * (float)prop->margin, size, size };
+        return (struct draw_item_t){ .image = prop->image, .y = p->y, .rect = r };
+    }
+}
+
+// Returns the draw item for the scene dinosaur `d`.
+static struct draw_item_t scene_dinosaur_draw_item(tm_rect_t background_r, const struct scene_dinosaur_t* d)
+{
+    const struct dinosaur_t* dinosaur = dinosaurs + d->dinosaur;
+
+    const float x = background_r.x + background_r.w * d->x;
+    const float y = background_r.y + background_r.h * d->y;
+
+    const float unit = background_r.h;
+    const float far_size = 0.12f * unit * (float)dinosaur->scale;
+    const float close_size = 0.48f * unit * (float)dinosaur->scale;
+    const float rel_size = (d->y - 0.35f) / (1.0f - 0.35f);
+    const float size = tm_lerp(far_size, close_size, rel_size);
+
+    if (d->region == REGION__LAKE) {
+        const tm_rect_t r = { x - size / 2, y - size + size * (float)dinosaur->margin, size, size / 2 };
+        const tm_rect_t uv = d->flipped ? (tm_rect_t){ 1, 0, -1, 0.5f } : (tm_rect_t){ 0, 0, 1, 0.5f };
+        return (struct draw_item_t){ .image = dinosaur->image, .y = d->y, .rect = r, .uv_rect = uv };
+    } else {
+        const tm_rect_t r = { x - size / 2, y - size + size * (float)dinosaur->margin, size, size };
+        const tm_rect_t uv = d->flipped ? (tm_rect_t){ 1, 0, -1, 1 } : (tm_rect_t){ 0, 0, 1, 1 };
+        return (struct draw_item_t){ .image = dinosaur->image, .y = d->y, .rect = r, .uv_rect = uv };
+    }
+}
+
+// Draws `d`.
+static void draw_item(tm_simulate_state_o* state, const tm_ui_buffers_t* uib, const tm_draw2d_style_t* style, const struct draw_item_t* d)
+{
+    if (d->image) {
+        const tm_rect_t uv = d->uv_rect.x == 0 && d->uv_rect.y == 0 && d->uv_rect.w == 0 && d->uv_rect.h == 0 ? (tm_rect_t){ 0, 0, 1, 1 } : d->uv_rect;
+        draw_image(state, uib, style, d->rect, d->image, uv);
+    } else {
+        tm_draw2d_style_t rstyle = *style;
+        rstyle.color = HEXCOLOR(0xffff00);
+        tm_draw2d_api->fill_rect(uib->vbuffer, *uib->ibuffers, &rstyle, d->rect);
+    }
+}
+
+// Background layers of the scene and the y-coordinates they are drawn at.
+static const struct {
+    enum IMAGE image;
+    float y;
+} background_layers[NUM_BACKGROUND_LAYERS] = {
+    { BACKGROUND_LAYER_0, 0 },
+    { BACKGROUND_LAYER_1, 0.45f },
+    { BACKGROUND_LAYER_2, 0.52f },
+    { BACKGROUND_LAYER_3, 0.82f },
+    { BACKGROUND_LAYER_4, 1 },
+};
+
+// Returns the index of the lowest set bit of `bits`, which must not be zero.
+static uint32_t lowest_bit_set(uint64_t bits)
+{
+#if defined(TM_OS_WINDOWS)
+    unsigned long i;
+    _BitScanForward64(&i, bits);
+    return (uint32_t)i;
+#else
+    return (uint32_t)__builtin_ctzll(bits);
+#endif
+}
+
+// Returns the column or row of the culling grid that the background-relative coordinate `t` falls
+// in, for a grid with `n` columns or rows. Coordinates outside `[0,1]` are clamped to the edge.
+static uint32_t scene_grid_coordinate(float t, uint32_t n)
+{
+    return (uint32_t)tm_clamp(t * (float)n, 0.0f, (float)(n - 1));
+}
+
+// Returns the grid cell of the background-relative position `(x,y)`.
+static uint32_t scene_grid_cell(float x, float y)
+{
+    return scene_grid_coordinate(y, SCENE_GRID_ROWS) * SCENE_GRID_COLUMNS + scene_grid_coordinate(x, SCENE_GRID_COLUMNS);
+}
+
+// Rebuilds the [[scene_cache_t]] of `state` for a background of `width` x `height`: the
+// [[background_layers]] and the props and dinosaurs in the [[depth_list_t]], merged by y. At
+// equal y, background layers come first. The items are binned in the culling grid with a counting
+// sort on their cell, which keeps the items of each cell in draw order.
+static void build_scene_cache(tm_simulate_state_o* state, float width, float height)
+{
+    struct scene_cache_t* cache = &state->scene_cache;
+    const uint32_t max_items = NUM_BACKGROUND_LAYERS + state->depth.num_keys;
+    tm_carray_ensure(cache->items, max_items, state->allocator);
+    tm_carray_ensure(cache->item_cells, max_items, state->allocator);
+    tm_carray_ensure(cache->cell_items, max_items, state->allocator);
+    memset(cache->cell_first, 0, sizeof(cache->cell_first));
+    const tm_rect_t background_r = { 0, 0, width, height };
+    const struct depth_key_t* k = state->depth.keys;
+    const struct depth_key_t* end = k + state->depth.num_keys;
+    uint32_t layer = 0;
+    cache->num_items = 0;
+    while (k != end || layer < NUM_BACKGROUND_LAYERS) {
+        const uint32_t i = cache->num_items++;
+        struct draw_item_t* d = cache->items + i;
+        if (layer < NUM_BACKGROUND_LAYERS && (k == end || background_layers[layer].y <= k->y)) {
+            *d = (struct draw_item_t){ .image = background_layers[layer].image, .y = background_layers[layer].y, .rect = background_r };
+            cache->item_cells[i] = SCENE_GRID_CELLS;
+            ++layer;
+        } else {
+            const uint32_t slot = k->item & ~DEPTH_ITEM__DINOSAUR;
+            if (k->item & DEPTH_ITEM__DINOSAUR) {
+                const struct scene_dinosaur_t* dino = state->scene_dinosaurs + state->dinosaur_slots.slots[slot].index;
+                *d = scene_dinosaur_draw_item(background_r, dino);
+                cache->item_cells[i] = scene_grid_cell(dino->x, dino->y);
+            } else {
+                const struct scene_prop_t* prop = state->scene_props + state->prop_slots.slots[slot].index;
+                *d = scene_prop_draw_item(background_r, prop);
+                cache->item_cells[i] = scene_grid_cell(prop->x, prop->y);
+            }
+            ++k;
+        }
+        ++cache->cell_first[cache->item_cells[i] + 1];
+    }
+    for (uint32_t c = 0; c < SCENE_GRID_CELLS + 1; ++c)
+        cache->cell_first[c + 1] += cache->cell_first[c];
+    uint32_t cell_fill[SCENE_GRID_CELLS + 1];
+    memcpy(cell_fill, cache->cell_first, sizeof(cell_fill));
+    for (uint32_t i = 0; i < cache->num_items; ++i)
+        cache->cell_items[cell_fill[cache->item_cells[i]]++] = i;
+    cache->valid = true;
+    cache->version = state->scene_version;
+    cache->width = width;
+    cache->height = height;
+}
+
+// Sets the `visible` bits of the [[scene_cache_t]] items that may overlap `view_r`, when the
+// background is drawn at `background_r`. The view is grown by the largest sprite size, so that
+// every item in a cell outside the grown view is outside the view. Sprites shrink towards the
+// back of the scene, so each row of the grid is grown by the largest size at its front edge. Items
+// in cells that overlap the grown view are drawn even if they are just outside it.
+static void cull_scene_cache(tm_simulate_state_o* state, tm_rect_t background_r, tm_rect_t view_r)
+{
+    struct scene_cache_t* cache = &state->scene_cache;
+    const uint32_t num_words = (cache->num_items + 63) / 64;
+    tm_carray_ensure(cache->visible, num_words, state->allocator);
+    memset(cache->visible, 0, num_words * sizeof(*cache->visible));
+
+    // The sprites are anchored at the bottom center of their rect, but the margins can move the
+    // rect down, so we grow the view by the full sprite size vertically.
+    const float y0 = (view_r.y - background_r.y) / background_r.h - indices.max_sprite_size;
+    const float y1 = (view_r.y + view_r.h - background_r.y) / background_r.h + indices.max_sprite_size;
+    const uint32_t r0 = scene_grid_coordinate(y0, SCENE_GRID_ROWS), r1 = scene_grid_coordinate(y1, SCENE_GRID_ROWS);
+
+    uint32_t num_drawn = 0;
+    for (uint32_t r = r0; r <= r1; ++r) {
+        const float rel_size = tm_clamp(((float)(r + 1) / SCENE_GRID_ROWS - 0.35f) / (1.0f - 0.35f), 0.0f, 1.0f);
+        const float size = indices.max_sprite_size * tm_lerp(0.25f, 1.0f, rel_size);
+        const float margin_x = size * background_r.h / background_r.w / 2;
+        const float x0 = (view_r.x - background_r.x) / background_r.w - margin_x;
+        const float x1 = (view_r.x + view_r.w - background_r.x) / background_r.w + margin_x;
+        const uint32_t c0 = scene_grid_coordinate(x0, SCENE_GRID_COLUMNS), c1 = scene_grid_coordinate(x1, SCENE_GRID_COLUMNS);
+        const uint32_t first = cache->cell_first[r * SCENE_GRID_COLUMNS + c0];
+        const uint32_t last = cache->cell_first[r * SCENE_GRID_COLUMNS + c1 + 1];
+        for (uint32_t j = first; j < last; ++j)
+            cache->visible[cache->cell_items[j] / 64] |= 1ULL << (cache->cell_items[j] % 64);
+        num_drawn += last - first;
+    }
+    for (uint32_t j = cache->cell_first[SCENE_GRID_CELLS]; j < cache->cell_first[SCENE_GRID_CELLS + 1]; ++j)
+        cache->visible[cache->cell_items[j] / 64] |= 1ULL << (cache->cell_items[j] % 64);
+    num_drawn += NUM_BACKGROUND_LAYERS;
+
+    cache->num_drawn = num_drawn;
+    cache->num_culled = cache->num_items - num_drawn;
+}
+
+// Draws the scene back to front from the [[scene_cache_t]], offset to `background_r`. Only the
+// items that [[cull_scene_cache]] marked as visible are drawn. The prop being placed, `preview`,
+// if any, is drawn after the items with a smaller or equal y.
+static void draw_scene_cache(tm_simulate_state_o* state, const tm_ui_buffers_t* uib, const tm_draw2d_style_t* style, tm_rect_t background_r,
+    const struct scene_prop_t* preview)
+{
+    const struct scene_cache_t* cache = &state->scene_cache;
+    for (uint32_t w = 0; w < (cache->num_items + 63) / 64; ++w) {
+        for (uint64_t bits = cache->visible[w]; bits; bits &= bits - 1) {
+            const struct draw_item_t* c = cache->items + w * 64 + lowest_bit_set(bits);
+            if (preview && preview->y < c->y) {
+                const struct draw_item_t d = scene_prop_draw_item(background_r, preview);
+                draw_item(state, uib, style, &d);
+                preview = NULL;
+            }
+            struct draw_item_t d = *c;
+            d.rect.x += background_r.x;
+            d.rect.y += background_r.y;
+            draw_item(state, uib, style, &d);
+        }
+    }
+    if (preview) {
+        const struct draw_item_t d = scene_prop_draw_item(background_r, preview);
+        draw_item(state, uib, style, &d);
+    }
+}
+
+// Scene storage
+
+// Returns the current handle of `slot`.
+static uint32_t slot_handle(const struct scene_slots_t* slots, uint32_t slot)
+{
+    return slot | (slots->slots[slot].generation << SCENE_HANDLE_SLOT_BITS);
+}
+
+// Returns the index in the scene array of the entity with `handle`, or `UINT32_MAX` if the entity
+// has been removed.
+static uint32_t handle_index(const struct scene_slots_t* slots, uint32_t handle)
 {
-    struct draw_item_t* draw = *draw_ptr;
-    for (struct scene_prop_t* p = draw_props; p < draw_props + num_props; ++p) {
-        const struct prop_t* prop = p->prop;
+    const uint32_t slot = handle & SCENE_HANDLE_SLOT_MASK;
+    if (slot >= slots->num_slots || slot_handle(slots, slot) != handle)
+        return UINT32_MAX;
+    return slots->slots[slot].index;
+}
 
-        const float x = background_r.x + background_r.w * p->x;
-        const float y = background_r.y + background_r.h * p->y;
+// Allocates a slot in `slots` for the entity at `index` in the scene array and returns its handle.
+// The slots grow in `a`.
+static uint32_t alloc_handle(tm_allocator_i* a, struct scene_slots_t* slots, uint32_t index)
+{
+    uint32_t slot;
+    if (slots->first_free) {
+        slot = slots->first_free - 1;
+        slots->first_free = slots->slots[slot].index;
+    } else {
+        slot = slots->num_slots++;
+        tm_carray_ensure(slots->slots, slots->num_slots, a);
+        slots->slots[slot].generation = 1;
+    }
+    slots->slots[slot].index = index;
+    return slot_handle(slots, slot);
+}
 
-        const float unit = background_r.h;
-        const float far_size = 0.06f * unit * (float)prop->scale;
-        const float close_size = 0.24f * unit * (float)prop->scale;
-        const float rel_size = (p->y - 0.35f) / (1.0f - 0.35f);
-        const float size = tm_lerp(far_size, close_size, rel_size);
+// Frees the slot of `handle`. The handle, and any copies of it, become stale.
+static void free_handle(struct scene_slots_t* slots, uint32_t handle)
+{
+    const uint32_t slot = handle & SCENE_HANDLE_SLOT_MASK;
+    struct scene_slot_t* s = slots->slots + slot;
+    s->generation = s->generation % ((1u << (32 - SCENE_HANDLE_SLOT_BITS)) - 1) + 1;
+    s->index = slots->first_free;
+    slots->first_free = slot + 1;
+}
 
-        if (in_lake(p->x, p->y)) {
-            const tm_rect_t r = { x - size / 2, y - size + size * (float)prop->margin, size, size / 2 };
-            tm_carray_temp_push(draw, ((struct draw_item_t){ .image = prop->image, .y = p->y, .rect = r, .uv_rect = (tm_rect_t){ 0, 0, 1, 0.5f } }), ta);
-        } else {
-            const tm_rect_t r = { x - size / 2, y - size + size * (float)prop->margin, size, size };
-            tm_carray_temp_push(draw, ((struct draw_item_t){ .image = prop->image, .y = p->y, .rect = r }), ta);
+// Pushes the handle of a newly placed prop to `prop_ages`.
+//
+// When the ring is full, the handles of props that have been removed are dropped, and the ring
+// only grows if that doesn't free up at least half of it. So pushes are amortized O(1) and the
+// ring stays within twice the number of props in the scene.
+static void push_prop_age(tm_simulate_state_o* state, uint32_t handle)
+{
+    struct handle_ring_t* ring = &state->prop_ages;
+    if (ring->head - ring->tail == ring->capacity) {
+        const uint32_t mask = ring->capacity - 1;
+        uint32_t n = 0;
+        for (uint32_t i = ring->tail; i != ring->head; ++i) {
+            const uint32_t h = ring->handles[i & mask];
+            if (handle_index(&state->prop_slots, h) != UINT32_MAX)
+                ring->handles[(ring->tail + n++) & mask] = h;
+        }
+        ring->head = ring->tail + n;
+        if (!ring->capacity || n > ring->capacity / 2) {
+            const uint32_t capacity = ring->capacity ? ring->capacity * 2 : 16;
+            uint32_t* handles = 0;
+            tm_carray_ensure(handles, capacity, state->allocator);
+            for (uint32_t i = 0; i < n; ++i)
+                handles[i] = ring->handles[(ring->tail + i) & mask];
+            tm_carray_free(ring->handles, state->allocator);
+            *ring = (struct handle_ring_t){ .head = n, .capacity = capacity, .handles = handles };
         }
     }
-    *draw_ptr = draw;
+    ring->handles[ring->head++ & (ring->capacity - 1)] = handle;
 }
 
-// Draws scene dinosaurs in the array `(draw_dinosaurs, num_dinosaurs)`.
-static void draw_scene_dinosaurs(tm_rect_t background_r, struct scene_dinosaur_t* draw_dinosaurs, uint32_t num_dinosaurs,
-    struct draw_item_t** draw_ptr, tm_temp_allocator_i* ta)
+// Returns the index of the oldest prop in the scene. The scene must have props. Skips the handles
+// of removed props at the tail of `prop_ages`, so it is amortized O(1).
+static uint32_t oldest_scene_prop(tm_simulate_state_o* state)
 {
-    struct draw_item_t* draw = *draw_ptr;
-    for (struct scene_dinosaur_t* d = draw_dinosaurs; d < draw_dinosaurs + num_dinosaurs; ++d) {
-        const struct dinosaur_t* dinosaur = d->dinosaur;
+    struct handle_ring_t* ring = &state->prop_ages;
+    while (true) {
+        const uint32_t i = handle_index(&state->prop_slots, ring->handles[ring->tail & (ring->capacity - 1)]);
+        if (i != UINT32_MAX)
+            return i;
+        ++ring->tail;
+    }
+}
 
-        const float x = background_r.x + background_r.w * d->x;
-        const float y = background_r.y + background_r.h * d->y;
+// Frees the scene storage of `state`.
+static void free_scene(tm_simulate_state_o* state)
+{
+    tm_allocator_i* a = state->allocator;
+    tm_carray_free(state->scene_props, a);
+    tm_carray_free(state->prop_slots.slots, a);
+    tm_carray_free(state->prop_ages.handles, a);
+    tm_carray_free(state->scene_dinosaurs, a);
+    tm_carray_free(state->dinosaur_slots.slots, a);
+    tm_carray_free(state->events, a);
+    tm_carray_free(state->depth.keys, a);
+    tm_carray_free(state->scene_cache.items, a);
+    tm_carray_free(state->scene_cache.cell_items, a);
+    tm_carray_free(state->scene_cache.item_cells, a);
+    tm_carray_free(state->scene_cache.visible, a);
+}
 
-        const float unit = background_r.h;
-        const float far_size = 0.12f * unit * (float)dinosaur->scale;
-        const float close_size = 0.48f * unit * (float)dinosaur->scale;
-        const float rel_size = (d->y - 0.35f) / (1.0f - 0.35f);
-        const float size = tm_lerp(far_size, close_size, rel_size);
+// Depth sorting
 
-        if (in_lake(d->x, d->y)) {
-            const tm_rect_t r = { x - size / 2, y - size + size * (float)dinosaur->margin, size, size / 2 };
-            const tm_rect_t uv = d->flipped ? (tm_rect_t){ 1, 0, -1, 0.5f } : (tm_rect_t){ 0, 0, 1, 0.5f };
-            tm_carray_temp_push(draw, ((struct draw_item_t){ .image = dinosaur->image, .y = d->y, .rect = r, .uv_rect = uv }), ta);
-        } else {
-            const tm_rect_t r = { x - size / 2, y - size + size * (float)dinosaur->margin, size, size };
-            const tm_rect_t uv = d->flipped ? (tm_rect_t){ 1, 0, -1, 1 } : (tm_rect_t){ 0, 0, 1, 1 };
-            tm_carray_temp_push(draw, ((struct draw_item_t){ .image = dinosaur->image, .y = d->y, .rect = r, .uv_rect = uv }), ta);
+// Returns the index of the first key in the sorted `(keys, n)` with a y-coordinate greater than
+// `y`. Inserting there keeps items with equal y in insertion order.
+static uint32_t depth_upper_bound(const struct depth_key_t* keys, uint32_t n, float y)
+{
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi) / 2;
+        if (keys[mid].y <= y)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Returns the index of `key` in the sorted `(keys, n)`, or `n` if it isn't there.
+static uint32_t depth_find(const struct depth_key_t* keys, uint32_t n, struct depth_key_t key)
+{
+    for (uint32_t i = depth_upper_bound(keys, n, key.y); i-- > 0 && keys[i].y == key.y;) {
+        if (keys[i].item == key.item)
+            return i;
+    }
+    return n;
+}
+
+// Inserts `key` in the sorted `(keys, *n)`.
+static void depth_insert(struct depth_key_t* keys, uint32_t* n, struct depth_key_t key)
+{
+    const uint32_t i = depth_upper_bound(keys, *n, key.y);
+    memmove(keys + i + 1, keys + i, (*n - i) * sizeof(*keys));
+    keys[i] = key;
+    ++*n;
+}
+
+// Removes `key` from the sorted `(keys, *n)`.
+static void depth_remove(struct depth_key_t* keys, uint32_t* n, struct depth_key_t key)
+{
+    const uint32_t i = depth_find(keys, *n, key);
+    if (i == *n)
+        return;
+    memmove(keys + i, keys + i + 1, (*n - i - 1) * sizeof(*keys));
+    --*n;
+}
+
+// Returns a radix sort key for `y`, that orders the same way as the float.
+static uint32_t depth_radix_key(float y)
+{
+    uint32_t u;
+    memcpy(&u, &y, sizeof(u));
+    return u & 0x80000000u ? ~u : u | 0x80000000u;
+}
+
+// Sorts `(keys, n)` by y, keeping items with equal y in their current order. Small lists are
+// insertion sorted. Large lists are radix sorted on the bits of y, one byte per pass, using `tmp`
+// (with room for `n` keys) as scratch space. Passes where all keys have the same byte, such as
+// the exponent byte of coordinates in the same range, are skipped.
+static void depth_sort(struct depth_key_t* keys, uint32_t n, struct depth_key_t* tmp)
+{
+    if (n <= 64) {
+        for (uint32_t i = 1; i < n; ++i) {
+            const struct depth_key_t k = keys[i];
+            uint32_t j = i;
+            for (; j > 0 && keys[j - 1].y > k.y; --j)
+                keys[j] = keys[j - 1];
+            keys[j] = k;
         }
+        return;
+    }
+
+    uint32_t count[4][256] = { 0 };
+    for (uint32_t i = 0; i < n; ++i) {
+        const uint32_t r = depth_radix_key(keys[i].y);
+        for (uint32_t b = 0; b < 4; ++b)
+            ++count[b][(r >> (8 * b)) & 0xff];
+    }
+
+    struct depth_key_t* src = keys;
+    struct depth_key_t* dst = tmp;
+    for (uint32_t b = 0; b < 4; ++b) {
+        if (count[b][(depth_radix_key(keys[0].y) >> (8 * b)) & 0xff] == n)
+            continue;
+        uint32_t offset[256];
+        for (uint32_t i = 0, sum = 0; i < 256; sum += count[b][i++])
+            offset[i] = sum;
+        for (uint32_t i = 0; i < n; ++i)
+            dst[offset[(depth_radix_key(src[i].y) >> (8 * b)) & 0xff]++] = src[i];
+        struct depth_key_t* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != keys)
+        memcpy(keys, src, n * sizeof(*keys));
+}
+
+// Rebuilds the [[depth_list_t]] of `state` from the scene.
+static void rebuild_depth_list(tm_simulate_state_o* state)
+{
+    struct depth_list_t* depth = &state->depth;
+    const uint32_t n = state->num_scene_props + state->num_scene_dinosaurs;
+    tm_carray_ensure(depth->keys, n, state->allocator);
+    depth->num_keys = 0;
+    for (uint32_t i = 0; i < state->num_scene_props; ++i)
+        depth->keys[depth->num_keys++] = (struct depth_key_t){ state->scene_props[i].y, state->scene_props[i].handle & SCENE_HANDLE_SLOT_MASK };
+    for (uint32_t i = 0; i < state->num_scene_dinosaurs; ++i)
+        depth->keys[depth->num_keys++] = (struct depth_key_t){ state->scene_dinosaurs[i].y, (state->scene_dinosaurs[i].handle & SCENE_HANDLE_SLOT_MASK) | DEPTH_ITEM__DINOSAUR };
+    if (n) {
+        struct depth_key_t* tmp = tm_alloc(state->allocator, n * sizeof(*tmp));
+        depth_sort(depth->keys, depth->num_keys, tmp);
+        tm_free(state->allocator, tmp, n * sizeof(*tmp));
+    }
+    depth->ready = true;
+}
+
+// Seeds `stream` from `seed`. Any seed, including zero, gives a usable stream.
+static void seed_random(struct random_stream_t* stream, uint64_t seed)
+{
+    // Expand the seed with splitmix64, so that similar seeds give unrelated streams.
+    for (uint32_t i = 0; i < 2; ++i) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        stream->s[i] = z ^ (z >> 31);
     }
-    *draw_ptr = draw;
 }
 
-// Rolls a random value in the range and returns it.
-static double roll(struct range_t r)
+// Returns the next 64 random bits of `stream`.
+static uint64_t random_next(struct random_stream_t* stream)
+{
+    uint64_t s1 = stream->s[0];
+    const uint64_t s0 = stream->s[1];
+    stream->s[0] = s0;
+    s1 ^= s1 << 23;
+    stream->s[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+    return stream->s[1] + s0;
+}
+
+// Rolls a random value in the range from the random stream of `state` and returns it.
+static double roll(tm_simulate_state_o* state, struct range_t r)
 {
-    const double t = tm_random_to_double(tm_random_api->next());
+    const double t = tm_random_to_double(random_next(&state->random));
     return r.min + t * (r.max - r.min);
 }
 
-// Implements the game logic.
-static void game_logic(tm_simulate_state_o* state, double dt)
+// Event queue
+//
+// In event queue mode, every prop and dinosaur in the scene has exactly one pending event in the
+// `events` heap, and each entity stores the heap index of its event. The heap helpers below keep
+// those back-references up to date as events move in the heap, and the scene helpers keep the
+// events' entity indices up to date as entities move in the scene arrays.
+
+// Returns the heap index field of the entity that owns `e`.
+static uint32_t* event_owner(tm_simulate_state_o* state, const struct event_t* e)
 {
-    // Time doesn't pass in award screen.
-    if (state->state == STATE__AWARD)
-        dt = 0;
+    switch (e->type) {
+    case EVENT__PROP:
+        return &state->scene_props[handle_index(&state->prop_slots, e->handle)].event;
+    case EVENT__DINOSAUR:
+        return &state->scene_dinosaurs[handle_index(&state->dinosaur_slots, e->handle)].event;
+    case EVENT__COIN:
+        return &state->coin_event;
+    }
+    return 0;
+}
+
+// Stores `e` at heap index `i` and updates the owner's back-reference.
+static void event_set(tm_simulate_state_o* state, uint32_t i, struct event_t e)
+{
+    state->events[i] = e;
+    *event_owner(state, &e) = i;
+}
+
+// Restores the heap property for the event at index `i`.
+static void event_sift(tm_simulate_state_o* state, uint32_t i)
+{
+    const struct event_t e = state->events[i];
+    while (i > 0 && e.time < state->events[(i - 1) / 2].time) {
+        event_set(state, i, state->events[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    while (true) {
+        uint32_t child = 2 * i + 1;
+        if (child >= state->num_events)
+            break;
+        if (child + 1 < state->num_events && state->events[child + 1].time < state->events[child].time)
+            ++child;
+        if (state->events[child].time >= e.time)
+            break;
+        event_set(state, i, state->events[child]);
+        i = child;
+    }
+    event_set(state, i, e);
+}
+
+// Schedules the event `e`.
+static void event_push(tm_simulate_state_o* state, struct event_t e)
+{
+    tm_carray_ensure(state->events, state->num_events + 1, state->allocator);
+    const uint32_t i = state->num_events++;
+    event_set(state, i, e);
+    event_sift(state, i);
+}
+
+// Removes the event at heap index `i`.
+static void event_remove(tm_simulate_state_o* state, uint32_t i)
+{
+    --state->num_events;
+    if (i == state->num_events)
+        return;
+    event_set(state, i, state->events[state->num_events]);
+    event_sift(state, i);
+}
+
+// Samples the time to the next event of a Poisson process with the specified mean interval.
+static double roll_exponential(tm_simulate_state_o* state, double mean)
+{
+    return -log(1.0 - roll(state, (struct range_t){ 0, 1 })) * mean;
+}
+
+// Samples the time of the event for the prop with index `i`, which is either the time when it
+// spoils or the time when it attracts its first dinosaur. The spawns of the dinosaurs attracted by
+// the prop are independent Poisson processes, so the first spawn is the minimum of their
+// exponentially distributed arrival times.
+static struct event_t prop_event(tm_simulate_state_o* state, uint32_t i)
+{
+    struct scene_prop_t* p = state->scene_props + i;
+
+    // Only ICTYOSAURS can spawn in the lake. ICTYOSAURS cannot spawn on land.
+    const uint32_t key = props[p->prop].image * 2 + (p->region == REGION__LAKE);
+
+    double time = p->expires;
+    p->attracts = NUM_DINOSAURS;
+    for (uint32_t a = indices.attraction_first[key]; a < indices.attraction_first[key + 1]; ++a) {
+        const struct dinosaur_t* d = dinosaurs + indices.attraction[a];
+        const double spawn_time = state->time + roll_exponential(state, d->minutes_to_spawn * 60);
+        if (spawn_time < time) {
+            time = spawn_time;
+            p->attracts = indices.attraction[a];
+        }
+    }
+    return (struct event_t){ .time = time, .type = EVENT__PROP, .handle = p->handle };
+}
+
+// Schedules the event for the newly added prop with index `i`.
+static void schedule_prop(tm_simulate_state_o* state, uint32_t i)
+{
+    struct scene_prop_t* p = state->scene_props + i;
+    if (!p->lifetime)
+        p->lifetime = roll(state, rules.food_lifetime_minutes) * 60.0f;
+    p->expires = state->time + p->lifetime;
+    event_push(state, prop_event(state, i));
+}
+
+// Schedules the event for the newly added dinosaur with index `i`.
+static void schedule_dinosaur(tm_simulate_state_o* state, uint32_t i)
+{
+    struct scene_dinosaur_t* d = state->scene_dinosaurs + i;
+    if (!d->lifetime)
+        d->lifetime = roll(state, rules.dinosaur_lifetime_minutes) * 60.0f;
+    event_push(state, (struct event_t){ .time = state->time + d->lifetime, .type = EVENT__DINOSAUR, .handle = d->handle });
+}
+
+// Length in seconds of the fixed simulation steps. See [[step_game]].
+static double simulation_step(void)
+{
+    return rules.simulation_hz > 0 ? 1 / rules.simulation_hz : 0.1;
+}
+
+// Rolls the time in seconds until the next coin. It is never shorter than one simulation step, so
+// with a zero `rules.minutes_to_coin` a coin is paid every step (as the polled logic of the
+// original game paid one every tick) rather than the coin being rescheduled at the same time
+// forever.
+static double roll_coin_interval(tm_simulate_state_o* state)
+{
+    return tm_max(roll(state, rules.minutes_to_coin) * 60, simulation_step());
+}
+
+// Builds the event queue from the current scene. Remaining lifetimes and coin time are carried
+// over from the polled state, so that switching modes or rebasing the state keeps them.
+static void build_event_queue(tm_simulate_state_o* state)
+{
+    state->num_events = 0;
+    const double next_coin = state->next_coin > 0 ? state->next_coin : roll_coin_interval(state);
+    event_push(state, (struct event_t){ .time = state->time + next_coin, .type = EVENT__COIN });
+    for (uint32_t i = 0; i < state->num_scene_props; ++i)
+        schedule_prop(state, i);
+    for (uint32_t i = 0; i < state->num_scene_dinosaurs; ++i)
+        schedule_dinosaur(state, i);
+    state->events_ready = true;
+}
+
+// Tears down the event queue and stores the remaining times in the polled state (`next_coin`
+// and the `lifetime` of props and dinosaurs).
+static void flush_event_queue(tm_simulate_state_o* state)
+{
+    state->next_coin = state->events[state->coin_event].time - state->time;
+    for (uint32_t i = 0; i < state->num_scene_props; ++i)
+        state->scene_props[i].lifetime = (float)(state->scene_props[i].expires - state->time);
+    for (uint32_t i = 0; i < state->num_scene_dinosaurs; ++i)
+        state->scene_dinosaurs[i].lifetime = (float)(state->events[state->scene_dinosaurs[i].event].time - state->time);
+    state->num_events = 0;
+    state->events_ready = false;
+}
+
+// Updates the regions of the props and dinosaurs in the scene from the current [[region_map]].
+static void classify_scene(tm_simulate_state_o* state)
+{
+    const uint32_t n = state->num_scene_props + state->num_scene_dinosaurs;
+    TM_INIT_TEMP_ALLOCATOR(ta);
+    tm_vec2_t* points = tm_temp_alloc(ta, n * sizeof(*points));
+    uint8_t* regions = tm_temp_alloc(ta, n * sizeof(*regions));
+    for (uint32_t i = 0; i < state->num_scene_props; ++i)
+        points[i] = (tm_vec2_t){ state->scene_props[i].x, state->scene_props[i].y };
+    for (uint32_t i = 0; i < state->num_scene_dinosaurs; ++i)
+        points[state->num_scene_props + i] = (tm_vec2_t){ state->scene_dinosaurs[i].x, state->scene_dinosaurs[i].y };
+    classify_regions(points, n, regions);
+    for (uint32_t i = 0; i < state->num_scene_props; ++i)
+        state->scene_props[i].region = regions[i];
+    for (uint32_t i = 0; i < state->num_scene_dinosaurs; ++i)
+        state->scene_dinosaurs[i].region = regions[state->num_scene_props + i];
+    TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+}
+
+// Updates `state` for the current [[props]], [[dinosaurs]] and [[region_map]] tables. The scene and
+// the awarded drops refer to the tables by index, so they carry over as they are, but the regions
+// of the scene are looked up in the new [[region_map]]. Pending spawns were rolled with the old
+// rates and regions, so the event queue is flushed and rebuilt on the next tick.
+static void rebase_state(tm_simulate_state_o* state)
+{
+    classify_scene(state);
+    if (state->events_ready)
+        flush_event_queue(state);
+    state->data_props = props;
+    state->data_dinosaurs = dinosaurs;
+    ++state->scene_version;
+    state->menu_layout.valid = false;
+    state->money_layout.valid = false;
+}
+
+// Scene
+
+// True if the dinosaur with index `dino_i` is in the album.
+static inline bool in_album(const tm_simulate_state_o* state, uint32_t dino_i)
+{
+    return (state->in_album[dino_i / 64] >> (dino_i % 64)) & 1;
+}
+
+// Returns the position of the first index in `list`, a sorted list of `num` indices, that isn't
+// less than `i`.
+static uint32_t sorted_list_lower_bound(const uint16_t* list, uint32_t num, uint32_t i)
+{
+    uint32_t lo = 0, hi = num;
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi) / 2;
+        if (list[mid] < i)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Inserts the index `i` into `list`, a sorted list of `*num` indices.
+static void sorted_list_insert(uint16_t* list, uint32_t* num, uint32_t i)
+{
+    const uint32_t lo = sorted_list_lower_bound(list, *num, i);
+    memmove(list + lo + 1, list + lo, sizeof(*list) * (*num - lo));
+    list[lo] = (uint16_t)i;
+    ++*num;
+}
 
-    // Earn money
+// Removes the index `i` from `list`, a sorted list of `*num` indices that contains it.
+static void sorted_list_remove(uint16_t* list, uint32_t* num, uint32_t i)
+{
+    const uint32_t lo = sorted_list_lower_bound(list, *num, i);
+    memmove(list + lo, list + lo + 1, sizeof(*list) * (*num - lo - 1));
+    --*num;
+}
+
+// Adds the dinosaur with index `dino_i` to the album.
+static inline void add_to_album(tm_simulate_state_o* state, uint32_t dino_i)
+{
+    if (in_album(state, dino_i))
+        return;
+    state->in_album[dino_i / 64] |= 1ULL << (dino_i % 64);
+    sorted_list_insert(state->album_dinosaurs, &state->num_album_dinosaurs, dino_i);
+    ++state->items_version;
+}
+
+// Sets the number of props with index `prop_i` that the player has to `count`.
+static void set_inventory(tm_simulate_state_o* state, uint32_t prop_i, uint32_t count)
+{
+    if (!state->inventory[prop_i] && count)
+        sorted_list_insert(state->owned_props, &state->num_owned_props, prop_i);
+    else if (state->inventory[prop_i] && !count)
+        sorted_list_remove(state->owned_props, &state->num_owned_props, prop_i);
+    state->inventory[prop_i] = count;
+    ++state->items_version;
+}
+
+// Sets the number of mementos with index `memento_i` that the player has to `count`.
+static void set_mementos(tm_simulate_state_o* state, uint32_t memento_i, uint32_t count)
+{
+    if (!state->mementos[memento_i] && count)
+        sorted_list_insert(state->owned_mementos, &state->num_owned_mementos, memento_i);
+    else if (state->mementos[memento_i] && !count)
+        sorted_list_remove(state->owned_mementos, &state->num_owned_mementos, memento_i);
+    state->mementos[memento_i] = count;
+    ++state->items_version;
+}
+
+// Rebuilds the lists of owned props and mementos and of the dinosaurs in the album from the
+// inventory, the mementos and the album, e.g. after loading a save.
+static void rebuild_item_lists(tm_simulate_state_o* state)
+{
+    state->num_owned_props = 0;
+    for (uint32_t i = 0; i < NUM_PROPS; ++i) {
+        if (state->inventory[i])
+            state->owned_props[state->num_owned_props++] = (uint16_t)i;
+    }
+    state->num_owned_mementos = 0;
+    for (uint32_t i = 0; i < NUM_MEMENTOS; ++i) {
+        if (state->mementos[i])
+            state->owned_mementos[state->num_owned_mementos++] = (uint16_t)i;
+    }
+    state->num_album_dinosaurs = 0;
+    for (uint32_t i = 0; i < NUM_DINOSAURS; ++i) {
+        if (in_album(state, i))
+            state->album_dinosaurs[state->num_album_dinosaurs++] = (uint16_t)i;
+    }
+    ++state->items_version;
+}
+
+// Returns the `i`th unclaimed drop, counting from the oldest.
+static inline struct awarded_drop_t* unclaimed_drop(tm_simulate_state_o* state, uint32_t i)
+{
+    return state->awarded_drops + ((state->first_awarded_drop + i) & (MAX_AWARDED_DROPS - 1));
+}
+
+// Removes the oldest unclaimed drop.
+static inline void pop_unclaimed_drop(tm_simulate_state_o* state)
+{
+    state->first_awarded_drop = (state->first_awarded_drop + 1) & (MAX_AWARDED_DROPS - 1);
+    --state->num_awarded_drops;
+}
+
+// Removes the prop with index `i` from the scene. The last prop takes its place.
+static void remove_scene_prop(tm_simulate_state_o* state, uint32_t i)
+{
+    struct scene_prop_t* p = state->scene_props + i;
+    ++state->scene_version;
+    if (state->events_ready)
+        event_remove(state, p->event);
+    if (state->depth.ready)
+        depth_remove(state->depth.keys, &state->depth.num_keys, (struct depth_key_t){ p->y, p->handle & SCENE_HANDLE_SLOT_MASK });
+    free_handle(&state->prop_slots, p->handle);
+    *p = state->scene_props[--state->num_scene_props];
+    if (i < state->num_scene_props)
+        state->prop_slots.slots[p->handle & SCENE_HANDLE_SLOT_MASK].index = i;
+}
+
+// Adds `prop` to the scene and returns its handle. If the scene already has
+// `rules.max_scene_props` props, the oldest one is removed first, together with its event, before
+// the new prop is scheduled.
+static uint32_t add_scene_prop(tm_simulate_state_o* state, struct scene_prop_t prop)
+{
+    const uint32_t max_props = tm_clamp(rules.max_scene_props, 1, SCENE_HANDLE_SLOT_MASK);
+    while (state->num_scene_props >= max_props)
+        remove_scene_prop(state, oldest_scene_prop(state));
+
+    const uint32_t i = state->num_scene_props++;
+    tm_carray_ensure(state->scene_props, state->num_scene_props, state->allocator);
+    prop.lifetime = 0;
+    prop.handle = alloc_handle(state->allocator, &state->prop_slots, i);
+    prop.region = region_at(prop.x, prop.y);
+    state->scene_props[i] = prop;
+    push_prop_age(state, prop.handle);
+    ++state->scene_version;
+    if (state->events_ready)
+        schedule_prop(state, i);
+    if (state->depth.ready) {
+        tm_carray_ensure(state->depth.keys, state->depth.num_keys + 1, state->allocator);
+        depth_insert(state->depth.keys, &state->depth.num_keys, (struct depth_key_t){ prop.y, prop.handle & SCENE_HANDLE_SLOT_MASK });
+    }
+    return prop.handle;
+}
+
+// Adds a dinosaur to the scene and the album and returns its handle.
+static uint32_t add_scene_dinosaur(tm_simulate_state_o* state, struct scene_dinosaur_t dino)
+{
+    add_to_album(state, dino.dinosaur);
+    const uint32_t i = state->num_scene_dinosaurs++;
+    tm_carray_ensure(state->scene_dinosaurs, state->num_scene_dinosaurs, state->allocator);
+    dino.handle = alloc_handle(state->allocator, &state->dinosaur_slots, i);
+    dino.region = region_at(dino.x, dino.y);
+    state->scene_dinosaurs[i] = dino;
+    ++state->scene_version;
+    if (state->events_ready)
+        schedule_dinosaur(state, i);
+    if (state->depth.ready) {
+        tm_carray_ensure(state->depth.keys, state->depth.num_keys + 1, state->allocator);
+        depth_insert(state->depth.keys, &state->depth.num_keys, (struct depth_key_t){ dino.y, (dino.handle & SCENE_HANDLE_SLOT_MASK) | DEPTH_ITEM__DINOSAUR });
+    }
+    return dino.handle;
+}
+
+// Removes the dinosaur with index `i` from the scene. The last dinosaur takes its place.
+static void remove_scene_dinosaur(tm_simulate_state_o* state, uint32_t i)
+{
+    struct scene_dinosaur_t* d = state->scene_dinosaurs + i;
+    ++state->scene_version;
+    if (state->events_ready)
+        event_remove(state, d->event);
+    if (state->depth.ready)
+        depth_remove(state->depth.keys, &state->depth.num_keys, (struct depth_key_t){ d->y, (d->handle & SCENE_HANDLE_SLOT_MASK) | DEPTH_ITEM__DINOSAUR });
+    free_handle(&state->dinosaur_slots, d->handle);
+    *d = state->scene_dinosaurs[--state->num_scene_dinosaurs];
+    if (i < state->num_scene_dinosaurs)
+        state->dinosaur_slots.slots[d->handle & SCENE_HANDLE_SLOT_MASK].index = i;
+}
+
+// Adds `quantity` items of `image` to `drop`, keeping the items sorted by image.
+static void add_award_item(struct awarded_drop_t* drop, uint32_t image, uint32_t quantity)
+{
+    uint32_t i = 0;
+    while (i < drop->num_items && drop->items[i].image < image)
+        ++i;
+    if (i < drop->num_items && drop->items[i].image == image) {
+        drop->items[i].quantity = (uint16_t)tm_min(drop->items[i].quantity + quantity, UINT16_MAX);
+        return;
+    }
+    // [[build_indices]] asserts that a dinosaur has at most [[MAX_AWARD_ITEMS]] drops.
+    if (drop->num_items == MAX_AWARD_ITEMS)
+        return;
+    memmove(drop->items + i + 1, drop->items + i, sizeof(*drop->items) * (drop->num_items - i));
+    drop->items[i] = (struct award_item_t){ .image = (uint16_t)image, .quantity = (uint16_t)tm_min(quantity, UINT16_MAX) };
+    ++drop->num_items;
+}
+
+// Awards the drops of the dinosaur with index `dino_i` when it leaves the scene.
+static void award_drop(tm_simulate_state_o* state, uint32_t dino_i)
+{
+    struct awarded_drop_t awarded_drop = { .dinosaur = (uint16_t)dino_i };
+
+    for (uint32_t di = indices.drops_first[dino_i]; di < indices.drops_first[dino_i + 1]; ++di) {
+        const struct drop_t* drop = drops + indices.drops[di];
+        if (roll(state, (struct range_t){ 0, 1 }) > drop->probability)
+            continue;
+
+        const uint32_t quantity = (uint32_t)(roll(state, drop->quantity) + 0.5f);
+        if (quantity)
+            add_award_item(&awarded_drop, drop->drop_image, quantity);
+    }
+
+    if (awarded_drop.num_items) {
+        if (state->num_awarded_drops < MAX_AWARDED_DROPS)
+            *unclaimed_drop(state, state->num_awarded_drops++) = awarded_drop;
+        else
+            ++state->num_discarded_drops;
+    }
+}
+
+// Game logic
+
+// Implements the game logic by polling every prop and dinosaur.
+static void polled_game_logic(tm_simulate_state_o* state, double dt)
+{
+    // Earn money. Coin intervals are at least one simulation step, so at most `dt / step + 1`
+    // coins are due. The loop is bounded by that even if `next_coin` was overdue.
     if (!state->next_coin)
-        state->next_coin = roll(rules.minutes_to_coin) * 60;
+        state->next_coin = roll_coin_interval(state);
     state->next_coin -= dt;
-    if (state->next_coin <= 0) {
+    const double max_coins = dt / simulation_step() + 1;
+    for (double coins = 0; state->next_coin <= 0 && coins < max_coins; ++coins) {
         state->money++;
-        state->next_coin = 0;
+        state->next_coin += roll_coin_interval(state);
     }
 
     // Food spoils
     for (uint32_t i = 0; i < state->num_scene_props; ++i) {
         struct scene_prop_t* p = state->scene_props + i;
         if (!p->lifetime)
-            p->lifetime = roll(rules.food_lifetime_minutes) * 60.0f;
-        p->lifetime -= dt;
+            p->lifetime = roll(state, rules.food_lifetime_minutes) * 60.0f;
+        p->lifetime -= (float)dt;
         if (p->lifetime <= 0)
-            state->scene_props[i--] = state->scene_props[--state->num_scene_props];
+            remove_scene_prop(state, i--);
     }
 
-    // Dinosaurs walk away
-    const struct dinosaur_t* dropping_dino = 0;
+    // Dinosaurs walk away and leave drops.
     for (uint32_t i = 0; i < state->num_scene_dinosaurs; ++i) {
         struct scene_dinosaur_t* d = state->scene_dinosaurs + i;
         if (!d->lifetime)
-            d->lifetime = roll(rules.dinosaur_lifetime_minutes) * 60.0f;
-        d->lifetime -= dt;
+            d->lifetime = roll(state, rules.dinosaur_lifetime_minutes) * 60.0f;
+        d->lifetime -= (float)dt;
         if (d->lifetime <= 0) {
-            dropping_dino = state->scene_dinosaurs[i].dinosaur;
-            state->scene_dinosaurs[i--] = state->scene_dinosaurs[--state->num_scene_dinosaurs];
+            const uint32_t dropping_dino = d->dinosaur;
+            remove_scene_dinosaur(state, i--);
+            award_drop(state, dropping_dino);
+        }
+    }
+
+    // Food attracts dinosaurs
+    for (uint32_t pi = 0; pi < state->num_scene_props && state->num_scene_dinosaurs < rules.max_scene_dinosaurs; ++pi) {
+        struct scene_prop_t* p = state->scene_props + pi;
+
+        // Only ICTYOSAURS can spawn in the lake. ICTYOSAURS cannot spawn on land.
+        const uint32_t key = props[p->prop].image * 2 + (p->region == REGION__LAKE);
+
+        for (uint32_t a = indices.attraction_first[key]; a < indices.attraction_first[key + 1]; ++a) {
+            const struct dinosaur_t* d = dinosaurs + indices.attraction[a];
+            // Spawns are a Poisson process, so this is the exact chance of a spawn during `dt`,
+            // for any `dt`.
+            const double spawn_chance = -expm1(-dt / 60 / d->minutes_to_spawn);
+            const bool spawn = roll(state, (struct range_t){ 0, 1 }) <= spawn_chance;
+            if (!spawn)
+                continue;
+
+            add_scene_dinosaur(state, (struct scene_dinosaur_t){ .dinosaur = indices.attraction[a], .x = p->x, .y = p->y, .flipped = tm_random_to_bool(random_next(&state->random)) });
+            remove_scene_prop(state, pi--);
             break;
         }
     }
+}
+
+// Processes the events in the event queue that are due by the simulated time `end_time` and
+// advances the simulated time to `end_time`. Builds the event queue first, if needed. Since the
+// events carry their own times, advancing to a time in one call or in several steps gives the same
+// result.
+static void run_events_until(tm_simulate_state_o* state, double end_time)
+{
+    if (!state->events_ready)
+        build_event_queue(state);
+
+    while (state->num_events && state->events[0].time <= end_time) {
+        const struct event_t e = state->events[0];
+        state->time = e.time;
+
+        switch (e.type) {
+        case EVENT__COIN: {
+            state->money++;
+            state->events[0].time = e.time + roll_coin_interval(state);
+            event_sift(state, 0);
+        } break;
+
+        case EVENT__PROP: {
+            const uint32_t i = handle_index(&state->prop_slots, e.handle);
+            struct scene_prop_t* p = state->scene_props + i;
+            if (p->attracts == NUM_DINOSAURS) {
+                remove_scene_prop(state, i);
+            } else if (state->num_scene_dinosaurs < rules.max_scene_dinosaurs) {
+                add_scene_dinosaur(state, (struct scene_dinosaur_t){ .dinosaur = p->attracts, .x = p->x, .y = p->y, .flipped = tm_random_to_bool(random_next(&state->random)) });
+                remove_scene_prop(state, i);
+            } else {
+                // No room for more dinosaurs. Spawns are memoryless, so we can just sample a new
+                // spawn time from now.
+                state->events[0] = prop_event(state, i);
+                event_sift(state, 0);
+            }
+        } break;
+
+        case EVENT__DINOSAUR: {
+            const uint32_t i = handle_index(&state->dinosaur_slots, e.handle);
+            const uint32_t dropping_dino = state->scene_dinosaurs[i].dinosaur;
+            remove_scene_dinosaur(state, i);
+            award_drop(state, dropping_dino);
+        } break;
+        }
+    }
+    state->time = end_time;
+}
+
+// Implements the game logic by processing the events in the event queue that are due. The cost
+// of a tick is proportional to the number of due events, rather than to the number of props and
+// dinosaurs in the scene.
+static void scheduled_game_logic(tm_simulate_state_o* state, double dt)
+{
+    run_events_until(state, state->time + dt);
+}
 
-    // Drops
-    if (dropping_dino) {
-        struct awarded_drop_t awarded_drop = { .dinosaur = dropping_dino };
+// If fewer coins than this are expected during a fast forward, the coin intervals are sampled one
+// by one. Otherwise the number of coins is sampled from its asymptotic distribution.
+enum { FAST_FORWARD_EXACT_COINS = 256 };
 
-        for (struct drop_t* drop = drops; drop != TM_ARRAY_END(drops); ++drop) {
-            if (dropping_dino->image != drop->dinosaur_image)
-                continue;
+// Most coins that [[fast_forward_coins]] returns for a single fast forward, so that the count fits
+// in the money counter even for absurd durations.
+#define MAX_FAST_FORWARD_COINS ((double)(UINT32_MAX - 1))
 
-            if (roll((struct range_t){ 0, 1 }) > drop->probability)
-                continue;
+// Time steps longer than this many seconds are handled by [[fast_forward]] in [[game_logic]].
+enum { FAST_FORWARD_MIN_SECONDS = 10 };
+
+// Samples a standard normally distributed value.
+static double roll_normal(tm_simulate_state_o* state)
+{
+    const double u1 = roll(state, (struct range_t){ 0, 1 });
+    const double u2 = roll(state, (struct range_t){ 0, 1 });
+    return sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * 3.14159265358979323846 * u2);
+}
+
+// Returns the number of coins received from the time `*next_coin` up to `end_time` and updates
+// `*next_coin` to the time of the first coin after `end_time`.
+//
+// The coins form a renewal process with intervals uniformly distributed in
+// `rules.minutes_to_coin`. For long durations, the number of renewals is asymptotically normal
+// with mean `t/mu` and variance `t * sigma^2 / mu^3` and the time to the next coin follows the
+// equilibrium residual distribution, so the cost is bounded regardless of the duration.
+static uint32_t fast_forward_coins(tm_simulate_state_o* state, double* next_coin, double end_time)
+{
+    if (*next_coin > end_time)
+        return 0;
 
-            const uint32_t quantity = (uint32_t)(roll(drop->quantity) + 0.5f);
-            awarded_drop.quantity[drop->drop_image] += quantity;
-            awarded_drop.total_items += quantity;
+    // Intervals are at least one step (see [[roll_coin_interval]]), so `mu` is positive. For
+    // intervals that straddle the step, the clamped part is treated as uniform too.
+    const double a = tm_max(rules.minutes_to_coin.min * 60, simulation_step());
+    const double b = tm_max(rules.minutes_to_coin.max * 60, a);
+    const double mu = (a + b) / 2;
+    const double span = end_time - *next_coin;
+
+    if (span / mu <= FAST_FORWARD_EXACT_COINS) {
+        uint32_t coins = 0;
+        while (*next_coin <= end_time) {
+            ++coins;
+            *next_coin += roll_coin_interval(state);
         }
+        return coins;
+    }
 
-        if (awarded_drop.total_items && state->num_awarded_drops < MAX_AWARDED_DROPS)
-            state->awarded_drops[state->num_awarded_drops++] = awarded_drop;
+    // Fixed intervals are deterministic.
+    if (b <= a) {
+        const double n = tm_min(floor(span / mu), MAX_FAST_FORWARD_COINS);
+        *next_coin += (n + 1) * mu;
+        return 1 + (uint32_t)n;
     }
 
-    // Food attracts dinosaurs
-    if (state->num_scene_dinosaurs < MAX_SCENE_DINOSAURS) {
-        for (uint32_t pi = 0; pi < state->num_scene_props; ++pi) {
-            struct scene_prop_t* p = state->scene_props + pi;
-            enum IMAGE food = p->prop->image;
-            const bool food_in_lake = in_lake(p->x, p->y);
-
-            for (struct dinosaur_t* d = dinosaurs; d != dinosaurs + NUM_DINOSAURS; ++d) {
-                if (d->attracted_by[0] != food)
-                    continue;
-
-                // Only ICTYOSAURS can spawn in the lake. ICTYOSAURS cannot spawn on land.
-                const bool is_ictyosaur = d->type == DINO_TYPE__ICTYOSAUR;
-                if (food_in_lake != is_ictyosaur)
-                    continue;
-
-                const double spawn_chance = dt / 60 / d->minutes_to_spawn;
-                const bool spawn = roll((struct range_t){ 0, 1 }) <= spawn_chance;
-                if (!spawn)
-                    continue;
-
-                const uint32_t dino_i = (uint32_t)(d - dinosaurs);
-                state->in_album[dino_i] = true;
-                const struct scene_dinosaur_t dino = { .dinosaur = d, .x = p->x, .y = p->y, .flipped = tm_random_to_bool(tm_random_api->next()) };
-                state->scene_dinosaurs[state->num_scene_dinosaurs++] = dino;
-                state->scene_props[pi--] = state->scene_props[--state->num_scene_props];
-                break;
-            }
-        }
+    const double variance = (b - a) * (b - a) / 12;
+    const double n = floor(span / mu + sqrt(span * variance / (mu * mu * mu)) * roll_normal(state) + 0.5);
+
+    // The equilibrium residual has density `(1 - F(x)) / mu`. For uniform intervals on `[a, b]`
+    // that is uniform on `[0, a]` (with probability `a / mu`) followed by a linearly decreasing
+    // ramp on `[a, b]`.
+    const double u = roll(state, (struct range_t){ 0, 1 });
+    const double residual = u < a / mu ? roll(state, (struct range_t){ 0, a }) : b - (b - a) * sqrt(roll(state, (struct range_t){ 0, 1 }));
+    *next_coin = end_time + residual;
+    return 1 + (uint32_t)tm_clamp(n, 0, MAX_FAST_FORWARD_COINS);
+}
+
+// Advances the game state by `seconds` of simulated time, for example to catch up on the time the
+// player was away. The result is statistically equivalent to calling [[game_logic]] with small
+// time steps, but the cost is bounded regardless of the duration:
+//
+// * Coins are handled in closed form by [[fast_forward_coins]].
+// * All other events come from props and dinosaurs. No new props are placed during the fast
+//   forward and props and dinosaurs have bounded lifetimes, so the number of these events is
+//   bounded too.
+static void fast_forward(tm_simulate_state_o* state, double seconds)
+{
+    const bool was_ready = state->events_ready;
+    if (!was_ready)
+        build_event_queue(state);
+
+    const double end_time = state->time + seconds;
+    double next_coin = state->events[state->coin_event].time;
+    event_remove(state, state->coin_event);
+    state->money += fast_forward_coins(state, &next_coin, end_time);
+
+    scheduled_game_logic(state, seconds);
+    event_push(state, (struct event_t){ .time = next_coin, .type = EVENT__COIN });
+
+    if (!was_ready)
+        flush_event_queue(state);
+}
+
+// Implements the game logic.
+//
+// Depending on `rules.event_queue`, this either processes the events that are due in the event
+// queue ([[scheduled_game_logic]]) or polls every prop and dinosaur ([[polled_game_logic]]).
+// Long time steps, such as after the machine has been asleep, are handled by [[fast_forward]].
+static void game_logic(tm_simulate_state_o* state, double dt)
+{
+    // Time doesn't pass in award screen.
+    if (state->state == STATE__AWARD)
+        dt = 0;
+
+    if (dt > FAST_FORWARD_MIN_SECONDS)
+        fast_forward(state, dt);
+    else if (rules.event_queue)
+        scheduled_game_logic(state, dt);
+    else
+        polled_game_logic(state, dt);
+}
+
+// Most simulation steps that [[step_game]] runs one by one in a frame. If more are due (after a long
+// stall), they are run as a single step, which is also exact since [[game_logic]] handles any `dt`.
+enum { MAX_STEPS_PER_FRAME = 64 };
+
+// Advances the game by the real time `dt` in fixed steps of `1 / rules.simulation_hz` seconds,
+// carrying the remainder over to the next call in `state->step_time`. Each step rolls its own
+// speed multiplier. Returns the number of steps that were run.
+static uint32_t step_game(tm_simulate_state_o* state, double dt)
+{
+    const double step = simulation_step();
+    state->step_time += dt;
+    const uint32_t steps = (uint32_t)floor(state->step_time / step);
+    state->step_time -= steps * step;
+
+    if (steps > MAX_STEPS_PER_FRAME)
+        game_logic(state, steps * step * roll(state, rules.speed_multiplier));
+    else {
+        for (uint32_t i = 0; i < steps; ++i)
+            game_logic(state, step * roll(state, rules.speed_multiplier));
     }
+    return steps;
 }
 
 // Draws the scene -- the background layers and the placed props.
@@ -845,66 +4345,51 @@ static void scene(tm_simulate_state_o* state, tm_simulate_frame_args_t* args)
         background_r.x = -state->scroll;
     }
 
-    uint32_t num_scene_props = state->num_scene_props;
+    // Prop being placed, drawn at the mouse position until it is placed.
+    struct scene_prop_t placing;
+    const struct scene_prop_t* preview = NULL;
     if (state->state == STATE__PLACING) {
-        const float scene_rel_mouse_x = (uib.input->mouse_pos.x - background_r.x) / background_r.w;
-        const float scene_rel_mouse_y = (uib.input->mouse_pos.y - background_r.y) / background_r.h;
+        const float scene_rel_mouse_x = (state->input.mouse_pos.x - background_r.x) / background_r.w;
+        const float scene_rel_mouse_y = (state->input.mouse_pos.y - background_r.y) / background_r.h;
 
-        const bool is_in_scene = tm_is_between(scene_rel_mouse_x, 0, 1) && tm_is_between(scene_rel_mouse_y, 0.35, 1);
-        const bool can_place = is_in_scene;
+        const bool is_in_scene = tm_is_between(scene_rel_mouse_x, 0, 1) && tm_is_between(scene_rel_mouse_y, 0, 1);
+        const enum REGION region = region_at(scene_rel_mouse_x, scene_rel_mouse_y);
+        const bool can_place = is_in_scene && region != REGION__OFF_LIMITS;
 
         if (can_place) {
-            state->scene_props[num_scene_props] = (struct scene_prop_t){
+            placing = (struct scene_prop_t){
                 .x = scene_rel_mouse_x,
                 .y = scene_rel_mouse_y,
-                .prop = props + state->place_prop,
+                .prop = (uint16_t)state->place_prop,
+                .region = region,
             };
-            if (uib.input->left_mouse_pressed) {
-                ++state->num_scene_props;
-                while (state->num_scene_props > MAX_SCENE_PROPS) {
-                    memmove(state->scene_props, state->scene_props + 1, MAX_SCENE_PROPS * sizeof(struct scene_prop_t));
-                    state->num_scene_props--;
-                }
-                --state->inventory[state->place_prop];
+            if (state->input.left_mouse_pressed) {
+                add_scene_prop(state, placing);
+                set_inventory(state, state->place_prop, state->inventory[state->place_prop] - 1);
                 if (state->inventory[state->place_prop] == 0)
                     state->state = STATE__MAIN;
+            } else {
+                preview = &placing;
             }
-            ++num_scene_props;
         }
     }
 
     // Draw
-    {
-        TM_INIT_TEMP_ALLOCATOR(ta);
-
-        // Collect draw calls.
-        struct draw_item_t* draw = 0;
-        tm_carray_temp_push(draw, ((struct draw_item_t){ .image = BACKGROUND_LAYER_0, .y = 0, .rect = background_r }), ta);
-        tm_carray_temp_push(draw, ((struct draw_item_t){ .image = BACKGROUND_LAYER_1, .y = 0.45f, .rect = background_r }), ta);
-        tm_carray_temp_push(draw, ((struct draw_item_t){ .image = BACKGROUND_LAYER_2, .y = 0.52f, .rect = background_r }), ta);
-        tm_carray_temp_push(draw, ((struct draw_item_t){ .image = BACKGROUND_LAYER_3, .y = 0.82f, .rect = background_r }), ta);
-        tm_carray_temp_push(draw, ((struct draw_item_t){ .image = BACKGROUND_LAYER_4, .y = 1, .rect = background_r }), ta);
-        draw_scene_props(background_r, state->scene_props, num_scene_props, &draw, ta);
-        draw_scene_dinosaurs(background_r, state->scene_dinosaurs, state->num_scene_dinosaurs, &draw, ta);
-
-        // Sort them.
-        qsort(draw, tm_carray_size(draw), sizeof(*draw), compare_float);
-
-        // Draw them
-        for (struct draw_item_t* d = draw; d != tm_carray_end(draw); ++d) {
-            if (d->image) {
-                const tm_rect_t uv = d->uv_rect.x == 0 && d->uv_rect.y == 0 && d->uv_rect.w == 0 && d->uv_rect.h == 0 ? (tm_rect_t){ 0, 0, 1, 1 } : d->uv_rect;
-                tm_draw2d_api->textured_rect(uib.vbuffer, *uib.ibuffers, style, d->rect, state->images[d->image], uv);
-            } else {
-                tm_draw2d_style_t rstyle = *style;
-                rstyle.color = HEXCOLOR(0xffff00);
-                tm_draw2d_api->fill_rect(uib.vbuffer, *uib.ibuffers, &rstyle, d->rect);
-            }
+    const struct scene_cache_t* cache = &state->scene_cache;
+    if (!cache->valid || cache->version != state->scene_version || cache->width != background_r.w || cache->height != background_r.h) {
+        PROFILE_BEGIN(PROFILE_SCOPE__SCENE_CACHE);
+        if (!state->depth.ready) {
+            PROFILE_BEGIN(PROFILE_SCOPE__DEPTH_SORT);
+            rebuild_depth_list(state);
+            PROFILE_END(PROFILE_SCOPE__DEPTH_SORT);
         }
-        TM_SHUTDOWN_TEMP_ALLOCATOR(ta);
+        build_scene_cache(state, background_r.w, background_r.h);
+        PROFILE_END(PROFILE_SCOPE__SCENE_CACHE);
     }
+    cull_scene_cache(state, background_r, args->rect);
+    draw_scene_cache(state, &uib, style, background_r, preview);
 
-    const float rel_mouse_x = tm_clamp((uib.input->mouse_pos.x - args->rect.x) / args->rect.w, 0, 1);
+    const float rel_mouse_x = tm_clamp((state->input.mouse_pos.x - args->rect.x) / args->rect.w, 0, 1);
     if (rel_mouse_x < 0.25f) {
         const float edge_proximity = (0.25f - rel_mouse_x) / 0.25f;
         state->scroll -= args->dt * 2000 * edge_proximity;
@@ -916,13 +4401,63 @@ static void scene(tm_simulate_state_o* state, tm_simulate_frame_args_t* args)
     // Enable this to print mouse relative coordinates for testing.
     bool show_mouse_coordinates = false;
     if (show_mouse_coordinates) {
-        const float scene_rel_mouse_x = (uib.input->mouse_pos.x - background_r.x) / background_r.w;
-        const float scene_rel_mouse_y = (uib.input->mouse_pos.y - background_r.y) / background_r.h;
+        const float scene_rel_mouse_x = (state->input.mouse_pos.x - background_r.x) / background_r.w;
+        const float scene_rel_mouse_y = (state->input.mouse_pos.y - background_r.y) / background_r.h;
         char coords_str[128];
         sprintf(coords_str, "(%.2f, %.2f)", scene_rel_mouse_x, scene_rel_mouse_y);
-        const tm_rect_t coords_r = { uib.input->mouse_pos.x, uib.input->mouse_pos.y, 32, 32 };
+        const tm_rect_t coords_r = { state->input.mouse_pos.x, state->input.mouse_pos.y, 32, 32 };
         tm_ui_api->text(args->ui, args->uistyle, &(tm_ui_text_t){ .rect = coords_r, .text = coords_str, .color = &HEXCOLOR(0xff0000) });
     }
+
+    // Enable this to print the number of scene items drawn and culled for testing.
+    bool show_scene_culling = false;
+    if (show_scene_culling) {
+        char culling_str[128];
+        sprintf(culling_str, "%u drawn, %u culled", cache->num_drawn, cache->num_culled);
+        const tm_rect_t culling_r = { args->rect.x, args->rect.y + 32, 256, 32 };
+        tm_ui_api->text(args->ui, args->uistyle, &(tm_ui_text_t){ .rect = culling_r, .text = culling_str, .color = &HEXCOLOR(0xff0000) });
+    }
+
+    // Enable this to print the image residency for testing.
+    bool show_image_residency = false;
+    if (show_image_residency) {
+        const struct image_loader_t* loader = state->image_loader;
+        char residency_str[128];
+        sprintf(residency_str, "%u images, %.1f / %.0f MB, %u loading", loader->num_resident,
+            (double)loader->resident_bytes / (1024 * 1024), rules.image_budget_mb, loader->num_loading);
+        const tm_rect_t residency_r = { args->rect.x, args->rect.y, 256, 32 };
+        tm_ui_api->text(args->ui, args->uistyle, &(tm_ui_text_t){ .rect = residency_r, .text = residency_str, .color = &HEXCOLOR(0xff0000) });
+    }
+}
+
+// Pairs of decimal digits, `00` to `99`. See [[format_uint]].
+static const char decimal_pairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                    "8081828384858687888990919293949596979899";
+
+// Writes `value` in decimal to `s`, which must have room for [[UINT_STRING_SIZE]] characters, and
+// returns the length. Used for the numbers in the menus instead of `sprintf()`, since it doesn't
+// parse a format string and writes two digits per division.
+static uint32_t format_uint(char* s, uint32_t value)
+{
+    char digits[UINT_STRING_SIZE];
+    char* p = digits + sizeof(digits);
+    while (value >= 100) {
+        const uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        *--p = decimal_pairs[pair + 1];
+        *--p = decimal_pairs[pair];
+    }
+    if (value >= 10) {
+        *--p = decimal_pairs[value * 2 + 1];
+        *--p = decimal_pairs[value * 2];
+    } else {
+        *--p = (char)('0' + value);
+    }
+    const uint32_t n = (uint32_t)(digits + sizeof(digits) - p);
+    memcpy(s, p, n);
+    s[n] = 0;
+    return n;
 }
 
 // Draws the money counter.
@@ -933,31 +4468,39 @@ static void money(tm_simulate_state_o* state, tm_simulate_frame_args_t* args)
     tm_ui_api->to_draw_style(args->ui, style, args->uistyle);
     style->color = (tm_color_srgb_t){ .r = 255, .g = 255, .b = 255, .a = 255 };
     style->include_alpha = true;
-    const float unit = tm_min(args->rect.w, args->rect.h);
-
-    const float icon_size = 0.08f * unit;
-    const float font_scale = icon_size / 18.0f;
-
-    const tm_rect_t inset_r = tm_rect_inset(args->rect, 5, 5);
-    const tm_rect_t money_symbol_r = tm_rect_split_bottom(tm_rect_split_left(inset_r, icon_size, 0, 0), icon_size, 0, 1);
-    const tm_rect_t money_amount_r = { .x = tm_rect_right(money_symbol_r) + 10, .y = money_symbol_r.y - 2, .w = args->rect.w, .h = icon_size };
     tm_ui_style_t uistyle[1] = { *args->uistyle };
-    uistyle->font_scale = font_scale;
-    char money_str[64];
-    sprintf(money_str, "%d", state->money);
-    const tm_rect_t metrics_r = tm_ui_api->text_metrics(uistyle, money_str);
-    const tm_rect_t draw_r = { .y = money_symbol_r.y, .w = money_amount_r.x + metrics_r.w, .h = args->rect.h - money_symbol_r.y };
-    const tm_rect_t background_r = tm_rect_inset(draw_r, -5, -5);
-
-    tm_draw2d_api->fill_rect(uib.vbuffer, *uib.ibuffers, style, background_r);
-    tm_draw2d_api->textured_rect(uib.vbuffer, *uib.ibuffers, style, money_symbol_r, state->images[BONE], (tm_rect_t){ 0, 0, 1, 1 });
+
+    struct money_layout_t* l = &state->money_layout;
+    if (!l->valid || l->money != state->money || memcmp(&l->rect, &args->rect, sizeof(l->rect))) {
+        l->valid = true;
+        l->money = state->money;
+        l->rect = args->rect;
+
+        const float unit = tm_min(args->rect.w, args->rect.h);
+        const float icon_size = 0.08f * unit;
+        l->font_scale = icon_size / 18.0f;
+
+        const tm_rect_t inset_r = tm_rect_inset(args->rect, 5, 5);
+        l->symbol_r = tm_rect_split_bottom(tm_rect_split_left(inset_r, icon_size, 0, 0), icon_size, 0, 1);
+        l->amount_r = (tm_rect_t){ .x = tm_rect_right(l->symbol_r) + 10, .y = l->symbol_r.y - 2, .w = args->rect.w, .h = icon_size };
+        format_uint(l->money_str, state->money);
+        uistyle->font_scale = l->font_scale;
+        const tm_rect_t metrics_r = tm_ui_api->text_metrics(uistyle, l->money_str);
+        const tm_rect_t draw_r = { .y = l->symbol_r.y, .w = l->amount_r.x + metrics_r.w, .h = args->rect.h - l->symbol_r.y };
+        l->background_r = tm_rect_inset(draw_r, -5, -5);
+    }
+    uistyle->font_scale = l->font_scale;
+
+    tm_draw2d_api->fill_rect(uib.vbuffer, *uib.ibuffers, style, l->background_r);
+    draw_image(state, &uib, style, l->symbol_r, BONE, (tm_rect_t){ 0, 0, 1, 1 });
     style->color = (tm_color_srgb_t){ .a = 255 };
-    tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = money_amount_r, .text = money_str, .color = &style->color });
+    tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = l->amount_r, .text = l->money_str, .color = &style->color });
 }
 
-// Draws a button using the image specified by `image_idx`. Returns `true` if the button was
-// clicked.
-static bool button(tm_simulate_state_o* state, tm_simulate_frame_args_t* args, tm_rect_t r, const uint32_t image_idx)
+// Draws a button using the image specified by `image_idx`, which is hovered if `hovered` is true
+// and the UI lets the game be hovered. Returns `true` if the button was clicked. Used by grids that
+// find the hovered button themselves, see [[menu_hover_cell]].
+static bool hover_button(tm_simulate_state_o* state, tm_simulate_frame_args_t* args, tm_rect_t r, const uint32_t image_idx, bool hovered)
 {
     const uint64_t id = tm_ui_api->make_id(args->ui);
     tm_ui_buffers_t uib = tm_ui_api->buffers(args->ui);
@@ -966,12 +4509,19 @@ static bool button(tm_simulate_state_o* state, tm_simulate_frame_args_t* args, t
     style->color = (tm_color_srgb_t){ .r = 255, .g = 255, .b = 255, .a = 255 };
     style->include_alpha = true;
 
-    tm_draw2d_api->textured_rect(uib.vbuffer, *uib.ibuffers, style, r, state->images[image_idx], (tm_rect_t){ 0, 0, 1, 1 });
+    draw_image(state, &uib, style, r, image_idx, (tm_rect_t){ 0, 0, 1, 1 });
 
-    if (tm_ui_api->is_hovering(args->ui, r, 0))
+    if (state->input.hover && hovered)
         uib.activation->next_hover = id;
 
-    return (uib.activation->hover == id && uib.input->left_mouse_pressed);
+    return (uib.activation->hover == id && state->input.left_mouse_pressed);
+}
+
+// Draws a button using the image specified by `image_idx`. Returns `true` if the button was
+// clicked.
+static bool button(tm_simulate_state_o* state, tm_simulate_frame_args_t* args, tm_rect_t r, const uint32_t image_idx)
+{
+    return hover_button(state, args, r, image_idx, tm_rect_contains_point(r, state->input.mouse_pos));
 }
 
 // Draws a disabled (not clickable) button.
@@ -984,39 +4534,205 @@ static void disabled_button(tm_simulate_state_o* state, tm_simulate_frame_args_t
     style->color = (tm_color_srgb_t){ .r = 255, .g = 255, .b = 255, .a = 64 };
     style->include_alpha = true;
 
-    tm_draw2d_api->textured_rect(uib.vbuffer, *uib.ibuffers, style, r, state->images[image_idx], (tm_rect_t){ 0, 0, 1, 1 });
+    draw_image(state, &uib, style, r, image_idx, (tm_rect_t){ 0, 0, 1, 1 });
 }
 
 // Returns the name of the gift (Prop or Memento) with the specified image.
 static const char* gift_name(enum IMAGE image)
 {
-    for (struct prop_t* p = props; p != TM_ARRAY_END(props); ++p) {
-        if (p->image == image)
-            return p->name;
-    }
-
-    for (struct memento_t* m = mementos; m != TM_ARRAY_END(mementos); ++m) {
-        if (m->image == image)
-            return m->name;
+    const struct image_item_t item = indices.items[image];
+    switch (item.kind) {
+    case ITEM_KIND__PROP:
+        return props[item.index].name;
+    case ITEM_KIND__MEMENTO:
+        return mementos[item.index].name;
+    default:
+        return "Unknown";
     }
-
-    return "Unknown";
 }
 
 // Adds the specified gift (Prop or Memento) to the player's inventory.
 static void claim_gift(tm_simulate_state_o* state, enum IMAGE image, uint32_t quantity)
 {
-    for (struct prop_t* p = props; p != TM_ARRAY_END(props); ++p) {
-        if (p->image == image)
-            state->inventory[p - props] += quantity;
+    const struct image_item_t item = indices.items[image];
+    if (item.kind == ITEM_KIND__PROP)
+        set_inventory(state, item.index, state->inventory[item.index] + quantity);
+    else if (item.kind == ITEM_KIND__MEMENTO)
+        set_mementos(state, item.index, state->mementos[item.index] + quantity);
+}
+
+// Returns `true` if `state->menu_layout` was built for the current screen, page and viewport and
+// for what the screens show.
+static bool menu_layout_valid(tm_simulate_state_o* state, const tm_simulate_frame_args_t* args)
+{
+    const struct menu_layout_t* l = &state->menu_layout;
+    if (!l->valid || l->screen != state->state || l->page != state->page || l->money != state->money || l->items_version != state->items_version)
+        return false;
+    if (memcmp(&l->rect, &args->rect, sizeof(l->rect)) || l->font_scale != args->uistyle->font_scale)
+        return false;
+    const struct awarded_drop_t award = state->num_awarded_drops ? *unclaimed_drop(state, 0) : (struct awarded_drop_t){ 0 };
+    return !memcmp(&l->award, &award, sizeof(award));
+}
+
+// Lays out `cell` in `grid_r`, the rect of its grid cell, for the current screen. Screens with
+// numbers split a number row and a name row off the bottom of the cell, the album only a name row.
+static void layout_menu_cell(struct menu_cell_t* cell, tm_rect_t grid_r, enum STATE screen, float unit)
+{
+    tm_rect_t icon_r = grid_r;
+    if (screen != STATE__ALBUM)
+        cell->number_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
+    cell->desc_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
+    cell->icon_r = tm_rect_center_in(icon_r.h, icon_r.h, icon_r);
+    if (screen != STATE__ALBUM && screen != STATE__AWARD)
+        cell->number_r = tm_rect_center_in(cell->icon_r.w, cell->number_r.h, cell->number_r);
+    if (screen == STATE__SHOP || screen == STATE__MEMENTOS)
+        cell->bone_r = tm_rect_split_off_left(&cell->number_r, cell->number_r.h, 0.01f * unit);
+}
+
+// Returns the image of the item with index `idx` in the table of the screen of `l`. See
+// [[menu_cell_t]].
+static uint32_t menu_item_image(const struct menu_layout_t* l, uint32_t idx)
+{
+    switch (l->screen) {
+    case STATE__INVENTORY:
+    case STATE__SHOP:
+        return props[idx].image;
+    case STATE__ALBUM:
+        return dinosaurs[idx].image;
+    case STATE__MEMENTOS:
+        return mementos[idx].image;
+    default:
+        return l->award.items[idx].image;
+    }
+}
+
+// Builds `state->menu_layout` for the current screen, page and viewport. Clamps `state->page` to
+// the pages of the screen.
+static void build_menu_layout(tm_simulate_state_o* state, const tm_simulate_frame_args_t* args)
+{
+    struct menu_layout_t* l = &state->menu_layout;
+    *l = (struct menu_layout_t){
+        .valid = true,
+        .screen = state->state,
+        .rect = args->rect,
+        .font_scale = args->uistyle->font_scale,
+        .money = state->money,
+        .items_version = state->items_version,
+    };
+    if (state->num_awarded_drops)
+        l->award = *unclaimed_drop(state, 0);
+
+    const float unit = tm_min(args->rect.w, args->rect.h);
+    const float icon_size = 0.15f * unit;
+    const tm_rect_t inset_r = tm_rect_inset(args->rect, 5, 5);
+    l->menu_icon_r = tm_rect_split_top(tm_rect_split_left(inset_r, icon_size, 0, 0), icon_size, 0, 0);
+    l->menu_r = tm_rect_center_in(0.8f * unit, 0.8f * unit, args->rect);
+    l->close_r = tm_rect_center_in(0.1f * unit, 0.1f * unit, (tm_rect_t){ l->menu_r.x + 0.02f * unit, l->menu_r.y + 0.02f * unit });
+    const tm_rect_t left_edge_r = tm_rect_split_left(l->menu_r, 0.05f * unit, 0, 0);
+    l->left_button_r = tm_rect_center_in(unit * 0.15f, unit * 0.15f, left_edge_r);
+    const tm_rect_t right_edge_r = tm_rect_split_right(l->menu_r, 0.05f * unit, 0, 1);
+    l->right_button_r = tm_rect_center_in(unit * 0.15f, unit * 0.15f, right_edge_r);
+    l->grid_r = tm_rect_inset(l->menu_r, 0.05f * unit, 0.05f * unit);
+
+    if (l->screen == STATE__MENU) {
+        const uint32_t buttons[][2] = {
+            { STATE__INVENTORY, INVENTORY },
+            { STATE__SHOP, SHOP },
+            { STATE__ALBUM, ALBUM },
+            { STATE__MEMENTOS, MEMENTOS },
+        };
+        l->grid_gap = 0.04f * unit;
+        for (uint32_t i = 0; i < TM_ARRAY_COUNT(buttons); ++i) {
+            struct menu_cell_t* cell = l->cells + l->num_cells++;
+            const tm_rect_t row_r = tm_rect_divide_y(l->grid_r, l->grid_gap, 3, i / 3);
+            cell->icon_r = tm_rect_divide_x(row_r, l->grid_gap, 3, i % 3);
+            cell->item = buttons[i][0];
+            cell->image = buttons[i][1];
+        }
+        l->page = state->page;
+        return;
+    }
+
+    // Items of the screen, in the order they are shown. The shop shows all props, the other
+    // screens slice their lists, so that a page costs the same regardless of the table sizes.
+    const uint16_t* list = 0;
+    uint32_t num_items = 0;
+    if (l->screen == STATE__INVENTORY) {
+        list = state->owned_props;
+        num_items = state->num_owned_props;
+    } else if (l->screen == STATE__SHOP) {
+        num_items = NUM_PROPS;
+    } else if (l->screen == STATE__ALBUM) {
+        list = state->album_dinosaurs;
+        num_items = state->num_album_dinosaurs;
+    } else if (l->screen == STATE__AWARD && state->num_awarded_drops) {
+        l->title_r = tm_rect_split_off_top(&l->grid_r, 0.03f * unit, 0.01f * unit);
+        const char* name = dinosaurs[l->award.dinosaur].name;
+        const uint32_t name_len = (uint32_t)strnlen(name, NAME_SIZE);
+        memcpy(l->title, name, name_len);
+        memcpy(l->title + name_len, " left you a gift", sizeof(" left you a gift"));
+        num_items = l->award.num_items;
+    } else if (l->screen == STATE__MEMENTOS) {
+        list = state->owned_mementos;
+        num_items = state->num_owned_mementos;
     }
 
-    for (struct memento_t* m = mementos; m != TM_ARRAY_END(mementos); ++m) {
-        if (m->image == image)
-            state->mementos[m - mementos] += quantity;
+    l->grid_gap = 0.01f * unit;
+    l->num_pages = (num_items + MENU_PAGE_ITEMS - 1) / MENU_PAGE_ITEMS;
+    if (l->num_pages)
+        state->page = tm_min(state->page, l->num_pages - 1);
+    l->page = state->page;
+
+    // Only the current page and the pages next to it, whose images are prefetched, are visited.
+    const uint32_t first = l->page ? (l->page - 1) * MENU_PAGE_ITEMS : 0;
+    const uint32_t end = tm_min((l->page + 2) * MENU_PAGE_ITEMS, num_items);
+    for (uint32_t i = first; i < end; ++i) {
+        const uint32_t idx = list ? list[i] : i;
+        const uint32_t image = menu_item_image(l, idx);
+        if (i / MENU_PAGE_ITEMS != l->page) {
+            l->prefetch[l->num_prefetch++] = (uint16_t)image;
+            continue;
+        }
+
+        struct menu_cell_t* cell = l->cells + l->num_cells++;
+        cell->item = idx;
+        cell->image = image;
+        cell->enabled = true;
+        const tm_rect_t row_r = tm_rect_divide_y(l->grid_r, l->grid_gap, 3, (i % MENU_PAGE_ITEMS) / 3);
+        layout_menu_cell(cell, tm_rect_divide_x(row_r, l->grid_gap, 3, i % 3), l->screen, unit);
+        l->cell_font_scale = cell->desc_r.h / 18.0f;
+
+        if (l->screen == STATE__INVENTORY) {
+            format_uint(cell->count_str, state->inventory[idx]);
+        } else if (l->screen == STATE__SHOP) {
+            cell->enabled = state->money >= props[idx].price;
+            format_uint(cell->value_str, props[idx].price);
+            format_uint(cell->count_str, state->inventory[idx]);
+        } else if (l->screen == STATE__AWARD) {
+            format_uint(cell->count_str, l->award.items[idx].quantity);
+        } else if (l->screen == STATE__MEMENTOS) {
+            format_uint(cell->value_str, mementos[idx].sell_value);
+            format_uint(cell->count_str, state->mementos[idx]);
+        }
     }
 }
 
+// Returns the index in the cells of `l` of the cell whose button contains `pos`, or `UINT32_MAX`.
+// The cell is found from the position in the grid, rather than by testing every button.
+static uint32_t menu_hover_cell(const struct menu_layout_t* l, tm_vec2_t pos)
+{
+    const float cell_w = (l->grid_r.w - 2 * l->grid_gap) / 3;
+    const float cell_h = (l->grid_r.h - 2 * l->grid_gap) / 3;
+    const float x = (pos.x - l->grid_r.x) / (cell_w + l->grid_gap);
+    const float y = (pos.y - l->grid_r.y) / (cell_h + l->grid_gap);
+    if (!(x >= 0 && x < 3 && y >= 0 && y < 3))
+        return UINT32_MAX;
+    const uint32_t i = (uint32_t)y * 3 + (uint32_t)x;
+    if (i >= l->num_cells || !tm_rect_contains_point(l->cells[i].icon_r, pos))
+        return UINT32_MAX;
+    return i;
+}
+
 // Draws the menu screens.
 static void menu(tm_simulate_state_o* state, tm_simulate_frame_args_t* args)
 {
@@ -1025,348 +4741,1056 @@ static void menu(tm_simulate_state_o* state, tm_simulate_frame_args_t* args)
     tm_ui_api->to_draw_style(args->ui, style, args->uistyle);
     style->color = (tm_color_srgb_t){ .r = 255, .g = 255, .b = 255, .a = 255 };
     style->include_alpha = true;
-    const float unit = tm_min(args->rect.w, args->rect.h);
 
-    const float icon_size = 0.15f * unit;
-    const tm_rect_t inset_r = tm_rect_inset(args->rect, 5, 5);
-    const tm_rect_t menu_icon_r = tm_rect_split_top(tm_rect_split_left(inset_r, icon_size, 0, 0), icon_size, 0, 0);
-
-    tm_rect_t rect = args->rect;
+    if (!menu_layout_valid(state, args))
+        build_menu_layout(state, args);
+    const struct menu_layout_t* l = &state->menu_layout;
 
     // Click on menu button.
     if (state->state == STATE__MAIN || state->state == STATE__PLACING) {
         if (state->num_awarded_drops)
             state->state = STATE__AWARD;
 
-        if (button(state, args, menu_icon_r, MENU))
+        if (button(state, args, l->menu_icon_r, MENU))
             state->state = STATE__MENU;
         return;
     }
 
-    if (state->state != STATE__AWARD && button(state, args, menu_icon_r, CLOSE))
+    if (state->state != STATE__AWARD && button(state, args, l->menu_icon_r, CLOSE))
         state->state = STATE__MAIN;
 
-    const tm_rect_t menu_r = tm_rect_center_in(0.8f * unit, 0.8f * unit, args->rect);
-    const tm_rect_t close_r = tm_rect_center_in(0.1f * unit, 0.1f * unit, (tm_rect_t){ menu_r.x + 0.02f * unit, menu_r.y + 0.02f * unit });
-
-    tm_draw2d_api->textured_rect(uib.vbuffer, *uib.ibuffers, style, menu_r, state->images[MENU_BACKGROUND], (tm_rect_t){ 0, 0, 1, 1 });
+    draw_image(state, &uib, style, l->menu_r, MENU_BACKGROUND, (tm_rect_t){ 0, 0, 1, 1 });
 
-    if (state->state != STATE__AWARD && button(state, args, close_r, state->state == STATE__MENU ? CLOSE : BACK))
+    if (state->state != STATE__AWARD && button(state, args, l->close_r, state->state == STATE__MENU ? CLOSE : BACK))
         state->state = state->state == STATE__MENU ? STATE__MAIN : STATE__MENU;
-    const tm_rect_t menu_inset_r = tm_rect_inset(menu_r, 0.05f * unit, 0.05f * unit);
-    rect = menu_inset_r;
+
+    // The buttons above may have switched to another screen, which is drawn in this frame.
+    if (!menu_layout_valid(state, args))
+        build_menu_layout(state, args);
 
     tm_draw2d_style_t highlight = *style;
     highlight.color = HEXCOLOR(0xffff00);
 
     // Use this to highlight parts of the UI to examine the layout.
-    // tm_draw2d_api->fill_rect(uib.vbuffer, *uib.ibuffers, &highlight, price_r);
-
-    // Number of pages in this menu screen.
-    uint32_t num_pages = 0;
-
-    if (state->state == STATE__MENU) {
-        for (uint32_t idx = 0; idx < 9; ++idx) {
-            const uint32_t x = idx % 3;
-            const uint32_t y = idx / 3;
-            const tm_rect_t row_r = tm_rect_divide_y(rect, 0.04f * unit, 3, y);
-            const tm_rect_t icon_r = tm_rect_divide_x(row_r, 0.04f * unit, 3, x);
-            switch (idx) {
-            case 0:
-                if (button(state, args, icon_r, INVENTORY)) {
-                    state->state = STATE__INVENTORY;
-                    state->page = 0;
-                }
-                break;
-            case 1:
-                if (button(state, args, icon_r, SHOP)) {
-                    state->state = STATE__SHOP;
-                    state->page = 0;
-                }
-                break;
-            case 2:
-                if (button(state, args, icon_r, ALBUM)) {
-                    state->state = STATE__ALBUM;
-                    state->page = 0;
-                }
-                break;
-
-            case 3:
-                if (button(state, args, icon_r, MEMENTOS)) {
-                    state->state = STATE__MEMENTOS;
-                    state->page = 0;
-                }
-                break;
+    // tm_draw2d_api->fill_rect(uib.vbuffer, *uib.ibuffers, &highlight, l->cells[0].number_r);
+
+    tm_ui_style_t uistyle[1] = { *args->uistyle };
+    const uint32_t hovered = menu_hover_cell(l, state->input.mouse_pos);
+    for (uint32_t i = 0; i < l->num_prefetch; ++i)
+        prefetch_grid_image(state, l->prefetch[i]);
+
+    if (l->screen == STATE__MENU) {
+        for (uint32_t i = 0; i < l->num_cells; ++i) {
+            const struct menu_cell_t* cell = l->cells + i;
+            if (hover_button(state, args, cell->icon_r, cell->image, i == hovered)) {
+                state->state = cell->item;
+                state->page = 0;
             }
         }
-    } else if (state->state == STATE__INVENTORY) {
-        tm_ui_style_t uistyle[1] = { *args->uistyle };
+    } else if (l->screen == STATE__INVENTORY) {
+        const tm_color_srgb_t text_color = { .a = 255 };
+        uistyle->font_scale = l->cell_font_scale;
+        for (uint32_t i = 0; i < l->num_cells; ++i) {
+            const struct menu_cell_t* cell = l->cells + i;
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->desc_r, .text = props[cell->item].name, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->number_r, .text = cell->count_str, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
 
-        uint32_t idx = 0;
-        for (uint32_t i = 0;; ++i, ++idx) {
-            const uint32_t page = i / 9;
-            const uint32_t x = i % 3;
-            const uint32_t y = (i % 9) / 3;
+            if (hover_button(state, args, cell->icon_r, cell->image, i == hovered)) {
+                state->state = STATE__PLACING;
+                state->place_prop = cell->item;
+            }
+        }
+    } else if (l->screen == STATE__SHOP) {
+        uistyle->font_scale = l->cell_font_scale;
+        for (uint32_t i = 0; i < l->num_cells; ++i) {
+            const struct menu_cell_t* cell = l->cells + i;
+            const uint32_t idx = cell->item;
 
-            while (idx < NUM_PROPS && state->inventory[idx] == 0)
-                ++idx;
-            if (idx >= NUM_PROPS)
-                break;
+            const tm_color_srgb_t text_color = { .a = cell->enabled ? 255 : 64 };
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->desc_r, .text = props[idx].name, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
 
-            num_pages = page + 1;
+            style->color = (tm_color_srgb_t){ .a = cell->enabled ? 255 : 64, .r = 255, .g = 255, .b = 255 };
+            draw_image(state, &uib, style, cell->bone_r, BONE, (tm_rect_t){ 0, 0, 1, 1 });
 
-            if (state->page != page)
-                continue;
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->number_r, .text = cell->value_str, .color = &text_color, .align = TM_UI_ALIGN_LEFT });
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->number_r, .text = cell->count_str, .color = &text_color, .align = TM_UI_ALIGN_RIGHT });
 
-            const tm_rect_t row_r = tm_rect_divide_y(rect, 0.01f * unit, 3, y);
-            tm_rect_t icon_r = tm_rect_divide_x(row_r, 0.01f * unit, 3, x);
+            if (!cell->enabled) {
+                disabled_button(state, args, cell->icon_r, cell->image);
+            } else if (hover_button(state, args, cell->icon_r, cell->image, i == hovered)) {
+                state->money -= props[idx].price;
+                set_inventory(state, idx, state->inventory[idx] + 1);
+            }
+        }
+    } else if (l->screen == STATE__ALBUM) {
+        const tm_color_srgb_t text_color = { .a = 255 };
+        uistyle->font_scale = l->cell_font_scale;
+        for (uint32_t i = 0; i < l->num_cells; ++i) {
+            const struct menu_cell_t* cell = l->cells + i;
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->desc_r, .text = dinosaurs[cell->item].name, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+            hover_button(state, args, cell->icon_r, cell->image, i == hovered);
+        }
+    } else if (l->screen == STATE__AWARD) {
+        struct awarded_drop_t* award = unclaimed_drop(state, 0);
+
+        const tm_color_srgb_t text_color = { .a = 255 };
+        tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = l->title_r, .text = l->title, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+
+        // The claimed item is removed after the loop, so that the other items stay in place for
+        // the rest of the frame.
+        uint32_t claimed = UINT32_MAX;
+        uistyle->font_scale = l->cell_font_scale;
+        for (uint32_t i = 0; i < l->num_cells; ++i) {
+            const struct menu_cell_t* cell = l->cells + i;
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->desc_r, .text = gift_name(cell->image), .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->number_r, .text = cell->count_str, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+
+            if (hover_button(state, args, cell->icon_r, cell->image, i == hovered)) {
+                claim_gift(state, cell->image, award->items[cell->item].quantity);
+                claimed = cell->item;
+            }
+        }
 
-            tm_rect_t inventory_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
-            tm_rect_t desc_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
-            icon_r = tm_rect_center_in(icon_r.h, icon_r.h, icon_r);
-            inventory_r = tm_rect_center_in(icon_r.w, inventory_r.h, inventory_r);
+        if (claimed != UINT32_MAX) {
+            memmove(award->items + claimed, award->items + claimed + 1, sizeof(*award->items) * (award->num_items - claimed - 1));
+            --award->num_items;
+        }
+        if (award->num_items == 0)
+            pop_unclaimed_drop(state);
+        if (state->num_awarded_drops == 0)
+            state->state = STATE__MAIN;
+    } else if (l->screen == STATE__MEMENTOS) {
+        const tm_color_srgb_t text_color = { .a = 255 };
+        uistyle->font_scale = l->cell_font_scale;
+        for (uint32_t i = 0; i < l->num_cells; ++i) {
+            const struct menu_cell_t* cell = l->cells + i;
+            const uint32_t idx = cell->item;
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->desc_r, .text = mementos[idx].name, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
 
-            const tm_color_srgb_t text_color = { .a = 255 };
-            uistyle->font_scale = desc_r.h / 18.0f;
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = desc_r, .text = props[idx].name, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+            draw_image(state, &uib, style, cell->bone_r, BONE, (tm_rect_t){ 0, 0, 1, 1 });
 
-            char inventory_str[32] = { 0 };
-            sprintf(inventory_str, "%d", state->inventory[idx]);
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = inventory_r, .text = inventory_str, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->number_r, .text = cell->value_str, .color = &text_color, .align = TM_UI_ALIGN_LEFT });
+            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = cell->number_r, .text = cell->count_str, .color = &text_color, .align = TM_UI_ALIGN_RIGHT });
 
-            if (button(state, args, icon_r, props[idx].image)) {
-                state->state = STATE__PLACING;
-                state->place_prop = idx;
+            if (hover_button(state, args, cell->icon_r, cell->image, i == hovered)) {
+                set_mementos(state, idx, state->mementos[idx] - 1);
+                state->money += mementos[idx].sell_value;
             }
         }
-    } else if (state->state == STATE__SHOP) {
-        tm_ui_style_t uistyle[1] = { *args->uistyle };
+    }
 
-        for (uint32_t idx = 0; idx < NUM_PROPS; ++idx) {
-            const uint32_t page = idx / 9;
-            const uint32_t x = idx % 3;
-            const uint32_t y = (idx % 9) / 3;
-            num_pages = page + 1;
+    // Left and right buttons.
+    if (l->num_pages > 0) {
+        if (state->page > 0) {
+            if (button(state, args, l->left_button_r, LEFT_ARROW))
+                --state->page;
+        }
+        if (state->page < l->num_pages - 1) {
+            if (button(state, args, l->right_button_r, RIGHT_ARROW))
+                ++state->page;
+        }
+    }
+}
 
-            if (state->page != page)
-                continue;
+// Replay
 
-            const tm_rect_t row_r = tm_rect_divide_y(rect, 0.01f * unit, 3, y);
-            tm_rect_t icon_r = tm_rect_divide_x(row_r, 0.01f * unit, 3, x);
+// Returns a hash of the rules and the tables that the game logic reads. Stored in replays and
+// saves, to detect when they are used with different data.
+static uint64_t game_data_hash(void)
+{
+    uint64_t h = hash_bytes(HASH_BYTES_SEED, &rules, sizeof(rules));
+    h = hash_bytes(h, props, NUM_PROPS * sizeof(*props));
+    h = hash_bytes(h, dinosaurs, NUM_DINOSAURS * sizeof(*dinosaurs));
+    h = hash_bytes(h, drops, NUM_DROPS * sizeof(*drops));
+    h = hash_bytes(h, mementos, NUM_MEMENTOS * sizeof(*mementos));
+    return hash_bytes(h, region_map, sizeof(default_region_map));
+}
 
-            const bool enabled = state->money >= props[idx].price;
+// Returns a hash of the game state of `state`: everything that the game logic, the scene and the
+// menus read and write, but not the loaded images or caches.
+static uint64_t hash_state(const tm_simulate_state_o* state)
+{
+    uint64_t h = HASH_BYTES_SEED;
+    h = hash_bytes(h, &state->money, sizeof(state->money));
+    h = hash_bytes(h, &state->next_coin, sizeof(state->next_coin));
+    h = hash_bytes(h, &state->state, sizeof(state->state));
+    h = hash_bytes(h, &state->page, sizeof(state->page));
+    h = hash_bytes(h, state->inventory, sizeof(state->inventory));
+    h = hash_bytes(h, state->mementos, sizeof(state->mementos));
+    h = hash_bytes(h, &state->scroll, sizeof(state->scroll));
+    h = hash_bytes(h, &state->place_prop, sizeof(state->place_prop));
 
-            tm_rect_t price_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
-            tm_rect_t desc_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
-            icon_r = tm_rect_center_in(icon_r.h, icon_r.h, icon_r);
-            price_r = tm_rect_center_in(icon_r.w, price_r.h, price_r);
+    for (uint32_t i = 0; i < state->num_scene_props; ++i) {
+        const struct scene_prop_t* p = state->scene_props + i;
+        h = hash_bytes(h, &p->prop, sizeof(p->prop));
+        h = hash_bytes(h, &p->x, sizeof(p->x));
+        h = hash_bytes(h, &p->y, sizeof(p->y));
+        h = hash_bytes(h, &p->lifetime, sizeof(p->lifetime));
+        h = hash_bytes(h, &p->expires, sizeof(p->expires));
+        h = hash_bytes(h, &p->attracts, sizeof(p->attracts));
+        h = hash_bytes(h, &p->handle, sizeof(p->handle));
+    }
+    for (uint32_t i = 0; i < state->num_scene_dinosaurs; ++i) {
+        const struct scene_dinosaur_t* d = state->scene_dinosaurs + i;
+        h = hash_bytes(h, &d->dinosaur, sizeof(d->dinosaur));
+        h = hash_bytes(h, &d->x, sizeof(d->x));
+        h = hash_bytes(h, &d->y, sizeof(d->y));
+        h = hash_bytes(h, &d->flipped, sizeof(d->flipped));
+        h = hash_bytes(h, &d->lifetime, sizeof(d->lifetime));
+        h = hash_bytes(h, &d->handle, sizeof(d->handle));
+    }
+    h = hash_bytes(h, state->in_album, sizeof(state->in_album));
 
-            const tm_color_srgb_t text_color = { .a = enabled ? 255 : 64 };
-            uistyle->font_scale = desc_r.h / 18.0f;
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = desc_r, .text = props[idx].name, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+    for (uint32_t i = 0; i < state->num_awarded_drops; ++i) {
+        const struct awarded_drop_t* a = state->awarded_drops + ((state->first_awarded_drop + i) & (MAX_AWARDED_DROPS - 1));
+        h = hash_bytes(h, &a->dinosaur, sizeof(a->dinosaur));
+        h = hash_bytes(h, &a->num_items, sizeof(a->num_items));
+        h = hash_bytes(h, a->items, sizeof(*a->items) * a->num_items);
+    }
+    h = hash_bytes(h, &state->num_discarded_drops, sizeof(state->num_discarded_drops));
+
+    h = hash_bytes(h, &state->time, sizeof(state->time));
+    h = hash_bytes(h, &state->step_time, sizeof(state->step_time));
+    for (uint32_t i = 0; i < state->num_events; ++i) {
+        const struct event_t* e = state->events + i;
+        h = hash_bytes(h, &e->time, sizeof(e->time));
+        h = hash_bytes(h, &e->type, sizeof(e->type));
+        h = hash_bytes(h, &e->handle, sizeof(e->handle));
+    }
 
-            const tm_rect_t bone_r = tm_rect_split_off_left(&price_r, price_r.h, 0.01f * unit);
-            style->color = (tm_color_srgb_t){ .a = enabled ? 255 : 64, .r = 255, .g = 255, .b = 255 };
-            tm_draw2d_api->textured_rect(uib.vbuffer, *uib.ibuffers, style, bone_r, state->images[BONE], (tm_rect_t){ 0, 0, 1, 1 });
+    return hash_bytes(h, state->random.s, sizeof(state->random.s));
+}
 
-            char price_str[32] = { 0 };
-            char inventory_str[32] = { 0 };
-            sprintf(price_str, "%d", props[idx].price);
-            sprintf(inventory_str, "%d", state->inventory[idx]);
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = price_r, .text = price_str, .color = &text_color, .align = TM_UI_ALIGN_LEFT });
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = price_r, .text = inventory_str, .color = &text_color, .align = TM_UI_ALIGN_RIGHT });
+// Reads the whole file at `path` into memory allocated from `a`. Returns `NULL` if the file can't
+// be read.
+static uint8_t* read_replay_file(tm_allocator_i* a, const char* path, uint64_t* size)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    const long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = n > 0 ? tm_alloc(a, (uint64_t)n) : NULL;
+    const bool ok = data && fread(data, 1, (size_t)n, f) == (size_t)n;
+    fclose(f);
+    if (!ok) {
+        if (data)
+            tm_free(a, data, (uint64_t)n);
+        return NULL;
+    }
+    *size = (uint64_t)n;
+    return data;
+}
 
-            if (!enabled) {
-                disabled_button(state, args, icon_r, props[idx].image);
-            } else if (button(state, args, icon_r, props[idx].image)) {
-                state->money -= props[idx].price;
-                state->inventory[idx]++;
-            }
+// Frees the replay of `state` and returns the state to live input.
+static void free_replay(tm_simulate_state_o* state)
+{
+    struct replay_t* r = state->replay;
+    if (r->file)
+        fclose(r->file);
+    if (r->data)
+        tm_free(state->allocator, r->data, r->size);
+    tm_free(state->allocator, r, sizeof(*r));
+    state->replay = NULL;
+}
+
+// Starts playing back the replay named by [[REPLAY_PLAY_ENV]] or recording the one named by
+// [[REPLAY_RECORD_ENV]] and returns the seed for the random stream of `state`: the recorded seed
+// when playing back, a random one otherwise.
+static uint64_t start_replay(tm_simulate_state_o* state)
+{
+    const char* play_path = getenv(REPLAY_PLAY_ENV);
+    if (play_path && *play_path) {
+        uint64_t size = 0;
+        uint8_t* data = read_replay_file(state->allocator, play_path, &size);
+        struct replay_header_t header = { 0 };
+        if (data && size >= sizeof(header))
+            memcpy(&header, data, sizeof(header));
+        const bool valid = data && size >= sizeof(header) && !memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) && header.version == REPLAY_VERSION;
+        if (TM_ASSERT(valid, tm_error_api->def, "Could not play back replay `%s`", play_path)) {
+            TM_ASSERT(header.data_hash == game_data_hash(), tm_error_api->def, "Replay `%s` was recorded with different rules or tables and will not play back exactly", play_path);
+            state->replay = tm_alloc(state->allocator, sizeof(*state->replay));
+            *state->replay = (struct replay_t){ .playing = true, .data = data, .size = size, .pos = sizeof(header) };
+            TM_LOG("Playing back replay `%s`.", play_path);
+            return header.seed;
         }
-    } else if (state->state == STATE__ALBUM) {
-        tm_ui_style_t uistyle[1] = { *args->uistyle };
+        if (data)
+            tm_free(state->allocator, data, size);
+    }
 
-        uint32_t idx = 0;
-        for (uint32_t i = 0;; ++i, ++idx) {
-            const uint32_t page = i / 9;
-            const uint32_t x = i % 3;
-            const uint32_t y = (i % 9) / 3;
+    const uint64_t seed = tm_random_api->next();
+    const char* record_path = getenv(REPLAY_RECORD_ENV);
+    if (record_path && *record_path) {
+        FILE* f = fopen(record_path, "wb");
+        if (TM_ASSERT(f, tm_error_api->def, "Could not record replay `%s`", record_path)) {
+            struct replay_header_t header = { .version = REPLAY_VERSION, .seed = seed, .data_hash = game_data_hash() };
+            memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+            fwrite(&header, sizeof(header), 1, f);
+            state->replay = tm_alloc(state->allocator, sizeof(*state->replay));
+            *state->replay = (struct replay_t){ .file = f };
+        }
+    }
+    return seed;
+}
 
-            while (idx < NUM_DINOSAURS && !state->in_album[idx])
-                ++idx;
-            if (idx >= NUM_DINOSAURS)
-                break;
+// Writes the input of the frame `args` to the replay `r`.
+static void record_frame(struct replay_t* r, const tm_simulate_frame_args_t* args, const struct frame_input_t* input)
+{
+    // Compare bitwise, so that the playback gets exactly the recorded values.
+    const bool mouse = memcmp(&input->mouse_pos, &r->mouse_pos, sizeof(r->mouse_pos)) != 0;
+    const bool time = memcmp(&args->dt, &r->dt, sizeof(r->dt)) || memcmp(&args->dt_unscaled, &r->dt_unscaled, sizeof(r->dt_unscaled));
+    const bool rect = memcmp(&args->rect, &r->rect, sizeof(r->rect)) != 0;
+
+    const uint8_t flags = (input->left_mouse_pressed ? REPLAY_FRAME__PRESSED : 0)
+        | (input->hover ? REPLAY_FRAME__HOVER : 0)
+        | (mouse ? REPLAY_FRAME__MOUSE : 0)
+        | (time ? REPLAY_FRAME__TIME : 0)
+        | (rect ? REPLAY_FRAME__RECT : 0);
+    fwrite(&flags, 1, 1, r->file);
+    if (mouse) {
+        r->mouse_pos = input->mouse_pos;
+        fwrite(&r->mouse_pos, sizeof(r->mouse_pos), 1, r->file);
+    }
+    if (time) {
+        r->dt = args->dt;
+        r->dt_unscaled = args->dt_unscaled;
+        fwrite(&r->dt, sizeof(r->dt), 1, r->file);
+        fwrite(&r->dt_unscaled, sizeof(r->dt_unscaled), 1, r->file);
+    }
+    if (rect) {
+        r->rect = args->rect;
+        fwrite(&r->rect, sizeof(r->rect), 1, r->file);
+    }
+    ++r->num_frames;
+}
 
-            num_pages = page + 1;
+// Reads `size` bytes from the replay `r` into `dst`. Returns `false` if the replay ends first.
+static bool read_replay(struct replay_t* r, void* dst, uint64_t size)
+{
+    if (r->size - r->pos < size)
+        return false;
+    memcpy(dst, r->data + r->pos, size);
+    r->pos += size;
+    return true;
+}
 
-            if (state->page != page)
-                continue;
+// Reads the next frame of the replay `r` into `args` and `input`. Returns `false` if the replay is
+// at its end or truncated.
+static bool play_frame(struct replay_t* r, tm_simulate_frame_args_t* args, struct frame_input_t* input)
+{
+    const uint64_t start = r->pos;
+    uint8_t flags;
+    if (!read_replay(r, &flags, 1) || (flags & REPLAY_FRAME__END)) {
+        r->pos = start;
+        return false;
+    }
 
-            const tm_rect_t row_r = tm_rect_divide_y(rect, 0.01f * unit, 3, y);
-            tm_rect_t icon_r = tm_rect_divide_x(row_r, 0.01f * unit, 3, x);
-            tm_rect_t desc_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
-            icon_r = tm_rect_center_in(icon_r.h, icon_r.h, icon_r);
+    bool ok = true;
+    if (flags & REPLAY_FRAME__MOUSE)
+        ok = ok && read_replay(r, &r->mouse_pos, sizeof(r->mouse_pos));
+    if (flags & REPLAY_FRAME__TIME)
+        ok = ok && read_replay(r, &r->dt, sizeof(r->dt)) && read_replay(r, &r->dt_unscaled, sizeof(r->dt_unscaled));
+    if (flags & REPLAY_FRAME__RECT)
+        ok = ok && read_replay(r, &r->rect, sizeof(r->rect));
+    if (!ok) {
+        r->pos = start;
+        return false;
+    }
 
-            uistyle->font_scale = desc_r.h / 18.0f;
-            const tm_color_srgb_t text_color = { .a = 255 };
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = desc_r, .text = dinosaurs[idx].name, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+    *input = (struct frame_input_t){
+        .mouse_pos = r->mouse_pos,
+        .left_mouse_pressed = flags & REPLAY_FRAME__PRESSED,
+        .hover = flags & REPLAY_FRAME__HOVER,
+    };
+    args->dt = r->dt;
+    args->dt_unscaled = r->dt_unscaled;
+    args->rect = r->rect;
+    ++r->num_frames;
+    return true;
+}
 
-            button(state, args, icon_r, dinosaurs[idx].image);
+// Ends the replay of `state`. A recording is finished with the number of frames and the state hash.
+// A playback is checked against them, if it has reached the end of the replay.
+static void finish_replay(tm_simulate_state_o* state)
+{
+    struct replay_t* r = state->replay;
+    const struct replay_footer_t footer = { .num_frames = r->num_frames, .state_hash = hash_state(state) };
+    if (!r->playing) {
+        const uint8_t end = REPLAY_FRAME__END;
+        fwrite(&end, 1, 1, r->file);
+        fwrite(&footer, sizeof(footer), 1, r->file);
+        TM_LOG("Recorded replay of %u frames, state hash %016llx.", footer.num_frames, (unsigned long long)footer.state_hash);
+    } else {
+        uint8_t end = 0;
+        struct replay_footer_t recorded = { 0 };
+        if (read_replay(r, &end, 1) && end == REPLAY_FRAME__END && read_replay(r, &recorded, sizeof(recorded))) {
+            const bool match = recorded.num_frames == footer.num_frames && recorded.state_hash == footer.state_hash;
+            if (TM_ASSERT(match, tm_error_api->def, "Replay diverged: state hash %016llx after %u frames, recorded %016llx after %u frames", (unsigned long long)footer.state_hash, footer.num_frames, (unsigned long long)recorded.state_hash, recorded.num_frames))
+                TM_LOG("Replay matches after %u frames, state hash %016llx.", footer.num_frames, (unsigned long long)footer.state_hash);
+        } else {
+            TM_LOG("Replay stopped after %u frames, before its end.", footer.num_frames);
         }
-    } else if (state->state == STATE__AWARD) {
-        tm_ui_style_t uistyle[1] = { *args->uistyle };
+    }
+    free_replay(state);
+}
 
-        struct awarded_drop_t* award = state->awarded_drops;
+// Sets the input of `state` for this tick. When a replay is being played back, the input, the time
+// step and the rect of `args` come from the replay. Otherwise, the input comes from the UI and is
+// recorded if a replay is being recorded.
+static void read_input(tm_simulate_state_o* state, tm_simulate_frame_args_t* args)
+{
+    struct replay_t* r = state->replay;
+    if (r && r->playing) {
+        if (play_frame(r, args, &state->input))
+            return;
+        finish_replay(state);
+        r = NULL;
+    }
 
-        const tm_color_srgb_t text_color = { .a = 255 };
-        tm_rect_t title_r = tm_rect_split_off_top(&rect, 0.03f * unit, 0.01f * unit);
-        char gift_text[1024];
-        sprintf(gift_text, "%s left you a gift", award->dinosaur->name);
-        tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = title_r, .text = gift_text, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
+    tm_ui_buffers_t uib = tm_ui_api->buffers(args->ui);
+    state->input = (struct frame_input_t){
+        .mouse_pos = uib.input->mouse_pos,
+        .left_mouse_pressed = uib.input->left_mouse_pressed,
+        .hover = tm_ui_api->is_hovering(args->ui, args->rect, 0),
+    };
+    if (r)
+        record_frame(r, args, &state->input);
+}
+
+// Save games
 
-        uint32_t idx = 0;
-        for (uint32_t i = 0;; ++i, ++idx) {
-            const uint32_t page = i / 9;
-            const uint32_t x = i % 3;
-            const uint32_t y = (i % 9) / 3;
+// Returns the start of section `s` of the save `h`.
+static const void* save_section(const struct save_header_t* h, enum SAVE_SECTION s)
+{
+    return (const uint8_t*)h + h->sections[s].offset;
+}
 
-            while (idx < NUM_IMAGES && !award->quantity[idx])
-                ++idx;
-            if (idx >= NUM_IMAGES)
-                break;
+// Takes a snapshot of the game in `state`, to be saved to `path`.
+static struct save_t* snapshot_game(const tm_simulate_state_o* state, const char* path)
+{
+    const uint64_t sizes[SAVE_SECTION__COUNT] = {
+        [SAVE_SECTION__STATE] = sizeof(*state),
+        [SAVE_SECTION__SCENE_PROPS] = state->num_scene_props * sizeof(*state->scene_props),
+        [SAVE_SECTION__PROP_SLOTS] = state->prop_slots.num_slots * sizeof(*state->prop_slots.slots),
+        [SAVE_SECTION__PROP_AGES] = state->prop_ages.capacity * sizeof(*state->prop_ages.handles),
+        [SAVE_SECTION__SCENE_DINOSAURS] = state->num_scene_dinosaurs * sizeof(*state->scene_dinosaurs),
+        [SAVE_SECTION__DINOSAUR_SLOTS] = state->dinosaur_slots.num_slots * sizeof(*state->dinosaur_slots.slots),
+        [SAVE_SECTION__EVENTS] = state->num_events * sizeof(*state->events),
+    };
+    const void* sources[SAVE_SECTION__COUNT] = {
+        [SAVE_SECTION__STATE] = state,
+        [SAVE_SECTION__SCENE_PROPS] = state->scene_props,
+        [SAVE_SECTION__PROP_SLOTS] = state->prop_slots.slots,
+        [SAVE_SECTION__PROP_AGES] = state->prop_ages.handles,
+        [SAVE_SECTION__SCENE_DINOSAURS] = state->scene_dinosaurs,
+        [SAVE_SECTION__DINOSAUR_SLOTS] = state->dinosaur_slots.slots,
+        [SAVE_SECTION__EVENTS] = state->events,
+    };
 
-            num_pages = page + 1;
+    struct save_header_t header = {
+        .version = SAVE_VERSION,
+        .state_size = sizeof(*state),
+        .schema_hash = state_schema_hash,
+        .num_props = NUM_PROPS,
+        .num_dinosaurs = NUM_DINOSAURS,
+        .num_mementos = NUM_MEMENTOS,
+        .num_images = NUM_IMAGES,
+        .data_hash = game_data_hash(),
+    };
+    memcpy(header.magic, SAVE_MAGIC, sizeof(header.magic));
+    uint64_t size = sizeof(header);
+    for (uint32_t i = 0; i < SAVE_SECTION__COUNT; ++i) {
+        size = (size + DATA_PACK_ALIGN - 1) / DATA_PACK_ALIGN * DATA_PACK_ALIGN;
+        header.sections[i] = (struct save_section_t){ .offset = size, .size = sizes[i] };
+        size += sizes[i];
+    }
 
-            if (state->page != page)
-                continue;
+    struct save_t* save = tm_alloc(state->allocator, sizeof(*save));
+    *save = (struct save_t){ .data = tm_alloc(state->allocator, size), .size = size };
+    snprintf(save->path, sizeof(save->path), "%s", path);
+    uint64_t end = 0;
+    for (uint32_t i = 0; i < SAVE_SECTION__COUNT; ++i) {
+        memset(save->data + end, 0, header.sections[i].offset - end);
+        if (sizes[i])
+            memcpy(save->data + header.sections[i].offset, sources[i], sizes[i]);
+        end = header.sections[i].offset + sizes[i];
+    }
 
-            const tm_rect_t row_r = tm_rect_divide_y(rect, 0.01f * unit, 3, y);
-            tm_rect_t icon_r = tm_rect_divide_x(row_r, 0.01f * unit, 3, x);
-            tm_rect_t quantity_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
-            tm_rect_t desc_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
-            icon_r = tm_rect_center_in(icon_r.h, icon_r.h, icon_r);
-
-            uistyle->font_scale = desc_r.h / 18.0f;
-
-            // Returns the name of the gift (Prop or Memento) with the specified image.
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = desc_r, .text = gift_name(idx), .color = &text_color, .align = TM_UI_ALIGN_CENTER });
-            char buffer[32];
-            sprintf(buffer, "%d", award->quantity[idx]);
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = quantity_r, .text = buffer, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
-
-            if (button(state, args, icon_r, idx)) {
-                const uint32_t q = award->quantity[idx];
-                claim_gift(state, idx, q);
-                award->quantity[idx] = 0;
-                award->total_items -= q;
-            }
-        }
+    // Clear the runtime data.
+    tm_simulate_state_o* saved = (tm_simulate_state_o*)(save->data + header.sections[SAVE_SECTION__STATE].offset);
+    saved->allocator = NULL;
+    saved->scene_props = NULL;
+    saved->prop_slots.slots = NULL;
+    saved->prop_ages.handles = NULL;
+    saved->scene_dinosaurs = NULL;
+    saved->dinosaur_slots.slots = NULL;
+    saved->events = NULL;
+    saved->data_props = NULL;
+    saved->data_dinosaurs = NULL;
+    saved->image_loader = NULL;
+    saved->depth = (struct depth_list_t){ 0 };
+    saved->scene_cache = (struct scene_cache_t){ 0 };
+    saved->menu_layout = (struct menu_layout_t){ 0 };
+    saved->money_layout = (struct money_layout_t){ 0 };
+    saved->input = (struct frame_input_t){ 0 };
+    saved->replay = NULL;
+    saved->save = NULL;
+    saved->save_timer = 0;
+
+    // The hash is computed by the job.
+    memcpy(save->data, &header, sizeof(header));
+    return save;
+}
 
-        if (award->total_items == 0) {
-            memmove(state->awarded_drops, state->awarded_drops + 1, sizeof(struct awarded_drop_t) * (MAX_AWARDED_DROPS - 1));
-            --state->num_awarded_drops;
+// Job that hashes the snapshot `data`, a [[save_t]], and writes it to its file.
+static void save_job(void* data)
+{
+    struct save_t* save = data;
+    struct save_header_t* header = (struct save_header_t*)save->data;
+    header->hash = hash_bytes(HASH_BYTES_SEED, header + 1, save->size - sizeof(*header));
+
+    char temp_path[SAVE_PATH_SIZE + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", save->path);
+    FILE* f = fopen(temp_path, "wb");
+    bool ok = f && fwrite(save->data, 1, save->size, f) == save->size;
+    if (f)
+        ok = fclose(f) == 0 && ok;
+#if defined(TM_OS_WINDOWS)
+    ok = ok && MoveFileExA(temp_path, save->path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temp_path, save->path) == 0;
+#endif
+    save->ok = ok;
+    atomic_store_uint32_t(&save->done, 1);
+}
+
+// Waits for the save job of `save` to finish, reports whether it succeeded and frees the save.
+static void finish_save(tm_allocator_i* a, struct save_t* save)
+{
+    if (save->counter)
+        tm_job_system_api->wait_for_counter_and_free_no_fiber(save->counter);
+    TM_ASSERT(save->ok, tm_error_api->def, "Could not save the game to `%s`", save->path);
+    tm_free(a, save->data, save->size);
+    tm_free(a, save, sizeof(*save));
+}
+
+// Checks that the `size` bytes at `h` are a save that this build can load. Returns a description
+// of the problem, or `NULL` if the save is good.
+static const char* check_save(const struct save_header_t* h, uint64_t size)
+{
+    if (size < sizeof(*h) || memcmp(h->magic, SAVE_MAGIC, sizeof(h->magic)))
+        return "not a save file";
+    if (h->version != SAVE_VERSION || h->state_size != sizeof(tm_simulate_state_o) || h->schema_hash != state_schema_hash)
+        return "saved by a different version of the game";
+    if (h->num_props != NUM_PROPS || h->num_dinosaurs != NUM_DINOSAURS || h->num_mementos != NUM_MEMENTOS || h->num_images != NUM_IMAGES)
+        return "saved with different tables";
+    for (uint32_t i = 0; i < SAVE_SECTION__COUNT; ++i) {
+        const struct save_section_t* s = h->sections + i;
+        if (s->offset % DATA_PACK_ALIGN || s->offset < sizeof(*h) || s->offset > size || s->size > size - s->offset)
+            return "section out of bounds";
+    }
+    if (h->hash != hash_bytes(HASH_BYTES_SEED, h + 1, size - sizeof(*h)))
+        return "file is corrupt";
+
+    const tm_simulate_state_o* saved = save_section(h, SAVE_SECTION__STATE);
+    const uint64_t expected[SAVE_SECTION__COUNT] = {
+        [SAVE_SECTION__STATE] = sizeof(*saved),
+        [SAVE_SECTION__SCENE_PROPS] = saved->num_scene_props * sizeof(*saved->scene_props),
+        [SAVE_SECTION__PROP_SLOTS] = saved->prop_slots.num_slots * sizeof(*saved->prop_slots.slots),
+        [SAVE_SECTION__PROP_AGES] = saved->prop_ages.capacity * sizeof(*saved->prop_ages.handles),
+        [SAVE_SECTION__SCENE_DINOSAURS] = saved->num_scene_dinosaurs * sizeof(*saved->scene_dinosaurs),
+        [SAVE_SECTION__DINOSAUR_SLOTS] = saved->dinosaur_slots.num_slots * sizeof(*saved->dinosaur_slots.slots),
+        [SAVE_SECTION__EVENTS] = saved->num_events * sizeof(*saved->events),
+    };
+    for (uint32_t i = 0; i < SAVE_SECTION__COUNT; ++i) {
+        if (h->sections[i].size != expected[i])
+            return "section size doesn't match the saved state";
+    }
+    if (saved->num_awarded_drops > MAX_AWARDED_DROPS || saved->first_awarded_drop >= MAX_AWARDED_DROPS || (saved->prop_ages.capacity & (saved->prop_ages.capacity - 1)))
+        return "invalid state";
+    for (uint32_t i = 0; i < saved->num_awarded_drops; ++i) {
+        const struct awarded_drop_t* a = saved->awarded_drops + ((saved->first_awarded_drop + i) & (MAX_AWARDED_DROPS - 1));
+        if (a->dinosaur >= NUM_DINOSAURS || a->num_items > MAX_AWARD_ITEMS)
+            return "invalid awarded drop";
+        for (uint32_t j = 0; j < a->num_items; ++j) {
+            if (a->items[j].image >= NUM_IMAGES)
+                return "invalid awarded drop";
         }
-        if (state->num_awarded_drops == 0)
-            state->state = STATE__MAIN;
-    } else if (state->state == STATE__MEMENTOS) {
-        tm_ui_style_t uistyle[1] = { *args->uistyle };
+    }
+    const struct scene_prop_t* saved_props = save_section(h, SAVE_SECTION__SCENE_PROPS);
+    for (uint32_t i = 0; i < saved->num_scene_props; ++i) {
+        if (saved_props[i].prop >= NUM_PROPS || saved_props[i].attracts > NUM_DINOSAURS)
+            return "invalid prop index";
+    }
+    const struct scene_dinosaur_t* saved_dinosaurs = save_section(h, SAVE_SECTION__SCENE_DINOSAURS);
+    for (uint32_t i = 0; i < saved->num_scene_dinosaurs; ++i) {
+        if (saved_dinosaurs[i].dinosaur >= NUM_DINOSAURS)
+            return "invalid dinosaur index";
+    }
+    return NULL;
+}
 
-        uint32_t idx = 0;
-        for (uint32_t i = 0;; ++i, ++idx) {
-            const uint32_t page = i / 9;
-            const uint32_t x = i % 3;
-            const uint32_t y = (i % 9) / 3;
+// Loads the game saved at `path` into the newly started `state`, which must not have a scene yet.
+// Returns `false` and leaves the state untouched if there is no save or it can't be loaded.
+static bool load_game(tm_simulate_state_o* state, const char* path)
+{
+    uint64_t size = 0;
+    const struct save_header_t* h = map_file(path, &size);
+    if (!h)
+        return false;
+    const char* error = check_save(h, size);
+    if (!TM_ASSERT(!error, tm_error_api->def, "Save `%s`: %s", path, error)) {
+        unmap_file(h, size);
+        return false;
+    }
 
-            while (idx < NUM_MEMENTOS && state->mementos[idx] == 0)
-                ++idx;
-            if (idx >= NUM_MEMENTOS)
-                break;
+    tm_allocator_i* a = state->allocator;
+    memcpy(state, save_section(h, SAVE_SECTION__STATE), sizeof(*state));
+    state->allocator = a;
+
+    tm_carray_ensure(state->scene_props, state->num_scene_props, a);
+    memcpy(state->scene_props, save_section(h, SAVE_SECTION__SCENE_PROPS), h->sections[SAVE_SECTION__SCENE_PROPS].size);
+    tm_carray_ensure(state->prop_slots.slots, state->prop_slots.num_slots, a);
+    memcpy(state->prop_slots.slots, save_section(h, SAVE_SECTION__PROP_SLOTS), h->sections[SAVE_SECTION__PROP_SLOTS].size);
+    tm_carray_ensure(state->prop_ages.handles, state->prop_ages.capacity, a);
+    memcpy(state->prop_ages.handles, save_section(h, SAVE_SECTION__PROP_AGES), h->sections[SAVE_SECTION__PROP_AGES].size);
+    tm_carray_ensure(state->scene_dinosaurs, state->num_scene_dinosaurs, a);
+    memcpy(state->scene_dinosaurs, save_section(h, SAVE_SECTION__SCENE_DINOSAURS), h->sections[SAVE_SECTION__SCENE_DINOSAURS].size);
+    tm_carray_ensure(state->dinosaur_slots.slots, state->dinosaur_slots.num_slots, a);
+    memcpy(state->dinosaur_slots.slots, save_section(h, SAVE_SECTION__DINOSAUR_SLOTS), h->sections[SAVE_SECTION__DINOSAUR_SLOTS].size);
+    tm_carray_ensure(state->events, state->num_events, a);
+    memcpy(state->events, save_section(h, SAVE_SECTION__EVENTS), h->sections[SAVE_SECTION__EVENTS].size);
+
+    state->data_props = props;
+    state->data_dinosaurs = dinosaurs;
+    ++state->scene_version;
+
+    // The lists are derived from the counts, so they aren't trusted from the file.
+    rebuild_item_lists(state);
+
+    // If the data has changed since the save, the regions and the pending events are updated as
+    // when a new data pack is swapped in.
+    if (h->data_hash != game_data_hash())
+        rebase_state(state);
+
+    unmap_file(h, size);
+    return true;
+}
 
-            num_pages = page + 1;
+// Counts down to the next autosave and starts it when it is due, if [[SAVE_ENV]] is set. Finishes
+// the previous save when its job is done.
+static void update_save(tm_simulate_state_o* state, double dt)
+{
+    if (state->save && atomic_load_uint32_t(&state->save->done)) {
+        finish_save(state->allocator, state->save);
+        state->save = NULL;
+    }
 
-            if (state->page != page)
-                continue;
+    state->save_timer -= dt;
+    if (state->save_timer > 0 || state->save || state->replay)
+        return;
+    state->save_timer = SAVE_INTERVAL_SECONDS;
 
-            const tm_rect_t row_r = tm_rect_divide_y(rect, 0.01f * unit, 3, y);
-            tm_rect_t icon_r = tm_rect_divide_x(row_r, 0.01f * unit, 3, x);
-            tm_rect_t price_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
-            tm_rect_t desc_r = tm_rect_split_off_bottom(&icon_r, 0.03f * unit, 0.01f * unit);
-            icon_r = tm_rect_center_in(icon_r.h, icon_r.h, icon_r);
-            price_r = tm_rect_center_in(icon_r.w, price_r.h, price_r);
-
-            const tm_color_srgb_t text_color = { .a = 255 };
-            uistyle->font_scale = desc_r.h / 18.0f;
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = desc_r, .text = mementos[idx].name, .color = &text_color, .align = TM_UI_ALIGN_CENTER });
-
-            const tm_rect_t bone_r = tm_rect_split_off_left(&price_r, price_r.h, 0.01f * unit);
-            tm_draw2d_api->textured_rect(uib.vbuffer, *uib.ibuffers, style, bone_r, state->images[BONE], (tm_rect_t){ 0, 0, 1, 1 });
-
-            char price_str[32] = { 0 };
-            char inventory_str[32] = { 0 };
-            sprintf(price_str, "%d", mementos[idx].sell_value);
-            sprintf(inventory_str, "%d", state->mementos[idx]);
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = price_r, .text = price_str, .color = &text_color, .align = TM_UI_ALIGN_LEFT });
-            tm_ui_api->text(args->ui, uistyle, &(tm_ui_text_t){ .rect = price_r, .text = inventory_str, .color = &text_color, .align = TM_UI_ALIGN_RIGHT });
-
-            if (button(state, args, icon_r, mementos[idx].image)) {
-                --state->mementos[idx];
-                state->money += mementos[idx].sell_value;
-            }
-        }
+    const char* path = getenv(SAVE_ENV);
+    if (!path || !*path)
+        return;
+    struct save_t* save = snapshot_game(state, path);
+    save->job = (tm_jobdecl_t){ .task = save_job, .data = save };
+    save->counter = tm_job_system_api->run_jobs(&save->job, 1);
+    state->save = save;
+}
+
+// Returns the hash of the layout `t`, with the layouts of its members, by name, so that the hash
+// can be compared between builds.
+static uint64_t hash_layout(const struct layout_type_t* t)
+{
+    uint64_t h = hash_bytes(HASH_BYTES_SEED, &t->size, sizeof(t->size));
+    for (uint32_t i = 0; i < t->num_members; ++i) {
+        const struct layout_member_t* m = t->members + i;
+        const uint64_t member_layout = m->type ? hash_layout(layout_types + m->type) : 0;
+        h = hash_bytes(h, m->name, strlen(m->name) + 1);
+        h = hash_bytes(h, &m->offset, sizeof(m->offset));
+        h = hash_bytes(h, &m->size, sizeof(m->size));
+        h = hash_bytes(h, &member_layout, sizeof(member_layout));
     }
+    return h;
+}
 
-    // Left and right buttons.
-    if (num_pages > 0) {
-        state->page = tm_clamp(state->page, 0, num_pages - 1);
-        if (state->page > 0) {
-            const tm_rect_t left_edge_r = tm_rect_split_left(menu_r, 0.05f * unit, 0, 0);
-            const tm_rect_t left_button_r = tm_rect_center_in(unit * 0.15f, unit * 0.15f, left_edge_r);
-            if (button(state, args, left_button_r, LEFT_ARROW))
-                --state->page;
+// Returns the hash of the layout of `type`. See [[hash_layout]].
+static uint64_t hash_layout_type(enum LAYOUT_TYPE type)
+{
+    return hash_layout(layout_types + type);
+}
+
+// Returns the hash of the [[handle_layouts]], to be compared with [[STATE_HANDLE_LAYOUT]].
+static uint64_t hash_handle_layouts(void)
+{
+    uint64_t h = HASH_BYTES_SEED;
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(handle_layouts); ++i) {
+        const uint64_t layout = hash_layout(handle_layouts + i);
+        h = hash_bytes(h, &layout, sizeof(layout));
+    }
+    return h;
+}
+
+// Checks that the layout `t` describes its struct, in the same way as [[check_state_schema]].
+// Returns a description of the problem, or `NULL` if the layout is fine.
+static const char* check_layout(const struct layout_type_t* t)
+{
+    if (!t->num_members)
+        return "struct layout missing";
+    uint64_t end = 0;
+    for (uint32_t i = 0; i < t->num_members; ++i) {
+        const struct layout_member_t* m = t->members + i;
+        const uint32_t align = tm_min(m->size & (0u - m->size), 8);
+        if (m->offset < end)
+            return "struct members out of order";
+        if (m->offset - end >= align)
+            return "gap between struct members, is a member missing?";
+        if (m->type && m->size % layout_types[m->type].size && m->size != sizeof(void*))
+            return "struct member doesn't match its layout";
+        end = m->offset + (uint64_t)m->size;
+    }
+    if (t->size - end >= 8)
+        return "gap at the end of a struct, is a member missing?";
+    return NULL;
+}
+
+// Checks [[layout_types]] and [[handle_layouts]] with [[check_layout]]. Returns a description of
+// the problem, or `NULL` if the layouts are fine.
+static const char* check_layout_types(void)
+{
+    for (uint32_t type = LAYOUT_TYPE__NONE + 1; type < LAYOUT_TYPE__COUNT; ++type) {
+        const char* error = check_layout(layout_types + type);
+        if (error)
+            return error;
+    }
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(handle_layouts); ++i) {
+        const char* error = check_layout(handle_layouts + i);
+        if (error)
+            return error;
+    }
+    return NULL;
+}
+
+// Checks that [[state_schema]] describes [[tm_simulate_state_o]]. The fields must be in order and
+// not overlap, and the gaps between them must be smaller than the alignment of the next field, so
+// that a field that is missing from the schema is usually caught. Returns a description of the
+// problem, or `NULL` if the schema is fine.
+static const char* check_state_schema(void)
+{
+    uint64_t end = 0;
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(state_schema); ++i) {
+        const struct state_field_t* f = state_schema + i;
+        if (f->name[sizeof(f->name) - 1] || f->type[sizeof(f->type) - 1])
+            return "field or type name too long";
+        for (uint32_t j = 0; j < i; ++j) {
+            if (strcmp(state_schema[j].name, f->name) == 0)
+                return "duplicate field";
         }
-        if (state->page < num_pages - 1) {
-            const tm_rect_t right_edge_r = tm_rect_split_right(menu_r, 0.05f * unit, 0, 1);
-            const tm_rect_t right_button_r = tm_rect_center_in(unit * 0.15f, unit * 0.15f, right_edge_r);
-            if (button(state, args, right_button_r, RIGHT_ARROW))
-                ++state->page;
+        const uint32_t align = tm_min(f->size & (0u - f->size), 8);
+        if (f->offset < end)
+            return "fields out of order";
+        if (f->offset - end >= align)
+            return "gap between fields, is a field missing?";
+        end = f->offset + (uint64_t)f->size * f->count;
+    }
+    if (sizeof(tm_simulate_state_o) - end >= 8)
+        return "gap at the end, is a field missing?";
+    const char* error = check_layout_types();
+    if (error)
+        return error;
+    if (hash_handle_layouts() != STATE_HANDLE_LAYOUT)
+        return "state_handle_t or state_field_t changed, bump the version in STATE_HANDLE_MAGIC and set STATE_HANDLE_LAYOUT to the hash of the handle layouts";
+    return NULL;
+}
+
+// Sets the `layout` hashes of the [[state_schema]] fields.
+static void hash_state_layouts(void)
+{
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(state_schema); ++i) {
+        struct state_field_t* f = state_schema + i;
+        f->layout = f->layout_type ? hash_layout_type(f->layout_type) : 0;
+    }
+}
+
+// Returns the hash of [[state_schema]], including the layout hashes set by [[hash_state_layouts]].
+static uint64_t hash_state_schema(void)
+{
+    const uint64_t size = sizeof(tm_simulate_state_o);
+    return hash_bytes(hash_bytes(HASH_BYTES_SEED, state_schema, sizeof(state_schema)), &size, sizeof(size));
+}
+
+// Sets the layout hashes of the [[state_schema]] and [[state_schema_hash]]. Called when the plugin
+// is loaded, and by the tools that save or load games.
+static void init_state_schema(void)
+{
+    hash_state_layouts();
+    state_schema_hash = hash_state_schema();
+}
+
+// Returns the field of `old_schema` with the name of `f`, the field with index `i` in
+// [[state_schema]], or `NULL` if there is none.
+static const struct state_field_t* find_old_field(const struct state_field_t* f, uint32_t i, const struct state_field_t* old_schema, uint32_t num_old_fields)
+{
+    // Most fields keep their place, so the search starts at the same index.
+    for (uint32_t k = 0; k < num_old_fields; ++k) {
+        const struct state_field_t* o = old_schema + (i + k) % num_old_fields;
+        if (strcmp(o->name, f->name) == 0)
+            return o;
+    }
+    return NULL;
+}
+
+// Copies the fields of `old`, a state laid out as described by the `num_old_fields` fields of
+// `old_schema`, into `state`, which must be zeroed. Fields are matched by name and copied if they
+// have the same type, element size and layout, arrays up to the shorter of the two lengths. If a
+// field of a [[STATE_GROUP]] changed, the whole group is left zeroed. Fields that are new in this
+// build don't reset their group. Returns the number of fields copied and sets `num_reset` to the
+// number of old fields that were dropped, whose buffers are abandoned.
+static uint32_t migrate_state(tm_simulate_state_o* state, const void* old, const struct state_field_t* old_schema, uint32_t num_old_fields, uint32_t* num_reset)
+{
+    bool group_changed[STATE_GROUP__COUNT] = { 0 };
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(state_schema); ++i) {
+        const struct state_field_t* f = state_schema + i;
+        const struct state_field_t* o = find_old_field(f, i, old_schema, num_old_fields);
+        if (o && (o->size != f->size || o->layout != f->layout || strcmp(o->type, f->type)))
+            group_changed[f->group] = true;
+    }
+
+    uint32_t copied = 0;
+    *num_reset = 0;
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(state_schema); ++i) {
+        const struct state_field_t* f = state_schema + i;
+        const struct state_field_t* o = find_old_field(f, i, old_schema, num_old_fields);
+        if (!o)
+            continue;
+        const bool changed = o->size != f->size || o->layout != f->layout || strcmp(o->type, f->type);
+        if (changed || (f->group != STATE_GROUP__NONE && group_changed[f->group])) {
+            ++*num_reset;
+            continue;
         }
+        memcpy((char*)state + f->offset, (const char*)old + o->offset, (uint64_t)f->size * tm_min(f->count, o->count));
+        ++copied;
+    }
+    return copied;
+}
+
+// Invalidates the caches that are derived from the rest of `state`, so that they are rebuilt on the
+// next tick. If a cache kept its layout, its buffers are reused.
+static void reset_state_caches(tm_simulate_state_o* state)
+{
+    state->depth.ready = false;
+    state->scene_cache.valid = false;
+    state->menu_layout.valid = false;
+    state->money_layout.valid = false;
+    state->input = (struct frame_input_t){ 0 };
+}
+
+// Replaces the schema copy of `h` with the [[state_schema]] of this build.
+static void set_handle_schema(struct state_handle_t* h)
+{
+    if (h->schema)
+        tm_free(h->allocator, h->schema, h->num_fields * sizeof(*h->schema));
+    h->schema = tm_alloc(h->allocator, sizeof(state_schema));
+    memcpy(h->schema, state_schema, sizeof(state_schema));
+    h->num_fields = TM_ARRAY_COUNT(state_schema);
+    h->schema_hash = state_schema_hash;
+}
+
+// True if `handle`, the `tm_simulate_state_o` held by the engine, is a [[state_handle_t]]. It
+// isn't if the game was started by a build from before the magic or the handle, or with a
+// different handle version. There is no way to migrate such a state, and neither the start arguments nor the
+// allocator needed to start a new game are available, so the game isn't ticked and must be
+// restarted. This is logged once.
+static bool is_state_handle(tm_simulate_state_o* handle)
+{
+    static bool logged;
+    if (((struct state_handle_t*)handle)->magic == STATE_HANDLE_MAGIC)
+        return true;
+    if (!logged)
+        TM_LOG("The game was started by an incompatible build of the plugin and can't be hot reloaded. Restart the simulation.");
+    logged = true;
+    return false;
+}
+
+// Returns the state of the handle `h`. If a hot reload has changed the [[state_schema]] since the
+// state was laid out, the state is first moved to the new layout with [[migrate_state]], and the
+// item lists and the caches are rebuilt.
+static tm_simulate_state_o* handle_state(struct state_handle_t* h)
+{
+    if (h->schema_hash == state_schema_hash)
+        return h->state;
+
+    const tm_clock_o start_time = tm_os_api->time->now();
+    tm_simulate_state_o* state = tm_alloc(h->allocator, sizeof(*state));
+    memset(state, 0, sizeof(*state));
+    uint32_t num_reset;
+    const uint32_t copied = migrate_state(state, h->state, h->schema, h->num_fields, &num_reset);
+    tm_free(h->allocator, h->state, h->state_size);
+    h->state = state;
+    h->state_size = sizeof(*state);
+    set_handle_schema(h);
+
+    // The allocator isn't game data, so it is restored even if its field changed.
+    state->allocator = h->allocator;
+    reset_state_caches(state);
+    rebuild_item_lists(state);
+    rebase_state(state);
+
+    // The old image loader is abandoned if its layout changed, so a new one is started. Its images
+    // show the placeholder until they have loaded again.
+    if (!state->image_loader) {
+        tm_simulate_start_args_t args = {
+            .tt = h->tt,
+            .asset_root = h->asset_root,
+            .allocator = h->allocator,
+            .ui_renderer = h->ui_renderer,
+            .render_backend = h->render_backend,
+        };
+        start_image_loader(state, &args, start_time);
+        TM_LOG("Started a new image loader, since the reload changed its layout");
     }
+    TM_LOG("Migrated the state to a new layout in %.1f us, %u of %u fields copied, %u old fields reset", tm_os_api->time->delta(tm_os_api->time->now(), start_time) * 1e6,
+        copied, (uint32_t)TM_ARRAY_COUNT(state_schema), num_reset);
+    return state;
 }
 
-// Implements `tm_simulate_entry_i->start()`.
+// Implements `tm_simulate_entry_i->start()`. Returns a [[state_handle_t]].
 static tm_simulate_state_o* simulate__start(tm_simulate_start_args_t* args)
 {
-    TM_STATIC_ASSERT(sizeof(tm_simulate_state_o) < RESERVE_STATE_BYTES);
+    // The scene and the awarded drops store table indices as `uint16_t`.
+    TM_STATIC_ASSERT(NUM_PROPS < UINT16_MAX && NUM_DINOSAURS < UINT16_MAX && NUM_IMAGES < UINT16_MAX);
+
+    const char* schema_error = check_state_schema();
+    TM_ASSERT(!schema_error, tm_error_api->def, "The state schema doesn't match the state: %s (hash of the handle layouts: 0x%016llxULL)", schema_error, (unsigned long long)hash_handle_layouts());
+
+    const tm_clock_o start_time = tm_os_api->time->now();
+    tm_simulate_state_o* state = tm_alloc(args->allocator, sizeof(*state));
+    memset(state, 0, sizeof(*state));
+    reload_data_pack();
 
-    tm_simulate_state_o* state = tm_alloc(args->allocator, RESERVE_STATE_BYTES);
-    memset(state, 0, RESERVE_STATE_BYTES);
     *state = (tm_simulate_state_o){
         .allocator = args->allocator,
-        .money = (uint32_t)roll(rules.start_money),
+        .data_props = props,
+        .data_dinosaurs = dinosaurs,
     };
-
-    for (uint32_t i = 0; i < NUM_IMAGES; ++i)
-        state->images[i] = load_image(args, image_paths[i]);
-
-    return state;
+    seed_random(&state->random, start_replay(state));
+    state->money = (uint32_t)roll(state, rules.start_money);
+
+    const char* save_path = getenv(SAVE_ENV);
+    if (!state->replay && save_path && *save_path && load_game(state, save_path))
+        TM_LOG("Loaded the game from `%s`.", save_path);
+    state->save_timer = SAVE_INTERVAL_SECONDS;
+
+    start_image_loader(state, args, start_time);
+    state->image_loader->first_frame_seconds = tm_os_api->time->delta(tm_os_api->time->now(), start_time);
+
+    struct state_handle_t* h = tm_alloc(args->allocator, sizeof(*h));
+    *h = (struct state_handle_t){
+        .magic = STATE_HANDLE_MAGIC,
+        .state = state,
+        .state_size = sizeof(*state),
+        .allocator = args->allocator,
+        .tt = args->tt,
+        .asset_root = args->asset_root,
+        .render_backend = args->render_backend,
+        .ui_renderer = args->ui_renderer,
+    };
+    set_handle_schema(h);
+    return (tm_simulate_state_o*)h;
 }
 
-// Implements `tm_simulate_entry_i->stop()`.
-static void simulate__stop(tm_simulate_state_o* state)
+// Implements `tm_simulate_entry_i->stop()`. `handle` is the [[state_handle_t]] returned by
+// [[simulate__start]].
+static void simulate__stop(tm_simulate_state_o* handle)
 {
-    tm_allocator_i a = *state->allocator;
-    tm_free(&a, state, RESERVE_STATE_BYTES);
+    // A state that isn't ours is left alone, since we don't know how to free it.
+    if (!is_state_handle(handle))
+        return;
+    struct state_handle_t* h = (struct state_handle_t*)handle;
+    tm_simulate_state_o* state = handle_state(h);
+    if (state->save) {
+        finish_save(state->allocator, state->save);
+        state->save = NULL;
+    }
+    const char* save_path = getenv(SAVE_ENV);
+    if (!state->replay && save_path && *save_path) {
+        const tm_clock_o save_start = tm_os_api->time->now();
+        struct save_t* save = snapshot_game(state, save_path);
+        const double snapshot_seconds = tm_os_api->time->delta(tm_os_api->time->now(), save_start);
+        save_job(save);
+        if (save->ok)
+            TM_LOG("Saved the game to `%s` (%.1f KB) in %.2f ms, snapshot %.2f ms", save_path, (double)save->size / 1024, tm_os_api->time->delta(tm_os_api->time->now(), save_start) * 1000, snapshot_seconds * 1000);
+        finish_save(state->allocator, save);
+    }
+
+    if (state->replay)
+        finish_replay(state);
+    stop_image_loader(state);
+    free_scene(state);
+
+#if DINO_PROFILE
+    const char* trace_path = getenv(PROFILE_TRACE_ENV);
+    if (trace_path && *trace_path)
+        write_profile_trace(trace_path);
+#endif
+
+    tm_allocator_i* a = h->allocator;
+    tm_free(a, state, h->state_size);
+    tm_free(a, h->schema, h->num_fields * sizeof(*h->schema));
+    tm_free(a, h, sizeof(*h));
 }
 
-// Implements `tm_simulate_entry_i->tick()`.
-static void simulate__tick(tm_simulate_state_o* state, tm_simulate_frame_args_t* args)
+// Implements `tm_simulate_entry_i->tick()`. `handle` is the [[state_handle_t]] returned by
+// [[simulate__start]].
+static void simulate__tick(tm_simulate_state_o* handle, tm_simulate_frame_args_t* frame_args)
 {
-    const double speed_multiplier = roll(rules.speed_multiplier);
-    game_logic(state, args->dt_unscaled * speed_multiplier);
+    if (!is_state_handle(handle))
+        return;
+    tm_simulate_state_o* state = handle_state((struct state_handle_t*)handle);
+
+    // A replay may replace the time step and the rect, so we tick on a copy of the arguments.
+    tm_simulate_frame_args_t frame = *frame_args;
+    tm_simulate_frame_args_t* args = &frame;
+    read_input(state, args);
+
+    data_packs.poll_timer -= args->dt_unscaled;
+    if (data_packs.poll_timer <= 0) {
+        data_packs.poll_timer = DATA_PACK_POLL_SECONDS;
+        reload_data_pack();
+    }
+    if (state->data_props != props || state->data_dinosaurs != dinosaurs)
+        rebase_state(state);
+    PROFILE_BEGIN(PROFILE_SCOPE__TICK);
+    update_image_loader(state);
 
+    PROFILE_BEGIN(PROFILE_SCOPE__GAME_LOGIC);
+    step_game(state, args->dt_unscaled);
+    PROFILE_END(PROFILE_SCOPE__GAME_LOGIC);
+
+    PROFILE_BEGIN(PROFILE_SCOPE__SCENE);
     scene(state, args);
+    PROFILE_END(PROFILE_SCOPE__SCENE);
+
+    PROFILE_BEGIN(PROFILE_SCOPE__MONEY);
     money(state, args);
+    PROFILE_END(PROFILE_SCOPE__MONEY);
+
+    PROFILE_BEGIN(PROFILE_SCOPE__MENU + state->state);
     menu(state, args);
+    PROFILE_END(PROFILE_SCOPE__MENU + state->state);
+
+    update_save(state, args->dt_unscaled);
+    PROFILE_END(PROFILE_SCOPE__TICK);
+
+#if DINO_PROFILE
+    // Enable this to show the p50 and p99 times of the profile scopes.
+    bool show_profile_overlay = false;
+    if (show_profile_overlay)
+        profile_overlay(args);
+#endif
 }
 
 // `tm_simulate_entry_i` interface.
@@ -1392,4 +5816,24 @@ TM_DLL_EXPORT void tm_load_plugin(struct tm_api_registry_api* reg, bool load)
     tm_the_truth_api = reg->get(TM_THE_TRUTH_API_NAME);
     tm_temp_allocator_api = reg->get(TM_TEMP_ALLOCATOR_API_NAME);
     tm_random_api = reg->get(TM_RANDOM_API_NAME);
+    tm_job_system_api = reg->get(TM_JOB_SYSTEM_API_NAME);
+    tm_logger_api = reg->get(TM_LOGGER_API_NAME);
+    tm_os_api = reg->get(TM_OS_API_NAME);
+
+    // The indices are built after getting the APIs, since [[build_indices]] reports bad tables.
+    if (load) {
+        build_indices();
+        init_state_schema();
+    } else {
+        for (uint32_t i = 0; i < data_packs.num_packs; ++i)
+            unmap_data_pack(data_packs.packs + i);
+        data_packs.num_packs = 0;
+    }
+
+#if DINO_PROFILE
+    if (load)
+        start_profiler();
+    else
+        stop_profiler();
+#endif
 }
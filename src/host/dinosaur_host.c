@@ -0,0 +1,944 @@
+
+// Headless Linux host for the dinosaur game.
+//
+// Loads `tm_dinosaur_simulate.so`, hands it recording stub versions of the Machinery APIs it uses
+// and drives [[simulate__start]], [[simulate__tick]] and [[simulate__stop]] for a number of frames
+// with synthetic mouse input. When done, it prints per-frame timing percentiles and the number of
+// draw calls the plugin issued.
+//
+// Usage:
+//
+// ~~~
+// dinosaur_host [--plugin <path>] [--frames <n>] [--dt <seconds>] [--seed <n>]
+//     [--width <pixels>] [--height <pixels>] [--clicks-per-second <n>]
+//     [--image-load-ms <ms>] [--job-threads <n>] [--reload <path>] [--reload-frame <n>]
+//     [--missing-art <n>] [--verbose]
+// ~~~
+//
+// `--image-load-ms` makes every creation graph image evaluation take the given time, to model the
+// cost of loading real art. `--reload` models a hot reload: at frame `--reload-frame`
+// (default half of `--frames`) the plugin is unloaded and the plugin at the given path is loaded
+// and ticks the running game. The old library stays mapped, as jobs may still run its code.
+// `--missing-art <n>` makes about one in `n` art paths fail to resolve, to exercise the plugin's
+// handling of missing images (each one is reported as an error). `--verbose` prints the messages
+// the plugin logs and how many images the plugin held at most, as counted by the stub creation
+// graph.
+
+#include <foundation/allocator.h>
+#include <foundation/api_registry.h>
+#include <foundation/error.h>
+#include <foundation/job_system.h>
+#include <foundation/log.h>
+#include <foundation/os.h>
+#include <foundation/random.h>
+#include <foundation/temp_allocator.h>
+#include <foundation/the_truth.h>
+#include <foundation/the_truth_assets.h>
+
+#include <plugins/creation_graph/creation_graph.h>
+#include <plugins/creation_graph/image_nodes.h>
+#include <plugins/simulate/simulate_entry.h>
+#include <plugins/ui/draw2d.h>
+#include <plugins/ui/ui.h>
+#include <plugins/ui/ui_renderer.h>
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Returns the current time in seconds.
+static double host_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Counters
+
+// Number of calls made by the plugin to the stub APIs. Reset by the host between phases.
+struct host_counters_t {
+    uint64_t fill_rect;
+    uint64_t textured_rect;
+    uint64_t atlas_rects;
+    uint64_t texture_switches;
+    uint64_t add_clip_rect;
+    uint64_t text;
+    uint64_t text_metrics;
+    uint64_t make_id;
+    uint64_t is_hovering;
+    uint64_t temp_allocs;
+    uint64_t temp_bytes;
+    uint64_t allocs;
+    uint64_t image_slots;
+    uint64_t creation_graph_instances;
+    uint64_t creation_graph_destroys;
+    uint64_t errors;
+};
+
+static struct host_counters_t counters;
+
+// Number of creation graph instances that the plugin holds, i.e. its resident images, and the most
+// it held at once, with their sizes in bytes. Not reset between phases.
+static uint64_t live_images;
+static uint64_t peak_live_images;
+static uint64_t live_image_bytes;
+static uint64_t peak_live_image_bytes;
+
+// If non-zero, about one in this many art paths can't be found. Set by `--missing-art`.
+static uint32_t missing_art;
+
+// Seconds that each creation graph image evaluation takes. Set by `--image-load-ms`.
+static double image_load_seconds;
+
+// Time of the last `set_image()` call, i.e. when the last image finished loading.
+static double last_set_image_time;
+
+// Returns the total number of draw2d calls in `c`.
+static uint64_t draw2d_calls(const struct host_counters_t* c)
+{
+    return c->fill_rect + c->textured_rect + c->add_clip_rect;
+}
+
+// Allocator
+
+// Implements `tm_allocator_i->realloc()` on top of the C heap.
+static void* host_realloc(tm_allocator_i* a, void* ptr, uint64_t old_size, uint64_t new_size, const char* file, uint32_t line)
+{
+    if (!new_size) {
+        free(ptr);
+        return 0;
+    }
+    if (!ptr)
+        ++counters.allocs;
+    return realloc(ptr, new_size);
+}
+
+static tm_allocator_i host_allocator = { .realloc = host_realloc };
+
+// Temp allocator
+//
+// The stub temp allocator does not use the stack buffer passed to `create_in_buffer()`. Every
+// allocation is a separate heap block, chained so that it can be freed when the temp allocator is
+// destroyed. This keeps the stub simple and lets us count the temp allocations made by the plugin.
+
+// Header for a block allocated by the stub temp allocator.
+struct host_temp_block_t {
+    struct host_temp_block_t* next;
+    uint64_t size;
+};
+
+// Stub temp allocator. Temp allocators are created and destroyed in stack order, so we keep them in
+// a fixed stack.
+struct host_temp_allocator_t {
+    tm_temp_allocator_i i;
+    struct host_temp_block_t* blocks;
+};
+
+enum { MAX_TEMP_ALLOCATORS = 64 };
+static struct host_temp_allocator_t temp_allocators[MAX_TEMP_ALLOCATORS];
+static uint32_t num_temp_allocators;
+
+// Implements `tm_temp_allocator_i->realloc()`.
+static void* host_temp_realloc(struct tm_temp_allocator_o* inst, void* ptr, uint64_t old_size, uint64_t new_size)
+{
+    struct host_temp_allocator_t* ta = (struct host_temp_allocator_t*)inst;
+    if (!new_size)
+        return 0;
+
+    struct host_temp_block_t* b = malloc(sizeof(*b) + new_size);
+    b->next = ta->blocks;
+    b->size = new_size;
+    ta->blocks = b;
+    if (ptr)
+        memcpy(b + 1, ptr, old_size < new_size ? old_size : new_size);
+
+    ++counters.temp_allocs;
+    counters.temp_bytes += new_size;
+    return b + 1;
+}
+
+// Implements `tm_temp_allocator_api->create_in_buffer()`.
+static tm_temp_allocator_i* host_temp_create_in_buffer(char* buffer, uint64_t size, tm_allocator_i* backing)
+{
+    if (num_temp_allocators == MAX_TEMP_ALLOCATORS) {
+        fprintf(stderr, "Temp allocators nested too deep\n");
+        exit(1);
+    }
+    struct host_temp_allocator_t* ta = temp_allocators + num_temp_allocators++;
+    *ta = (struct host_temp_allocator_t){ .i = { .inst = (struct tm_temp_allocator_o*)ta, .realloc = host_temp_realloc } };
+    return &ta->i;
+}
+
+// Implements `tm_temp_allocator_api->create()`.
+static tm_temp_allocator_i* host_temp_create(tm_allocator_i* backing)
+{
+    return host_temp_create_in_buffer(0, 0, backing);
+}
+
+// Implements `tm_temp_allocator_api->destroy()`.
+static void host_temp_destroy(tm_temp_allocator_i* i)
+{
+    struct host_temp_allocator_t* ta = (struct host_temp_allocator_t*)i->inst;
+    for (struct host_temp_block_t* b = ta->blocks, *next; b; b = next) {
+        next = b->next;
+        free(b);
+    }
+    ta->blocks = 0;
+    --num_temp_allocators;
+}
+
+static struct tm_temp_allocator_api host_temp_allocator_api = {
+    .create = host_temp_create,
+    .create_in_buffer = host_temp_create_in_buffer,
+    .destroy = host_temp_destroy,
+};
+
+// Error
+
+// Implements `tm_error_i->errorf()`.
+static void host_errorf(struct tm_error_o* inst, const char* file, uint32_t line, const char* format, ...)
+{
+    ++counters.errors;
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s(%u): error: ", file, line);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+// Implements `tm_error_i->fatal()`.
+static void host_fatal(struct tm_error_o* inst, const char* file, uint32_t line, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s(%u): fatal: ", file, line);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+static tm_error_i host_error = { .errorf = host_errorf, .fatal = host_fatal };
+static struct tm_error_api host_error_api = { .def = &host_error };
+
+// Logger
+
+// If true, messages logged by the plugin are printed. Set by `--verbose`.
+static bool verbose;
+
+// Implements `tm_logger_api->printf()`.
+static int host_log_printf(enum tm_log_type log_type, const char* format, ...)
+{
+    if (!verbose)
+        return 0;
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "log: ");
+    const int n = vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    return n;
+}
+
+static struct tm_logger_api host_logger_api = { .printf = host_log_printf };
+
+// OS
+
+// Implements `tm_os_time_api->now()`. The clock counts nanoseconds.
+static tm_clock_o host_time_now(void)
+{
+    return (tm_clock_o){ (uint64_t)(host_now() * 1e9) };
+}
+
+// Implements `tm_os_time_api->delta()`.
+static double host_time_delta(tm_clock_o to, tm_clock_o from)
+{
+    return (double)(int64_t)(to.opaque - from.opaque) * 1e-9;
+}
+
+static struct tm_os_time_api host_os_time_api = { .now = host_time_now, .delta = host_time_delta };
+
+// Implements `tm_os_virtual_memory_api->map()`.
+static void* host_vm_map(uint64_t size)
+{
+    void* p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+// Implements `tm_os_virtual_memory_api->unmap()`.
+static void host_vm_unmap(void* p, uint64_t size)
+{
+    munmap(p, size);
+}
+
+static struct tm_os_virtual_memory_api host_os_virtual_memory_api = { .map = host_vm_map, .unmap = host_vm_unmap };
+
+// Jobs
+//
+// `run_jobs()` starts a set of threads that take jobs from the batch until it is empty. Waiting for
+// the counter joins the threads and frees the batch.
+
+// Maximum number of threads per batch of jobs.
+enum { MAX_JOB_THREADS = 64 };
+
+// Number of threads to run each batch of jobs on. Set by `--job-threads`.
+static uint32_t job_threads;
+
+// A batch of jobs started by `run_jobs()`. Returned as the `tm_jobs_counter_o`.
+struct host_job_batch_t {
+    tm_jobdecl_t* jobs;
+    uint32_t num_jobs;
+
+    // Index of the next job to run. Incremented atomically by the threads.
+    uint32_t next_job;
+
+    uint32_t num_threads;
+    pthread_t threads[MAX_JOB_THREADS];
+};
+
+// Thread function that runs jobs from the [[host_job_batch_t]] `data` until there are none left.
+static void* host_job_thread(void* data)
+{
+    struct host_job_batch_t* b = data;
+    for (uint32_t i; (i = __atomic_fetch_add(&b->next_job, 1, __ATOMIC_RELAXED)) < b->num_jobs;)
+        b->jobs[i].task(b->jobs[i].data);
+    return 0;
+}
+
+// Implements `tm_job_system_api->run_jobs()`.
+static struct tm_jobs_counter_o* host_run_jobs(tm_jobdecl_t* jobs, uint32_t num_jobs)
+{
+    struct host_job_batch_t* b = calloc(1, sizeof(*b));
+    b->jobs = malloc(num_jobs * sizeof(*jobs));
+    memcpy(b->jobs, jobs, num_jobs * sizeof(*jobs));
+    b->num_jobs = num_jobs;
+    b->num_threads = num_jobs < job_threads ? num_jobs : job_threads;
+    for (uint32_t i = 0; i < b->num_threads; ++i)
+        pthread_create(b->threads + i, 0, host_job_thread, b);
+    return (struct tm_jobs_counter_o*)b;
+}
+
+// Implements `tm_job_system_api->wait_for_counter_and_free()`.
+static void host_wait_for_counter_and_free(struct tm_jobs_counter_o* counter)
+{
+    struct host_job_batch_t* b = (struct host_job_batch_t*)counter;
+    for (uint32_t i = 0; i < b->num_threads; ++i)
+        pthread_join(b->threads[i], 0);
+    free(b->jobs);
+    free(b);
+}
+
+static struct tm_job_system_api host_job_system_api = {
+    .run_jobs = host_run_jobs,
+    .wait_for_counter_and_free = host_wait_for_counter_and_free,
+    .wait_for_counter_and_free_no_fiber = host_wait_for_counter_and_free,
+};
+
+// Implements `tm_os_info_api->num_logical_processors()`. Returns the number of job threads, which
+// is what the plugin sizes its per-thread data from.
+static uint32_t host_num_logical_processors(void)
+{
+    return job_threads;
+}
+
+static struct tm_os_info_api host_os_info_api = { .num_logical_processors = host_num_logical_processors };
+static struct tm_os_api host_os_api = { .virtual_memory = &host_os_virtual_memory_api, .info = &host_os_info_api, .time = &host_os_time_api };
+
+// Random
+//
+// The plugin seeds the random stream of its state from `tm_random_api->next()`, which comes from a
+// xorshift128+ generator seeded from the command line, so that runs with the same seed and input
+// are repeatable.
+
+static uint64_t random_state[2] = { 0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL };
+
+// Returns the next number from the xorshift128+ generator `s`.
+static uint64_t xorshift128plus(uint64_t s[2])
+{
+    uint64_t s1 = s[0];
+    const uint64_t s0 = s[1];
+    s[0] = s0;
+    s1 ^= s1 << 23;
+    s[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+    return s[1] + s0;
+}
+
+// Implements `tm_random_api->next()`.
+static uint64_t host_random_next(void)
+{
+    return xorshift128plus(random_state);
+}
+
+static struct tm_random_api host_random_api = { .next = host_random_next };
+
+// The Truth
+//
+// Asset lookups always succeed. We return a non-zero ID derived from the path so that the
+// plugin's "Image not found" check passes.
+
+// Bit set in the path IDs of the atlas pages, so that they can be given the size of a page.
+#define HOST_ATLAS_PAGE_ID 2ULL
+
+// Implements `tm_the_truth_assets_api->asset_from_path()`. Returns a path ID, a hash of the path
+// with the lowest bit set, for any path.
+static tm_tt_id_t host_asset_from_path(struct tm_the_truth_o* tt, tm_tt_id_t root, const char* path)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (const char* s = path; *s; ++s)
+        h = (h ^ (uint8_t)*s) * 1099511628211ULL;
+    if (missing_art && (h >> 32) % missing_art == 0 && strncmp(path, "art/icons/", 10) != 0)
+        return (tm_tt_id_t){ 0 };
+    const uint64_t atlas_page = strncmp(path, "art/atlas/", 10) == 0 ? HOST_ATLAS_PAGE_ID : 0;
+    return (tm_tt_id_t){ .u64 = (h & ~HOST_ATLAS_PAGE_ID) | atlas_page | 1 };
+}
+
+static struct tm_the_truth_assets_api host_the_truth_assets_api = { .asset_from_path = host_asset_from_path };
+
+// Implements `tm_the_truth_api->read()`.
+static const struct tm_the_truth_object_o* host_tt_read(struct tm_the_truth_o* tt, tm_tt_id_t id)
+{
+    return (const struct tm_the_truth_object_o*)(uintptr_t)id.u64;
+}
+
+// Implements `tm_the_truth_api->get_subobject()`.
+static tm_tt_id_t host_tt_get_subobject(struct tm_the_truth_o* tt, const struct tm_the_truth_object_o* obj, uint32_t prop)
+{
+    return (tm_tt_id_t){ .u64 = (uint64_t)(uintptr_t)obj };
+}
+
+static struct tm_the_truth_api host_the_truth_api = {
+    .read = host_tt_read,
+    .get_subobject = host_tt_get_subobject,
+};
+
+// Creation graph
+
+// Image data returned for the creation graph image outputs. Sized like the game's art and the
+// atlas pages written by the packer, so that the plugin's image budget sees realistic sizes. The
+// resource of an atlas page marks it for [[host_set_image]].
+static tm_creation_graph_image_data_t host_image_data = {
+    .desc = { .width = 256, .height = 256, .depth = 1, .mip_levels = 9 },
+};
+static tm_creation_graph_image_data_t host_atlas_page_data = {
+    .handle = { .resource = 1 },
+    .desc = { .width = 2048, .height = 2048, .depth = 1, .mip_levels = 12 },
+};
+
+// Returns the image data of the creation graph asset `asset`.
+static const tm_creation_graph_image_data_t* host_asset_image_data(tm_tt_id_t asset)
+{
+    return asset.u64 & HOST_ATLAS_PAGE_ID ? &host_atlas_page_data : &host_image_data;
+}
+
+// Returns the size in bytes of the image `d`, with its mip chain.
+static uint64_t host_image_bytes(const tm_creation_graph_image_data_t* d)
+{
+    const uint64_t bytes = (uint64_t)d->desc.width * d->desc.height * 4;
+    return d->desc.mip_levels > 1 ? bytes * 4 / 3 : bytes;
+}
+
+// Raises `*peak` to `value` if it's higher.
+static void host_update_peak(uint64_t* peak, uint64_t value)
+{
+    for (uint64_t p = __atomic_load_n(peak, __ATOMIC_RELAXED); value > p;) {
+        if (__atomic_compare_exchange_n(peak, &p, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+}
+
+// Implements `tm_creation_graph_api->create_instance()`.
+static tm_creation_graph_instance_t host_cg_create_instance(struct tm_the_truth_o* tt, tm_tt_id_t asset, tm_creation_graph_context_t* ctx)
+{
+    // May be called from jobs.
+    __atomic_fetch_add(&counters.creation_graph_instances, 1, __ATOMIC_RELAXED);
+    host_update_peak(&peak_live_images, __atomic_add_fetch(&live_images, 1, __ATOMIC_RELAXED));
+    const uint64_t bytes = host_image_bytes(host_asset_image_data(asset));
+    host_update_peak(&peak_live_image_bytes, __atomic_add_fetch(&live_image_bytes, bytes, __ATOMIC_RELAXED));
+    return (tm_creation_graph_instance_t){ .asset = asset };
+}
+
+// Implements `tm_creation_graph_api->destroy_instance()`.
+static void host_cg_destroy_instance(tm_creation_graph_instance_t* inst, tm_creation_graph_context_t* ctx)
+{
+    ++counters.creation_graph_destroys;
+    __atomic_sub_fetch(&live_images, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&live_image_bytes, host_image_bytes(host_asset_image_data(inst->asset)), __ATOMIC_RELAXED);
+}
+
+// Implements `tm_creation_graph_api->output()`.
+static tm_creation_graph_output_t host_cg_output(tm_creation_graph_instance_t* inst, tm_strhash_t output, tm_creation_graph_context_t* ctx, uint64_t* version)
+{
+    if (image_load_seconds > 0)
+        usleep((useconds_t)(image_load_seconds * 1e6));
+    return (tm_creation_graph_output_t){ .output = host_asset_image_data(inst->asset), .num_output_objects = 1, .stride = sizeof(host_image_data) };
+}
+
+static struct tm_creation_graph_api host_creation_graph_api = {
+    .create_instance = host_cg_create_instance,
+    .destroy_instance = host_cg_destroy_instance,
+    .output = host_cg_output,
+};
+
+// UI renderer
+
+// Implements `tm_ui_renderer_api->allocate_image_slot()`.
+static uint32_t host_allocate_image_slot(struct tm_ui_renderer_o* r)
+{
+    return (uint32_t)++counters.image_slots;
+}
+
+// Maximum number of image slots that can hold atlas pages.
+enum { MAX_HOST_ATLAS_SLOTS = 16 };
+
+// Image slots that hold atlas pages, set by [[host_set_image]].
+static uint32_t host_atlas_slots[MAX_HOST_ATLAS_SLOTS];
+static uint32_t num_host_atlas_slots;
+
+// Implements `tm_ui_renderer_api->set_image()`.
+static void host_set_image(struct tm_ui_renderer_o* r, uint32_t slot, tm_renderer_handle_t image)
+{
+    last_set_image_time = host_now();
+    if (image.resource == host_atlas_page_data.handle.resource && num_host_atlas_slots < MAX_HOST_ATLAS_SLOTS)
+        host_atlas_slots[num_host_atlas_slots++] = slot;
+}
+
+static struct tm_ui_renderer_api host_ui_renderer_api = {
+    .allocate_image_slot = host_allocate_image_slot,
+    .set_image = host_set_image,
+};
+
+// Draw2D
+//
+// The draw calls are only counted, no vertices are generated.
+
+// Image of the last `textured_rect()` call in the frame. Used to count texture switches.
+static uint32_t last_textured_image = UINT32_MAX;
+
+// Implements `tm_draw2d_api->fill_rect()`.
+static void host_fill_rect(tm_draw2d_vbuffer_t* vbuffer, tm_draw2d_ibuffer_t* ibuffer, const tm_draw2d_style_t* style, tm_rect_t r)
+{
+    ++counters.fill_rect;
+}
+
+// Implements `tm_draw2d_api->textured_rect()`.
+static void host_textured_rect(tm_draw2d_vbuffer_t* vbuffer, tm_draw2d_ibuffer_t* ibuffer, const tm_draw2d_style_t* style, tm_rect_t r, uint32_t image, tm_rect_t uv)
+{
+    ++counters.textured_rect;
+    for (uint32_t i = 0; i < num_host_atlas_slots; ++i)
+        counters.atlas_rects += host_atlas_slots[i] == image;
+    if (image != last_textured_image)
+        ++counters.texture_switches;
+    last_textured_image = image;
+}
+
+// Implements `tm_draw2d_api->add_clip_rect()`.
+static uint32_t host_add_clip_rect(tm_draw2d_vbuffer_t* vbuffer, tm_rect_t clip)
+{
+    return (uint32_t)++counters.add_clip_rect;
+}
+
+static struct tm_draw2d_api host_draw2d_api = {
+    .fill_rect = host_fill_rect,
+    .textured_rect = host_textured_rect,
+    .add_clip_rect = host_add_clip_rect,
+};
+
+// UI
+//
+// The stub UI holds the input state and the hover activation. The activation is advanced at the
+// end of every frame, the same way the real UI does it.
+
+// Stub UI state.
+struct host_ui_t {
+    tm_ui_activation_t activation;
+    tm_ui_input_state_t input;
+    uint64_t next_id;
+
+    // Dummy buffers. The plugin only passes them back to the stub [[host_draw2d_api]].
+    uint64_t vbuffer[4];
+    tm_draw2d_ibuffer_t ibuffer[4];
+    tm_draw2d_ibuffer_t* ibuffers[1];
+};
+
+static struct host_ui_t host_ui;
+
+// Implements `tm_ui_api->buffers()`.
+static tm_ui_buffers_t host_ui_buffers(struct tm_ui_o* ui)
+{
+    host_ui.ibuffers[0] = host_ui.ibuffer;
+    return (tm_ui_buffers_t){
+        .activation = &host_ui.activation,
+        .input = &host_ui.input,
+        .vbuffer = (tm_draw2d_vbuffer_t*)host_ui.vbuffer,
+        .ibuffers = host_ui.ibuffers,
+    };
+}
+
+// Implements `tm_ui_api->to_draw_style()`.
+static void host_ui_to_draw_style(struct tm_ui_o* ui, tm_draw2d_style_t* style, const tm_ui_style_t* uistyle)
+{
+    *style = (tm_draw2d_style_t){ .color = { 255, 255, 255, 255 } };
+}
+
+// Implements `tm_ui_api->make_id()`.
+static uint64_t host_ui_make_id(struct tm_ui_o* ui)
+{
+    ++counters.make_id;
+    return ++host_ui.next_id;
+}
+
+// Implements `tm_ui_api->is_hovering()`.
+static bool host_ui_is_hovering(struct tm_ui_o* ui, tm_rect_t r, uint32_t clip)
+{
+    ++counters.is_hovering;
+    const tm_vec2_t p = host_ui.input.mouse_pos;
+    return p.x >= r.x && p.x < r.x + r.w && p.y >= r.y && p.y < r.y + r.h;
+}
+
+// Implements `tm_ui_api->text_metrics()`. Pretends that every glyph is 8 x 18 pixels.
+static tm_rect_t host_ui_text_metrics(const tm_ui_style_t* uistyle, const char* text)
+{
+    ++counters.text_metrics;
+    const float scale = uistyle->font_scale ? uistyle->font_scale : 1.0f;
+    return (tm_rect_t){ 0, 0, 8.0f * scale * (float)strlen(text), 18.0f * scale };
+}
+
+// Implements `tm_ui_api->text()`.
+static tm_rect_t host_ui_text(struct tm_ui_o* ui, const tm_ui_style_t* uistyle, const tm_ui_text_t* c)
+{
+    ++counters.text;
+    const tm_rect_t m = host_ui_text_metrics(uistyle, c->text);
+    --counters.text_metrics;
+    return (tm_rect_t){ c->rect.x, c->rect.y, m.w, m.h };
+}
+
+static struct tm_ui_api host_ui_api = {
+    .buffers = host_ui_buffers,
+    .to_draw_style = host_ui_to_draw_style,
+    .make_id = host_ui_make_id,
+    .is_hovering = host_ui_is_hovering,
+    .text = host_ui_text,
+    .text_metrics = host_ui_text_metrics,
+};
+
+// Ends the UI frame. Promotes `next_hover` to `hover` and clears the per-frame input.
+static void host_ui_end_frame(void)
+{
+    host_ui.activation.hover = host_ui.activation.next_hover;
+    host_ui.activation.next_hover = 0;
+    host_ui.input.left_mouse_pressed = false;
+    host_ui.input.left_mouse_released = false;
+    host_ui.next_id = 0;
+    last_textured_image = UINT32_MAX;
+}
+
+// API registry
+
+// Implementation of [[TM_SIMULATE_ENTRY_INTERFACE_NAME]] registered by the plugin.
+static tm_simulate_entry_i* simulate_entry;
+
+// Implements `tm_api_registry_api->get()`.
+static void* host_registry_get(const char* name)
+{
+    static const struct {
+        const char* name;
+        void* api;
+    } apis[] = {
+        { TM_UI_API_NAME, &host_ui_api },
+        { TM_DRAW2D_API_NAME, &host_draw2d_api },
+        { TM_THE_TRUTH_ASSETS_API_NAME, &host_the_truth_assets_api },
+        { TM_CREATION_GRAPH_API_NAME, &host_creation_graph_api },
+        { TM_UI_RENDERER_API_NAME, &host_ui_renderer_api },
+        { TM_ERROR_API_NAME, &host_error_api },
+        { TM_THE_TRUTH_API_NAME, &host_the_truth_api },
+        { TM_TEMP_ALLOCATOR_API_NAME, &host_temp_allocator_api },
+        { TM_RANDOM_API_NAME, &host_random_api },
+        { TM_JOB_SYSTEM_API_NAME, &host_job_system_api },
+        { TM_LOGGER_API_NAME, &host_logger_api },
+        { TM_OS_API_NAME, &host_os_api },
+    };
+    for (uint32_t i = 0; i < TM_ARRAY_COUNT(apis); ++i) {
+        if (strcmp(apis[i].name, name) == 0)
+            return apis[i].api;
+    }
+    fprintf(stderr, "Plugin requested unknown API `%s`\n", name);
+    exit(1);
+}
+
+// Implements `tm_api_registry_api->add_implementation()`.
+static void host_registry_add_implementation(const char* name, void* implementation)
+{
+    if (strcmp(name, TM_SIMULATE_ENTRY_INTERFACE_NAME) == 0)
+        simulate_entry = implementation;
+}
+
+// Implements `tm_api_registry_api->remove_implementation()`.
+static void host_registry_remove_implementation(const char* name, void* implementation)
+{
+    if (strcmp(name, TM_SIMULATE_ENTRY_INTERFACE_NAME) == 0 && simulate_entry == implementation)
+        simulate_entry = 0;
+}
+
+static struct tm_api_registry_api host_registry = {
+    .get = host_registry_get,
+    .add_implementation = host_registry_add_implementation,
+    .remove_implementation = host_registry_remove_implementation,
+};
+
+// Host
+
+// Command line options.
+struct host_options_t {
+    const char* plugin;
+    uint32_t frames;
+    double dt;
+    uint64_t seed;
+    float width, height;
+    double clicks_per_second;
+    const char* reload;
+    uint32_t reload_frame;
+};
+
+// Loads the plugin at `path` and stores its library in `lib` and its `tm_load_plugin()` in
+// `load_plugin`. Returns `false` with a message if the plugin couldn't be loaded.
+static bool open_plugin(const char* path, void** lib, void (**load_plugin)(struct tm_api_registry_api* reg, bool load))
+{
+    *lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!*lib) {
+        fprintf(stderr, "Could not load plugin: %s\n", dlerror());
+        return false;
+    }
+    *load_plugin = (void (*)(struct tm_api_registry_api*, bool))dlsym(*lib, "tm_load_plugin");
+    if (!*load_plugin) {
+        fprintf(stderr, "Plugin does not export `tm_load_plugin`\n");
+        return false;
+    }
+    (*load_plugin)(&host_registry, true);
+    if (!simulate_entry) {
+        fprintf(stderr, "Plugin did not register a `%s`\n", TM_SIMULATE_ENTRY_INTERFACE_NAME);
+        return false;
+    }
+    return true;
+}
+
+// Compares two doubles for `qsort()`.
+static int compare_double(const void* a, const void* b)
+{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Returns the `p` percentile (0--1) of the sorted array `(v, n)`.
+static double percentile(const double* v, uint32_t n, double p)
+{
+    const uint32_t i = (uint32_t)(p * (double)(n - 1) + 0.5);
+    return v[i];
+}
+
+// Updates the synthetic mouse input for the next frame. The mouse drifts around the window in a
+// random walk and clicks at random intervals.
+static void synthesize_input(const struct host_options_t* opt, uint64_t input_rng[2])
+{
+    tm_ui_input_state_t* in = &host_ui.input;
+    const tm_vec2_t old = in->mouse_pos;
+
+    const double jump = tm_random_to_double(xorshift128plus(input_rng));
+    if (jump < 0.02) {
+        in->mouse_pos.x = (float)tm_random_to_double(xorshift128plus(input_rng)) * opt->width;
+        in->mouse_pos.y = (float)tm_random_to_double(xorshift128plus(input_rng)) * opt->height;
+    } else {
+        in->mouse_pos.x += (float)(tm_random_to_double(xorshift128plus(input_rng)) - 0.5) * 20.0f;
+        in->mouse_pos.y += (float)(tm_random_to_double(xorshift128plus(input_rng)) - 0.5) * 20.0f;
+        in->mouse_pos.x = in->mouse_pos.x < 0 ? 0 : in->mouse_pos.x > opt->width ? opt->width : in->mouse_pos.x;
+        in->mouse_pos.y = in->mouse_pos.y < 0 ? 0 : in->mouse_pos.y > opt->height ? opt->height : in->mouse_pos.y;
+    }
+    in->mouse_delta = (tm_vec2_t){ in->mouse_pos.x - old.x, in->mouse_pos.y - old.y };
+
+    const bool click = tm_random_to_double(xorshift128plus(input_rng)) < opt->clicks_per_second * opt->dt;
+    in->left_mouse_pressed = click;
+    in->left_mouse_released = click;
+}
+
+// Prints usage information.
+static void print_usage(void)
+{
+    printf("Usage: dinosaur_host [--plugin <path>] [--frames <n>] [--dt <seconds>] [--seed <n>]\n"
+           "    [--width <pixels>] [--height <pixels>] [--clicks-per-second <n>]\n"
+           "    [--image-load-ms <ms>] [--job-threads <n>] [--reload <path>] [--reload-frame <n>]\n"
+           "    [--missing-art <n>] [--verbose]\n");
+}
+
+int main(int argc, char** argv)
+{
+    struct host_options_t opt = {
+        .plugin = "bin/Debug/tm_dinosaur_simulate.so",
+        .frames = 10000,
+        .dt = 1.0 / 60.0,
+        .seed = 1,
+        .width = 1280,
+        .height = 720,
+        .clicks_per_second = 2,
+    };
+    job_threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : 0;
+        if (strcmp(a, "--help") == 0) {
+            print_usage();
+            return 0;
+        } else if (strcmp(a, "--verbose") == 0) {
+            verbose = true;
+            continue;
+        } else if (!v) {
+            print_usage();
+            return 1;
+        }
+
+        if (strcmp(a, "--plugin") == 0)
+            opt.plugin = v;
+        else if (strcmp(a, "--frames") == 0)
+            opt.frames = (uint32_t)strtoul(v, 0, 10);
+        else if (strcmp(a, "--dt") == 0)
+            opt.dt = strtod(v, 0);
+        else if (strcmp(a, "--seed") == 0)
+            opt.seed = strtoull(v, 0, 10);
+        else if (strcmp(a, "--width") == 0)
+            opt.width = strtof(v, 0);
+        else if (strcmp(a, "--height") == 0)
+            opt.height = strtof(v, 0);
+        else if (strcmp(a, "--clicks-per-second") == 0)
+            opt.clicks_per_second = strtod(v, 0);
+        else if (strcmp(a, "--image-load-ms") == 0)
+            image_load_seconds = strtod(v, 0) * 1e-3;
+        else if (strcmp(a, "--job-threads") == 0)
+            job_threads = (uint32_t)strtoul(v, 0, 10);
+        else if (strcmp(a, "--reload") == 0)
+            opt.reload = v;
+        else if (strcmp(a, "--reload-frame") == 0)
+            opt.reload_frame = (uint32_t)strtoul(v, 0, 10);
+        else if (strcmp(a, "--missing-art") == 0)
+            missing_art = (uint32_t)strtoul(v, 0, 10);
+        else {
+            print_usage();
+            return 1;
+        }
+        ++i;
+    }
+    job_threads = job_threads < 1 ? 1 : job_threads > MAX_JOB_THREADS ? MAX_JOB_THREADS : job_threads;
+    if (!opt.frames) {
+        print_usage();
+        return 1;
+    }
+
+    if (!opt.reload_frame)
+        opt.reload_frame = opt.frames / 2;
+    void* lib;
+    void (*load_plugin)(struct tm_api_registry_api* reg, bool load);
+    if (!open_plugin(opt.plugin, &lib, &load_plugin))
+        return 1;
+    void* old_lib = 0;
+
+    random_state[0] ^= opt.seed * 0x9e3779b97f4a7c15ULL;
+    random_state[1] ^= opt.seed;
+    uint64_t input_rng[2] = { 0x243f6a8885a308d3ULL ^ opt.seed, 0x13198a2e03707344ULL };
+    host_ui.input.mouse_pos = (tm_vec2_t){ opt.width / 2, opt.height / 2 };
+
+    // Start
+    tm_simulate_start_args_t start_args = {
+        .asset_root = { .u64 = 1 },
+        .tt = (struct tm_the_truth_o*)&host_the_truth_api,
+        .allocator = &host_allocator,
+        .ui_renderer = (struct tm_ui_renderer_o*)&host_ui_renderer_api,
+    };
+    const double start_t0 = host_now();
+    tm_simulate_state_o* state = simulate_entry->start(&start_args);
+    const double start_time = host_now() - start_t0;
+    const struct host_counters_t start_counters = counters;
+
+    // Tick
+    tm_ui_style_t uistyle = { .font_scale = 1.0f };
+    tm_simulate_frame_args_t frame_args = {
+        .dt = (float)opt.dt,
+        .dt_unscaled = (float)opt.dt,
+        .running = true,
+        .ui = (struct tm_ui_o*)&host_ui,
+        .uistyle = &uistyle,
+        .rect = { 0, 0, opt.width, opt.height },
+    };
+    double* frame_times = malloc(opt.frames * sizeof(*frame_times));
+    memset(&counters, 0, sizeof(counters));
+    for (uint32_t i = 0; i < opt.frames; ++i) {
+        if (opt.reload && i == opt.reload_frame) {
+            load_plugin(&host_registry, false);
+            old_lib = lib;
+            if (!open_plugin(opt.reload, &lib, &load_plugin))
+                return 1;
+            printf("reloaded:      %s at frame %u\n", opt.reload, i);
+        }
+        synthesize_input(&opt, input_rng);
+        const double t0 = host_now();
+        simulate_entry->tick(state, &frame_args);
+        frame_times[i] = host_now() - t0;
+        host_ui_end_frame();
+    }
+    const struct host_counters_t tick_counters = counters;
+    const uint64_t tick_live_images = live_images;
+    const uint64_t tick_live_image_bytes = live_image_bytes;
+
+    // Stop
+    const double stop_t0 = host_now();
+    simulate_entry->stop(state);
+    const double stop_time = host_now() - stop_t0;
+
+    load_plugin(&host_registry, false);
+    dlclose(lib);
+    if (old_lib)
+        dlclose(old_lib);
+
+    // Report
+    double total = 0;
+    for (uint32_t i = 0; i < opt.frames; ++i)
+        total += frame_times[i];
+    qsort(frame_times, opt.frames, sizeof(*frame_times), compare_double);
+
+    const double n = (double)opt.frames;
+    printf("plugin:        %s\n", opt.plugin);
+    printf("frames:        %u (%.1f s simulated)\n", opt.frames, n * opt.dt);
+    printf("start:         %.3f ms (%llu images)\n", start_time * 1e3, (unsigned long long)start_counters.image_slots);
+    printf("images loaded: %.3f ms after start (%llu images, %u job threads)\n", (last_set_image_time - start_t0) * 1e3,
+        (unsigned long long)(start_counters.image_slots + tick_counters.image_slots), job_threads);
+    printf("image loads:   %llu (%llu released during play)\n",
+        (unsigned long long)(start_counters.creation_graph_instances + tick_counters.creation_graph_instances),
+        (unsigned long long)tick_counters.creation_graph_destroys);
+    if (verbose) {
+        const double mb = 1024 * 1024;
+        printf("resident:      %llu images at the last frame (%.1f MB), peak %llu (%.1f MB), %llu after stop\n",
+            (unsigned long long)tick_live_images, tick_live_image_bytes / mb, (unsigned long long)peak_live_images,
+            peak_live_image_bytes / mb, (unsigned long long)live_images);
+    }
+    printf("stop:          %.3f ms\n", stop_time * 1e3);
+    printf("frame time:    mean %.2f us, p50 %.2f us, p90 %.2f us, p99 %.2f us, max %.2f us\n",
+        total / n * 1e6, percentile(frame_times, opt.frames, 0.5) * 1e6, percentile(frame_times, opt.frames, 0.9) * 1e6,
+        percentile(frame_times, opt.frames, 0.99) * 1e6, frame_times[opt.frames - 1] * 1e6);
+    printf("draw2d calls:  %llu (%.1f / frame: fill_rect %.1f, textured_rect %.1f, add_clip_rect %.1f)\n",
+        (unsigned long long)draw2d_calls(&tick_counters), (double)draw2d_calls(&tick_counters) / n,
+        (double)tick_counters.fill_rect / n, (double)tick_counters.textured_rect / n, (double)tick_counters.add_clip_rect / n);
+    printf("textures:      %.1f switches / frame, %.1f rects / frame from %u atlas pages\n", (double)tick_counters.texture_switches / n,
+        (double)tick_counters.atlas_rects / n, num_host_atlas_slots);
+    printf("ui calls:      %.1f text, %.1f text_metrics, %.1f make_id, %.1f is_hovering / frame\n",
+        (double)tick_counters.text / n, (double)tick_counters.text_metrics / n, (double)tick_counters.make_id / n, (double)tick_counters.is_hovering / n);
+    printf("temp allocs:   %.1f / frame (%.0f bytes / frame)\n", (double)tick_counters.temp_allocs / n, (double)tick_counters.temp_bytes / n);
+    printf("errors:        %llu\n", (unsigned long long)(start_counters.errors + tick_counters.errors));
+
+    free(frame_times);
+    return 0;
+}
@@ -0,0 +1,1282 @@
+// Data pack builder for the dinosaur game.
+//
+// Builds a data pack (see [[data_pack_header_t]]) from CSV exports of the game design
+// spreadsheet, so that data edits can be tried in the running game without rebuilding the plugin.
+// Point the `DINO_DATA_PACK` environment variable at the pack to use it.
+//
+// The packer is built as a unity build that includes `dinosaur_simulate.c` directly, so the packed
+// tables always have the same layout as the plugin's. Each table is read from its own CSV file,
+// with a header row naming the columns:
+//
+// * `images.csv`: `image`, `path`
+// * `props.csv`: `name`, `image`, `type`, `price`, `margin`, `scale`
+// * `dinosaurs.csv`: `name`, `image`, `type`, `minutes_to_spawn`, `attracted_by`, `margin`, `scale`
+// * `drops.csv`: `dinosaur`, `drop`, `quantity_min`, `quantity_max`, `probability`
+// * `mementos.csv`: `name`, `image`, `sell_value`
+// * `rules.csv`: `rule`, `min`, `max`, for the design rules in [[rule_fields]]. The engine settings
+//   in [[rules_t]] aren't stored in the pack.
+// * `atlas.csv`: `image`, `width`, `height`
+//
+// Images are referred to by their [[IMAGE]] enum names, and types by their enum names without the
+// prefix (`VEG`, `HERBIVORE`, ...). A missing file keeps the compiled table. The tables are
+// validated before anything is written, and the pack is written to a temporary file and renamed
+// into place, so a running plugin never sees a partially written pack.
+//
+// `atlas.csv` lists the images to put in the atlas (see [[atlas_rect_t]]) with their size in
+// pixels. The packer lays them out on [[ATLAS_PAGE_SIZE]] pages, stores the rects in the pack and
+// writes the layout to `<pack>.atlas.csv` (`page`, `image`, `path`, `x`, `y`, `width`, `height`).
+// With `--project`, the sizes are read from the imported art of the project, so they can be left
+// empty, and the page images are composed from it and written to `<pack>.page_<n>.tga`, to be
+// imported at [[ATLAS_PAGE_PATH]].
+//
+// `regions.ppm` is a mask of the [[REGION]]s, painted over the background art in a binary PPM
+// (`P6`) image with the background's 2:1 aspect ratio, in the [[region_colors]]. The packer bakes
+// it into the [[region_map]]: each cell gets the region of most of its pixels, with each pixel
+// classified by the nearest color. `--export` writes the compiled map as a starting point, and
+// `art/backgrounds/regions.ppm` is a mask traced from the background art.
+//
+// Usage:
+//
+// ~~~
+// dinosaur_pack [--project <dir>] <csv-dir> <pack>     Builds a pack from the CSV files in <csv-dir>.
+// dinosaur_pack [--project <dir>] --export <csv-dir>   Writes the compiled tables to <csv-dir>.
+// dinosaur_pack --info <pack>                          Checks a pack and prints its contents and load time.
+// ~~~
+
+#include "../dinosaur_simulate.c"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Names
+
+// Names of the [[IMAGE]] enum values, as used in the CSV files.
+static const char* image_names[NUM_IMAGES] = {
+    [PLACEHOLDER] = "PLACEHOLDER",
+    [BACKGROUND_LAYER_0] = "BACKGROUND_LAYER_0",
+    [BACKGROUND_LAYER_1] = "BACKGROUND_LAYER_1",
+    [BACKGROUND_LAYER_2] = "BACKGROUND_LAYER_2",
+    [BACKGROUND_LAYER_3] = "BACKGROUND_LAYER_3",
+    [BACKGROUND_LAYER_4] = "BACKGROUND_LAYER_4",
+    [ANKYLOSAURUS] = "ANKYLOSAURUS",
+    [ANKYLOSAURUS_2] = "ANKYLOSAURUS_2",
+    [APATOSAURUS] = "APATOSAURUS",
+    [BRACHIOSAURUS] = "BRACHIOSAURUS",
+    [BRACHIOSAURUS_2] = "BRACHIOSAURUS_2",
+    [CARNOTAURUS] = "CARNOTAURUS",
+    [DIMORPHODON] = "DIMORPHODON",
+    [PACHYCEPHALOSAURUS] = "PACHYCEPHALOSAURUS",
+    [PARASAUROLOPHUS] = "PARASAUROLOPHUS",
+    [PARASAUROLOPHUS_2] = "PARASAUROLOPHUS_2",
+    [PLESIOSAURUS] = "PLESIOSAURUS",
+    [PLIOSAURUS] = "PLIOSAURUS",
+    [PTERANODON] = "PTERANODON",
+    [SPINOSAURUS] = "SPINOSAURUS",
+    [STEGOSAURUS] = "STEGOSAURUS",
+    [STEGOSAURUS_2] = "STEGOSAURUS_2",
+    [STEGOSAURUS_3] = "STEGOSAURUS_3",
+    [STYGIMOLOCH] = "STYGIMOLOCH",
+    [THERIZINOSAURUS] = "THERIZINOSAURUS",
+    [TRICERATOPS] = "TRICERATOPS",
+    [TRICERATOPS_2] = "TRICERATOPS_2",
+    [TYRANNOSAURUS] = "TYRANNOSAURUS",
+    [UTAHCERATOPS] = "UTAHCERATOPS",
+    [VELOCIRAPTOR] = "VELOCIRAPTOR",
+    [ALBUM] = "ALBUM",
+    [BACK] = "BACK",
+    [BONE] = "BONE",
+    [CLOSE] = "CLOSE",
+    [INVENTORY] = "INVENTORY",
+    [MENU] = "MENU",
+    [MENU_BACKGROUND] = "MENU_BACKGROUND",
+    [SHOP] = "SHOP",
+    [SQUARE] = "SQUARE",
+    [LEFT_ARROW] = "LEFT_ARROW",
+    [RIGHT_ARROW] = "RIGHT_ARROW",
+    [MEMENTOS] = "MEMENTOS",
+    [BANANA_BUNCH] = "BANANA_BUNCH",
+    [BERRY_BUNCH] = "BERRY_BUNCH",
+    [DEAD_MOUSE] = "DEAD_MOUSE",
+    [FISH] = "FISH",
+    [HAM] = "HAM",
+    [HAUNCH] = "HAUNCH",
+    [HERB_BUNDLE] = "HERB_BUNDLE",
+    [LEAVES] = "LEAVES",
+    [MEAT] = "MEAT",
+    [SQUID] = "SQUID",
+    [STARFISH] = "STARFISH",
+    [URCHIN] = "URCHIN",
+    [ORE] = "ORE",
+    [DIAMOND] = "DIAMOND",
+    [AGATE] = "AGATE",
+    [BRANCH] = "BRANCH",
+    [COCONUT] = "COCONUT",
+    [DEAD_BIRD] = "DEAD_BIRD",
+    [FEATHER] = "FEATHER",
+    [FERN] = "FERN",
+    [LAVENDER] = "LAVENDER",
+    [PEARL] = "PEARL",
+    [SHELL] = "SHELL",
+};
+
+// Names of the [[PROP_TYPE]] enum values.
+static const char* prop_type_names[] = { "VEG", "MEAT", "FISH" };
+
+// Names of the [[DINO_TYPE]] enum values.
+static const char* dino_type_names[] = { "HERBIVORE", "CARNIVORE", "PTEROSAUR", "ICTYOSAUR" };
+
+// Names of the [[REGION]] enum values.
+static const char* region_names[NUM_REGIONS] = { "LAND", "LAKE", "SHORE", "OFF_LIMITS" };
+
+// Errors
+
+// Number of errors reported so far. Nothing is written if there are errors.
+static uint32_t num_errors;
+
+// Reports an error in `file`.
+static void error(const char* file, const char* format, ...)
+{
+    ++num_errors;
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s: error: ", file);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+// Reports a problem in `file` that doesn't stop the pack from being written.
+static void warning(const char* file, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s: warning: ", file);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+// Implements `tm_error_i->errorf()` and `tm_error_i->fatal()` for errors reported by the plugin
+// code.
+static void pack_errorf(struct tm_error_o* inst, const char* file, uint32_t line, const char* format, ...)
+{
+    ++num_errors;
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "error: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+static tm_error_i pack_error = { .errorf = pack_errorf, .fatal = pack_errorf };
+static struct tm_error_api pack_error_api = { .def = &pack_error };
+
+// CSV
+
+// Maximum number of columns in a CSV file.
+enum { MAX_CSV_COLUMNS = 32 };
+
+// A row in a CSV file.
+struct csv_row_t {
+    // Line number of the row in the file.
+    uint32_t line;
+
+    uint32_t num_fields;
+    char* fields[MAX_CSV_COLUMNS];
+};
+
+// A CSV file. The fields point into `text`, which is unescaped in place.
+struct csv_t {
+    // Name of the file, used in error messages.
+    const char* name;
+
+    char* text;
+
+    // Rows of the file, not counting empty lines. The first row is the header.
+    uint32_t num_rows;
+    struct csv_row_t* rows;
+};
+
+// Reads the file `name` in `dir` into `csv`. Returns `false` if the file doesn't exist.
+static bool read_csv(struct csv_t* csv, const char* dir, const char* name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    *csv = (struct csv_t){ .name = name, .text = malloc((size_t)size + 1) };
+    const size_t read = fread(csv->text, 1, (size_t)size, f);
+    csv->text[read] = 0;
+    fclose(f);
+
+    // Every row has at least one character, so this is enough rows.
+    uint32_t max_rows = 1;
+    for (const char* c = csv->text; *c; ++c)
+        max_rows += *c == '\n';
+    csv->rows = calloc(max_rows, sizeof(*csv->rows));
+
+    // Split into rows and fields. Quoted fields are unescaped in place by copying each character to
+    // `out`, which never gets ahead of `c`.
+    char* c = csv->text;
+    uint32_t line = 1;
+    while (*c) {
+        struct csv_row_t row = { .line = line };
+        for (;;) {
+            char* out = c;
+            char* field = out;
+            if (*c == '"') {
+                ++c;
+                while (*c && !(*c == '"' && c[1] != '"')) {
+                    if (*c == '"')
+                        ++c;
+                    line += *c == '\n';
+                    *out++ = *c++;
+                }
+                if (*c == '"')
+                    ++c;
+                while (*c && *c != ',' && *c != '\n' && *c != '\r')
+                    ++c;
+            } else {
+                while (*c && *c != ',' && *c != '\n' && *c != '\r')
+                    *out++ = *c++;
+            }
+            // Terminating the field may overwrite the separator, so we look at `sep` instead.
+            const char sep = *c;
+            *out = 0;
+            if (row.num_fields < MAX_CSV_COLUMNS)
+                row.fields[row.num_fields++] = field;
+            if (sep)
+                ++c;
+            if (sep == ',')
+                continue;
+            if (sep == '\r' && *c == '\n')
+                ++c;
+            break;
+        }
+        ++line;
+        if (row.num_fields > 1 || row.fields[0][0])
+            csv->rows[csv->num_rows++] = row;
+    }
+    return true;
+}
+
+// Frees the data allocated by [[read_csv]].
+static void free_csv(struct csv_t* csv)
+{
+    free(csv->rows);
+    free(csv->text);
+}
+
+// Returns the index of `column` in the header of `csv`, or `MAX_CSV_COLUMNS` if there is no such
+// column.
+static uint32_t csv_column(const struct csv_t* csv, const char* column)
+{
+    for (uint32_t i = 0; csv->num_rows && i < csv->rows[0].num_fields; ++i) {
+        if (strcmp(csv->rows[0].fields[i], column) == 0)
+            return i;
+    }
+    return MAX_CSV_COLUMNS;
+}
+
+// Checks that `csv` has the `n` specified `columns` and `count` data rows.
+static bool check_csv(const struct csv_t* csv, const char** columns, uint32_t n, uint32_t count)
+{
+    const uint32_t errors = num_errors;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (csv_column(csv, columns[i]) == MAX_CSV_COLUMNS)
+            error(csv->name, "missing column `%s`", columns[i]);
+    }
+    if (count && csv->num_rows != count + 1) {
+        error(csv->name, "has %u rows, but the plugin was built with %u (adding or removing entries requires a rebuild of the plugin)",
+            csv->num_rows ? csv->num_rows - 1 : 0, count);
+    }
+    return num_errors == errors;
+}
+
+// Returns the field in `column` of `row`. Returns an empty string if the row is too short.
+static const char* field(const struct csv_t* csv, const struct csv_row_t* row, const char* column)
+{
+    const uint32_t i = csv_column(csv, column);
+    return i < row->num_fields ? row->fields[i] : "";
+}
+
+// Parsing
+
+// Parses the number in `column` of `row`.
+static double parse_number(const struct csv_t* csv, const struct csv_row_t* row, const char* column)
+{
+    const char* s = field(csv, row, column);
+    char* end;
+    const double v = strtod(s, &end);
+    while (*end == ' ')
+        ++end;
+    if (end == s || *end)
+        error(csv->name, "line %u: `%s` is not a number (%s)", row->line, s, column);
+    return v;
+}
+
+// Parses the non-negative integer in `column` of `row`.
+static uint32_t parse_uint(const struct csv_t* csv, const struct csv_row_t* row, const char* column)
+{
+    const double v = parse_number(csv, row, column);
+    if (v < 0 || v > UINT32_MAX || v != floor(v))
+        error(csv->name, "line %u: %s must be a non-negative integer", row->line, column);
+    return (uint32_t)v;
+}
+
+// Parses the enum name `s` from the list of `n` `names`. Returns `n` if not found.
+static uint32_t find_name(const char* s, const char** names, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        if (names[i] && strcmp(s, names[i]) == 0)
+            return i;
+    }
+    return n;
+}
+
+// Parses the enum name in `column` of `row` from the list of `n` `names`.
+static uint32_t parse_enum(const struct csv_t* csv, const struct csv_row_t* row, const char* column, const char** names, uint32_t n)
+{
+    const char* s = field(csv, row, column);
+    const uint32_t v = find_name(s, names, n);
+    if (v == n) {
+        error(csv->name, "line %u: unknown %s `%s`", row->line, column, s);
+        return 0;
+    }
+    return v;
+}
+
+// Parses the image name in `column` of `row`.
+static enum IMAGE parse_image(const struct csv_t* csv, const struct csv_row_t* row, const char* column)
+{
+    return parse_enum(csv, row, column, image_names, NUM_IMAGES);
+}
+
+// Copies the string in `column` of `row` to the `size` bytes at `dst`.
+static void parse_string(char* dst, uint32_t size, const struct csv_t* csv, const struct csv_row_t* row, const char* column)
+{
+    const char* s = field(csv, row, column);
+    if (strlen(s) >= size)
+        error(csv->name, "line %u: %s `%s` is longer than %u characters", row->line, column, s, size - 1);
+    memset(dst, 0, size);
+    strncpy(dst, s, size - 1);
+}
+
+// Tables
+
+// Tables of a data pack, in the order they are stored.
+struct tables_t {
+    char image_paths[NUM_IMAGES][IMAGE_PATH_SIZE];
+    struct prop_t props[NUM_PROPS];
+    struct dinosaur_t dinosaurs[NUM_DINOSAURS];
+    struct drop_t drops[NUM_DROPS];
+    struct memento_t mementos[NUM_MEMENTOS];
+    struct rules_t rules;
+    uint32_t num_atlas_pages;
+    char atlas_pages[MAX_ATLAS_PAGES][IMAGE_PATH_SIZE];
+    struct atlas_rect_t atlas_rects[NUM_IMAGES];
+    uint8_t regions[REGION_MAP_HEIGHT][REGION_MAP_WIDTH];
+};
+
+// Reads `images.csv`. Images that aren't listed keep their compiled path.
+static void read_images(struct tables_t* t, const char* dir)
+{
+    struct csv_t csv;
+    if (!read_csv(&csv, dir, "images.csv"))
+        return;
+    if (check_csv(&csv, (const char*[]){ "image", "path" }, 2, 0)) {
+        for (const struct csv_row_t* row = csv.rows + 1; row < csv.rows + csv.num_rows; ++row)
+            parse_string(t->image_paths[parse_image(&csv, row, "image")], IMAGE_PATH_SIZE, &csv, row, "path");
+    }
+    free_csv(&csv);
+}
+
+// Reads `props.csv`.
+static void read_props(struct tables_t* t, const char* dir)
+{
+    struct csv_t csv;
+    if (!read_csv(&csv, dir, "props.csv"))
+        return;
+    if (check_csv(&csv, (const char*[]){ "name", "image", "type", "price", "margin", "scale" }, 6, NUM_PROPS)) {
+        for (uint32_t i = 0; i < NUM_PROPS; ++i) {
+            const struct csv_row_t* row = csv.rows + 1 + i;
+            struct prop_t* p = t->props + i;
+            parse_string(p->name, NAME_SIZE, &csv, row, "name");
+            p->image = parse_image(&csv, row, "image");
+            p->type = parse_enum(&csv, row, "type", prop_type_names, TM_ARRAY_COUNT(prop_type_names));
+            p->price = parse_uint(&csv, row, "price");
+            p->margin = parse_number(&csv, row, "margin");
+            p->scale = parse_number(&csv, row, "scale");
+        }
+    }
+    free_csv(&csv);
+}
+
+// Reads `dinosaurs.csv`. The `attracted_by` column holds up to [[MAX_ATTRACTED_BY]] space
+// separated prop images.
+static void read_dinosaurs(struct tables_t* t, const char* dir)
+{
+    struct csv_t csv;
+    if (!read_csv(&csv, dir, "dinosaurs.csv"))
+        return;
+    if (check_csv(&csv, (const char*[]){ "name", "image", "type", "minutes_to_spawn", "attracted_by", "margin", "scale" }, 7, NUM_DINOSAURS)) {
+        for (uint32_t i = 0; i < NUM_DINOSAURS; ++i) {
+            const struct csv_row_t* row = csv.rows + 1 + i;
+            struct dinosaur_t* d = t->dinosaurs + i;
+            parse_string(d->name, NAME_SIZE, &csv, row, "name");
+            d->image = parse_image(&csv, row, "image");
+            d->type = parse_enum(&csv, row, "type", dino_type_names, TM_ARRAY_COUNT(dino_type_names));
+            d->minutes_to_spawn = parse_number(&csv, row, "minutes_to_spawn");
+            d->margin = parse_number(&csv, row, "margin");
+            d->scale = parse_number(&csv, row, "scale");
+
+            char attracted_by[256];
+            parse_string(attracted_by, sizeof(attracted_by), &csv, row, "attracted_by");
+            memset(d->attracted_by, 0, sizeof(d->attracted_by));
+            uint32_t n = 0;
+            for (char* s = strtok(attracted_by, " "); s; s = strtok(NULL, " ")) {
+                const uint32_t image = find_name(s, image_names, NUM_IMAGES);
+                if (image == NUM_IMAGES)
+                    error(csv.name, "line %u: unknown attracted_by `%s`", row->line, s);
+                else if (n == MAX_ATTRACTED_BY)
+                    error(csv.name, "line %u: more than %u attracted_by", row->line, (uint32_t)MAX_ATTRACTED_BY);
+                else
+                    d->attracted_by[n++] = image;
+            }
+        }
+    }
+    free_csv(&csv);
+}
+
+// Reads `drops.csv`.
+static void read_drops(struct tables_t* t, const char* dir)
+{
+    struct csv_t csv;
+    if (!read_csv(&csv, dir, "drops.csv"))
+        return;
+    if (check_csv(&csv, (const char*[]){ "dinosaur", "drop", "quantity_min", "quantity_max", "probability" }, 5, NUM_DROPS)) {
+        for (uint32_t i = 0; i < NUM_DROPS; ++i) {
+            const struct csv_row_t* row = csv.rows + 1 + i;
+            struct drop_t* d = t->drops + i;
+            d->dinosaur_image = parse_image(&csv, row, "dinosaur");
+            d->drop_image = parse_image(&csv, row, "drop");
+            d->quantity.min = parse_number(&csv, row, "quantity_min");
+            d->quantity.max = parse_number(&csv, row, "quantity_max");
+            d->probability = parse_number(&csv, row, "probability");
+        }
+    }
+    free_csv(&csv);
+}
+
+// Reads `mementos.csv`.
+static void read_mementos(struct tables_t* t, const char* dir)
+{
+    struct csv_t csv;
+    if (!read_csv(&csv, dir, "mementos.csv"))
+        return;
+    if (check_csv(&csv, (const char*[]){ "name", "image", "sell_value" }, 3, NUM_MEMENTOS)) {
+        for (uint32_t i = 0; i < NUM_MEMENTOS; ++i) {
+            const struct csv_row_t* row = csv.rows + 1 + i;
+            struct memento_t* m = t->mementos + i;
+            parse_string(m->name, NAME_SIZE, &csv, row, "name");
+            m->image = parse_image(&csv, row, "image");
+            m->sell_value = parse_uint(&csv, row, "sell_value");
+        }
+    }
+    free_csv(&csv);
+}
+
+// Reads `rules.csv`. Rules that aren't listed keep their compiled value.
+static void read_rules(struct tables_t* t, const char* dir)
+{
+    struct csv_t csv;
+    if (!read_csv(&csv, dir, "rules.csv"))
+        return;
+    if (check_csv(&csv, (const char*[]){ "rule", "min", "max" }, 3, 0)) {
+        for (const struct csv_row_t* row = csv.rows + 1; row < csv.rows + csv.num_rows; ++row) {
+            const char* name = field(&csv, row, "rule");
+            const struct rule_field_t* f = rule_fields;
+            while (f != TM_ARRAY_END(rule_fields) && strcmp(f->name, name))
+                ++f;
+            if (f == TM_ARRAY_END(rule_fields)) {
+                error(csv.name, "line %u: unknown rule `%s`", row->line, name);
+                continue;
+            }
+            struct range_t* r = (struct range_t*)((char*)&t->rules + f->offset);
+            r->min = parse_number(&csv, row, "min");
+            r->max = parse_number(&csv, row, "max");
+        }
+    }
+    free_csv(&csv);
+}
+
+// Checks that `r` is a valid range of non-negative values. If `interval` is set, it is an interval
+// between events and `max` must also be positive. See [[is_valid_range]].
+static void check_range(const char* file, const char* name, const char* what, struct range_t r, bool interval)
+{
+    if (!is_valid_range(r, interval))
+        error(file, "%s: %s must satisfy 0 <= min <= max%s", name, what, interval ? " and max > 0" : "");
+}
+
+// Checks the references between the tables and the ranges of the values.
+static void check_tables(const struct tables_t* t)
+{
+    enum ITEM_KIND kind[NUM_IMAGES] = { 0 };
+    for (const struct prop_t* p = t->props; p != t->props + NUM_PROPS; ++p) {
+        if (kind[p->image])
+            error("props.csv", "%s: image %s is used by more than one item", p->name, image_names[p->image]);
+        kind[p->image] = ITEM_KIND__PROP;
+        if (!is_positive(p->scale))
+            error("props.csv", "%s: scale must be positive", p->name);
+    }
+    for (const struct dinosaur_t* d = t->dinosaurs; d != t->dinosaurs + NUM_DINOSAURS; ++d) {
+        if (kind[d->image])
+            error("dinosaurs.csv", "%s: image %s is used by more than one item", d->name, image_names[d->image]);
+        kind[d->image] = ITEM_KIND__DINOSAUR;
+        if (!is_positive(d->minutes_to_spawn))
+            error("dinosaurs.csv", "%s: minutes_to_spawn must be positive", d->name);
+        if (!is_positive(d->scale))
+            error("dinosaurs.csv", "%s: scale must be positive", d->name);
+    }
+    for (const struct memento_t* m = t->mementos; m != t->mementos + NUM_MEMENTOS; ++m) {
+        if (kind[m->image])
+            error("mementos.csv", "%s: image %s is used by more than one item", m->name, image_names[m->image]);
+        kind[m->image] = ITEM_KIND__MEMENTO;
+    }
+
+    for (const struct dinosaur_t* d = t->dinosaurs; d != t->dinosaurs + NUM_DINOSAURS; ++d) {
+        for (uint32_t a = 0; a < MAX_ATTRACTED_BY; ++a) {
+            if (d->attracted_by[a] && kind[d->attracted_by[a]] != ITEM_KIND__PROP)
+                error("dinosaurs.csv", "%s: attracted_by %s is not a prop", d->name, image_names[d->attracted_by[a]]);
+        }
+    }
+    uint32_t drops_per_image[NUM_IMAGES] = { 0 };
+    for (const struct drop_t* d = t->drops; d != t->drops + NUM_DROPS; ++d) {
+        const char* name = image_names[d->dinosaur_image];
+        if (kind[d->dinosaur_image] != ITEM_KIND__DINOSAUR)
+            error("drops.csv", "%s is not a dinosaur", name);
+        if (++drops_per_image[d->dinosaur_image] == MAX_AWARD_ITEMS + 1)
+            error("drops.csv", "%s has more than %d drops", name, MAX_AWARD_ITEMS);
+        if (kind[d->drop_image] != ITEM_KIND__PROP && kind[d->drop_image] != ITEM_KIND__MEMENTO)
+            error("drops.csv", "%s: drop %s is not a prop or a memento", name, image_names[d->drop_image]);
+        check_range("drops.csv", name, "quantity", d->quantity, false);
+        if (!(d->probability >= 0 && d->probability <= 1))
+            error("drops.csv", "%s: probability must be in [0, 1]", name);
+    }
+    for (const struct rule_field_t* f = rule_fields; f != TM_ARRAY_END(rule_fields); ++f)
+        check_range("rules.csv", f->name, "range", *(const struct range_t*)((const char*)&t->rules + f->offset), f->interval);
+}
+
+// Atlas
+
+// Width and height of an atlas page in pixels.
+enum { ATLAS_PAGE_SIZE = 2048 };
+
+// Pixels left free around each image, so that filtering doesn't bleed between images.
+enum { ATLAS_PADDING = 2 };
+
+// Format of the asset paths of the atlas pages, given the page index.
+#define ATLAS_PAGE_PATH "art/atlas/page_%u.creation"
+
+// An image placed in the atlas.
+struct atlas_entry_t {
+    enum IMAGE image;
+    uint32_t page;
+    uint32_t x, y, w, h;
+};
+
+// Images in the atlas, set by [[read_atlas]].
+static uint32_t num_atlas_entries;
+static struct atlas_entry_t atlas_entries[NUM_IMAGES];
+
+// Sorts [[atlas_entry_t]] by decreasing height, then by image, so the layout is deterministic.
+static int compare_atlas_entries(const void* a, const void* b)
+{
+    const struct atlas_entry_t* x = a;
+    const struct atlas_entry_t* y = b;
+    if (x->h != y->h)
+        return x->h < y->h ? 1 : -1;
+    return (int)x->image - (int)y->image;
+}
+
+// Project directory with the imported art, set by `--project`. If set, the atlas image sizes are
+// read from the art and the page images are composed from it.
+static const char* project_dir;
+
+// Writes the path of the pixel buffer of the image asset `image_path` in [[project_dir]] to `buf`.
+// Returns `false` if the asset doesn't exist or doesn't reference a buffer.
+//
+// An imported image is a `.tm_creation` asset whose image archive references a `.tm_buffers`
+// file with the RGBA8 pixels, named by the hash in its `buffer` property.
+static bool art_buffer_path(char* buf, size_t size, const char* image_path)
+{
+    const char* ext = strrchr(image_path, '.');
+    const int stem = ext ? (int)(ext - image_path) : (int)strlen(image_path);
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%.*s.tm_creation", project_dir, stem, image_path);
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return false;
+    char line[1024];
+    bool found = false;
+    unsigned long long hash = 0;
+    while (!found && fgets(line, sizeof(line), f)) {
+        const char* b = strstr(line, "buffer: \"");
+        found = b && sscanf(b + 9, "%16llx", &hash) == 1;
+    }
+    fclose(f);
+    if (!found)
+        return false;
+    // The file is named by the hash without leading zeros.
+    snprintf(buf, size, "%s/%.*s.tm_buffers/%llx", project_dir, stem, image_path, hash);
+    return true;
+}
+
+// Reads the size of the image asset `image_path` in [[project_dir]]. Returns `false` if its pixels
+// are missing. The image archive doesn't store the size, so the image must be square, like all the
+// game's art is.
+static bool read_art_size(const char* image_path, uint32_t* w, uint32_t* h)
+{
+    char path[1024];
+    struct stat st;
+    if (!art_buffer_path(path, sizeof(path), image_path) || stat(path, &st))
+        return false;
+    const uint32_t side = (uint32_t)sqrt((double)st.st_size / 4);
+    if ((uint64_t)side * side * 4 != (uint64_t)st.st_size) {
+        error(path, "%lld bytes isn't a square RGBA8 image", (long long)st.st_size);
+        return false;
+    }
+    *w = *h = side;
+    return true;
+}
+
+// Reads the RGBA8 pixels of the `w` x `h` image asset `image_path` in [[project_dir]]. Returns
+// them allocated with `malloc()`, or `NULL` if they can't be read.
+static uint8_t* read_art_pixels(const char* image_path, uint32_t w, uint32_t h)
+{
+    char path[1024];
+    if (!art_buffer_path(path, sizeof(path), image_path))
+        return NULL;
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    const size_t size = (size_t)w * h * 4;
+    uint8_t* pixels = malloc(size);
+    const bool read = fread(pixels, 1, size, f) == size;
+    fclose(f);
+    if (!read) {
+        free(pixels);
+        return NULL;
+    }
+    return pixels;
+}
+
+// Reads `atlas.csv` into [[atlas_entries]]. The `width` and `height` of an image can be left empty
+// if [[project_dir]] is set, in which case they are read from the art. Images whose art is missing
+// from the project are left out of the atlas, so they are drawn from their own textures.
+static void read_atlas(const struct tables_t* t, const char* dir)
+{
+    struct csv_t csv;
+    if (!read_csv(&csv, dir, "atlas.csv"))
+        return;
+    if (check_csv(&csv, (const char*[]){ "image" }, 1, 0)) {
+        bool listed[NUM_IMAGES] = { 0 };
+        for (const struct csv_row_t* row = csv.rows + 1; row < csv.rows + csv.num_rows; ++row) {
+            const enum IMAGE image = parse_image(&csv, row, "image");
+            const bool sized = *field(&csv, row, "width") || *field(&csv, row, "height");
+            uint32_t w = sized ? parse_uint(&csv, row, "width") : 0;
+            uint32_t h = sized ? parse_uint(&csv, row, "height") : 0;
+            if (image == PLACEHOLDER) {
+                error(csv.name, "line %u: PLACEHOLDER is always loaded on its own", row->line);
+                continue;
+            }
+            if (listed[image]) {
+                error(csv.name, "line %u: %s is listed twice", row->line, image_names[image]);
+                continue;
+            }
+            listed[image] = true;
+            if (project_dir) {
+                uint32_t art_w, art_h;
+                if (!read_art_size(t->image_paths[image], &art_w, &art_h)) {
+                    warning(csv.name, "line %u: the art of %s (%s) is missing from %s, leaving it out of the atlas",
+                        row->line, image_names[image], t->image_paths[image], project_dir);
+                    continue;
+                }
+                if (sized && (w != art_w || h != art_h)) {
+                    error(csv.name, "line %u: %s is %u x %u, but the art is %u x %u", row->line, image_names[image], w, h, art_w, art_h);
+                    continue;
+                }
+                w = art_w;
+                h = art_h;
+            } else if (!sized) {
+                error(csv.name, "line %u: no size for %s (pass --project to read it from the art)", row->line, image_names[image]);
+                continue;
+            }
+            if (!w || !h || w + 2 * ATLAS_PADDING > ATLAS_PAGE_SIZE || h + 2 * ATLAS_PADDING > ATLAS_PAGE_SIZE)
+                error(csv.name, "line %u: %s must be between 1 and %u pixels", row->line, image_names[image], ATLAS_PAGE_SIZE - 2 * ATLAS_PADDING);
+            else
+                atlas_entries[num_atlas_entries++] = (struct atlas_entry_t){ .image = image, .w = w, .h = h };
+        }
+    }
+    free_csv(&csv);
+}
+
+// Lays out [[atlas_entries]] on pages with a shelf packer -- the images are sorted by height and
+// placed left to right on shelves as high as their first image -- and stores the result in `t`.
+static void build_atlas(struct tables_t* t)
+{
+    qsort(atlas_entries, num_atlas_entries, sizeof(*atlas_entries), compare_atlas_entries);
+
+    uint32_t page = 0, x = 0, y = 0, shelf_h = 0;
+    for (struct atlas_entry_t* e = atlas_entries; e != atlas_entries + num_atlas_entries; ++e) {
+        const uint32_t w = e->w + 2 * ATLAS_PADDING;
+        const uint32_t h = e->h + 2 * ATLAS_PADDING;
+        if (x + w > ATLAS_PAGE_SIZE) {
+            x = 0;
+            y += shelf_h;
+            shelf_h = 0;
+        }
+        if (y + h > ATLAS_PAGE_SIZE) {
+            ++page;
+            x = y = shelf_h = 0;
+        }
+        if (page == MAX_ATLAS_PAGES) {
+            error("atlas.csv", "images don't fit on %u pages of %u x %u pixels", (uint32_t)MAX_ATLAS_PAGES, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+            return;
+        }
+        e->page = page;
+        e->x = x + ATLAS_PADDING;
+        e->y = y + ATLAS_PADDING;
+        x += w;
+        shelf_h = tm_max(shelf_h, h);
+
+        const float s = 1.0f / ATLAS_PAGE_SIZE;
+        t->atlas_rects[e->image] = (struct atlas_rect_t){ .page = page + 1, .uv = { e->x * s, e->y * s, e->w * s, e->h * s } };
+    }
+
+    t->num_atlas_pages = num_atlas_entries ? page + 1 : 0;
+    for (uint32_t p = 0; p < t->num_atlas_pages; ++p)
+        snprintf(t->atlas_pages[p], IMAGE_PATH_SIZE, ATLAS_PAGE_PATH, p);
+}
+
+// Regions
+
+// Colors of the [[REGION]]s in `regions.ppm`, as `0xRRGGBB`.
+static const uint32_t region_colors[NUM_REGIONS] = {
+    [REGION__LAND] = 0x00ff00,
+    [REGION__LAKE] = 0x0000ff,
+    [REGION__SHORE] = 0xffff00,
+    [REGION__OFF_LIMITS] = 0xff0000,
+};
+
+// Reads the next number in the header of a PPM file, skipping whitespace and comments. Returns
+// zero if there is no number.
+static uint32_t read_ppm_number(FILE* f)
+{
+    int c = fgetc(f);
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#') {
+        if (c == '#') {
+            while (c != '\n' && c != EOF)
+                c = fgetc(f);
+        }
+        c = fgetc(f);
+    }
+    uint32_t n = 0;
+    for (; c >= '0' && c <= '9' && n < 100000; c = fgetc(f))
+        n = n * 10 + (uint32_t)(c - '0');
+    return n;
+}
+
+// Returns the region whose color in [[region_colors]] is nearest to the pixel `rgb`.
+static enum REGION nearest_region(const uint8_t* rgb)
+{
+    enum REGION best = REGION__LAND;
+    int32_t best_d = INT32_MAX;
+    for (uint32_t r = 0; r < NUM_REGIONS; ++r) {
+        const int32_t dr = rgb[0] - (int32_t)(region_colors[r] >> 16 & 0xff);
+        const int32_t dg = rgb[1] - (int32_t)(region_colors[r] >> 8 & 0xff);
+        const int32_t db = rgb[2] - (int32_t)(region_colors[r] & 0xff);
+        const int32_t d = dr * dr + dg * dg + db * db;
+        if (d < best_d) {
+            best = r;
+            best_d = d;
+        }
+    }
+    return best;
+}
+
+// Reads `regions.ppm` and bakes it into the region map of `t`. A missing file keeps the compiled
+// map.
+static void read_regions(struct tables_t* t, const char* dir)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, "regions.ppm");
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return;
+
+    const bool p6 = fgetc(f) == 'P' && fgetc(f) == '6';
+    const uint32_t w = read_ppm_number(f);
+    const uint32_t h = read_ppm_number(f);
+    const uint32_t max_value = read_ppm_number(f);
+    uint8_t* pixels = p6 && w && h && max_value == 255 ? malloc((size_t)w * h * 3) : NULL;
+    const bool read = pixels && fread(pixels, 3, (size_t)w * h, f) == (size_t)w * h;
+    fclose(f);
+    if (!read) {
+        error("regions.ppm", "not a binary PPM image with 8-bit channels");
+        free(pixels);
+        return;
+    }
+    if (w != 2 * h) {
+        error("regions.ppm", "the mask is %u x %u pixels, but must have the 2:1 aspect ratio of the background", w, h);
+        free(pixels);
+        return;
+    }
+
+    // Each cell covers the pixels from its top left corner up to the next cell's, and at least
+    // one pixel if the mask is smaller than the map.
+    for (uint32_t r = 0; r < REGION_MAP_HEIGHT; ++r) {
+        const uint32_t y0 = r * h / REGION_MAP_HEIGHT, y1 = tm_max((r + 1) * h / REGION_MAP_HEIGHT, y0 + 1);
+        for (uint32_t c = 0; c < REGION_MAP_WIDTH; ++c) {
+            const uint32_t x0 = c * w / REGION_MAP_WIDTH, x1 = tm_max((c + 1) * w / REGION_MAP_WIDTH, x0 + 1);
+            uint32_t votes[NUM_REGIONS] = { 0 };
+            for (uint32_t y = y0; y < y1; ++y) {
+                for (uint32_t x = x0; x < x1; ++x)
+                    ++votes[nearest_region(pixels + ((size_t)y * w + x) * 3)];
+            }
+            uint32_t best = 0;
+            for (uint32_t i = 1; i < NUM_REGIONS; ++i)
+                best = votes[i] > votes[best] ? i : best;
+            t->regions[r][c] = (uint8_t)best;
+        }
+    }
+    free(pixels);
+}
+
+// Writes the region map `regions` as a PPM image in the [[region_colors]], with one pixel per
+// cell.
+static bool write_regions(const uint8_t (*regions)[REGION_MAP_WIDTH], FILE* f)
+{
+    fprintf(f, "P6\n%u %u\n255\n", (uint32_t)REGION_MAP_WIDTH, (uint32_t)REGION_MAP_HEIGHT);
+    for (uint32_t r = 0; r < REGION_MAP_HEIGHT; ++r) {
+        for (uint32_t c = 0; c < REGION_MAP_WIDTH; ++c) {
+            const uint32_t color = region_colors[regions[r][c]];
+            const uint8_t rgb[3] = { (uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color };
+            fwrite(rgb, 1, 3, f);
+        }
+    }
+    return !ferror(f);
+}
+
+// Pack
+
+// Returns `x` rounded up to a multiple of [[DATA_PACK_ALIGN]].
+static uint32_t align_up(uint32_t x)
+{
+    return (x + DATA_PACK_ALIGN - 1) / DATA_PACK_ALIGN * DATA_PACK_ALIGN;
+}
+
+// Lays out the tables `t` as a data pack. Returns the pack, allocated with `malloc()`.
+static struct data_pack_header_t* build_pack(const struct tables_t* t)
+{
+    const struct {
+        const void* data;
+        uint32_t count;
+        uint32_t stride;
+    } tables[DATA_PACK_TABLE__COUNT] = {
+        [DATA_PACK_TABLE__IMAGE_PATHS] = { t->image_paths, NUM_IMAGES, IMAGE_PATH_SIZE },
+        [DATA_PACK_TABLE__PROPS] = { t->props, NUM_PROPS, sizeof(struct prop_t) },
+        [DATA_PACK_TABLE__DINOSAURS] = { t->dinosaurs, NUM_DINOSAURS, sizeof(struct dinosaur_t) },
+        [DATA_PACK_TABLE__DROPS] = { t->drops, NUM_DROPS, sizeof(struct drop_t) },
+        [DATA_PACK_TABLE__MEMENTOS] = { t->mementos, NUM_MEMENTOS, sizeof(struct memento_t) },
+        [DATA_PACK_TABLE__RULES] = { &t->rules, 1, sizeof(struct rules_t) },
+        [DATA_PACK_TABLE__ATLAS_PAGES] = { t->atlas_pages, t->num_atlas_pages, IMAGE_PATH_SIZE },
+        [DATA_PACK_TABLE__ATLAS_RECTS] = { t->atlas_rects, NUM_IMAGES, sizeof(struct atlas_rect_t) },
+        [DATA_PACK_TABLE__REGIONS] = { t->regions, REGION_MAP_HEIGHT, REGION_MAP_WIDTH },
+    };
+
+    struct data_pack_header_t header = { .version = DATA_PACK_VERSION };
+    memcpy(header.magic, DATA_PACK_MAGIC, sizeof(header.magic));
+    uint32_t size = align_up(sizeof(header));
+    for (uint32_t i = 0; i < DATA_PACK_TABLE__COUNT; ++i) {
+        header.tables[i] = (struct data_pack_table_t){ .offset = size, .count = tables[i].count, .stride = tables[i].stride };
+        size = align_up(size + tables[i].count * tables[i].stride);
+    }
+    header.size = size;
+
+    struct data_pack_header_t* pack = calloc(1, size);
+    *pack = header;
+    for (uint32_t i = 0; i < DATA_PACK_TABLE__COUNT; ++i)
+        memcpy((char*)pack + header.tables[i].offset, tables[i].data, tables[i].count * tables[i].stride);
+    pack->hash = hash_bytes(HASH_BYTES_SEED, pack + 1, size - sizeof(header));
+    return pack;
+}
+
+// Writes `pack` to `path`, replacing the old file atomically.
+static bool write_pack(const struct data_pack_header_t* pack, const char* path)
+{
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f)
+        return false;
+    const bool written = fwrite(pack, 1, pack->size, f) == pack->size;
+    if (fclose(f) || !written) {
+        remove(tmp_path);
+        return false;
+    }
+#if defined(TM_OS_WINDOWS)
+    return MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    return rename(tmp_path, path) == 0;
+#endif
+}
+
+// Export
+
+// Writes the CSV field `s`, quoting it if necessary.
+static void write_field(FILE* f, const char* s)
+{
+    if (!strpbrk(s, ",\"\n")) {
+        fputs(s, f);
+        return;
+    }
+    fputc('"', f);
+    for (; *s; ++s) {
+        if (*s == '"')
+            fputc('"', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+// Opens the file `name` in `dir` for writing.
+static FILE* open_export(const char* dir, const char* name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        error(path, "can't write file");
+    return f;
+}
+
+// Writes the compiled tables as CSV files, and the region map as `regions.ppm`, to `dir`. If
+// [[project_dir]] is set, also writes an `atlas.csv` with the small art of the project.
+static void export_tables(const char* dir)
+{
+    FILE* f;
+    if ((f = open_export(dir, "images.csv"))) {
+        fprintf(f, "image,path\n");
+        for (uint32_t i = 0; i < NUM_IMAGES; ++i) {
+            fprintf(f, "%s,", image_names[i]);
+            write_field(f, default_image_paths[i]);
+            fprintf(f, "\n");
+        }
+        fclose(f);
+    }
+    if ((f = open_export(dir, "props.csv"))) {
+        fprintf(f, "name,image,type,price,margin,scale\n");
+        for (const struct prop_t* p = default_props; p != TM_ARRAY_END(default_props); ++p) {
+            write_field(f, p->name);
+            fprintf(f, ",%s,%s,%u,%.15g,%.15g\n", image_names[p->image], prop_type_names[p->type], p->price, p->margin, p->scale);
+        }
+        fclose(f);
+    }
+    if ((f = open_export(dir, "dinosaurs.csv"))) {
+        fprintf(f, "name,image,type,minutes_to_spawn,attracted_by,margin,scale\n");
+        for (const struct dinosaur_t* d = default_dinosaurs; d != TM_ARRAY_END(default_dinosaurs); ++d) {
+            write_field(f, d->name);
+            fprintf(f, ",%s,%s,%.15g,", image_names[d->image], dino_type_names[d->type], d->minutes_to_spawn);
+            for (uint32_t a = 0; a < MAX_ATTRACTED_BY && d->attracted_by[a]; ++a)
+                fprintf(f, "%s%s", a ? " " : "", image_names[d->attracted_by[a]]);
+            fprintf(f, ",%.15g,%.15g\n", d->margin, d->scale);
+        }
+        fclose(f);
+    }
+    if ((f = open_export(dir, "drops.csv"))) {
+        fprintf(f, "dinosaur,drop,quantity_min,quantity_max,probability\n");
+        for (const struct drop_t* d = default_drops; d != TM_ARRAY_END(default_drops); ++d)
+            fprintf(f, "%s,%s,%.15g,%.15g,%.15g\n", image_names[d->dinosaur_image], image_names[d->drop_image], d->quantity.min, d->quantity.max, d->probability);
+        fclose(f);
+    }
+    if ((f = open_export(dir, "mementos.csv"))) {
+        fprintf(f, "name,image,sell_value\n");
+        for (const struct memento_t* m = default_mementos; m != TM_ARRAY_END(default_mementos); ++m) {
+            write_field(f, m->name);
+            fprintf(f, ",%s,%u\n", image_names[m->image], m->sell_value);
+        }
+        fclose(f);
+    }
+    if ((f = open_export(dir, "rules.csv"))) {
+        fprintf(f, "rule,min,max\n");
+        for (const struct rule_field_t* r = rule_fields; r != TM_ARRAY_END(rule_fields); ++r) {
+            const struct range_t* v = (const struct range_t*)((const char*)&rules + r->offset);
+            fprintf(f, "%s,%.15g,%.15g\n", r->name, v->min, v->max);
+        }
+        fclose(f);
+    }
+    if (project_dir && (f = open_export(dir, "atlas.csv"))) {
+        // The small art: the props, the mementos and the icons, if it's in the project and takes at
+        // most a quarter of a page.
+        bool small[NUM_IMAGES] = { 0 };
+        for (const struct prop_t* p = default_props; p != TM_ARRAY_END(default_props); ++p)
+            small[p->image] = true;
+        for (const struct memento_t* m = default_mementos; m != TM_ARRAY_END(default_mementos); ++m)
+            small[m->image] = true;
+        for (uint32_t i = 0; i < NUM_IMAGES; ++i)
+            small[i] |= strncmp(default_image_paths[i], "art/icons/", 10) == 0;
+        small[PLACEHOLDER] = false;
+        fprintf(f, "image,width,height\n");
+        for (uint32_t i = 0; i < NUM_IMAGES; ++i) {
+            uint32_t w, h;
+            if (small[i] && read_art_size(default_image_paths[i], &w, &h) && w <= ATLAS_PAGE_SIZE / 2 - 2 * ATLAS_PADDING && h <= ATLAS_PAGE_SIZE / 2 - 2 * ATLAS_PADDING)
+                fprintf(f, "%s,%u,%u\n", image_names[i], w, h);
+        }
+        fclose(f);
+    }
+    if ((f = open_export(dir, "regions.ppm"))) {
+        bake_default_region_map();
+        if (!write_regions(default_region_map, f))
+            error("regions.ppm", "can't write file");
+        fclose(f);
+    }
+}
+
+// Writes the atlas layout to `<path>.atlas.csv`, sorted by page and image.
+static bool write_atlas_layout(const struct tables_t* t, const char* path)
+{
+    char layout_path[1024];
+    snprintf(layout_path, sizeof(layout_path), "%s.atlas.csv", path);
+    FILE* f = fopen(layout_path, "wb");
+    if (!f)
+        return false;
+    fprintf(f, "page,image,path,x,y,width,height\n");
+    for (uint32_t p = 0; p < t->num_atlas_pages; ++p) {
+        for (uint32_t i = 0; i < NUM_IMAGES; ++i) {
+            for (const struct atlas_entry_t* e = atlas_entries; e != atlas_entries + num_atlas_entries; ++e) {
+                if (e->page != p || e->image != i)
+                    continue;
+                write_field(f, t->atlas_pages[p]);
+                fprintf(f, ",%s,", image_names[i]);
+                write_field(f, t->image_paths[i]);
+                fprintf(f, ",%u,%u,%u,%u\n", e->x, e->y, e->w, e->h);
+            }
+        }
+    }
+    return fclose(f) == 0;
+}
+
+// Writes the `w` x `h` RGBA8 `pixels` to `path` as a run-length encoded TGA image.
+static bool write_tga(const char* path, const uint8_t* pixels, uint32_t w, uint32_t h)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return false;
+    // Type 10 is run-length encoded true-color; descriptor 0x28 is 8 alpha bits, top-left origin.
+    const uint8_t header[18] = { [2] = 10, [12] = (uint8_t)w, [13] = (uint8_t)(w >> 8), [14] = (uint8_t)h, [15] = (uint8_t)(h >> 8), [16] = 32, [17] = 0x28 };
+    fwrite(header, 1, sizeof(header), f);
+    for (uint32_t y = 0; y < h; ++y) {
+        // Packets don't cross rows. A packet is a run of up to 128 equal pixels or a list of up to
+        // 128 literal pixels.
+        const uint32_t* row = (const uint32_t*)pixels + (size_t)y * w;
+        for (uint32_t x = 0; x < w;) {
+            const bool run = x + 1 < w && row[x + 1] == row[x];
+            uint32_t n = 1;
+            if (run) {
+                while (x + n < w && n < 128 && row[x + n] == row[x])
+                    ++n;
+            } else {
+                while (x + n < w && n < 128 && !(x + n + 1 < w && row[x + n + 1] == row[x + n]))
+                    ++n;
+            }
+            fputc((run ? 0x80 : 0) | (int)(n - 1), f);
+            for (uint32_t i = 0; i < (run ? 1 : n); ++i) {
+                const uint8_t* c = (const uint8_t*)(row + x + i);
+                const uint8_t bgra[4] = { c[2], c[1], c[0], c[3] };
+                fwrite(bgra, 1, 4, f);
+            }
+            x += n;
+        }
+    }
+    const bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+// Composes the atlas page images from the art in [[project_dir]] and writes them to
+// `<path>.page_<n>.tga`, to be imported as [[ATLAS_PAGE_PATH]]. The edge pixels of each image are
+// repeated into its padding, so that filtering at the edges doesn't blend in the neighbors.
+static void write_atlas_pages(const struct tables_t* t, const char* path)
+{
+    const size_t page_bytes = (size_t)ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * 4;
+    uint8_t* page = malloc(page_bytes);
+    for (uint32_t p = 0; p < t->num_atlas_pages; ++p) {
+        memset(page, 0, page_bytes);
+        for (const struct atlas_entry_t* e = atlas_entries; e != atlas_entries + num_atlas_entries; ++e) {
+            if (e->page != p)
+                continue;
+            const char* image_path = t->image_paths[e->image];
+            uint8_t* pixels = read_art_pixels(image_path, e->w, e->h);
+            if (!pixels) {
+                error(image_path, "can't read the pixels of %s", image_names[e->image]);
+                continue;
+            }
+            for (uint32_t y = e->y - ATLAS_PADDING; y < e->y + e->h + ATLAS_PADDING; ++y) {
+                const uint32_t sy = (uint32_t)tm_clamp((int32_t)(y - e->y), 0, (int32_t)e->h - 1);
+                for (uint32_t x = e->x - ATLAS_PADDING; x < e->x + e->w + ATLAS_PADDING; ++x) {
+                    const uint32_t sx = (uint32_t)tm_clamp((int32_t)(x - e->x), 0, (int32_t)e->w - 1);
+                    memcpy(page + ((size_t)y * ATLAS_PAGE_SIZE + x) * 4, pixels + ((size_t)sy * e->w + sx) * 4, 4);
+                }
+            }
+            free(pixels);
+        }
+        char page_path[1024];
+        snprintf(page_path, sizeof(page_path), "%s.page_%u.tga", path, p);
+        if (!write_tga(page_path, page, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE))
+            error(page_path, "can't write file");
+    }
+    free(page);
+}
+
+// Main
+
+// Returns the current time in seconds.
+static double now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Maps the pack at `path` the same way the plugin does and prints its contents.
+static int print_info(const char* path)
+{
+    const double t0 = now();
+    struct mapped_data_pack_t pack = { 0 };
+    if (!map_data_pack(path, &pack)) {
+        error(path, "can't map file");
+        return 1;
+    }
+    const char* problem = check_data_pack(pack.header, pack.size);
+    if (problem) {
+        error(path, "%s", problem);
+        return 1;
+    }
+    use_data_pack(pack.header);
+    const double t1 = now();
+
+    printf("%s: version %u, %u bytes, mapped, checked and indexed in %.1f us\n", path, pack.header->version, pack.header->size, (t1 - t0) * 1e6);
+    printf("%u images, %u props, %u dinosaurs, %u drops, %u mementos\n", (uint32_t)NUM_IMAGES, (uint32_t)NUM_PROPS,
+        (uint32_t)NUM_DINOSAURS, (uint32_t)NUM_DROPS, (uint32_t)NUM_MEMENTOS);
+    for (uint32_t i = 0; i < NUM_PROPS; ++i)
+        printf("  prop      %-20s price %u\n", props[i].name, props[i].price);
+    for (uint32_t i = 0; i < NUM_DINOSAURS; ++i)
+        printf("  dinosaur  %-20s spawns in %g min at %s\n", dinosaurs[i].name, dinosaurs[i].minutes_to_spawn, image_names[dinosaurs[i].attracted_by[0]]);
+    for (uint32_t i = 0; i < NUM_MEMENTOS; ++i)
+        printf("  memento   %-20s sells for %u\n", mementos[i].name, mementos[i].sell_value);
+    for (uint32_t p = 0; p < num_atlas_pages; ++p) {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < NUM_IMAGES; ++i)
+            n += atlas_rects[i].page == p + 1;
+        printf("  atlas     %-20s %u images\n", atlas_pages[p], n);
+    }
+    uint32_t cells[NUM_REGIONS] = { 0 };
+    for (uint32_t r = 0; r < REGION_MAP_HEIGHT; ++r) {
+        for (uint32_t c = 0; c < REGION_MAP_WIDTH; ++c)
+            ++cells[region_map[r][c]];
+    }
+    for (uint32_t i = 0; i < NUM_REGIONS; ++i)
+        printf("  region    %-20s %.1f %%\n", region_names[i], 100.0 * cells[i] / (REGION_MAP_WIDTH * REGION_MAP_HEIGHT));
+    unmap_data_pack(&pack);
+    return 0;
+}
+
+// Prints the command line options.
+static void print_usage(void)
+{
+    printf("Usage: dinosaur_pack [--project <dir>] <csv-dir> <pack>\n"
+           "       dinosaur_pack [--project <dir>] --export <csv-dir>\n"
+           "       dinosaur_pack --info <pack>\n");
+}
+
+int main(int argc, char** argv)
+{
+    tm_error_api = &pack_error_api;
+
+    if (argc >= 3 && strcmp(argv[1], "--project") == 0) {
+        project_dir = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 3) {
+        print_usage();
+        return 1;
+    }
+    if (strcmp(argv[1], "--info") == 0)
+        return print_info(argv[2]);
+    if (strcmp(argv[1], "--export") == 0) {
+        export_tables(argv[2]);
+        return num_errors ? 1 : 0;
+    }
+
+    const char* dir = argv[1];
+    const char* path = argv[2];
+
+    static struct tables_t t;
+    memcpy(t.image_paths, default_image_paths, sizeof(t.image_paths));
+    memcpy(t.props, default_props, sizeof(t.props));
+    memcpy(t.dinosaurs, default_dinosaurs, sizeof(t.dinosaurs));
+    memcpy(t.drops, default_drops, sizeof(t.drops));
+    memcpy(t.mementos, default_mementos, sizeof(t.mementos));
+    // Only the design rules go in the pack. The engine settings are left zeroed, and the plugin
+    // keeps its own.
+    for (const struct rule_field_t* f = rule_fields; f != TM_ARRAY_END(rule_fields); ++f)
+        memcpy((char*)&t.rules + f->offset, (const char*)&rules + f->offset, sizeof(struct range_t));
+    bake_default_region_map();
+    memcpy(t.regions, default_region_map, sizeof(t.regions));
+
+    read_images(&t, dir);
+    read_props(&t, dir);
+    read_dinosaurs(&t, dir);
+    read_drops(&t, dir);
+    read_mementos(&t, dir);
+    read_rules(&t, dir);
+    read_atlas(&t, dir);
+    read_regions(&t, dir);
+    if (!num_errors) {
+        check_tables(&t);
+        build_atlas(&t);
+    }
+    if (num_errors) {
+        fprintf(stderr, "%u errors, %s not written\n", num_errors, path);
+        return 1;
+    }
+
+    // The pages are written first, so that a running plugin that picks up the new pack finds them.
+    if (t.num_atlas_pages && project_dir) {
+        write_atlas_pages(&t, path);
+        if (num_errors)
+            return 1;
+    }
+    struct data_pack_header_t* pack = build_pack(&t);
+    const char* problem = check_data_pack(pack, pack->size);
+    if (problem || !write_pack(pack, path)) {
+        error(path, "%s", problem ? problem : "can't write file");
+        return 1;
+    }
+    if (t.num_atlas_pages && !write_atlas_layout(&t, path)) {
+        error(path, "can't write atlas layout");
+        return 1;
+    }
+    printf("%s: %u bytes, %u atlas pages%s\n", path, pack->size, t.num_atlas_pages, t.num_atlas_pages && project_dir ? " (page images written)" : "");
+    free(pack);
+    return 0;
+}
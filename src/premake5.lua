@@ -55,6 +55,23 @@ filter "platforms:Win64"
     }
     linkoptions {"/ignore:4099"}
 
+filter "system:linux"
+    platforms { "Linux" }
+    toolset "clang"
+
+filter "platforms:Linux"
+    defines { "TM_OS_LINUX", "TM_OS_POSIX" }
+    includedirs { (os.getenv("TM_DINO_SDK_DIR") or "") .. "/headers" }
+    architecture "x64"
+    pic "On"
+    buildoptions {
+        "-fms-extensions",                   -- Allow anonymous struct as C inheritance.
+        "-Wno-missing-field-initializers",   -- = {0} is OK.
+        "-Wno-unused-parameter",             -- Useful for documentation purposes.
+        "-Wno-missing-braces",               -- = {0} is OK.
+        "-Wno-microsoft-anon-tag",           -- Allow anonymous structs.
+    }
+
 filter "configurations:Debug"
     defines { "TM_CONFIGURATION_DEBUG", "DEBUG" }
     symbols "On"
@@ -70,3 +87,64 @@ project "dinosaur_simulate"
     language "C++"
     files {"*.inl", "*.h", "*.c"}
     sysincludedirs { "" }
+
+    filter "platforms:Linux"
+        links { "m" }
+
+-- Headless host that loads `tm_dinosaur_simulate.so` against stub APIs. Linux only.
+project "dinosaur_host"
+    location "build/dinosaur_host"
+    targetname "dinosaur_host"
+    kind "ConsoleApp"
+    language "C++"
+    removeplatforms { "Win64" }
+    files {"host/*.c"}
+    sysincludedirs { "" }
+    links { "dl", "pthread" }
+
+-- Monte Carlo balance simulator. Unity build of `dinosaur_simulate.c`. Linux only.
+project "dinosaur_balance"
+    location "build/dinosaur_balance"
+    targetname "dinosaur_balance"
+    kind "ConsoleApp"
+    language "C++"
+    removeplatforms { "Win64" }
+    files {"balance/*.c"}
+    sysincludedirs { "" }
+    links { "pthread", "m" }
+
+-- Headless server that ticks many player sessions in one process. Unity build of
+-- `dinosaur_simulate.c`. Linux only.
+project "dinosaur_server"
+    location "build/dinosaur_server"
+    targetname "dinosaur_server"
+    kind "ConsoleApp"
+    language "C++"
+    removeplatforms { "Win64" }
+    files {"server/*.c"}
+    sysincludedirs { "" }
+    links { "pthread", "m" }
+
+-- Builds data packs from CSV exports of the game design spreadsheet. Unity build of
+-- `dinosaur_simulate.c`.
+project "dinosaur_pack"
+    location "build/dinosaur_pack"
+    targetname "dinosaur_pack"
+    kind "ConsoleApp"
+    language "C++"
+    files {"pack/*.c"}
+    sysincludedirs { "" }
+
+    filter "platforms:Linux"
+        links { "m" }
+
+-- Microbenchmarks of the plugin's hot paths. Unity build of `dinosaur_simulate.c`. Linux only.
+project "dinosaur_bench"
+    location "build/dinosaur_bench"
+    targetname "dinosaur_bench"
+    kind "ConsoleApp"
+    language "C++"
+    removeplatforms { "Win64" }
+    files {"bench/*.c"}
+    sysincludedirs { "" }
+    links { "m" }
@@ -0,0 +1,654 @@
+// Headless session server for the dinosaur game.
+//
+// Holds many player sessions in one process and advances the game logic of all of them in batch
+// ticks, for running the game economy on a server (idle progress, validating clients). Sessions
+// have no UI, so they never show the award screen and their drops stay unclaimed until the caller
+// claims them.
+//
+// The server is built as a unity build that includes `dinosaur_simulate.c` directly, so it runs
+// the same game logic and tables as the plugin. Like the plugin, it uses the data pack named by
+// the `DINO_DATA_PACK` environment variable, if set. The sessions always use the event queue (see
+// `rules.event_queue`).
+//
+// Usage:
+//
+// ~~~
+// dinosaur_server [--sessions <n>[,<n>...]] [--minutes <n>] [--tick <seconds>] [--props <n>]
+//     [--threads <n>] [--seed <n>]
+// ~~~
+//
+// Runs a load benchmark. For each number of `--sessions` (default `10000,100000`), starts that many
+// sessions with `--props` (default 8) props placed in their scenes, and ticks them by `--tick`
+// (default 1) seconds of game time at a time for `--minutes` (default 60) of game time. Every
+// number of sessions is ticked for the same game time, so that the runs see the same mix of events.
+// Reports the session ticks per second, the sessions that had an event due and ran the game logic,
+// separately from the wake checks per second, all sessions times the batch ticks, in total and per
+// thread, and the cost of adding, snapshotting and removing a session.
+//
+// Before the benchmark, it checks that batch ticking gives the same sessions as ticking each
+// session by itself with [[game_logic]], while sessions are added and removed, and that a snapshot
+// of a session loads back to the same state. The program exits with an error if a check fails.
+//
+// ## Sessions
+//
+// The sessions are kept in dense struct-of-arrays columns, in no particular order. A batch tick
+// only reads the `wake` column, the simulated time of each session's next event, and only runs
+// [[run_events_until]] for the sessions that have an event due. Since the events carry their own
+// times, a session that is skipped until its next event ends up in the same state as one that is
+// ticked every time. Most sessions of idle players have nothing due in a tick, so the cost of a
+// tick is mostly the scan of `wake`. Removing a session moves the last session into its place, so
+// sessions are referred to by handles that are resolved through a [[scene_slots_t]], like the
+// entities of the scene.
+//
+// The game logic of a session only touches its own state, so the sessions are split into chunks
+// that are ticked in parallel by a pool of threads. Each thread starts on a range of chunks of its
+// own and when it runs out, it steals chunks from the ranges of the other threads.
+
+#include "../dinosaur_simulate.c"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Errors
+
+// Implements `tm_error_i->errorf()` and `tm_error_i->fatal()` by printing to `stderr`. Errors are
+// reported when loading a data pack or a save.
+static void server_errorf(struct tm_error_o* inst, const char* file, uint32_t line, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "error: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+static tm_error_i server_error = { .errorf = server_errorf, .fatal = server_errorf };
+static struct tm_error_api server_error_api = { .def = &server_error };
+
+// Number of failed checks.
+static uint32_t num_failures;
+
+// Reports a failed check.
+static void fail(const char* format, ...)
+{
+    ++num_failures;
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "FAILED: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+// Memory
+
+// Implements `tm_allocator_i->realloc()` with `realloc()`, which can be called from any thread.
+// Used for the sessions and their scene storage.
+static void* server_realloc(struct tm_allocator_i* a, void* ptr, uint64_t old_size, uint64_t new_size, const char* file, uint32_t line)
+{
+    if (!new_size) {
+        free(ptr);
+        return 0;
+    }
+    return realloc(ptr, new_size);
+}
+
+static tm_allocator_i server_allocator = { .realloc = server_realloc };
+
+// Server
+
+// Number of sessions in a chunk, the unit of work of a batch tick.
+enum { CHUNK_SESSIONS = 512 };
+
+// Chunks of a batch tick that are assigned to a thread. Padded to a cache line, so that the
+// counters of different threads don't share a line.
+struct chunk_range_t {
+    // Next chunk to tick and the end of the range. The owning thread and the threads that steal
+    // from it claim chunks by incrementing `next`.
+    uint32_t next;
+    uint32_t end;
+
+    // Number of sessions that had events due in the chunks that the owning thread ticked.
+    uint32_t woken;
+
+    uint8_t padding[52];
+};
+
+// Session server.
+struct server_t {
+    // Simulated time of the server. A batch tick advances all sessions to this time.
+    double time;
+
+    // Number of sessions.
+    uint32_t num_sessions;
+
+    // Columns of the sessions. `wake` is the simulated time of the session's next event, `states`
+    // its game state and `handles` its handle.
+    /* carray */ double* wake;
+    /* carray */ tm_simulate_state_o** states;
+    /* carray */ uint32_t* handles;
+
+    // Maps session handles to indices in the columns.
+    struct scene_slots_t slots;
+
+    // Threads that tick the chunks. Thread 0 is the thread that calls [[tick_server]], the others
+    // are started by [[start_server]].
+    uint32_t num_threads;
+    pthread_t* threads;
+    struct worker_t* workers;
+    struct chunk_range_t* ranges;
+
+    // Signals the threads to start a batch tick or to quit and the caller of [[tick_server]] that
+    // the batch tick is done.
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+
+    // Incremented for each batch tick.
+    uint64_t batch;
+
+    // Number of started threads that haven't finished the current batch tick.
+    uint32_t num_busy;
+
+    // Set to stop the threads.
+    bool quit;
+};
+
+// Data passed to a thread of the server.
+struct worker_t {
+    struct server_t* server;
+    uint32_t index;
+};
+
+// Batch tick
+
+// Ticks the sessions in chunk `chunk`. Returns the number of sessions that had events due.
+static uint32_t tick_chunk(struct server_t* server, uint32_t chunk)
+{
+    const double time = server->time;
+    const uint32_t end = tm_min(server->num_sessions, (chunk + 1) * CHUNK_SESSIONS);
+    uint32_t woken = 0;
+    for (uint32_t i = chunk * CHUNK_SESSIONS; i < end; ++i) {
+        if (server->wake[i] > time)
+            continue;
+        tm_simulate_state_o* state = server->states[i];
+        run_events_until(state, time);
+
+        // There is always a coin event.
+        server->wake[i] = state->events[0].time;
+        ++woken;
+    }
+    return woken;
+}
+
+// Ticks chunks for thread `t` until there are none left, first from its own range and then from
+// the ranges of the other threads.
+static void run_batch(struct server_t* server, uint32_t t)
+{
+    uint32_t woken = 0;
+    for (uint32_t k = 0; k < server->num_threads; ++k) {
+        struct chunk_range_t* r = server->ranges + (t + k) % server->num_threads;
+        while (__atomic_load_n(&r->next, __ATOMIC_RELAXED) < r->end) {
+            const uint32_t chunk = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED);
+            if (chunk >= r->end)
+                break;
+            woken += tick_chunk(server, chunk);
+        }
+    }
+    server->ranges[t].woken = woken;
+}
+
+// Thread entry point. Runs the batch ticks of the server until it quits.
+static void* worker(void* data)
+{
+    const struct worker_t* w = data;
+    struct server_t* server = w->server;
+    uint64_t batch = 0;
+    pthread_mutex_lock(&server->mutex);
+    while (true) {
+        while (server->batch == batch && !server->quit)
+            pthread_cond_wait(&server->start, &server->mutex);
+        if (server->quit)
+            break;
+        batch = server->batch;
+        pthread_mutex_unlock(&server->mutex);
+
+        run_batch(server, w->index);
+
+        pthread_mutex_lock(&server->mutex);
+        if (--server->num_busy == 0)
+            pthread_cond_signal(&server->done);
+    }
+    pthread_mutex_unlock(&server->mutex);
+    return 0;
+}
+
+// Advances all sessions by `dt` seconds of simulated time, which must be at most
+// [[FAST_FORWARD_MIN_SECONDS]] for the result to match [[game_logic]]. Returns the number of
+// sessions that had events due.
+static uint32_t tick_server(struct server_t* server, double dt)
+{
+    server->time += dt;
+
+    const uint32_t num_chunks = (server->num_sessions + CHUNK_SESSIONS - 1) / CHUNK_SESSIONS;
+    for (uint32_t t = 0; t < server->num_threads; ++t) {
+        server->ranges[t] = (struct chunk_range_t){
+            .next = num_chunks * t / server->num_threads,
+            .end = num_chunks * (t + 1) / server->num_threads,
+        };
+    }
+
+    pthread_mutex_lock(&server->mutex);
+    ++server->batch;
+    server->num_busy = server->num_threads - 1;
+    pthread_cond_broadcast(&server->start);
+    pthread_mutex_unlock(&server->mutex);
+
+    run_batch(server, 0);
+
+    pthread_mutex_lock(&server->mutex);
+    while (server->num_busy)
+        pthread_cond_wait(&server->done, &server->mutex);
+    pthread_mutex_unlock(&server->mutex);
+
+    uint32_t woken = 0;
+    for (uint32_t t = 0; t < server->num_threads; ++t)
+        woken += server->ranges[t].woken;
+    return woken;
+}
+
+// Starts a server without sessions, with `num_threads` threads for the batch ticks.
+static void start_server(struct server_t* server, uint32_t num_threads)
+{
+    *server = (struct server_t){ .num_threads = num_threads };
+    pthread_mutex_init(&server->mutex, 0);
+    pthread_cond_init(&server->start, 0);
+    pthread_cond_init(&server->done, 0);
+    server->threads = calloc(num_threads, sizeof(*server->threads));
+    server->workers = calloc(num_threads, sizeof(*server->workers));
+    server->ranges = calloc(num_threads, sizeof(*server->ranges));
+    for (uint32_t t = 1; t < num_threads; ++t) {
+        server->workers[t] = (struct worker_t){ .server = server, .index = t };
+        pthread_create(server->threads + t, 0, worker, server->workers + t);
+    }
+}
+
+// Sessions
+
+// Places a random prop at a random position on land in the scene of `state`.
+static void place_random_prop(tm_simulate_state_o* state)
+{
+    const uint32_t prop_i = (uint32_t)(random_next(&state->random) % NUM_PROPS);
+    float x, y;
+    do {
+        x = (float)roll(state, (struct range_t){ 0, 1 });
+        y = (float)roll(state, (struct range_t){ 0.35, 1 });
+    } while (region_at(x, y) != REGION__LAND);
+    add_scene_prop(state, (struct scene_prop_t){ .prop = (uint16_t)prop_i, .x = x, .y = y });
+}
+
+// Starts a new game in `state` at simulated time `time`, with the random seed `seed` and
+// `num_props` props placed in the scene. The event queue is built by the first tick.
+static void start_game(tm_simulate_state_o* state, double time, uint64_t seed, uint32_t num_props)
+{
+    *state = (tm_simulate_state_o){
+        .allocator = &server_allocator,
+        .time = time,
+        .data_props = props,
+        .data_dinosaurs = dinosaurs,
+    };
+    seed_random(&state->random, seed);
+    state->money = (uint32_t)roll(state, rules.start_money);
+    for (uint32_t i = 0; i < num_props; ++i)
+        place_random_prop(state);
+}
+
+// Adds a session with a new game, started as by [[start_game]], and returns its handle.
+static uint32_t add_session(struct server_t* server, uint64_t seed, uint32_t num_props)
+{
+    tm_simulate_state_o* state = calloc(1, sizeof(*state));
+    start_game(state, server->time, seed, num_props);
+    build_event_queue(state);
+
+    const uint32_t i = server->num_sessions++;
+    tm_carray_ensure(server->wake, server->num_sessions, &server_allocator);
+    tm_carray_ensure(server->states, server->num_sessions, &server_allocator);
+    tm_carray_ensure(server->handles, server->num_sessions, &server_allocator);
+    server->wake[i] = state->events[0].time;
+    server->states[i] = state;
+    server->handles[i] = alloc_handle(&server_allocator, &server->slots, i);
+    return server->handles[i];
+}
+
+// Returns the state of the session with `handle`, advanced to the server's time, or `NULL` if the
+// session has been removed. The caller may change the state, for example to claim drops or place
+// props. The session is woken by the next batch tick, which picks up the changes.
+static tm_simulate_state_o* session_state(struct server_t* server, uint32_t handle)
+{
+    const uint32_t i = handle_index(&server->slots, handle);
+    if (i == UINT32_MAX)
+        return NULL;
+    tm_simulate_state_o* state = server->states[i];
+    run_events_until(state, server->time);
+    server->wake[i] = -INFINITY;
+    return state;
+}
+
+// Takes a snapshot of the session with `handle` at the server's time, to be written to `path`
+// with [[save_job]]. Returns `NULL` if the session has been removed.
+static struct save_t* snapshot_session(struct server_t* server, uint32_t handle, const char* path)
+{
+    const uint32_t i = handle_index(&server->slots, handle);
+    if (i == UINT32_MAX)
+        return NULL;
+    run_events_until(server->states[i], server->time);
+    server->wake[i] = server->states[i]->events[0].time;
+    return snapshot_game(server->states[i], path);
+}
+
+// Frees a snapshot taken by [[snapshot_session]] without writing it.
+static void free_snapshot(struct save_t* save)
+{
+    tm_free(&server_allocator, save->data, save->size);
+    tm_free(&server_allocator, save, sizeof(*save));
+}
+
+// Removes the session with `handle`. Returns `false` if it has already been removed.
+static bool remove_session(struct server_t* server, uint32_t handle)
+{
+    const uint32_t i = handle_index(&server->slots, handle);
+    if (i == UINT32_MAX)
+        return false;
+    free_scene(server->states[i]);
+    free(server->states[i]);
+    free_handle(&server->slots, handle);
+
+    const uint32_t last = --server->num_sessions;
+    server->wake[i] = server->wake[last];
+    server->states[i] = server->states[last];
+    server->handles[i] = server->handles[last];
+    if (i < last)
+        server->slots.slots[server->handles[i] & SCENE_HANDLE_SLOT_MASK].index = i;
+    return true;
+}
+
+// Removes all sessions and stops the threads of the server.
+static void stop_server(struct server_t* server)
+{
+    while (server->num_sessions)
+        remove_session(server, server->handles[server->num_sessions - 1]);
+
+    pthread_mutex_lock(&server->mutex);
+    server->quit = true;
+    pthread_cond_broadcast(&server->start);
+    pthread_mutex_unlock(&server->mutex);
+    for (uint32_t t = 1; t < server->num_threads; ++t)
+        pthread_join(server->threads[t], 0);
+
+    tm_carray_free(server->wake, &server_allocator);
+    tm_carray_free(server->states, &server_allocator);
+    tm_carray_free(server->handles, &server_allocator);
+    tm_carray_free(server->slots.slots, &server_allocator);
+    free(server->threads);
+    free(server->workers);
+    free(server->ranges);
+    pthread_mutex_destroy(&server->mutex);
+    pthread_cond_destroy(&server->start);
+    pthread_cond_destroy(&server->done);
+}
+
+// Options
+
+// Maximum number of session counts in `--sessions`.
+enum { MAX_LOAD_RUNS = 8 };
+
+// Command line options.
+struct options_t {
+    uint32_t sessions[MAX_LOAD_RUNS];
+    uint32_t num_runs;
+    double minutes;
+    double tick;
+    uint32_t props;
+    uint32_t threads;
+    uint64_t seed;
+};
+
+// Returns the seed of session number `session_i`.
+static uint64_t session_seed(const struct options_t* opt, uint64_t session_i)
+{
+    return opt->seed * 0x2545f4914f6cdd1dULL + session_i;
+}
+
+// Returns the current time in seconds.
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Check
+
+// Number of sessions, ticks and sessions replaced per tick of the check.
+enum { CHECK_SESSIONS = 1000, CHECK_TICKS = 1200, CHECK_REPLACED = 4 };
+
+// File name of the snapshot written by the check.
+#define CHECK_SAVE_PATH "dinosaur_server_check.save"
+
+// Checks that batch ticking gives the same states as ticking each session by itself with
+// [[game_logic]], while sessions are added and removed, and that a snapshot of a session loads back
+// to the same state.
+static void check_server(const struct options_t* opt)
+{
+    struct server_t server;
+    start_server(&server, opt->threads);
+
+    // Sessions and their reference states, ticked with [[game_logic]].
+    uint32_t handles[CHECK_SESSIONS];
+    tm_simulate_state_o* refs[CHECK_SESSIONS];
+    uint64_t num_started = 0;
+    for (uint32_t i = 0; i < CHECK_SESSIONS; ++i, ++num_started) {
+        handles[i] = add_session(&server, session_seed(opt, num_started), opt->props);
+        refs[i] = calloc(1, sizeof(tm_simulate_state_o));
+        start_game(refs[i], server.time, session_seed(opt, num_started), opt->props);
+    }
+
+    uint64_t woken = 0;
+    struct random_stream_t rng;
+    seed_random(&rng, opt->seed);
+    for (uint32_t t = 0; t < CHECK_TICKS; ++t) {
+        for (uint32_t k = 0; k < CHECK_REPLACED; ++k, ++num_started) {
+            const uint32_t i = (uint32_t)(random_next(&rng) % CHECK_SESSIONS);
+            if (!remove_session(&server, handles[i]) || remove_session(&server, handles[i]))
+                fail("removing session %u", i);
+            free_scene(refs[i]);
+            handles[i] = add_session(&server, session_seed(opt, num_started), opt->props);
+            start_game(refs[i], server.time, session_seed(opt, num_started), opt->props);
+        }
+
+        woken += tick_server(&server, opt->tick);
+        for (uint32_t i = 0; i < CHECK_SESSIONS; ++i)
+            game_logic(refs[i], opt->tick);
+    }
+
+    uint32_t num_mismatches = 0;
+    for (uint32_t i = 0; i < CHECK_SESSIONS; ++i) {
+        const tm_simulate_state_o* state = session_state(&server, handles[i]);
+        if (!state || hash_state(state) != hash_state(refs[i]))
+            ++num_mismatches;
+    }
+    if (num_mismatches)
+        fail("%u of %u sessions differ from ticking them with game_logic()", num_mismatches, CHECK_SESSIONS);
+
+    // Keep ticking after taking the states, which wakes the sessions.
+    tick_server(&server, opt->tick);
+    game_logic(refs[0], opt->tick);
+    if (hash_state(session_state(&server, handles[0])) != hash_state(refs[0]))
+        fail("session differs after session_state()");
+
+    struct save_t* save = snapshot_session(&server, handles[0], CHECK_SAVE_PATH);
+    save_job(save);
+    if (!save->ok)
+        fail("could not write `%s`", CHECK_SAVE_PATH);
+    free_snapshot(save);
+    tm_simulate_state_o* loaded = calloc(1, sizeof(tm_simulate_state_o));
+    loaded->allocator = &server_allocator;
+    if (!load_game(loaded, CHECK_SAVE_PATH) || hash_state(loaded) != hash_state(refs[0]))
+        fail("snapshot of a session doesn't load to the same state");
+    remove(CHECK_SAVE_PATH);
+    free_scene(loaded);
+    free(loaded);
+
+    printf("check: %u sessions, %u ticks of %g s, %u sessions replaced per tick, %.1f %% woken per tick: %s\n",
+        CHECK_SESSIONS, CHECK_TICKS, opt->tick, CHECK_REPLACED, 100.0 * (double)woken / CHECK_TICKS / CHECK_SESSIONS,
+        num_failures ? "FAILED" : "batch ticks match game_logic()");
+
+    for (uint32_t i = 0; i < CHECK_SESSIONS; ++i) {
+        free_scene(refs[i]);
+        free(refs[i]);
+    }
+    stop_server(&server);
+}
+
+// Load benchmark
+
+// Number of sessions snapshotted to time [[snapshot_session]].
+enum { LOAD_SNAPSHOTS = 1000 };
+
+// Runs the load benchmark with `n` sessions.
+static void bench_load(const struct options_t* opt, uint32_t n)
+{
+    struct server_t server;
+    start_server(&server, opt->threads);
+
+    const double t0 = now();
+    for (uint32_t i = 0; i < n; ++i)
+        add_session(&server, session_seed(opt, i), opt->props);
+    const double add_seconds = now() - t0;
+
+    // Warm up, so that the sessions' first events are out of the way.
+    for (uint32_t t = 0; t < 10; ++t)
+        tick_server(&server, opt->tick);
+
+    const uint64_t num_ticks = tm_max((uint64_t)(opt->minutes * 60 / opt->tick + 0.5), 1);
+    uint64_t woken = 0;
+    const double t1 = now();
+    for (uint64_t t = 0; t < num_ticks; ++t)
+        woken += tick_server(&server, opt->tick);
+    const double wall = now() - t1;
+
+    const double t2 = now();
+    for (uint32_t i = 0; i < LOAD_SNAPSHOTS; ++i)
+        free_snapshot(snapshot_session(&server, server.handles[(uint64_t)i * server.num_sessions / LOAD_SNAPSHOTS], ""));
+    const double snapshot_seconds = now() - t2;
+
+    uint32_t money = 0, dinosaurs_in_scene = 0;
+    for (uint32_t i = 0; i < server.num_sessions; ++i) {
+        money += server.states[i]->money;
+        dinosaurs_in_scene += server.states[i]->num_scene_dinosaurs;
+    }
+
+    const double t3 = now();
+    while (server.num_sessions)
+        remove_session(&server, server.handles[server.num_sessions / 2]);
+    const double remove_seconds = now() - t3;
+
+    const double ticked_per_second = (double)woken / wall;
+    const double checked_per_second = (double)n * (double)num_ticks / wall;
+    printf("%u sessions on %u threads: %llu ticks of %g s (%g min of game time) in %.2f s (%.3g x real time)\n", n, opt->threads,
+        (unsigned long long)num_ticks, opt->tick, (double)num_ticks * opt->tick / 60, wall, (double)num_ticks * opt->tick / wall);
+    printf("  session ticks / s       %10.3g   (%.3g per thread)\n", ticked_per_second, ticked_per_second / opt->threads);
+    printf("  wake checks / s         %10.3g   (%.3g per thread)\n", checked_per_second, checked_per_second / opt->threads);
+    printf("  woken / tick            %10.1f   (%.2f %% of sessions)\n", (double)woken / (double)num_ticks, 100.0 * (double)woken / (double)num_ticks / n);
+    printf("  tick                    %10.1f us\n", wall / (double)num_ticks * 1e6);
+    printf("  add session             %10.1f ns\n", add_seconds / n * 1e9);
+    printf("  snapshot session        %10.1f ns\n", snapshot_seconds / LOAD_SNAPSHOTS * 1e9);
+    printf("  remove session          %10.1f ns\n", remove_seconds / n * 1e9);
+    printf("  money / session         %10.1f,   dinosaurs / session %.2f\n", (double)money / n, (double)dinosaurs_in_scene / n);
+
+    stop_server(&server);
+}
+
+// Prints usage information.
+static void print_usage(void)
+{
+    printf("Usage: dinosaur_server [--sessions <n>[,<n>...]] [--minutes <n>] [--tick <seconds>] [--props <n>]\n"
+           "    [--threads <n>] [--seed <n>]\n");
+}
+
+int main(int argc, char** argv)
+{
+    tm_error_api = &server_error_api;
+    build_indices();
+    init_state_schema();
+    reload_data_pack();
+
+    // The batch tick only works with the event queue.
+    rules.event_queue = true;
+
+    struct options_t opt = {
+        .sessions = { 10000, 100000 },
+        .num_runs = 2,
+        .minutes = 60,
+        .tick = 1,
+        .props = 8,
+        .threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN),
+        .seed = 1,
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        if (strcmp(a, "--help") == 0) {
+            print_usage();
+            return 0;
+        }
+
+        const char* v = i + 1 < argc ? argv[++i] : 0;
+        if (!v) {
+            print_usage();
+            return 1;
+        }
+        if (strcmp(a, "--sessions") == 0) {
+            opt.num_runs = 0;
+            for (const char* s = v; opt.num_runs < MAX_LOAD_RUNS;) {
+                char* end;
+                opt.sessions[opt.num_runs++] = (uint32_t)strtoul(s, &end, 10);
+                if (*end != ',')
+                    break;
+                s = end + 1;
+            }
+        } else if (strcmp(a, "--minutes") == 0)
+            opt.minutes = strtod(v, 0);
+        else if (strcmp(a, "--tick") == 0)
+            opt.tick = strtod(v, 0);
+        else if (strcmp(a, "--props") == 0)
+            opt.props = (uint32_t)strtoul(v, 0, 10);
+        else if (strcmp(a, "--threads") == 0)
+            opt.threads = (uint32_t)strtoul(v, 0, 10);
+        else if (strcmp(a, "--seed") == 0)
+            opt.seed = strtoull(v, 0, 10);
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+    bool valid_sessions = opt.num_runs > 0;
+    for (uint32_t i = 0; i < opt.num_runs; ++i)
+        valid_sessions = valid_sessions && opt.sessions[i] > 0 && opt.sessions[i] <= SCENE_HANDLE_SLOT_MASK;
+    if (!valid_sessions || !opt.threads || opt.minutes < 0 || opt.tick <= 0 || opt.tick > FAST_FORWARD_MIN_SECONDS) {
+        print_usage();
+        return 1;
+    }
+
+    check_server(&opt);
+    for (uint32_t i = 0; i < opt.num_runs; ++i)
+        bench_load(&opt, opt.sessions[i]);
+
+    if (num_failures)
+        fprintf(stderr, "%u checks failed\n", num_failures);
+    return num_failures ? 1 : 0;
+}